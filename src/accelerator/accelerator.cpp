@@ -1,11 +1,13 @@
 #include "accelerator.h"
 
+#include "cpu/image/image_mixer.h"
 #include "ogl/image/image_mixer.h"
 #include "ogl/util/device.h"
 
 #include <boost/property_tree/ptree.hpp>
 
 #include <common/bit_depth.h>
+#include <common/log.h>
 
 #include <core/mixer/image/image_mixer.h>
 
@@ -26,7 +28,28 @@ struct accelerator::impl
     }
 
     std::unique_ptr<core::image_mixer>
-    create_image_mixer(int channel_id, common::bit_depth depth, core::color_space color_space)
+    create_image_mixer(int channel_id, common::bit_depth depth, core::color_space color_space, accelerator_type type)
+    {
+        switch (type) {
+            case accelerator_type::cpu:
+                return std::make_unique<cpu::image_mixer>(channel_id, depth, color_space);
+            case accelerator_type::automatic:
+                try {
+                    return create_ogl_image_mixer(channel_id, depth, color_space);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    CASPAR_LOG(warning) << L"Failed to initialize OpenGL device. Falling back to CPU Image Mixer for "
+                                           L"channel "
+                                        << channel_id;
+                    return std::make_unique<cpu::image_mixer>(channel_id, depth, color_space);
+                }
+            default:
+                return create_ogl_image_mixer(channel_id, depth, color_space);
+        }
+    }
+
+    std::unique_ptr<core::image_mixer>
+    create_ogl_image_mixer(int channel_id, common::bit_depth depth, core::color_space color_space)
     {
         return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(get_device()),
                                                   channel_id,
@@ -52,15 +75,17 @@ accelerator::accelerator(const core::video_format_repository format_repository)
 
 accelerator::~accelerator() {}
 
-std::unique_ptr<core::image_mixer>
-accelerator::create_image_mixer(const int channel_id, common::bit_depth depth, core::color_space color_space)
+std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(const int         channel_id,
+                                                                   common::bit_depth depth,
+                                                                   core::color_space color_space,
+                                                                   accelerator_type  type)
 {
-    return impl_->create_image_mixer(channel_id, depth, color_space);
+    return impl_->create_image_mixer(channel_id, depth, color_space, type);
 }
 
 std::shared_ptr<accelerator_device> accelerator::get_device() const
 {
-    return std::dynamic_pointer_cast<accelerator_device>(impl_->get_device());
+    return std::dynamic_pointer_cast<accelerator_device>(impl_->ogl_device_);
 }
 
 }} // namespace caspar::accelerator
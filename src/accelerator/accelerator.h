@@ -14,6 +14,13 @@
 
 namespace caspar { namespace accelerator {
 
+enum class accelerator_type
+{
+    gpu,
+    cpu,
+    automatic, // gpu, falling back to cpu when no OpenGL device can be created
+};
+
 class accelerator_device
 {
   public:
@@ -31,8 +38,12 @@ class accelerator
     accelerator& operator=(accelerator&) = delete;
 
     std::unique_ptr<caspar::core::image_mixer>
-    create_image_mixer(int channel_id, common::bit_depth depth, core::color_space color_space);
+    create_image_mixer(int               channel_id,
+                       common::bit_depth depth,
+                       core::color_space color_space,
+                       accelerator_type  type = accelerator_type::gpu);
 
+    // Returns the OpenGL device, or nullptr if no channel uses it.
     std::shared_ptr<accelerator_device> get_device() const;
 
   private:
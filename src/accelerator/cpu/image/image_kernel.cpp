@@ -0,0 +1,1058 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "image_kernel.h"
+
+#include "../util/surface.h"
+
+#include <common/assert.h>
+
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/equal.hpp>
+
+#include <tbb/parallel_for.h>
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse4.1.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <smmintrin.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+namespace {
+
+// http://stackoverflow.com/questions/563198/how-do-you-detect-where-two-line-segments-intersect
+bool get_line_intersection(double  p0_x,
+                           double  p0_y,
+                           double  p1_x,
+                           double  p1_y,
+                           double  p2_x,
+                           double  p2_y,
+                           double  p3_x,
+                           double  p3_y,
+                           double& result_x,
+                           double& result_y)
+{
+    double s1_x = p1_x - p0_x;
+    double s1_y = p1_y - p0_y;
+    double s2_x = p3_x - p2_x;
+    double s2_y = p3_y - p2_y;
+
+    double s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y)) / (-s2_x * s1_y + s1_x * s2_y);
+    double t = (s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x)) / (-s2_x * s1_y + s1_x * s2_y);
+
+    if (s >= 0 && s <= 1 && t >= 0 && t <= 1) {
+        result_x = p0_x + t * s1_x;
+        result_y = p0_y + t * s1_y;
+
+        return true;
+    }
+
+    return false;
+}
+
+double hypotenuse(double x1, double y1, double x2, double y2)
+{
+    auto x = x2 - x1;
+    auto y = y2 - y1;
+
+    return std::sqrt(x * x + y * y);
+}
+
+float get_precision_factor(common::bit_depth depth)
+{
+    switch (depth) {
+        case common::bit_depth::bit10:
+            return 64.0f;
+        case common::bit_depth::bit12:
+            return 16.0f;
+        default:
+            return 1.0f;
+    }
+}
+
+double calc_q(double close_diagonal, double distant_diagonal)
+{
+    return (close_diagonal + distant_diagonal) / distant_diagonal;
+}
+
+bool is_outside_screen(const std::vector<core::frame_geometry::coord>& coords)
+{
+    auto x_coords =
+        coords | boost::adaptors::transformed([](const core::frame_geometry::coord& c) { return c.vertex_x; });
+    auto y_coords =
+        coords | boost::adaptors::transformed([](const core::frame_geometry::coord& c) { return c.vertex_y; });
+
+    return boost::algorithm::all_of(x_coords, [](double x) { return x < 0.0; }) ||
+           boost::algorithm::all_of(x_coords, [](double x) { return x > 1.0; }) ||
+           boost::algorithm::all_of(y_coords, [](double y) { return y < 0.0; }) ||
+           boost::algorithm::all_of(y_coords, [](double y) { return y > 1.0; });
+}
+
+// Scalar helpers mirroring the GLSL built-ins used by the ogl fragment shader.
+
+float mix(float x, float y, float a) { return x * (1.0f - a) + y * a; }
+
+float step(float edge, float x) { return x < edge ? 0.0f : 1.0f; }
+
+float fract(float x) { return x - std::floor(x); }
+
+float smoothstep(float edge0, float edge1, float x)
+{
+    if (edge1 <= edge0) {
+        return x < edge0 ? 0.0f : 1.0f;
+    }
+    auto t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+struct hsl
+{
+    float h = 0.0f;
+    float s = 0.0f;
+    float l = 0.0f;
+};
+
+hsl rgb_to_hsl(const float* color)
+{
+    hsl result;
+
+    auto fmin  = std::min(std::min(color[0], color[1]), color[2]);
+    auto fmax  = std::max(std::max(color[0], color[1]), color[2]);
+    auto delta = fmax - fmin;
+
+    result.l = (fmax + fmin) / 2.0f;
+
+    if (delta == 0.0f) {
+        return result;
+    }
+
+    result.s = result.l < 0.5f ? delta / (fmax + fmin) : delta / (2.0f - fmax - fmin);
+
+    auto delta_r = (((fmax - color[0]) / 6.0f) + (delta / 2.0f)) / delta;
+    auto delta_g = (((fmax - color[1]) / 6.0f) + (delta / 2.0f)) / delta;
+    auto delta_b = (((fmax - color[2]) / 6.0f) + (delta / 2.0f)) / delta;
+
+    if (color[0] == fmax) {
+        result.h = delta_b - delta_g;
+    } else if (color[1] == fmax) {
+        result.h = (1.0f / 3.0f) + delta_r - delta_b;
+    } else if (color[2] == fmax) {
+        result.h = (2.0f / 3.0f) + delta_g - delta_r;
+    }
+
+    if (result.h < 0.0f) {
+        result.h += 1.0f;
+    } else if (result.h > 1.0f) {
+        result.h -= 1.0f;
+    }
+
+    return result;
+}
+
+float hue_to_rgb(float f1, float f2, float hue)
+{
+    if (hue < 0.0f) {
+        hue += 1.0f;
+    } else if (hue > 1.0f) {
+        hue -= 1.0f;
+    }
+
+    if ((6.0f * hue) < 1.0f) {
+        return f1 + (f2 - f1) * 6.0f * hue;
+    }
+    if ((2.0f * hue) < 1.0f) {
+        return f2;
+    }
+    if ((3.0f * hue) < 2.0f) {
+        return f1 + (f2 - f1) * ((2.0f / 3.0f) - hue) * 6.0f;
+    }
+    return f1;
+}
+
+void hsl_to_rgb(const hsl& value, float* color)
+{
+    if (value.s == 0.0f) {
+        color[0] = color[1] = color[2] = value.l;
+        return;
+    }
+
+    auto f2 = value.l < 0.5f ? value.l * (1.0f + value.s) : (value.l + value.s) - (value.s * value.l);
+    auto f1 = 2.0f * value.l - f2;
+
+    color[0] = hue_to_rgb(f1, f2, value.h + (1.0f / 3.0f));
+    color[1] = hue_to_rgb(f1, f2, value.h);
+    color[2] = hue_to_rgb(f1, f2, value.h - (1.0f / 3.0f));
+}
+
+float blend_color_dodge(float base, float blend)
+{
+    return blend == 1.0f ? blend : std::min(base / (1.0f - blend), 1.0f);
+}
+
+float blend_color_burn(float base, float blend)
+{
+    return blend == 0.0f ? blend : std::max(1.0f - ((1.0f - base) / blend), 0.0f);
+}
+
+float blend_vivid_light(float base, float blend)
+{
+    return blend < 0.5f ? blend_color_burn(base, 2.0f * blend) : blend_color_dodge(base, 2.0f * (blend - 0.5f));
+}
+
+float blend_overlay(float base, float blend)
+{
+    return base < 0.5f ? 2.0f * base * blend : 1.0f - 2.0f * (1.0f - base) * (1.0f - blend);
+}
+
+float blend_reflect(float base, float blend)
+{
+    return blend == 1.0f ? blend : std::min(base * base / (1.0f - blend), 1.0f);
+}
+
+float blend_channel(int mode, float base, float blend)
+{
+    switch (mode) {
+        case 1:
+            return std::max(blend, base);
+        case 2:
+            return std::min(blend, base);
+        case 3:
+            return base * blend;
+        case 4:
+            return (base + blend) / 2.0f;
+        case 5:
+        case 16:
+            return std::min(base + blend, 1.0f);
+        case 6:
+        case 17:
+            return std::max(base + blend - 1.0f, 0.0f);
+        case 7:
+            return std::abs(base - blend);
+        case 8:
+            return 1.0f - std::abs(1.0f - base - blend);
+        case 9:
+            return base + blend - 2.0f * base * blend;
+        case 10:
+            return 1.0f - ((1.0f - base) * (1.0f - blend));
+        case 11:
+            return blend_overlay(base, blend);
+        case 13:
+            return blend_overlay(blend, base);
+        case 14:
+            return blend_color_dodge(base, blend);
+        case 15:
+            return blend_color_burn(base, blend);
+        case 18:
+            return blend < 0.5f ? std::max(base + 2.0f * blend - 1.0f, 0.0f)
+                                : std::min(base + 2.0f * (blend - 0.5f), 1.0f);
+        case 19:
+            return blend_vivid_light(base, blend);
+        case 20:
+            return blend < 0.5f ? std::min(2.0f * blend, base) : std::max(2.0f * (blend - 0.5f), base);
+        case 21:
+            return blend_vivid_light(base, blend) < 0.5f ? 0.0f : 1.0f;
+        case 22:
+            return blend_reflect(base, blend);
+        case 23:
+            return blend_reflect(blend, base);
+        case 24:
+            return std::min(base, blend) - std::max(base, blend) + 1.0f;
+        default: // soft_light is disabled in the shader as well.
+            return blend;
+    }
+}
+
+// Same numbering as get_blend_color in the ogl fragment shader, which for 25-28 differs from core::blend_mode.
+void blend_color(int mode, const float* back, float* fore)
+{
+    if (mode >= 25 && mode <= 28) {
+        auto back_hsl = rgb_to_hsl(back);
+        auto fore_hsl = rgb_to_hsl(fore);
+        switch (mode) {
+            case 25:
+                hsl_to_rgb({fore_hsl.h, back_hsl.s, back_hsl.l}, fore);
+                break;
+            case 26:
+                hsl_to_rgb({back_hsl.h, fore_hsl.s, back_hsl.l}, fore);
+                break;
+            case 27:
+                hsl_to_rgb({fore_hsl.h, fore_hsl.s, back_hsl.l}, fore);
+                break;
+            case 28:
+                hsl_to_rgb({back_hsl.h, back_hsl.s, fore_hsl.l}, fore);
+                break;
+        }
+        return;
+    }
+
+    for (int n = 0; n < 3; ++n) {
+        fore[n] = blend_channel(mode, back[n], fore[n]);
+    }
+}
+
+// Everything the fragment shader gets as uniforms, resolved once per draw.
+struct uniforms
+{
+    core::pixel_format format = core::pixel_format::invalid;
+    float              precision_factor[4]{1.0f, 1.0f, 1.0f, 1.0f};
+    float              color_matrix[9]{};
+    float              luma_coeff[3]{};
+
+    bool  chroma = false;
+    bool  chroma_show_mask;
+    float chroma_target_hue;
+    float chroma_hue_width;
+    float chroma_min_saturation;
+    float chroma_min_brightness;
+    float chroma_softness;
+    float chroma_spill_suppress;
+    float chroma_spill_suppress_saturation;
+
+    bool  levels = false;
+    float min_input;
+    float max_input;
+    float gamma;
+    float min_output;
+    float max_output;
+
+    bool  csb = false;
+    float brt;
+    float sat;
+    float con;
+
+    float opacity = 1.0f;
+    bool  invert  = false;
+    int        blend_mode;
+    cpu::keyer keyer;
+};
+
+// Reads texels the way a bound ogl::texture would return them: as normalized rgba with missing components set to 0
+// and missing alpha set to 1, using linear filtering and clamp to edge.
+struct sampler
+{
+    const std::uint8_t* data     = nullptr;
+    int                 width    = 0;
+    int                 height   = 0;
+    int                 stride   = 0;
+    int                 linesize = 0;
+    bool                is_16bit = false;
+    __m128              scale;
+
+    sampler() = default;
+
+    sampler(const array<const std::uint8_t>& image_data, const core::pixel_format_desc::plane& plane)
+        : data(image_data.data())
+        , width(plane.width)
+        , height(plane.height)
+        , stride(plane.stride)
+        , linesize(plane.linesize)
+        , is_16bit(plane.depth != common::bit_depth::bit8)
+        , scale(_mm_set1_ps(is_16bit ? 1.0f / 65535.0f : 1.0f / 255.0f))
+    {
+    }
+
+    __m128 fetch(int x, int y) const
+    {
+        const auto bytes = is_16bit ? 2 : 1;
+        const auto ptr   = data + static_cast<std::ptrdiff_t>(y) * linesize + x * stride * bytes;
+
+        __m128i value;
+        if (is_16bit) {
+            std::uint16_t texel[4] = {0, 0, 0, 0};
+            std::memcpy(texel, ptr, stride * bytes);
+            value = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(texel)));
+        } else {
+            std::uint32_t texel = 0;
+            std::memcpy(&texel, ptr, stride);
+            value = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(static_cast<int>(texel)));
+        }
+
+        auto color = _mm_mul_ps(_mm_cvtepi32_ps(value), scale);
+
+        switch (stride) {
+            case 4: // GL_BGRA
+                return _mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 0, 1, 2));
+            case 3: // GL_BGR
+                return _mm_blend_ps(_mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 0, 1, 2)), _mm_set1_ps(1.0f), 0x8);
+            default: // GL_RED, GL_RG
+                return _mm_blend_ps(color, _mm_set1_ps(1.0f), 0x8);
+        }
+    }
+
+    __m128 operator()(float s, float t) const
+    {
+        const auto x  = s * static_cast<float>(width) - 0.5f;
+        const auto y  = t * static_cast<float>(height) - 0.5f;
+        const auto fx = std::floor(x);
+        const auto fy = std::floor(y);
+        const auto ax = x - fx;
+        const auto ay = y - fy;
+
+        auto x0 = static_cast<int>(fx);
+        auto y0 = static_cast<int>(fy);
+        auto x1 = std::min(std::max(x0 + 1, 0), width - 1);
+        auto y1 = std::min(std::max(y0 + 1, 0), height - 1);
+        x0      = std::min(std::max(x0, 0), width - 1);
+        y0      = std::min(std::max(y0, 0), height - 1);
+
+        auto c00 = fetch(x0, y0);
+        if (ax == 0.0f && ay == 0.0f) {
+            return c00;
+        }
+
+        auto wx   = _mm_set1_ps(ax);
+        auto wy   = _mm_set1_ps(ay);
+        auto c10  = fetch(x1, y0);
+        auto c01  = fetch(x0, y1);
+        auto c11  = fetch(x1, y1);
+        auto top  = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), wx));
+        auto bttm = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), wx));
+        return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bttm, top), wy));
+    }
+};
+
+__m128 ycbcra_to_rgba(const uniforms& u, float y, float cb, float cr, float a)
+{
+    const float luma_coefficient   = 255.0f / 219.0f;
+    const float chroma_coefficient = 255.0f / 224.0f;
+
+    auto Y  = (y * 255.0f - 16.0f) * luma_coefficient;
+    auto Cb = (cb * 255.0f - 128.0f) * chroma_coefficient;
+    auto Cr = (cr * 255.0f - 128.0f) * chroma_coefficient;
+
+    const auto m = u.color_matrix;
+    auto       r = (m[0] * Y + m[1] * Cb + m[2] * Cr) / 255.0f;
+    auto       g = (m[3] * Y + m[4] * Cb + m[5] * Cr) / 255.0f;
+    auto       b = (m[6] * Y + m[7] * Cb + m[8] * Cr) / 255.0f;
+
+    return _mm_setr_ps(b, g, r, a);
+}
+
+// get_rgba_color() of the fragment shader. The result is in shader component order.
+__m128 get_rgba_color(const uniforms& u, const std::array<sampler, 4>& planes, float s, float t)
+{
+    const auto pf = u.precision_factor;
+    switch (u.format) {
+        case core::pixel_format::gray: {
+            auto c = planes[0](s, t);
+            auto r = _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0));
+            return _mm_blend_ps(_mm_mul_ps(r, _mm_set1_ps(pf[0])), _mm_set1_ps(1.0f), 0x8);
+        }
+        case core::pixel_format::bgra: {
+            auto c = planes[0](s, t);
+            return _mm_mul_ps(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 1, 2)), _mm_set1_ps(pf[0]));
+        }
+        case core::pixel_format::rgba:
+            return _mm_mul_ps(planes[0](s, t), _mm_set1_ps(pf[0]));
+        case core::pixel_format::argb: {
+            auto c = planes[0](s, t);
+            return _mm_mul_ps(_mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 1, 0, 3)), _mm_set1_ps(pf[0]));
+        }
+        case core::pixel_format::abgr: {
+            auto c = planes[0](s, t);
+            return _mm_mul_ps(_mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 3, 2, 1)), _mm_set1_ps(pf[0]));
+        }
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::ycbcra: {
+            auto y  = _mm_cvtss_f32(planes[0](s, t)) * pf[0];
+            auto cb = _mm_cvtss_f32(planes[1](s, t)) * pf[1];
+            auto cr = _mm_cvtss_f32(planes[2](s, t)) * pf[2];
+            auto a  = u.format == core::pixel_format::ycbcra ? _mm_cvtss_f32(planes[3](s, t)) * pf[3] : 1.0f;
+            return ycbcra_to_rgba(u, y, cb, cr, a);
+        }
+        case core::pixel_format::luma: {
+            auto y = (_mm_cvtss_f32(planes[0](s, t)) * pf[0] - 0.065f) / 0.859f;
+            return _mm_setr_ps(y, y, y, 1.0f);
+        }
+        case core::pixel_format::bgr: {
+            auto c = planes[0](s, t);
+            c      = _mm_mul_ps(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 1, 2)), _mm_set1_ps(pf[0]));
+            return _mm_blend_ps(c, _mm_set1_ps(1.0f), 0x8);
+        }
+        case core::pixel_format::rgb:
+            return _mm_blend_ps(_mm_mul_ps(planes[0](s, t), _mm_set1_ps(pf[0])), _mm_set1_ps(1.0f), 0x8);
+        case core::pixel_format::uyvy: {
+            float p0[4];
+            float p1[4];
+            _mm_storeu_ps(p0, planes[0](s, t));
+            _mm_storeu_ps(p1, planes[1](s, t));
+            return ycbcra_to_rgba(u, p0[1] * pf[0], p1[2] * pf[1], p1[0] * pf[1], 1.0f);
+        }
+        default:
+            return _mm_setzero_ps();
+    }
+}
+
+// Chroma keying, see the ogl fragment shader for the origin of the algorithm.
+void chroma_key(const uniforms& u, float* color)
+{
+    // The shader keys on color.bgra, i.e. in rgb order.
+    const float r = color[2];
+    const float g = color[1];
+    const float b = color[0];
+
+    // rgb2hsv
+    const float K[4] = {0.0f, -1.0f / 3.0f, 2.0f / 3.0f, -1.0f};
+    const float ps   = step(b, g);
+    const float p[4] = {mix(b, g, ps), mix(g, b, ps), mix(K[3], K[0], ps), mix(K[2], K[1], ps)};
+    const float qs   = step(p[0], r);
+    const float q[4] = {mix(p[0], r, qs), mix(p[1], p[1], qs), mix(p[3], p[2], qs), mix(r, p[0], qs)};
+    const float d    = q[0] - std::min(q[3], q[1]);
+    const float e    = 1.0e-10f;
+    float       h    = std::abs(q[2] + (q[3] - q[1]) / (6.0f * d + e));
+    float       s    = d / (q[0] + e);
+    const float v    = q[0];
+
+    auto angle_diff = [](float angle1, float angle2) { return 0.5f - std::abs(std::abs(angle1 - angle2) - 0.5f); };
+
+    // ColorDistance
+    const float hue_diff         = angle_diff(h, u.chroma_target_hue) * 2.0f;
+    const float saturation_diff  = std::min(0.0f, u.chroma_min_saturation - s);
+    const float brightness_diff  = std::min(0.0f, u.chroma_min_brightness - v);
+    const float sat_bright_score = std::max(brightness_diff, saturation_diff);
+    const float hue_score        = hue_diff - u.chroma_hue_width;
+    const float distance         = -hue_score * sat_bright_score;
+
+    // supress_spill
+    float diff = h - u.chroma_target_hue;
+    diff       = diff < -0.5f ? diff + 1.0f : (diff > 0.5f ? diff - 1.0f : diff);
+    if (std::abs(diff) / u.chroma_spill_suppress < 1.0f) {
+        const float spill_distance = std::abs(diff) / u.chroma_spill_suppress;
+        h = diff < 0.0f ? u.chroma_target_hue - u.chroma_spill_suppress : u.chroma_target_hue + u.chroma_spill_suppress;
+        s *= std::min(1.0f, spill_distance + u.chroma_spill_suppress_saturation);
+    }
+
+    // hsv2rgb
+    const float hk[3] = {1.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float       rgb[3];
+    for (int n = 0; n < 3; ++n) {
+        const float pn = std::abs(fract(h + hk[n]) * 6.0f - 3.0f);
+        rgb[n]         = v * mix(1.0f, std::min(std::max(pn - 1.0f, 0.0f), 1.0f), s);
+    }
+
+    const float alpha = 1.0f - smoothstep(1.0f, u.chroma_softness, distance * -2.0f + 1.0f);
+
+    if (u.chroma_show_mask) {
+        color[0] = color[1] = color[2] = alpha;
+        color[3]                       = 1.0f;
+    } else {
+        color[0] = rgb[2] * alpha;
+        color[1] = rgb[1] * alpha;
+        color[2] = rgb[0] * alpha;
+        color[3] = alpha;
+    }
+}
+
+void levels(const uniforms& u, float* color)
+{
+    for (int n = 0; n < 3; ++n) {
+        auto c   = std::min(std::max(color[n] - u.min_input, 0.0f) / (u.max_input - u.min_input), 1.0f);
+        c        = std::pow(c, 1.0f / u.gamma);
+        color[n] = mix(u.min_output, u.max_output, c);
+    }
+}
+
+void contrast_saturation_brightness(const uniforms& u, float* color)
+{
+    // luma_coeff.bgr since the color is in shader component order.
+    const float lum_coeff[3] = {u.luma_coeff[2], u.luma_coeff[1], u.luma_coeff[0]};
+
+    float rgb[3] = {color[0], color[1], color[2]};
+    if (color[3] > 0.0f) {
+        for (auto& c : rgb) {
+            c /= color[3];
+        }
+    }
+
+    float brt_color[3];
+    float intensity = 0.0f;
+    for (int n = 0; n < 3; ++n) {
+        brt_color[n] = rgb[n] * u.brt;
+        intensity += brt_color[n] * lum_coeff[n];
+    }
+
+    for (int n = 0; n < 3; ++n) {
+        auto sat_color = mix(intensity, brt_color[n], u.sat);
+        color[n]       = mix(0.5f, sat_color, u.con) * color[3];
+    }
+}
+
+__m128 clamp01(__m128 value) { return _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+
+// blend() of the fragment shader followed by the clamping done when writing to a normalized texture.
+__m128 blend(const uniforms& u, __m128 fore, __m128 back)
+{
+    if (u.blend_mode != 0) {
+        const auto epsilon = _mm_set1_ps(0.0000001f);
+        float      f[4];
+        float      b[4];
+        _mm_storeu_ps(f, _mm_div_ps(fore, _mm_add_ps(_mm_shuffle_ps(fore, fore, _MM_SHUFFLE(3, 3, 3, 3)), epsilon)));
+        _mm_storeu_ps(b, _mm_div_ps(back, _mm_add_ps(_mm_shuffle_ps(back, back, _MM_SHUFFLE(3, 3, 3, 3)), epsilon)));
+        blend_color(u.blend_mode, b, f);
+        const auto alpha = _mm_shuffle_ps(fore, fore, _MM_SHUFFLE(3, 3, 3, 3));
+        fore             = _mm_blend_ps(_mm_mul_ps(_mm_loadu_ps(f), alpha), fore, 0x8);
+    }
+
+    if (u.keyer == keyer::additive) {
+        return clamp01(_mm_add_ps(fore, back));
+    }
+
+    const auto inv_alpha = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_shuffle_ps(fore, fore, _MM_SHUFFLE(3, 3, 3, 3)));
+    return clamp01(_mm_add_ps(fore, _mm_mul_ps(inv_alpha, back)));
+}
+
+__m128 load_background(const surface& background, const float* row, int x)
+{
+    if (background.stride() == 4) {
+        return _mm_loadu_ps(row + x * 4);
+    }
+    // Single channel keys are sampled as .bgra of a GL_RED texture.
+    return _mm_setr_ps(0.0f, 0.0f, row[x], 1.0f);
+}
+
+void store_background(const surface& background, float* row, int x, __m128 color)
+{
+    if (background.stride() == 4) {
+        _mm_storeu_ps(row + x * 4, color);
+    } else {
+        float c[4];
+        _mm_storeu_ps(c, color);
+        row[x] = c[2];
+    }
+}
+
+struct vertex
+{
+    double x;
+    double y;
+    double s;
+    double t;
+    double q;
+};
+
+// A triangle edge which covers the pixel centers on or to the left of it (counter-clockwise winding), or only strictly
+// to the left of it for the diagonal shared by the two triangles of a quad, so that no pixel is drawn twice.
+struct edge
+{
+    double a;
+    double b;
+    bool   strict;
+};
+
+struct triangle
+{
+    std::array<vertex, 3> v;
+    std::array<edge, 3>   edges;
+    double                ds_dx, ds_dy, dt_dx, dt_dy, dq_dx, dq_dy;
+    bool                  valid = false;
+
+    triangle(vertex a, vertex b, vertex c, std::array<bool, 3> strict)
+    {
+        auto area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+        if (std::abs(area) < std::numeric_limits<double>::epsilon()) {
+            return;
+        }
+        if (area < 0.0) {
+            std::swap(b, c);
+            strict = {strict[2], strict[1], strict[0]};
+            area   = -area;
+        }
+        v = {a, b, c};
+
+        auto gradient = [&](double fa, double fb, double fc, double& dx, double& dy) {
+            dx = ((fb - fa) * (c.y - a.y) - (fc - fa) * (b.y - a.y)) / area;
+            dy = ((fc - fa) * (b.x - a.x) - (fb - fa) * (c.x - a.x)) / area;
+        };
+        gradient(a.s, b.s, c.s, ds_dx, ds_dy);
+        gradient(a.t, b.t, c.t, dt_dx, dt_dy);
+        gradient(a.q, b.q, c.q, dq_dx, dq_dy);
+
+        for (int n = 0; n < 3; ++n) {
+            const auto& p0 = v[n];
+            const auto& p1 = v[(n + 1) % 3];
+            // Edge function (p1.x - p0.x) * (y - p0.y) - (p1.y - p0.y) * (x - p0.x), which is a * x + b on a row.
+            edges[n].a      = -(p1.y - p0.y);
+            edges[n].b      = (p1.y - p0.y) * p0.x - (p1.x - p0.x) * p0.y;
+            edges[n].strict = strict[n];
+        }
+        valid = true;
+    }
+
+    // Returns the half open span of pixels on row y whose centers are covered.
+    std::pair<int, int> span(int y, int min_x, int max_x) const
+    {
+        const auto py = static_cast<double>(y) + 0.5;
+
+        auto   lo        = -std::numeric_limits<double>::infinity();
+        auto   hi        = std::numeric_limits<double>::infinity();
+        bool   lo_strict = false;
+        bool   hi_strict = false;
+
+        for (int n = 0; n < 3; ++n) {
+            const auto& p0     = v[n];
+            const auto& p1     = v[(n + 1) % 3];
+            const auto  a      = edges[n].a;
+            const auto  b      = edges[n].b + (p1.x - p0.x) * py;
+            const auto  strict = edges[n].strict;
+            if (a == 0.0) {
+                if (b < 0.0 || (b == 0.0 && strict)) {
+                    return {0, 0};
+                }
+            } else if (a > 0.0) {
+                const auto bound = -b / a;
+                lo_strict        = bound > lo ? strict : (bound == lo ? lo_strict || strict : lo_strict);
+                lo               = std::max(lo, bound);
+            } else {
+                const auto bound = -b / a;
+                hi_strict        = bound < hi ? strict : (bound == hi ? hi_strict || strict : hi_strict);
+                hi               = std::min(hi, bound);
+            }
+        }
+
+        if (!(lo <= hi)) {
+            return {0, 0};
+        }
+
+        // Pixel centers are at x + 0.5.
+        auto first = lo_strict ? std::floor(lo - 0.5) + 1.0 : std::ceil(lo - 0.5);
+        auto last  = hi_strict ? std::ceil(hi - 0.5) : std::floor(hi - 0.5) + 1.0;
+
+        first = std::min(std::max(first, static_cast<double>(min_x)), static_cast<double>(max_x));
+        last  = std::min(std::max(last, static_cast<double>(min_x)), static_cast<double>(max_x));
+
+        return {static_cast<int>(first), static_cast<int>(last)};
+    }
+};
+
+} // namespace
+
+void image_kernel::draw(const draw_params& params)
+{
+    static const double epsilon = 0.001;
+
+    if (!params.background) {
+        return;
+    }
+
+    auto& background = *params.background;
+
+    uniforms u;
+    u.blend_mode = static_cast<int>(params.transform.is_key ? core::blend_mode::normal : params.blend_mode);
+    u.keyer      = params.keyer;
+
+    if (params.source) {
+        // Draw a full frame intermediate surface, which the ogl renderer does as a default transform BGRA texture.
+        const auto& source = *params.source;
+        tbb::parallel_for(tbb::blocked_range<int>(0, background.height()), [&](const tbb::blocked_range<int>& r) {
+            for (auto y = r.begin(); y < r.end(); ++y) {
+                auto src = source.row(y);
+                auto dst = background.row(y);
+                for (int x = 0; x < background.width(); ++x) {
+                    auto fore = _mm_loadu_ps(src + x * 4);
+                    store_background(background, dst, x, blend(u, fore, load_background(background, dst, x)));
+                }
+            }
+        });
+        return;
+    }
+
+    CASPAR_ASSERT(params.pix_desc.planes.size() == params.planes.size());
+
+    if (params.planes.empty() || params.planes.size() != params.pix_desc.planes.size()) {
+        return;
+    }
+
+    if (params.transform.opacity < epsilon) {
+        return;
+    }
+
+    auto coords = params.geometry.data();
+
+    if (coords.size() < 4) {
+        return;
+    }
+
+    // Calculate transforms
+    auto f_p = params.transform.fill_translation;
+    auto f_s = params.transform.fill_scale;
+
+    bool is_default_geometry = boost::equal(coords, core::frame_geometry::get_default().data()) ||
+                               boost::equal(coords, core::frame_geometry::get_default_vflip().data());
+    auto aspect = params.aspect_ratio;
+    auto angle  = params.transform.angle;
+    auto anchor = params.transform.anchor;
+    auto crop   = params.transform.crop;
+    auto pers   = params.transform.perspective;
+    pers.ur[0] -= 1.0;
+    pers.lr[0] -= 1.0;
+    pers.lr[1] -= 1.0;
+    pers.ll[1] -= 1.0;
+    std::vector<std::array<double, 2>> pers_corners = {pers.ul, pers.ur, pers.lr, pers.ll};
+
+    int corner = 0;
+    for (auto& coord : coords) {
+        if (is_default_geometry) {
+            coord.vertex_x  = std::min(std::max(coord.vertex_x, crop.ul[0]), crop.lr[0]);
+            coord.vertex_y  = std::min(std::max(coord.vertex_y, crop.ul[1]), crop.lr[1]);
+            coord.texture_x = std::min(std::max(coord.texture_x, crop.ul[0]), crop.lr[0]);
+            coord.texture_y = std::min(std::max(coord.texture_y, crop.ul[1]), crop.lr[1]);
+
+            coord.vertex_x += pers_corners.at(corner)[0];
+            coord.vertex_y += pers_corners.at(corner)[1];
+        }
+
+        auto orig_x    = (coord.vertex_x - anchor[0]) * f_s[0];
+        auto orig_y    = (coord.vertex_y - anchor[1]) * f_s[1] / aspect;
+        coord.vertex_x = orig_x * std::cos(angle) - orig_y * std::sin(angle);
+        coord.vertex_y = orig_x * std::sin(angle) + orig_y * std::cos(angle);
+        coord.vertex_y *= aspect;
+
+        coord.vertex_x += f_p[0];
+        coord.vertex_y += f_p[1];
+
+        if (++corner == 4) {
+            corner = 0;
+        }
+    }
+
+    // Skip drawing if all the coordinates will be outside the screen.
+    if (is_outside_screen(coords)) {
+        return;
+    }
+
+    // Perspective correction
+    double diagonal_intersection_x;
+    double diagonal_intersection_y;
+
+    if (get_line_intersection(pers.ul[0] + crop.ul[0],
+                              pers.ul[1] + crop.ul[1],
+                              pers.lr[0] + crop.lr[0],
+                              pers.lr[1] + crop.lr[1],
+                              pers.ur[0] + crop.lr[0],
+                              pers.ur[1] + crop.ul[1],
+                              pers.ll[0] + crop.ul[0],
+                              pers.ll[1] + crop.lr[1],
+                              diagonal_intersection_x,
+                              diagonal_intersection_y) &&
+        is_default_geometry) {
+        auto d0 = hypotenuse(
+            pers.ll[0] + crop.ul[0], pers.ll[1] + crop.lr[1], diagonal_intersection_x, diagonal_intersection_y);
+        auto d1 = hypotenuse(
+            pers.lr[0] + crop.lr[0], pers.lr[1] + crop.lr[1], diagonal_intersection_x, diagonal_intersection_y);
+        auto d2 = hypotenuse(
+            pers.ur[0] + crop.lr[0], pers.ur[1] + crop.ul[1], diagonal_intersection_x, diagonal_intersection_y);
+        auto d3 = hypotenuse(
+            pers.ul[0] + crop.ul[0], pers.ul[1] + crop.ul[1], diagonal_intersection_x, diagonal_intersection_y);
+
+        std::vector<double> q_values = {calc_q(d3, d1), calc_q(d2, d0), calc_q(d1, d3), calc_q(d0, d2)};
+
+        corner = 0;
+        for (auto& coord : coords) {
+            coord.texture_q = q_values[corner];
+            coord.texture_x *= q_values[corner];
+            coord.texture_y *= q_values[corner];
+
+            if (++corner == 4) {
+                corner = 0;
+            }
+        }
+    }
+
+    // Setup uniforms
+    const auto is_hd       = params.pix_desc.planes.at(0).height > 700;
+    const auto color_space = is_hd ? params.pix_desc.color_space : core::color_space::bt601;
+
+    const float color_matrices[3][9] = {
+        {1.0, 0.0, 1.402, 1.0, -0.344, -0.509, 1.0, 1.772, 0.0},                          // bt.601
+        {1.0, 0.0, 1.5748, 1.0, -0.1873, -0.4681, 1.0, 1.8556, 0.0},                      // bt.709
+        {1.0, 0.0, 1.4746, 1.0, -0.16455312684366, -0.57135312684366, 1.0, 1.8814, 0.0}}; // bt.2020
+    const float luma_coefficients[3][3] = {{0.299, 0.587, 0.114},                         // bt.601
+                                           {0.2126, 0.7152, 0.0722},                      // bt.709
+                                           {0.2627, 0.6780, 0.0593}};                     // bt.2020
+
+    std::copy_n(color_matrices[static_cast<int>(color_space)], 9, u.color_matrix);
+    std::copy_n(luma_coefficients[static_cast<int>(color_space)], 3, u.luma_coeff);
+
+    std::array<sampler, 4> planes;
+    for (int n = 0; n < static_cast<int>(params.planes.size()) && n < 4; ++n) {
+        planes[n]             = sampler(params.planes[n], params.pix_desc.planes[n]);
+        u.precision_factor[n] = get_precision_factor(params.pix_desc.planes[n].depth);
+    }
+
+    u.format  = params.pix_desc.format;
+    u.opacity = static_cast<float>(params.transform.is_key ? 1.0 : params.transform.opacity);
+    u.invert  = params.transform.invert;
+
+    if (params.transform.chroma.enable) {
+        u.chroma                           = true;
+        u.chroma_show_mask                 = params.transform.chroma.show_mask;
+        u.chroma_target_hue                = static_cast<float>(params.transform.chroma.target_hue / 360.0);
+        u.chroma_hue_width                 = static_cast<float>(params.transform.chroma.hue_width);
+        u.chroma_min_saturation            = static_cast<float>(params.transform.chroma.min_saturation);
+        u.chroma_min_brightness            = static_cast<float>(params.transform.chroma.min_brightness);
+        u.chroma_softness                  = static_cast<float>(1.0 + params.transform.chroma.softness);
+        u.chroma_spill_suppress            = static_cast<float>(params.transform.chroma.spill_suppress / 360.0);
+        u.chroma_spill_suppress_saturation = static_cast<float>(params.transform.chroma.spill_suppress_saturation);
+    }
+
+    const auto& lvl = params.transform.levels;
+    if (lvl.min_input > epsilon || lvl.max_input < 1.0 - epsilon || lvl.min_output > epsilon ||
+        lvl.max_output < 1.0 - epsilon || std::abs(lvl.gamma - 1.0) > epsilon) {
+        u.levels     = true;
+        u.min_input  = static_cast<float>(lvl.min_input);
+        u.max_input  = static_cast<float>(lvl.max_input);
+        u.min_output = static_cast<float>(lvl.min_output);
+        u.max_output = static_cast<float>(lvl.max_output);
+        u.gamma      = static_cast<float>(lvl.gamma);
+    }
+
+    if (std::abs(params.transform.brightness - 1.0) > epsilon ||
+        std::abs(params.transform.saturation - 1.0) > epsilon || std::abs(params.transform.contrast - 1.0) > epsilon) {
+        u.csb = true;
+        u.brt = static_cast<float>(params.transform.brightness);
+        u.sat = static_cast<float>(params.transform.saturation);
+        u.con = static_cast<float>(params.transform.contrast);
+    }
+
+    // Setup drawing area
+    const auto width  = background.width();
+    const auto height = background.height();
+
+    int min_x = 0;
+    int min_y = 0;
+    int max_x = width;
+    int max_y = height;
+
+    auto m_p = params.transform.clip_translation;
+    auto m_s = params.transform.clip_scale;
+
+    bool scissor = m_p[0] > std::numeric_limits<double>::epsilon() || m_p[1] > std::numeric_limits<double>::epsilon() ||
+                   m_s[0] < 1.0 - std::numeric_limits<double>::epsilon() ||
+                   m_s[1] < 1.0 - std::numeric_limits<double>::epsilon();
+
+    if (scissor) {
+        min_x = std::max(min_x, static_cast<int>(m_p[0] * width));
+        min_y = std::max(min_y, static_cast<int>(m_p[1] * height));
+        max_x = std::min(max_x, min_x + std::max(0, static_cast<int>(m_s[0] * width)));
+        max_y = std::min(max_y, min_y + std::max(0, static_cast<int>(m_s[1] * height)));
+    }
+
+    auto to_vertex = [&](const core::frame_geometry::coord& coord) {
+        return vertex{
+            coord.vertex_x * width, coord.vertex_y * height, coord.texture_x, coord.texture_y, coord.texture_q};
+    };
+
+    for (std::size_t n = 0; n + 3 < coords.size(); n += 4) {
+        const std::array<triangle, 2> triangles = {
+            triangle(to_vertex(coords[n]), to_vertex(coords[n + 1]), to_vertex(coords[n + 2]), {false, false, false}),
+            triangle(to_vertex(coords[n]), to_vertex(coords[n + 2]), to_vertex(coords[n + 3]), {true, false, false})};
+
+        auto top    = max_y;
+        auto bottom = min_y;
+        for (auto& tri : triangles) {
+            if (!tri.valid) {
+                continue;
+            }
+            for (auto& v : tri.v) {
+                const auto y = std::min(std::max(v.y, static_cast<double>(min_y)), static_cast<double>(max_y));
+                top          = std::min(top, static_cast<int>(std::floor(y)));
+                bottom       = std::max(bottom, std::min(max_y, static_cast<int>(std::ceil(y)) + 1));
+            }
+        }
+
+        if (top >= bottom) {
+            continue;
+        }
+
+        tbb::parallel_for(tbb::blocked_range<int>(top, bottom), [&](const tbb::blocked_range<int>& r) {
+            for (auto y = r.begin(); y < r.end(); ++y) {
+                auto dst       = background.row(y);
+                auto local_key = params.local_key ? params.local_key->row(y) : nullptr;
+                auto layer_key = params.layer_key ? params.layer_key->row(y) : nullptr;
+
+                for (auto& tri : triangles) {
+                    if (!tri.valid) {
+                        continue;
+                    }
+
+                    const auto span = tri.span(y, min_x, max_x);
+                    if (span.first >= span.second) {
+                        continue;
+                    }
+
+                    const auto& a  = tri.v[0];
+                    const auto  px = static_cast<double>(span.first) + 0.5 - a.x;
+                    const auto  py = static_cast<double>(y) + 0.5 - a.y;
+                    auto        s  = a.s + tri.ds_dx * px + tri.ds_dy * py;
+                    auto        t  = a.t + tri.dt_dx * px + tri.dt_dy * py;
+                    auto        q  = a.q + tri.dq_dx * px + tri.dq_dy * py;
+
+                    for (auto x = span.first; x < span.second; ++x, s += tri.ds_dx, t += tri.dt_dx, q += tri.dq_dx) {
+                        auto color = get_rgba_color(u, planes, static_cast<float>(s / q), static_cast<float>(t / q));
+
+                        if (u.chroma || u.levels || u.csb) {
+                            float c[4];
+                            _mm_storeu_ps(c, color);
+                            if (u.chroma) {
+                                chroma_key(u, c);
+                            }
+                            if (u.levels) {
+                                levels(u, c);
+                            }
+                            if (u.csb) {
+                                contrast_saturation_brightness(u, c);
+                            }
+                            color = _mm_loadu_ps(c);
+                        }
+                        if (local_key) {
+                            color = _mm_mul_ps(color, _mm_set1_ps(local_key[x]));
+                        }
+                        if (layer_key) {
+                            color = _mm_mul_ps(color, _mm_set1_ps(layer_key[x]));
+                        }
+                        color = _mm_mul_ps(color, _mm_set1_ps(u.opacity));
+                        if (u.invert) {
+                            color = _mm_sub_ps(_mm_set1_ps(1.0f), color);
+                        }
+
+                        store_background(background, dst, x, blend(u, color, load_background(background, dst, x)));
+                    }
+                }
+            }
+        });
+    }
+}
+
+}}} // namespace caspar::accelerator::cpu
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/mixer/image/blend_modes.h>
+
+#include <common/array.h>
+
+#include <core/frame/frame_transform.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+enum class keyer
+{
+    linear = 0,
+    additive,
+};
+
+struct draw_params final
+{
+    core::pixel_format_desc                pix_desc = core::pixel_format_desc(core::pixel_format::invalid);
+    std::vector<array<const std::uint8_t>> planes;
+    std::shared_ptr<class surface>         source;
+    core::image_transform                  transform;
+    core::frame_geometry                   geometry   = core::frame_geometry::get_default();
+    core::blend_mode                       blend_mode = core::blend_mode::normal;
+    cpu::keyer                             keyer      = cpu::keyer::linear;
+    std::shared_ptr<class surface>         background;
+    std::shared_ptr<class surface>         local_key;
+    std::shared_ptr<class surface>         layer_key;
+    double                                 aspect_ratio = 1.0;
+};
+
+// Software implementation of ogl::image_kernel. Every stage of the ogl fragment shader (pixel format conversion,
+// chroma key, levels, contrast/saturation/brightness, keying, opacity, invert, blend modes and keyers) is reproduced
+// on SSE vectors, and the target is rasterized in row bands spread over the TBB worker threads.
+class image_kernel final
+{
+  public:
+    image_kernel() = default;
+
+    image_kernel(const image_kernel&)            = delete;
+    image_kernel& operator=(const image_kernel&) = delete;
+
+    // Draws either the frame planes or, when set, the source surface onto the background surface.
+    void draw(const draw_params& params);
+};
+
+}}} // namespace caspar::accelerator::cpu
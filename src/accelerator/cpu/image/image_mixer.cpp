@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "image_mixer.h"
+
+#include "image_kernel.h"
+
+#include "../util/surface.h"
+
+#include <common/array.h>
+#include <common/bit_depth.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <tbb/cache_aligned_allocator.h>
+#include <tbb/concurrent_queue.h>
+#include <tbb/concurrent_unordered_map.h>
+#include <tbb/parallel_for.h>
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse4.1.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <smmintrin.h>
+#endif
+#endif
+
+#include <cstring>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+// Recycles frame sized host buffers, so that neither producers nor the renderer page fault fresh allocations every
+// frame.
+class buffer_pool : public std::enable_shared_from_this<buffer_pool>
+{
+    using buffer = std::vector<std::uint8_t, tbb::cache_aligned_allocator<std::uint8_t>>;
+
+    tbb::concurrent_unordered_map<std::size_t, tbb::concurrent_queue<std::shared_ptr<buffer>>> pools_;
+
+  public:
+    array<std::uint8_t> create_array(std::size_t size)
+    {
+        std::shared_ptr<buffer> buf;
+        if (!pools_[size].try_pop(buf)) {
+            buf = std::make_shared<buffer>(size);
+        }
+
+        auto                       ptr       = buf->data();
+        std::weak_ptr<buffer_pool> weak_self = shared_from_this();
+        return array<std::uint8_t>(ptr, size, std::shared_ptr<void>(ptr, [buf, weak_self](void*) mutable {
+                                       auto self = weak_self.lock();
+                                       if (self) {
+                                           self->pools_[buf->size()].push(std::move(buf));
+                                       }
+                                   }));
+    }
+};
+
+struct item
+{
+    core::pixel_format_desc pix_desc = core::pixel_format_desc(core::pixel_format::invalid);
+    core::const_frame       frame;
+    core::image_transform   transform;
+    core::frame_geometry    geometry = core::frame_geometry::get_default();
+};
+
+struct layer
+{
+    std::vector<layer> sublayers;
+    std::vector<item>  items;
+    core::blend_mode   blend_mode;
+
+    explicit layer(core::blend_mode blend_mode)
+        : blend_mode(blend_mode)
+    {
+    }
+};
+
+class image_renderer
+{
+    spl::shared_ptr<buffer_pool>          buffers_;
+    image_kernel                          kernel_;
+    common::bit_depth                     depth_;
+    core::color_space                     color_space_;
+    std::vector<std::shared_ptr<surface>> surfaces_;
+    std::shared_ptr<std::vector<uint8_t>> empty_;
+    executor                              executor_;
+
+  public:
+    explicit image_renderer(const spl::shared_ptr<buffer_pool>& buffers,
+                            int                                 channel_id,
+                            common::bit_depth                   depth,
+                            core::color_space                   color_space)
+        : buffers_(buffers)
+        , depth_(depth)
+        , color_space_(color_space)
+        , executor_(L"cpu image mixer " + std::to_wstring(channel_id), task_priority::high)
+    {
+    }
+
+    std::future<array<const std::uint8_t>> operator()(std::vector<layer>             layers,
+                                                      const core::video_format_desc& format_desc)
+    {
+        const auto size = format_desc.size * (depth_ == common::bit_depth::bit8 ? 1 : 2);
+
+        if (layers.empty()) { // Bypass rendering with empty frame.
+            if (!empty_ || empty_->size() != size) {
+                empty_ = std::make_shared<std::vector<uint8_t>>(size, 0);
+            }
+            return make_ready_future(array<const std::uint8_t>(empty_->data(), size, empty_));
+        }
+
+        return executor_.begin_invoke([this, layers = std::move(layers), format_desc]() mutable {
+            auto target = create_surface(format_desc.width, format_desc.height, 4);
+
+            draw(target, std::move(layers), format_desc);
+
+            return read_back(*target);
+        });
+    }
+
+    common::bit_depth depth() const { return depth_; }
+    core::color_space color_space() const { return color_space_; }
+
+  private:
+    std::shared_ptr<surface> create_surface(int width, int height, int stride)
+    {
+        for (auto& s : surfaces_) {
+            if (s.use_count() == 1 && s->width() == width && s->height() == height && s->stride() == stride) {
+                s->clear();
+                return s;
+            }
+        }
+
+        surfaces_.push_back(std::make_shared<surface>(width, height, stride));
+        return surfaces_.back();
+    }
+
+    array<const std::uint8_t> read_back(const surface& source)
+    {
+        const auto width   = source.width();
+        const auto is_8bit = depth_ == common::bit_depth::bit8;
+        const auto size    = static_cast<std::size_t>(width) * source.height() * 4 * (is_8bit ? 1 : 2);
+        auto       result  = buffers_->create_array(size);
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, source.height()), [&](const tbb::blocked_range<int>& r) {
+            for (auto y = r.begin(); y < r.end(); ++y) {
+                auto       src    = source.row(y);
+                const auto offset = static_cast<std::size_t>(y) * width * 4;
+
+                if (is_8bit) {
+                    auto       dst   = result.data() + offset;
+                    const auto scale = _mm_set1_ps(255.0f);
+                    int        x     = 0;
+                    for (; x + 4 <= width; x += 4, src += 16) {
+                        auto a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + 0), scale));
+                        auto b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + 4), scale));
+                        auto c = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + 8), scale));
+                        auto d = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + 12), scale));
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4),
+                                         _mm_packus_epi16(_mm_packus_epi32(a, b), _mm_packus_epi32(c, d)));
+                    }
+                    for (; x < width; ++x, src += 4) {
+                        auto a     = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src), scale));
+                        auto px    = _mm_packus_epi16(_mm_packus_epi32(a, a), _mm_setzero_si128());
+                        auto value = _mm_cvtsi128_si32(px);
+                        std::memcpy(dst + x * 4, &value, 4);
+                    }
+                } else {
+                    auto       dst   = reinterpret_cast<std::uint16_t*>(result.data()) + offset;
+                    const auto scale = _mm_set1_ps(65535.0f);
+                    int        x     = 0;
+                    for (; x + 2 <= width; x += 2, src += 8) {
+                        auto a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + 0), scale));
+                        auto b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + 4), scale));
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi32(a, b));
+                    }
+                    for (; x < width; ++x, src += 4) {
+                        auto a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src), scale));
+                        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi32(a, a));
+                    }
+                }
+            }
+        });
+
+        return result;
+    }
+
+    void draw(std::shared_ptr<surface>& target, std::vector<layer> layers, const core::video_format_desc& format_desc)
+    {
+        std::shared_ptr<surface> layer_key_surface;
+
+        for (auto& layer : layers) {
+            draw(target, layer.sublayers, format_desc);
+            draw(target, std::move(layer), layer_key_surface, format_desc);
+        }
+    }
+
+    void draw(std::shared_ptr<surface>&      target,
+              layer                          layer,
+              std::shared_ptr<surface>&      layer_key_surface,
+              const core::video_format_desc& format_desc)
+    {
+        if (layer.items.empty())
+            return;
+
+        std::shared_ptr<surface> local_key_surface;
+        std::shared_ptr<surface> local_mix_surface;
+
+        if (layer.blend_mode != core::blend_mode::normal) {
+            auto layer_surface = create_surface(target->width(), target->height(), 4);
+
+            for (auto& item : layer.items)
+                draw(layer_surface,
+                     std::move(item),
+                     layer_key_surface,
+                     local_key_surface,
+                     local_mix_surface,
+                     format_desc);
+
+            draw(layer_surface, std::move(local_mix_surface), core::blend_mode::normal);
+            draw(target, std::move(layer_surface), layer.blend_mode);
+        } else // fast path
+        {
+            for (auto& item : layer.items)
+                draw(target, std::move(item), layer_key_surface, local_key_surface, local_mix_surface, format_desc);
+
+            draw(target, std::move(local_mix_surface), core::blend_mode::normal);
+        }
+
+        layer_key_surface = std::move(local_key_surface);
+    }
+
+    void draw(std::shared_ptr<surface>&      target,
+              item                           item,
+              std::shared_ptr<surface>&      layer_key_surface,
+              std::shared_ptr<surface>&      local_key_surface,
+              std::shared_ptr<surface>&      local_mix_surface,
+              const core::video_format_desc& format_desc)
+    {
+        draw_params draw_params;
+
+        draw_params.pix_desc  = std::move(item.pix_desc);
+        draw_params.transform = std::move(item.transform);
+        draw_params.geometry  = item.geometry;
+        draw_params.aspect_ratio =
+            static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+
+        for (int n = 0; n < static_cast<int>(draw_params.pix_desc.planes.size()); ++n) {
+            draw_params.planes.push_back(item.frame.image_data(n));
+        }
+
+        if (item.transform.is_key) {
+            local_key_surface = local_key_surface ? local_key_surface
+                                                  : create_surface(target->width(), target->height(), 1);
+
+            draw_params.background = local_key_surface;
+            draw_params.local_key  = nullptr;
+            draw_params.layer_key  = nullptr;
+
+            kernel_.draw(draw_params);
+        } else if (item.transform.is_mix) {
+            local_mix_surface = local_mix_surface ? local_mix_surface
+                                                  : create_surface(target->width(), target->height(), 4);
+
+            draw_params.background = local_mix_surface;
+            draw_params.local_key  = std::move(local_key_surface);
+            draw_params.layer_key  = layer_key_surface;
+
+            draw_params.keyer = keyer::additive;
+
+            kernel_.draw(draw_params);
+        } else {
+            draw(target, std::move(local_mix_surface), core::blend_mode::normal);
+
+            draw_params.background = target;
+            draw_params.local_key  = std::move(local_key_surface);
+            draw_params.layer_key  = layer_key_surface;
+
+            kernel_.draw(draw_params);
+        }
+    }
+
+    void draw(std::shared_ptr<surface>&  target,
+              std::shared_ptr<surface>&& source,
+              core::blend_mode           blend_mode = core::blend_mode::normal)
+    {
+        if (!source)
+            return;
+
+        draw_params draw_params;
+        draw_params.source     = std::move(source);
+        draw_params.blend_mode = blend_mode;
+        draw_params.background = target;
+
+        kernel_.draw(draw_params);
+    }
+};
+
+struct image_mixer::impl : public core::frame_factory
+{
+    spl::shared_ptr<buffer_pool>       buffers_ = spl::make_shared<buffer_pool>();
+    image_renderer                     renderer_;
+    std::vector<core::image_transform> transform_stack_;
+    std::vector<layer>                 layers_; // layer/stream/items
+    std::vector<layer*>                layer_stack_;
+
+  public:
+    impl(const int channel_id, common::bit_depth depth, core::color_space color_space)
+        : renderer_(buffers_, channel_id, depth, color_space)
+        , transform_stack_(1)
+    {
+        CASPAR_LOG(info) << L"Initialized CPU Image Mixer for channel " << channel_id;
+    }
+
+    void push(const core::frame_transform& transform)
+    {
+        auto previous_layer_depth = transform_stack_.back().layer_depth;
+        transform_stack_.push_back(transform_stack_.back() * transform.image_transform);
+        auto new_layer_depth = transform_stack_.back().layer_depth;
+
+        if (previous_layer_depth < new_layer_depth) {
+            layer new_layer(transform_stack_.back().blend_mode);
+
+            if (layer_stack_.empty()) {
+                layers_.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layers_.back());
+            } else {
+                layer_stack_.back()->sublayers.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layer_stack_.back()->sublayers.back());
+            }
+        }
+    }
+
+    void visit(const core::const_frame& frame)
+    {
+        if (frame.pixel_format_desc().format == core::pixel_format::invalid)
+            return;
+
+        if (frame.pixel_format_desc().planes.empty())
+            return;
+
+        item item;
+        item.pix_desc  = frame.pixel_format_desc();
+        item.frame     = frame;
+        item.transform = transform_stack_.back();
+        item.geometry  = frame.geometry();
+
+        layer_stack_.back()->items.push_back(item);
+    }
+
+    void pop()
+    {
+        transform_stack_.pop_back();
+        layer_stack_.resize(transform_stack_.back().layer_depth);
+    }
+
+    std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc)
+    {
+        return renderer_(std::move(layers_), format_desc);
+    }
+
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        return create_frame(tag, desc, common::bit_depth::bit8);
+    }
+
+    core::mutable_frame
+    create_frame(const void* tag, const core::pixel_format_desc& desc, common::bit_depth depth) override
+    {
+        std::vector<array<std::uint8_t>> image_data;
+        for (auto& plane : desc.planes) {
+            auto bytes_per_pixel = depth == common::bit_depth::bit8 ? 1 : 2;
+            image_data.push_back(buffers_->create_array(plane.size * bytes_per_pixel));
+        }
+
+        return core::mutable_frame(tag, std::move(image_data), array<int32_t>{}, desc);
+    }
+
+    common::bit_depth depth() const { return renderer_.depth(); }
+    core::color_space color_space() const { return renderer_.color_space(); }
+};
+
+image_mixer::image_mixer(const int channel_id, common::bit_depth depth, core::color_space color_space)
+    : impl_(std::make_unique<impl>(channel_id, depth, color_space))
+{
+}
+image_mixer::~image_mixer() {}
+void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
+void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
+void image_mixer::pop() { impl_->pop(); }
+std::future<array<const std::uint8_t>> image_mixer::operator()(const core::video_format_desc& format_desc)
+{
+    return impl_->render(format_desc);
+}
+core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
+{
+    return impl_->create_frame(tag, desc);
+}
+core::mutable_frame
+image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc, common::bit_depth depth)
+{
+    return impl_->create_frame(tag, desc, depth);
+}
+
+bool image_mixer::reads_image_data_in_place() const { return true; }
+
+common::bit_depth image_mixer::depth() const { return impl_->depth(); }
+core::color_space image_mixer::color_space() const { return impl_->color_space(); }
+
+}}} // namespace caspar::accelerator::cpu
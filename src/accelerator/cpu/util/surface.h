@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <tbb/cache_aligned_allocator.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+// Floating point render target, the cpu counterpart of ogl::texture. Colors are premultiplied and stored in the same
+// component order as the shader in the ogl accelerator works in, which is also the order of the final BGRA output.
+// A stride of 1 is used for key surfaces.
+class surface final
+{
+  public:
+    surface(int width, int height, int stride)
+        : width_(width)
+        , height_(height)
+        , stride_(stride)
+        , data_(static_cast<std::size_t>(width) * height * stride, 0.0f)
+    {
+    }
+
+    surface(const surface&)            = delete;
+    surface& operator=(const surface&) = delete;
+
+    void clear()
+    {
+        tbb::parallel_for(tbb::blocked_range<int>(0, height_), [&](const tbb::blocked_range<int>& r) {
+            std::fill(row(r.begin()), row(r.end()), 0.0f);
+        });
+    }
+
+    float*       row(int y) { return data_.data() + static_cast<std::size_t>(y) * width_ * stride_; }
+    const float* row(int y) const { return data_.data() + static_cast<std::size_t>(y) * width_ * stride_; }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int stride() const { return stride_; }
+
+  private:
+    int                                                     width_;
+    int                                                     height_;
+    int                                                     stride_;
+    std::vector<float, tbb::cache_aligned_allocator<float>> data_;
+};
+
+}}} // namespace caspar::accelerator::cpu
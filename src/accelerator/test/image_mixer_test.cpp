@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the output of the cpu image mixer against reference output computed here, per pixel and in plain floats, from
+// the formulas of the ogl fragment shader: fill, clip and rotation transforms with opacity, the separable blend modes
+// of a layer over the one below it, and the linear keyer of a masked fill as well as the additive keyer of mixed
+// frames. Frames go through draw_frame and the mixer the way the channel mixer sends them, and the 8 bit output may
+// differ from the reference by one step for rounding.
+
+#include "../cpu/image/image_mixer.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu { namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+const int width  = 64;
+const int height = 36;
+
+// Premultiplied BGRA in 0..1, in the component order of the frames.
+using color   = std::array<float, 4>;
+using picture = std::vector<color>;
+
+core::video_format_desc format_desc()
+{
+    return core::video_format_desc(
+        core::video_format::custom, 1, width, height, width, height, 25000, 1000, L"test", {1920});
+}
+
+// Random premultiplied pixels, opaque or with any alpha.
+picture random_picture(unsigned seed, bool opaque)
+{
+    std::mt19937                       random(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    picture result(static_cast<std::size_t>(width) * height);
+    for (auto& c : result) {
+        const auto alpha = opaque ? 255 : byte(random);
+        for (int n = 0; n < 3; ++n) {
+            c[n] = static_cast<float>(byte(random) * alpha / 255) / 255.0f;
+        }
+        c[3] = static_cast<float>(alpha) / 255.0f;
+    }
+    return result;
+}
+
+picture solid_picture(const color& c) { return picture(static_cast<std::size_t>(width) * height, c); }
+
+core::draw_frame make_frame(image_mixer& mixer, const picture& pixels)
+{
+    core::pixel_format_desc desc(core::pixel_format::bgra);
+    desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
+
+    auto frame = mixer.create_frame(&mixer, desc);
+    auto data  = frame.image_data(0).data();
+    for (std::size_t n = 0; n < pixels.size(); ++n) {
+        for (int c = 0; c < 4; ++c) {
+            data[n * 4 + c] = static_cast<std::uint8_t>(std::lround(pixels[n][c] * 255.0f));
+        }
+    }
+    return core::draw_frame(core::const_frame(std::move(frame)));
+}
+
+// Mixes the frames as layers from the bottom up, as the channel mixer does.
+std::vector<std::uint8_t> render(image_mixer& mixer, std::vector<core::draw_frame> layers)
+{
+    for (auto& frame : layers) {
+        frame.transform().image_transform.layer_depth = 1;
+        frame.accept(mixer);
+    }
+    auto image = mixer(format_desc()).get();
+    return std::vector<std::uint8_t>(image.begin(), image.end());
+}
+
+void compare(const std::vector<std::uint8_t>& output, const picture& reference, const std::string& what)
+{
+    if (output.size() != reference.size() * 4) {
+        check(false, what + ": output of " + std::to_string(output.size()) + " bytes");
+        return;
+    }
+
+    int         mismatches = 0;
+    std::string first;
+    for (std::size_t n = 0; n < reference.size(); ++n) {
+        for (int c = 0; c < 4; ++c) {
+            const auto value    = std::min(std::max(reference[n][c], 0.0f), 1.0f);
+            const auto expected = static_cast<int>(std::lround(value * 255.0f));
+            const auto actual   = static_cast<int>(output[n * 4 + c]);
+            if (std::abs(expected - actual) > 1 && mismatches++ == 0) {
+                first = " (first at " + std::to_string(n % width) + "," + std::to_string(n / width) + " component " +
+                        std::to_string(c) + ": " + std::to_string(actual) + " for " + std::to_string(expected) + ")";
+            }
+        }
+    }
+    check(mismatches == 0, what + ": " + std::to_string(mismatches) + " components differ" + first);
+}
+
+color over(const color& fore, const color& back)
+{
+    color result;
+    for (int n = 0; n < 4; ++n) {
+        result[n] = std::min(std::max(fore[n] + (1.0f - fore[3]) * back[n], 0.0f), 1.0f);
+    }
+    return result;
+}
+
+void test_transform()
+{
+    image_mixer mixer(1, common::bit_depth::bit8, core::color_space::bt709);
+
+    // Scaled to the middle quarter of the frame, at half opacity.
+    {
+        const color c     = {40.0f / 255, 80.0f / 255, 120.0f / 255, 160.0f / 255};
+        auto        frame = make_frame(mixer, solid_picture(c));
+
+        auto& transform            = frame.transform().image_transform;
+        transform.fill_translation = {0.25, 0.25};
+        transform.fill_scale       = {0.5, 0.5};
+        transform.opacity          = 0.5;
+
+        picture reference(static_cast<std::size_t>(width) * height, color{});
+        for (int y = height / 4; y < height * 3 / 4; ++y) {
+            for (int x = width / 4; x < width * 3 / 4; ++x) {
+                for (int n = 0; n < 4; ++n) {
+                    reference[y * width + x][n] = c[n] * 0.5f;
+                }
+            }
+        }
+        compare(render(mixer, {frame}), reference, "fill scale and translation with opacity");
+    }
+
+    // Clipped to the right half.
+    {
+        const auto pixels = random_picture(1, false);
+        auto       frame  = make_frame(mixer, pixels);
+
+        auto& transform            = frame.transform().image_transform;
+        transform.clip_translation = {0.5, 0.0};
+        transform.clip_scale       = {0.5, 1.0};
+
+        picture reference(static_cast<std::size_t>(width) * height, color{});
+        for (int y = 0; y < height; ++y) {
+            for (int x = width / 2; x < width; ++x) {
+                reference[y * width + x] = pixels[y * width + x];
+            }
+        }
+        compare(render(mixer, {frame}), reference, "clip");
+    }
+
+    // Turned half a turn around the center.
+    {
+        const auto pixels = random_picture(2, false);
+        auto       frame  = make_frame(mixer, pixels);
+
+        auto& transform            = frame.transform().image_transform;
+        transform.anchor           = {0.5, 0.5};
+        transform.fill_translation = {0.5, 0.5};
+        transform.angle            = std::acos(-1.0);
+
+        picture reference(pixels.size());
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                reference[y * width + x] = pixels[(height - 1 - y) * width + (width - 1 - x)];
+            }
+        }
+        compare(render(mixer, {frame}), reference, "rotation");
+    }
+}
+
+void test_blend_modes()
+{
+    image_mixer mixer(1, common::bit_depth::bit8, core::color_space::bt709);
+
+    // Per channel, on colors that are not premultiplied, with base below and blend above.
+    struct mode
+    {
+        core::blend_mode                   mode;
+        const char*                        name;
+        std::function<float(float, float)> blend;
+    };
+    const mode modes[] = {
+        {core::blend_mode::lighten, "lighten", [](float b, float f) { return std::max(b, f); }},
+        {core::blend_mode::darken, "darken", [](float b, float f) { return std::min(b, f); }},
+        {core::blend_mode::multiply, "multiply", [](float b, float f) { return b * f; }},
+        {core::blend_mode::average, "average", [](float b, float f) { return (b + f) / 2.0f; }},
+        {core::blend_mode::add, "add", [](float b, float f) { return std::min(b + f, 1.0f); }},
+        {core::blend_mode::subtract, "subtract", [](float b, float f) { return std::max(b + f - 1.0f, 0.0f); }},
+        {core::blend_mode::difference, "difference", [](float b, float f) { return std::abs(b - f); }},
+        {core::blend_mode::exclusion, "exclusion", [](float b, float f) { return b + f - 2.0f * b * f; }},
+        {core::blend_mode::screen, "screen", [](float b, float f) { return 1.0f - (1.0f - b) * (1.0f - f); }},
+        {core::blend_mode::overlay,
+         "overlay",
+         [](float b, float f) { return b < 0.5f ? 2.0f * b * f : 1.0f - 2.0f * (1.0f - b) * (1.0f - f); }},
+    };
+
+    const auto back_pixels = random_picture(3, false);
+    const auto fore_pixels = random_picture(4, false);
+
+    {
+        picture reference(back_pixels.size());
+        for (std::size_t n = 0; n < reference.size(); ++n) {
+            reference[n] = over(fore_pixels[n], back_pixels[n]);
+        }
+        compare(render(mixer, {make_frame(mixer, back_pixels), make_frame(mixer, fore_pixels)}), reference, "normal");
+    }
+
+    for (auto& m : modes) {
+        auto fore                                   = make_frame(mixer, fore_pixels);
+        fore.transform().image_transform.blend_mode = m.mode;
+
+        picture reference(back_pixels.size());
+        for (std::size_t n = 0; n < reference.size(); ++n) {
+            const auto& b = back_pixels[n];
+            const auto& f = fore_pixels[n];
+
+            color blended;
+            for (int c = 0; c < 3; ++c) {
+                blended[c] = m.blend(b[c] / (b[3] + 0.0000001f), f[c] / (f[3] + 0.0000001f)) * f[3];
+            }
+            blended[3]   = f[3];
+            reference[n] = over(blended, b);
+        }
+        compare(render(mixer, {make_frame(mixer, back_pixels), fore}), reference, m.name);
+    }
+}
+
+void test_keyers()
+{
+    image_mixer mixer(1, common::bit_depth::bit8, core::color_space::bt709);
+
+    const auto back_pixels = random_picture(5, true);
+    const auto fill_pixels = random_picture(6, false);
+
+    // Linear: the fill is multiplied by the red of the key, which is grey here.
+    {
+        std::mt19937                       random(7);
+        std::uniform_int_distribution<int> byte(0, 255);
+
+        picture key_pixels(back_pixels.size());
+        for (auto& c : key_pixels) {
+            const auto k = static_cast<float>(byte(random)) / 255.0f;
+            c            = {k, k, k, 1.0f};
+        }
+
+        picture reference(back_pixels.size());
+        for (std::size_t n = 0; n < reference.size(); ++n) {
+            color keyed;
+            for (int c = 0; c < 4; ++c) {
+                keyed[c] = fill_pixels[n][c] * key_pixels[n][2];
+            }
+            reference[n] = over(keyed, back_pixels[n]);
+        }
+
+        auto masked = core::draw_frame::mask(make_frame(mixer, fill_pixels), make_frame(mixer, key_pixels));
+        compare(render(mixer, {make_frame(mixer, back_pixels), masked}), reference, "linear keyer");
+    }
+
+    // Additive: mixed frames are summed, as by a mix transition, and the sum goes over the layer below.
+    {
+        const auto other_pixels = random_picture(8, false);
+
+        auto from                                = make_frame(mixer, fill_pixels);
+        from.transform().image_transform.is_mix  = true;
+        from.transform().image_transform.opacity = 0.75;
+        auto to                                  = make_frame(mixer, other_pixels);
+        to.transform().image_transform.is_mix    = true;
+        to.transform().image_transform.opacity   = 0.25;
+
+        picture reference(back_pixels.size());
+        for (std::size_t n = 0; n < reference.size(); ++n) {
+            color sum;
+            for (int c = 0; c < 4; ++c) {
+                sum[c] = std::min(fill_pixels[n][c] * 0.75f + other_pixels[n][c] * 0.25f, 1.0f);
+            }
+            reference[n] = over(sum, back_pixels[n]);
+        }
+
+        auto mixed = core::draw_frame::over(from, to);
+        compare(render(mixer, {make_frame(mixer, back_pixels), mixed}), reference, "additive keyer");
+    }
+}
+
+}}}} // namespace caspar::accelerator::cpu
+
+int main()
+{
+    using namespace caspar::accelerator::cpu;
+
+    test_transform();
+    test_blend_modes();
+    test_keyers();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,785 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "color_conversion.h"
+
+#include "except.h"
+
+#include <tbb/parallel_for.h>
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse4.1.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+#if !defined(USE_SIMDE) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define CASPAR_COLOR_CONVERSION_AVX
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CASPAR_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CASPAR_TARGET(isa)
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace caspar { namespace common {
+
+namespace {
+
+// Maps full range RGB to limited range Y, Cb and Cr on a 16 bit scale, i.e. 8 bit levels times 256. The chroma
+// coefficients apply to the sum of a pixel pair.
+struct coefficients
+{
+    float ry, gy, by, oy;
+    float ru, gu, bu, ou;
+    float rv, gv, bv, ov;
+};
+
+coefficients make_coefficients(color_space space, double max)
+{
+    double kr = 0.2126;
+    double kb = 0.0722;
+    switch (space) {
+        case color_space::bt601:
+            kr = 0.299;
+            kb = 0.114;
+            break;
+        case color_space::bt709:
+            break;
+        case color_space::bt2020:
+            kr = 0.2627;
+            kb = 0.0593;
+            break;
+    }
+    const auto kg = 1.0 - kr - kb;
+    const auto ys = 219.0 * 256.0 / max;
+    const auto cs = 224.0 * 256.0 / max / 2.0;
+
+    coefficients k;
+    k.ry = static_cast<float>(kr * ys);
+    k.gy = static_cast<float>(kg * ys);
+    k.by = static_cast<float>(kb * ys);
+    k.oy = 16.0f * 256.0f;
+    k.ru = static_cast<float>(-kr / (2.0 * (1.0 - kb)) * cs);
+    k.gu = static_cast<float>(-kg / (2.0 * (1.0 - kb)) * cs);
+    k.bu = static_cast<float>(0.5 * cs);
+    k.ou = 128.0f * 256.0f;
+    k.rv = static_cast<float>(0.5 * cs);
+    k.gv = static_cast<float>(-kg / (2.0 * (1.0 - kr)) * cs);
+    k.bv = static_cast<float>(-kb / (2.0 * (1.0 - kr)) * cs);
+    k.ov = 128.0f * 256.0f;
+    return k;
+}
+
+// Converts a row of pixels, starting at x, to 16 bit scale Y, Cb, Cr and optionally alpha, and returns the number of
+// pixels done. The SIMD kernels stop at the last whole block and leave the rest to the scalar kernel.
+using row_kernel = int (*)(const std::uint8_t* src,
+                           int                 x,
+                           int                 width,
+                           const coefficients& k,
+                           std::uint16_t*      y,
+                           std::uint16_t*      cb,
+                           std::uint16_t*      cr,
+                           std::uint16_t*      a);
+
+std::uint16_t to_u16(float value)
+{
+    return static_cast<std::uint16_t>(std::min(65535.0f, std::max(0.0f, std::nearbyint(value))));
+}
+
+template <typename T>
+int convert_row_c(const std::uint8_t* src,
+                  int                 x,
+                  int                 width,
+                  const coefficients& k,
+                  std::uint16_t*      y,
+                  std::uint16_t*      cb,
+                  std::uint16_t*      cr,
+                  std::uint16_t*      a)
+{
+    const auto px          = reinterpret_cast<const T*>(src);
+    const auto alpha_scale = sizeof(T) == 1 ? 257 : 1;
+
+    for (; x < width; x += 2) {
+        const auto x1 = std::min(x + 1, width - 1);
+
+        const auto b0 = static_cast<float>(px[x * 4 + 0]);
+        const auto g0 = static_cast<float>(px[x * 4 + 1]);
+        const auto r0 = static_cast<float>(px[x * 4 + 2]);
+        const auto b1 = static_cast<float>(px[x1 * 4 + 0]);
+        const auto g1 = static_cast<float>(px[x1 * 4 + 1]);
+        const auto r1 = static_cast<float>(px[x1 * 4 + 2]);
+
+        y[x]     = to_u16(r0 * k.ry + g0 * k.gy + b0 * k.by + k.oy);
+        y[x + 1] = to_u16(r1 * k.ry + g1 * k.gy + b1 * k.by + k.oy);
+
+        const auto rs = r0 + r1;
+        const auto gs = g0 + g1;
+        const auto bs = b0 + b1;
+        cb[x / 2]     = to_u16(rs * k.ru + gs * k.gu + bs * k.bu + k.ou);
+        cr[x / 2]     = to_u16(rs * k.rv + gs * k.gv + bs * k.bv + k.ov);
+
+        if (a) {
+            a[x]     = static_cast<std::uint16_t>(px[x * 4 + 3] * alpha_scale);
+            a[x + 1] = static_cast<std::uint16_t>(px[x1 * 4 + 3] * alpha_scale);
+        }
+    }
+    return width;
+}
+
+int convert_row8_c(const std::uint8_t* src,
+                   int                 x,
+                   int                 width,
+                   const coefficients& k,
+                   std::uint16_t*      y,
+                   std::uint16_t*      cb,
+                   std::uint16_t*      cr,
+                   std::uint16_t*      a)
+{
+    return convert_row_c<std::uint8_t>(src, x, width, k, y, cb, cr, a);
+}
+
+int convert_row16_c(const std::uint8_t* src,
+                    int                 x,
+                    int                 width,
+                    const coefficients& k,
+                    std::uint16_t*      y,
+                    std::uint16_t*      cb,
+                    std::uint16_t*      cr,
+                    std::uint16_t*      a)
+{
+    return convert_row_c<std::uint16_t>(src, x, width, k, y, cb, cr, a);
+}
+
+// SSE4.1, 8 pixels per iteration.
+
+struct sse_coefficients
+{
+    __m128 ry, gy, by, oy;
+    __m128 ru, gu, bu, ou;
+    __m128 rv, gv, bv, ov;
+
+    explicit sse_coefficients(const coefficients& k)
+        : ry(_mm_set1_ps(k.ry))
+        , gy(_mm_set1_ps(k.gy))
+        , by(_mm_set1_ps(k.by))
+        , oy(_mm_set1_ps(k.oy))
+        , ru(_mm_set1_ps(k.ru))
+        , gu(_mm_set1_ps(k.gu))
+        , bu(_mm_set1_ps(k.bu))
+        , ou(_mm_set1_ps(k.ou))
+        , rv(_mm_set1_ps(k.rv))
+        , gv(_mm_set1_ps(k.gv))
+        , bv(_mm_set1_ps(k.bv))
+        , ov(_mm_set1_ps(k.ov))
+    {
+    }
+};
+
+inline __m128i dot_sse(__m128 r, __m128 g, __m128 b, __m128 kr, __m128 kg, __m128 kb, __m128 o)
+{
+    return _mm_cvtps_epi32(
+        _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r, kr), _mm_mul_ps(g, kg)), _mm_mul_ps(b, kb)), o));
+}
+
+// r, g and b hold 8 pixels in two halves.
+inline void store_sse(const sse_coefficients& k,
+                      const __m128            r[2],
+                      const __m128            g[2],
+                      const __m128            b[2],
+                      std::uint16_t*          y,
+                      std::uint16_t*          cb,
+                      std::uint16_t*          cr)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y),
+                     _mm_packus_epi32(dot_sse(r[0], g[0], b[0], k.ry, k.gy, k.by, k.oy),
+                                      dot_sse(r[1], g[1], b[1], k.ry, k.gy, k.by, k.oy)));
+
+    const auto rs = _mm_hadd_ps(r[0], r[1]);
+    const auto gs = _mm_hadd_ps(g[0], g[1]);
+    const auto bs = _mm_hadd_ps(b[0], b[1]);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(cb),
+                     _mm_packus_epi32(dot_sse(rs, gs, bs, k.ru, k.gu, k.bu, k.ou), _mm_setzero_si128()));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(cr),
+                     _mm_packus_epi32(dot_sse(rs, gs, bs, k.rv, k.gv, k.bv, k.ov), _mm_setzero_si128()));
+}
+
+int convert_row8_sse(const std::uint8_t* src,
+                     int                 x,
+                     int                 width,
+                     const coefficients& coeffs,
+                     std::uint16_t*      y,
+                     std::uint16_t*      cb,
+                     std::uint16_t*      cr,
+                     std::uint16_t*      a)
+{
+    const sse_coefficients k(coeffs);
+    const auto             mask = _mm_set1_epi32(0xFF);
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i px[2];
+        __m128  r[2];
+        __m128  g[2];
+        __m128  b[2];
+        for (int n = 0; n < 2; ++n) {
+            px[n] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x + n * 4) * 4));
+            b[n]  = _mm_cvtepi32_ps(_mm_and_si128(px[n], mask));
+            g[n]  = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px[n], 8), mask));
+            r[n]  = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px[n], 16), mask));
+        }
+        store_sse(k, r, g, b, y + x, cb + x / 2, cr + x / 2);
+
+        if (a) {
+            const auto alpha = _mm_packus_epi32(_mm_srli_epi32(px[0], 24), _mm_srli_epi32(px[1], 24));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(a + x), _mm_mullo_epi16(alpha, _mm_set1_epi16(257)));
+        }
+    }
+    return x;
+}
+
+int convert_row16_sse(const std::uint8_t* src,
+                      int                 x,
+                      int                 width,
+                      const coefficients& coeffs,
+                      std::uint16_t*      y,
+                      std::uint16_t*      cb,
+                      std::uint16_t*      cr,
+                      std::uint16_t*      a)
+{
+    const sse_coefficients k(coeffs);
+    const auto             mask = _mm_set1_epi32(0xFFFF);
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i ra[2];
+        __m128  r[2];
+        __m128  g[2];
+        __m128  b[2];
+        for (int n = 0; n < 2; ++n) {
+            // Every pixel is a BG and an RA word, gather the four BG and the four RA words.
+            const auto p0 = _mm_shuffle_epi32(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x + n * 4) * 8)), _MM_SHUFFLE(3, 1, 2, 0));
+            const auto p1 = _mm_shuffle_epi32(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (x + n * 4) * 8 + 16)), _MM_SHUFFLE(3, 1, 2, 0));
+            const auto bg = _mm_unpacklo_epi64(p0, p1);
+            ra[n]         = _mm_unpackhi_epi64(p0, p1);
+            b[n]          = _mm_cvtepi32_ps(_mm_and_si128(bg, mask));
+            g[n]          = _mm_cvtepi32_ps(_mm_srli_epi32(bg, 16));
+            r[n]          = _mm_cvtepi32_ps(_mm_and_si128(ra[n], mask));
+        }
+        store_sse(k, r, g, b, y + x, cb + x / 2, cr + x / 2);
+
+        if (a) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(a + x),
+                             _mm_packus_epi32(_mm_srli_epi32(ra[0], 16), _mm_srli_epi32(ra[1], 16)));
+        }
+    }
+    return x;
+}
+
+#ifdef CASPAR_COLOR_CONVERSION_AVX
+
+// AVX2, 16 pixels per iteration.
+
+CASPAR_TARGET("avx2")
+inline __m256i dot_avx2(__m256 r, __m256 g, __m256 b, float kr, float kg, float kb, float o)
+{
+    return _mm256_cvtps_epi32(_mm256_add_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(kr)), _mm256_mul_ps(g, _mm256_set1_ps(kg))),
+                      _mm256_mul_ps(b, _mm256_set1_ps(kb))),
+        _mm256_set1_ps(o)));
+}
+
+CASPAR_TARGET("avx2")
+inline __m128i pack_avx2(__m256i values)
+{
+    return _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+}
+
+// r, g and b hold 16 pixels in two halves.
+CASPAR_TARGET("avx2")
+inline void store_avx2(const coefficients& k,
+                       const __m256        r[2],
+                       const __m256        g[2],
+                       const __m256        b[2],
+                       std::uint16_t*      y,
+                       std::uint16_t*      cb,
+                       std::uint16_t*      cr)
+{
+    for (int n = 0; n < 2; ++n) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + n * 8),
+                         pack_avx2(dot_avx2(r[n], g[n], b[n], k.ry, k.gy, k.by, k.oy)));
+    }
+
+    // hadd works within 128 bit lanes, restore the pair order.
+    const auto order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    const auto rs    = _mm256_permutevar8x32_ps(_mm256_hadd_ps(r[0], r[1]), order);
+    const auto gs    = _mm256_permutevar8x32_ps(_mm256_hadd_ps(g[0], g[1]), order);
+    const auto bs    = _mm256_permutevar8x32_ps(_mm256_hadd_ps(b[0], b[1]), order);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cb), pack_avx2(dot_avx2(rs, gs, bs, k.ru, k.gu, k.bu, k.ou)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cr), pack_avx2(dot_avx2(rs, gs, bs, k.rv, k.gv, k.bv, k.ov)));
+}
+
+CASPAR_TARGET("avx2")
+int convert_row8_avx2(const std::uint8_t* src,
+                      int                 x,
+                      int                 width,
+                      const coefficients& k,
+                      std::uint16_t*      y,
+                      std::uint16_t*      cb,
+                      std::uint16_t*      cr,
+                      std::uint16_t*      a)
+{
+    const auto mask = _mm256_set1_epi32(0xFF);
+
+    for (; x + 16 <= width; x += 16) {
+        __m256i px[2];
+        __m256  r[2];
+        __m256  g[2];
+        __m256  b[2];
+        for (int n = 0; n < 2; ++n) {
+            px[n] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + (x + n * 8) * 4));
+            b[n]  = _mm256_cvtepi32_ps(_mm256_and_si256(px[n], mask));
+            g[n]  = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px[n], 8), mask));
+            r[n]  = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px[n], 16), mask));
+        }
+        store_avx2(k, r, g, b, y + x, cb + x / 2, cr + x / 2);
+
+        if (a) {
+            for (int n = 0; n < 2; ++n) {
+                const auto alpha = _mm256_mullo_epi32(_mm256_srli_epi32(px[n], 24), _mm256_set1_epi32(257));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(a + x + n * 8), pack_avx2(alpha));
+            }
+        }
+    }
+    return x;
+}
+
+CASPAR_TARGET("avx2")
+int convert_row16_avx2(const std::uint8_t* src,
+                       int                 x,
+                       int                 width,
+                       const coefficients& k,
+                       std::uint16_t*      y,
+                       std::uint16_t*      cb,
+                       std::uint16_t*      cr,
+                       std::uint16_t*      a)
+{
+    const auto mask  = _mm256_set1_epi32(0xFFFF);
+    const auto split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    for (; x + 16 <= width; x += 16) {
+        __m256i ra[2];
+        __m256  r[2];
+        __m256  g[2];
+        __m256  b[2];
+        for (int n = 0; n < 2; ++n) {
+            // Every pixel is a BG and an RA word, gather the eight BG and the eight RA words.
+            const auto p0 = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + (x + n * 8) * 8)), split);
+            const auto p1 = _mm256_permutevar8x32_epi32(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + (x + n * 8) * 8 + 32)), split);
+            const auto bg = _mm256_permute2x128_si256(p0, p1, 0x20);
+            ra[n]         = _mm256_permute2x128_si256(p0, p1, 0x31);
+            b[n]          = _mm256_cvtepi32_ps(_mm256_and_si256(bg, mask));
+            g[n]          = _mm256_cvtepi32_ps(_mm256_srli_epi32(bg, 16));
+            r[n]          = _mm256_cvtepi32_ps(_mm256_and_si256(ra[n], mask));
+        }
+        store_avx2(k, r, g, b, y + x, cb + x / 2, cr + x / 2);
+
+        if (a) {
+            for (int n = 0; n < 2; ++n) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(a + x + n * 8),
+                                 pack_avx2(_mm256_srli_epi32(ra[n], 16)));
+            }
+        }
+    }
+    return x;
+}
+
+// AVX-512, 16 pixels per iteration.
+
+CASPAR_TARGET("avx512f")
+inline __m512i dot_avx512(__m512 r, __m512 g, __m512 b, float kr, float kg, float kb, float o)
+{
+    return _mm512_cvtps_epi32(_mm512_add_ps(
+        _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(r, _mm512_set1_ps(kr)), _mm512_mul_ps(g, _mm512_set1_ps(kg))),
+                      _mm512_mul_ps(b, _mm512_set1_ps(kb))),
+        _mm512_set1_ps(o)));
+}
+
+CASPAR_TARGET("avx512f")
+inline __m256i pack_avx512(__m512i values)
+{
+    return _mm512_cvtusepi32_epi16(_mm512_max_epi32(values, _mm512_setzero_si512()));
+}
+
+CASPAR_TARGET("avx512f")
+inline void store_avx512(const coefficients& k,
+                         __m512              r,
+                         __m512              g,
+                         __m512              b,
+                         std::uint16_t*      y,
+                         std::uint16_t*      cb,
+                         std::uint16_t*      cr)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y), pack_avx512(dot_avx512(r, g, b, k.ry, k.gy, k.by, k.oy)));
+
+    // The pair sums end up in the lower half.
+    const auto even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 0, 2, 4, 6, 8, 10, 12, 14);
+    const auto odd  = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 1, 3, 5, 7, 9, 11, 13, 15);
+    const auto rs   = _mm512_add_ps(_mm512_permutexvar_ps(even, r), _mm512_permutexvar_ps(odd, r));
+    const auto gs   = _mm512_add_ps(_mm512_permutexvar_ps(even, g), _mm512_permutexvar_ps(odd, g));
+    const auto bs   = _mm512_add_ps(_mm512_permutexvar_ps(even, b), _mm512_permutexvar_ps(odd, b));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cb),
+                     _mm256_castsi256_si128(pack_avx512(dot_avx512(rs, gs, bs, k.ru, k.gu, k.bu, k.ou))));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cr),
+                     _mm256_castsi256_si128(pack_avx512(dot_avx512(rs, gs, bs, k.rv, k.gv, k.bv, k.ov))));
+}
+
+CASPAR_TARGET("avx512f")
+int convert_row8_avx512(const std::uint8_t* src,
+                        int                 x,
+                        int                 width,
+                        const coefficients& k,
+                        std::uint16_t*      y,
+                        std::uint16_t*      cb,
+                        std::uint16_t*      cr,
+                        std::uint16_t*      a)
+{
+    const auto mask = _mm512_set1_epi32(0xFF);
+
+    for (; x + 16 <= width; x += 16) {
+        const auto px = _mm512_loadu_si512(src + x * 4);
+        const auto b  = _mm512_cvtepi32_ps(_mm512_and_si512(px, mask));
+        const auto g  = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(px, 8), mask));
+        const auto r  = _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(px, 16), mask));
+        store_avx512(k, r, g, b, y + x, cb + x / 2, cr + x / 2);
+
+        if (a) {
+            const auto alpha = _mm512_mullo_epi32(_mm512_srli_epi32(px, 24), _mm512_set1_epi32(257));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(a + x), pack_avx512(alpha));
+        }
+    }
+    return x;
+}
+
+CASPAR_TARGET("avx512f")
+int convert_row16_avx512(const std::uint8_t* src,
+                         int                 x,
+                         int                 width,
+                         const coefficients& k,
+                         std::uint16_t*      y,
+                         std::uint16_t*      cb,
+                         std::uint16_t*      cr,
+                         std::uint16_t*      a)
+{
+    const auto mask = _mm512_set1_epi32(0xFFFF);
+    const auto even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const auto odd  = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+
+    for (; x + 16 <= width; x += 16) {
+        // Every pixel is a BG and an RA word, gather the sixteen BG and the sixteen RA words.
+        const auto p0 = _mm512_loadu_si512(src + x * 8);
+        const auto p1 = _mm512_loadu_si512(src + x * 8 + 64);
+        const auto bg = _mm512_permutex2var_epi32(p0, even, p1);
+        const auto ra = _mm512_permutex2var_epi32(p0, odd, p1);
+        const auto b  = _mm512_cvtepi32_ps(_mm512_and_si512(bg, mask));
+        const auto g  = _mm512_cvtepi32_ps(_mm512_srli_epi32(bg, 16));
+        const auto r  = _mm512_cvtepi32_ps(_mm512_and_si512(ra, mask));
+        store_avx512(k, r, g, b, y + x, cb + x / 2, cr + x / 2);
+
+        if (a) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(a + x), pack_avx512(_mm512_srli_epi32(ra, 16)));
+        }
+    }
+    return x;
+}
+
+#endif
+
+struct kernels
+{
+    const char* isa   = "sse4.1";
+    row_kernel  row8  = convert_row8_sse;
+    row_kernel  row16 = convert_row16_sse;
+
+    kernels()
+    {
+#ifdef CASPAR_COLOR_CONVERSION_AVX
+        if (supports_avx512()) {
+            *this = kernels(color_conversion_kernel::avx512);
+        } else if (supports_avx2()) {
+            *this = kernels(color_conversion_kernel::avx2);
+        }
+#endif
+    }
+
+    explicit kernels(color_conversion_kernel kernel)
+    {
+        switch (kernel) {
+            case color_conversion_kernel::scalar:
+                isa   = "scalar";
+                row8  = convert_row8_c;
+                row16 = convert_row16_c;
+                break;
+#ifdef CASPAR_COLOR_CONVERSION_AVX
+            case color_conversion_kernel::avx2:
+                isa   = "avx2";
+                row8  = convert_row8_avx2;
+                row16 = convert_row16_avx2;
+                break;
+            case color_conversion_kernel::avx512:
+                isa   = "avx512";
+                row8  = convert_row8_avx512;
+                row16 = convert_row16_avx512;
+                break;
+#endif
+            default:
+                break;
+        }
+    }
+
+    static bool supported(color_conversion_kernel kernel)
+    {
+        switch (kernel) {
+            case color_conversion_kernel::automatic:
+            case color_conversion_kernel::scalar:
+            case color_conversion_kernel::sse41:
+                return true;
+#ifdef CASPAR_COLOR_CONVERSION_AVX
+            case color_conversion_kernel::avx2:
+                return supports_avx2();
+            case color_conversion_kernel::avx512:
+                return supports_avx512();
+#endif
+            default:
+                return false;
+        }
+    }
+
+#ifdef CASPAR_COLOR_CONVERSION_AVX
+#ifdef _MSC_VER
+    static bool os_saves(unsigned long long mask)
+    {
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & mask) == mask;
+    }
+
+    static int extended_features()
+    {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return 0;
+        }
+        __cpuidex(info, 7, 0);
+        return info[1];
+    }
+
+    static bool supports_avx2() { return os_saves(0x06) && (extended_features() & (1 << 5)) != 0; }
+    static bool supports_avx512() { return os_saves(0xE6) && (extended_features() & (1 << 16)) != 0; }
+#else
+    static bool supports_avx2() { return __builtin_cpu_supports("avx2"); }
+    static bool supports_avx512() { return __builtin_cpu_supports("avx512f"); }
+#endif
+#endif
+};
+
+const kernels& get_kernels()
+{
+    static const kernels instance;
+    return instance;
+}
+
+// Packs a row of 16 bit scale samples, padded to the v210 block size, into the destination format.
+void pack_row(yuv_format           format,
+              int                  width,
+              const std::uint16_t* y,
+              const std::uint16_t* cb,
+              const std::uint16_t* cr,
+              const std::uint16_t* a,
+              std::uint8_t* const  dst[4])
+{
+    const auto chroma_width = (width + 1) / 2;
+
+    switch (format) {
+        case yuv_format::yuv422p8: {
+            for (int x = 0; x < width; ++x) {
+                dst[0][x] = static_cast<std::uint8_t>((y[x] + 128) >> 8);
+            }
+            for (int x = 0; x < chroma_width; ++x) {
+                dst[1][x] = static_cast<std::uint8_t>((cb[x] + 128) >> 8);
+                dst[2][x] = static_cast<std::uint8_t>((cr[x] + 128) >> 8);
+            }
+            if (a) {
+                for (int x = 0; x < width; ++x) {
+                    dst[3][x] = static_cast<std::uint8_t>(a[x] >> 8);
+                }
+            }
+            break;
+        }
+        case yuv_format::yuv422p10: {
+            const auto dst_y  = reinterpret_cast<std::uint16_t*>(dst[0]);
+            const auto dst_cb = reinterpret_cast<std::uint16_t*>(dst[1]);
+            const auto dst_cr = reinterpret_cast<std::uint16_t*>(dst[2]);
+            for (int x = 0; x < width; ++x) {
+                dst_y[x] = static_cast<std::uint16_t>((y[x] + 32) >> 6);
+            }
+            for (int x = 0; x < chroma_width; ++x) {
+                dst_cb[x] = static_cast<std::uint16_t>((cb[x] + 32) >> 6);
+                dst_cr[x] = static_cast<std::uint16_t>((cr[x] + 32) >> 6);
+            }
+            if (a) {
+                const auto dst_a = reinterpret_cast<std::uint16_t*>(dst[3]);
+                for (int x = 0; x < width; ++x) {
+                    dst_a[x] = static_cast<std::uint16_t>(a[x] >> 6);
+                }
+            }
+            break;
+        }
+        case yuv_format::p216: {
+            const auto dst_y = reinterpret_cast<std::uint16_t*>(dst[0]);
+            const auto dst_c = reinterpret_cast<std::uint16_t*>(dst[1]);
+            std::copy(y, y + width, dst_y);
+            for (int x = 0; x < chroma_width; ++x) {
+                dst_c[x * 2 + 0] = cb[x];
+                dst_c[x * 2 + 1] = cr[x];
+            }
+            break;
+        }
+        case yuv_format::uyvy: {
+            for (int x = 0; x < chroma_width; ++x) {
+                dst[0][x * 4 + 0] = static_cast<std::uint8_t>((cb[x] + 128) >> 8);
+                dst[0][x * 4 + 1] = static_cast<std::uint8_t>((y[x * 2] + 128) >> 8);
+                dst[0][x * 4 + 2] = static_cast<std::uint8_t>((cr[x] + 128) >> 8);
+                dst[0][x * 4 + 3] = static_cast<std::uint8_t>((y[x * 2 + 1] + 128) >> 8);
+            }
+            break;
+        }
+        case yuv_format::v210: {
+            auto to10 = [](std::uint16_t value) { return static_cast<std::uint32_t>((value + 32) >> 6); };
+
+            auto dst_w = reinterpret_cast<std::uint32_t*>(dst[0]);
+            for (int x = 0; x < (width + 47) / 48 * 48; x += 6, y += 6, cb += 3, cr += 3, dst_w += 4) {
+                dst_w[0] = to10(cb[0]) | to10(y[0]) << 10 | to10(cr[0]) << 20;
+                dst_w[1] = to10(y[1]) | to10(cb[1]) << 10 | to10(y[2]) << 20;
+                dst_w[2] = to10(cr[1]) | to10(y[3]) << 10 | to10(cb[2]) << 20;
+                dst_w[3] = to10(y[4]) | to10(cr[2]) << 10 | to10(y[5]) << 20;
+            }
+            break;
+        }
+    }
+}
+
+} // namespace
+
+void bgra_to_yuv422(const std::uint8_t*     src,
+                    int                     src_linesize,
+                    bit_depth               src_depth,
+                    int                     width,
+                    int                     height,
+                    color_space             space,
+                    yuv_format              format,
+                    std::uint8_t* const     dst[4],
+                    const int               dst_linesize[4],
+                    color_conversion_kernel kernel)
+{
+    if (!kernels::supported(kernel)) {
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Color conversion kernel not supported by the cpu."));
+    }
+
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    const auto selected = kernel == color_conversion_kernel::automatic ? get_kernels() : kernels(kernel);
+
+    const auto is_16bit = src_depth != bit_depth::bit8;
+    const auto k        = make_coefficients(space, is_16bit ? 65535.0 : 255.0);
+    const auto simd     = is_16bit ? selected.row16 : selected.row8;
+    const auto scalar   = is_16bit ? convert_row16_c : convert_row8_c;
+    const auto alpha    = dst[3] != nullptr && (format == yuv_format::yuv422p8 || format == yuv_format::yuv422p10);
+
+    // Rows are padded with their last samples to whole v210 blocks of 48 pixels.
+    const auto padded_width = (width + 47) / 48 * 48;
+    const auto chroma_width = (width + 1) / 2;
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height, 16), [&](const tbb::blocked_range<int>& r) {
+        std::vector<std::uint16_t> y(padded_width);
+        std::vector<std::uint16_t> cb(padded_width / 2);
+        std::vector<std::uint16_t> cr(padded_width / 2);
+        std::vector<std::uint16_t> a(alpha ? padded_width : 0);
+
+        for (auto n = r.begin(); n != r.end(); ++n) {
+            const auto row = src + static_cast<std::ptrdiff_t>(n) * src_linesize;
+
+            const auto x = simd(row, 0, width, k, y.data(), cb.data(), cr.data(), alpha ? a.data() : nullptr);
+            scalar(row, x, width, k, y.data(), cb.data(), cr.data(), alpha ? a.data() : nullptr);
+
+            std::fill(y.begin() + width, y.end(), y[width - 1]);
+            std::fill(cb.begin() + chroma_width, cb.end(), cb[chroma_width - 1]);
+            std::fill(cr.begin() + chroma_width, cr.end(), cr[chroma_width - 1]);
+
+            std::uint8_t* rows[4] = {};
+            for (int p = 0; p < 4; ++p) {
+                if (dst[p]) {
+                    rows[p] = dst[p] + static_cast<std::ptrdiff_t>(n) * dst_linesize[p];
+                }
+            }
+            pack_row(format, width, y.data(), cb.data(), cr.data(), alpha ? a.data() : nullptr, rows);
+        }
+    });
+}
+
+int yuv422_linesize(yuv_format format, int width, int plane)
+{
+    const auto chroma_width = (width + 1) / 2;
+
+    switch (format) {
+        case yuv_format::yuv422p8:
+            return plane == 0 || plane == 3 ? width : plane < 3 ? chroma_width : 0;
+        case yuv_format::yuv422p10:
+            return plane == 0 || plane == 3 ? width * 2 : plane < 3 ? chroma_width * 2 : 0;
+        case yuv_format::p216:
+            return plane == 0 ? width * 2 : plane == 1 ? chroma_width * 4 : 0;
+        case yuv_format::uyvy:
+            return plane == 0 ? chroma_width * 4 : 0;
+        case yuv_format::v210:
+            return plane == 0 ? (width + 47) / 48 * 128 : 0;
+    }
+    return 0;
+}
+
+const char* color_conversion_isa() { return get_kernels().isa; }
+
+bool color_conversion_supported(color_conversion_kernel kernel) { return kernels::supported(kernel); }
+
+}} // namespace caspar::common
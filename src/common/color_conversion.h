@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "bit_depth.h"
+
+#include <cstdint>
+
+namespace caspar { namespace common {
+
+enum class color_space
+{
+    bt601,
+    bt709,
+    bt2020,
+};
+
+enum class yuv_format
+{
+    yuv422p8,  // Y, Cb, Cr planes of bytes.
+    yuv422p10, // Y, Cb, Cr planes of 16 bit words holding 10 bit samples.
+    p216,      // Y plane and interleaved CbCr plane of 16 bit words.
+    uyvy,      // Cb Y Cr Y bytes.
+    v210,      // Three 10 bit samples in every 32 bit word, rows padded to 48 pixels.
+};
+
+// Row conversion kernels by instruction set. automatic picks the widest one the cpu supports, the others are there to
+// compare the kernels against each other.
+enum class color_conversion_kernel
+{
+    automatic,
+    scalar,
+    sse41,
+    avx2,
+    avx512,
+};
+
+// Converts full range BGRA pixels, 8 bit or 16 bit per channel, to limited range YUV 4:2:2. Chroma is the average of
+// each horizontal pixel pair. dst holds the planes of the format, and for the planar formats an optional fourth plane
+// receives the alpha channel at the depth of the luma plane. Rows are converted in bands spread over the TBB worker
+// threads, each by the widest kernel the cpu supports (AVX-512, AVX2 or SSE4.1) unless another kernel is given. Throws
+// invalid_argument for a kernel the cpu does not support.
+void bgra_to_yuv422(const std::uint8_t*     src,
+                    int                     src_linesize,
+                    bit_depth               src_depth,
+                    int                     width,
+                    int                     height,
+                    color_space             space,
+                    yuv_format              format,
+                    std::uint8_t* const     dst[4],
+                    const int               dst_linesize[4],
+                    color_conversion_kernel kernel = color_conversion_kernel::automatic);
+
+// Minimum linesize in bytes of a plane of the format, 0 for planes it does not have.
+int yuv422_linesize(yuv_format format, int width, int plane);
+
+// Name of the instruction set used by bgra_to_yuv422.
+const char* color_conversion_isa();
+
+// Whether the cpu supports kernel.
+bool color_conversion_supported(color_conversion_kernel kernel);
+
+}} // namespace caspar::common
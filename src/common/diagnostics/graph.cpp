@@ -102,6 +102,12 @@ struct graph::impl
             sink->auto_reset();
     }
 
+    void remove(const std::string& name)
+    {
+        for (auto& sink : sinks_)
+            sink->remove(name);
+    }
+
   private:
     impl(impl&);
     impl& operator=(impl&);
@@ -117,6 +123,7 @@ void graph::set_value(const std::string& name, double value) { impl_->set_value(
 void graph::set_color(const std::string& name, int color) { impl_->set_color(name, color); }
 void graph::set_tag(tag_severity severity, const std::string& name) { impl_->set_tag(severity, name); }
 void graph::auto_reset() { impl_->auto_reset(); }
+void graph::remove(const std::string& name) { impl_->remove(name); }
 
 void register_graph(const spl::shared_ptr<graph>& graph) { graph->impl_->activate(); }
 
@@ -51,6 +51,9 @@ class graph
     void set_tag(tag_severity severity, const std::string& name);
     void auto_reset();
 
+    // Stops showing the line of name, for lines of something that has gone away. Setting it again brings it back.
+    void remove(const std::string& name);
+
   private:
     struct impl;
     std::shared_ptr<impl> impl_;
@@ -77,6 +80,7 @@ class graph_sink
     virtual void set_color(const std::string& name, int color)           = 0;
     virtual void set_tag(tag_severity severity, const std::string& name) = 0;
     virtual void auto_reset()                                            = 0;
+    virtual void remove(const std::string& name)                         = 0;
 };
 
 using sink_factory_t = std::function<spl::shared_ptr<graph_sink>()>;
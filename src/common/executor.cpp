@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "executor.h"
+
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <array>
+#include <thread>
+
+namespace caspar {
+
+namespace {
+
+struct task_pool
+{
+    // Strands may wait on each other (e.g. a stage invoking another stage), so the pool never drops below a few
+    // workers even on machines with few cores.
+    const int concurrency = std::max(static_cast<int>(std::thread::hardware_concurrency()), 8);
+
+    tbb::global_control parallelism{tbb::global_control::max_allowed_parallelism,
+                                    static_cast<std::size_t>(concurrency) + 1};
+
+    // Arenas share TBB's global worker threads, which serve the highest priority arena with pending work first.
+    std::array<tbb::task_arena, 3> arenas{
+        tbb::task_arena(concurrency, 0, tbb::task_arena::priority::low),
+        tbb::task_arena(concurrency, 0, tbb::task_arena::priority::normal),
+        tbb::task_arena(concurrency, 0, tbb::task_arena::priority::high),
+    };
+
+    static task_pool& instance()
+    {
+        static task_pool pool;
+        return pool;
+    }
+};
+
+} // namespace
+
+void enqueue_task(task_priority priority, std::function<void()> func)
+{
+    task_pool::instance().arenas.at(static_cast<std::size_t>(priority)).enqueue(std::move(func));
+}
+
+} // namespace caspar
@@ -24,27 +24,57 @@
 #include "except.h"
 #include "log.h"
 #include "os/thread.h"
+#include "task.h"
 
 #include <tbb/concurrent_queue.h>
+#include <tbb/task_arena.h>
 
 #include <atomic>
 #include <functional>
 #include <future>
+#include <memory>
+#include <thread>
 
 namespace caspar {
 
+enum class task_priority
+{
+    low = 0,
+    normal,
+    high,
+};
+
+// Runs func on the shared worker pool. The pool is TBB's work-stealing scheduler with one arena per priority, so idle
+// workers pick up high priority work (channel ticks) before normal (media decoding) and low (housekeeping) work.
+void enqueue_task(task_priority priority, std::function<void()> func);
+
+// Runs tasks one at a time in the order they were queued. An executor either owns a dedicated thread, which is needed
+// for work with thread affinity (OpenGL, COM, SDK callbacks) or that blocks for long periods, or is a strand on the
+// shared worker pool, which keeps the same serialization without a thread of its own.
 class executor final
 {
     executor(const executor&);
     executor& operator=(const executor&);
 
-    using task_t  = std::function<void()>;
-    using queue_t = tbb::concurrent_bounded_queue<task_t>;
+    using queue_t = tbb::concurrent_bounded_queue<task>;
 
-    std::wstring      name_;
-    std::atomic<bool> is_running_{true};
-    queue_t           queue_;
-    std::thread       thread_;
+    struct state
+    {
+        queue_t            queue;
+        std::atomic<bool>  scheduled{false};
+        std::promise<void> stopped;
+    };
+
+    // Maximum number of tasks a strand runs before yielding its worker to other strands of the same priority.
+    static constexpr int strand_batch_size = 64;
+
+    std::wstring           name_;
+    std::atomic<bool>      is_running_{true};
+    bool                   pooled_   = false;
+    task_priority          priority_ = task_priority::normal;
+    std::shared_ptr<state> state_    = std::make_shared<state>();
+    std::future<void>      stopped_  = state_->stopped.get_future();
+    std::thread            thread_;
 
   public:
     executor(const std::wstring& name)
@@ -53,6 +83,13 @@ class executor final
     {
     }
 
+    executor(const std::wstring& name, task_priority priority)
+        : name_(name)
+        , pooled_(true)
+        , priority_(priority)
+    {
+    }
+
     ~executor() { stop_and_wait(); }
 
     template <typename Func>
@@ -64,11 +101,23 @@ class executor final
 
         using result_type = decltype(func());
 
-        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Func>(func));
+        std::promise<result_type> promise;
+        auto                      future = promise.get_future();
 
-        queue_.push([=]() mutable { (*task)(); });
+        post([promise = std::move(promise), func = std::forward<Func>(func)]() mutable {
+            try {
+                if constexpr (std::is_void<result_type>::value) {
+                    func();
+                    promise.set_value();
+                } else {
+                    promise.set_value(func());
+                }
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        });
 
-        return task->get_future();
+        return future;
     }
 
     template <typename Func>
@@ -92,11 +141,18 @@ class executor final
         begin_invoke(std::forward<Func>(func)).wait();
     }
 
-    void set_capacity(queue_t::size_type capacity) { queue_.set_capacity(capacity); }
+    void set_capacity(queue_t::size_type capacity) { state_->queue.set_capacity(capacity); }
 
-    queue_t::size_type capacity() const { return queue_.capacity(); }
+    queue_t::size_type capacity() const { return state_->queue.capacity(); }
 
-    void clear() { queue_.clear(); }
+    // Drops the queued tasks. The queue's own clear() is not safe while the thread is blocked in pop(), and would leave
+    // it waiting for a task that is never handed to it, so the tasks are popped instead.
+    void clear()
+    {
+        task func;
+        while (state_->queue.try_pop(func)) {
+        }
+    }
 
     void stop()
     {
@@ -104,15 +160,19 @@ class executor final
             return;
         }
         is_running_ = false;
-        queue_.push(nullptr);
+        post(nullptr);
     }
 
     void stop_and_wait()
     {
         stop();
 
-        if (thread_.joinable())
+        if (pooled_) {
+            if (!is_current())
+                stopped_.wait();
+        } else if (thread_.joinable()) {
             thread_.join();
+        }
     }
 
     void wait()
@@ -120,30 +180,93 @@ class executor final
         invoke([] {});
     }
 
-    queue_t::size_type size() const { return queue_.size(); }
+    queue_t::size_type size() const { return state_->queue.size(); }
 
     bool is_running() const { return is_running_; }
 
-    bool is_current() const { return std::this_thread::get_id() == thread_.get_id(); }
+    bool is_current() const { return current() == state_.get(); }
 
     const std::wstring& name() const { return name_; }
 
   private:
+    static const state*& current()
+    {
+        static thread_local const state* current = nullptr;
+        return current;
+    }
+
+    void post(task&& func)
+    {
+        state_->queue.push(std::move(func));
+
+        if (pooled_ && !state_->scheduled.exchange(true)) {
+            schedule(state_, priority_);
+        }
+    }
+
+    static void schedule(const std::shared_ptr<state>& state, task_priority priority)
+    {
+        enqueue_task(priority, [state, priority] { drain(state, priority); });
+    }
+
+    static void drain(const std::shared_ptr<state>& state, task_priority priority)
+    {
+        // Restored rather than cleared, in case a strand is ever drained from within a task of another.
+        struct scoped_current
+        {
+            const executor::state* prev = current();
+
+            explicit scoped_current(const executor::state* state) { current() = state; }
+            ~scoped_current() { current() = prev; }
+        } scope(state.get());
+
+        task func;
+        for (auto n = 0; n < strand_batch_size; ++n) {
+            if (!state->queue.try_pop(func)) {
+                state->scheduled = false;
+
+                // A task may have been queued after the pop failed but before the flag was cleared.
+                if (state->queue.empty() || state->scheduled.exchange(true)) {
+                    return;
+                }
+                continue;
+            }
+
+            if (!func) {
+                state->stopped.set_value();
+                return;
+            }
+
+            // Isolated, so that a worker waiting on the parallel work of a task only helps with that work, instead of
+            // draining another strand, which could then block on this one.
+            try {
+                tbb::this_task_arena::isolate([&] { func(); });
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+
+        // Yield to other strands, the remaining tasks run when the pool comes back to this one.
+        schedule(state, priority);
+    }
+
     void run()
     {
         set_thread_name(name_);
 
-        task_t task;
+        current() = state_.get();
+
+        task func;
 
         while (is_running_) {
             try {
-                queue_.pop(task);
+                state_->queue.pop(func);
                 do {
-                    if (!task) {
+                    if (!func) {
                         return;
                     }
-                    task();
-                } while (queue_.try_pop(task));
+                    func();
+                } while (state_->queue.try_pop(func));
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
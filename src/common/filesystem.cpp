@@ -22,6 +22,7 @@
 
 #include "./os/filesystem.h"
 #include "filesystem.h"
+#include "media_index.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -63,8 +64,22 @@ find_file_within_dir_or_absolute(const std::wstring&
                                  const std::wstring&                                        filename,
                                  const std::function<bool(const boost::filesystem::path&)>& is_valid_file)
 {
+    auto file_path = boost::filesystem::path(filename);
+
+    // Look relative names up in the index of the folder first. When it has no match, as when it has not caught up with
+    // a change yet or the name is relative to the working directory, the paths are probed as before
+    if (!file_path.is_absolute() && std::find(file_path.begin(), file_path.end(), "..") == file_path.end()) {
+        auto index = find_media_index(parent_dir);
+        if (index && index->ready()) {
+            for (auto& candidate : index->find(filename)) {
+                if (is_valid_file(candidate)) {
+                    return candidate;
+                }
+            }
+        }
+    }
+
     // Try it assuming an absolute path was given
-    auto file_path       = boost::filesystem::path(filename);
     auto file_path_match = probe_path(file_path, is_valid_file);
     if (file_path_match) {
         return file_path_match;
@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "media_index.h"
+
+#include "executor.h"
+#include "log.h"
+#include "os/directory_watcher.h"
+#include "timer.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/range/algorithm_ext/erase.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+namespace caspar {
+
+namespace {
+
+const std::locale& system_locale()
+{
+    static const std::locale loc(""); // Use system locale
+    return loc;
+}
+
+std::wstring fold(std::wstring name)
+{
+    boost::replace_all(name, L"\\", L"/");
+    boost::to_upper(name, system_locale());
+    return name;
+}
+
+boost::filesystem::path normalize(const boost::filesystem::path& folder)
+{
+    auto str = folder.generic_wstring();
+    while (str.size() > 1 && str.back() == L'/') {
+        str.pop_back();
+    }
+    return boost::filesystem::path(str).lexically_normal();
+}
+
+std::mutex                                registry_mutex;
+std::vector<std::shared_ptr<media_index>> registry;
+
+} // namespace
+
+struct media_index::impl
+{
+    using entry = media_index::entry;
+
+    const boost::filesystem::path root_;
+
+    mutable std::mutex                                                     mutex_;
+    std::map<boost::filesystem::path, entry>                               files_;
+    std::unordered_map<std::wstring, std::vector<boost::filesystem::path>> by_filename_;
+    std::unordered_map<std::wstring, std::vector<boost::filesystem::path>> by_name_;
+    prober_t                                                               prober_;
+    std::atomic<bool>                                                      ready_{false};
+    std::atomic<std::size_t>                                               unprobed_{0};
+
+    // Used by the executor thread only.
+    std::deque<boost::filesystem::path> to_probe_;
+    bool                                probe_scheduled_ = false;
+
+    std::atomic<bool>                  aborted_{false};
+    executor                           executor_{L"media_index"};
+    std::unique_ptr<directory_watcher> watcher_;
+
+    impl(boost::filesystem::path root, bool watch)
+        : root_(normalize(root))
+    {
+        if (watch) {
+            try {
+                watcher_ = std::make_unique<directory_watcher>(root_, [this](const boost::filesystem::path& path) {
+                    executor_.begin_invoke([=] { update(path); });
+                });
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(warning) << L"[media_index] Changes below " << root_.wstring() << L" are not followed.";
+            }
+        }
+
+        executor_.begin_invoke([=] { scan(); });
+    }
+
+    ~impl()
+    {
+        aborted_ = true;
+        watcher_.reset();
+        executor_.clear();
+        executor_.stop_and_wait();
+    }
+
+    std::optional<entry> make_entry(const boost::filesystem::path& path) const
+    {
+        boost::system::error_code ec;
+
+        entry e;
+        e.path       = path;
+        e.size       = boost::filesystem::file_size(path, ec);
+        e.write_time = boost::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return {};
+        }
+
+        auto relative = path.lexically_relative(root_);
+        e.name        = fold((relative.parent_path() / relative.stem()).generic_wstring());
+
+        return e;
+    }
+
+    // Adds or replaces an entry, returns whether it needs probing. Called with the lock held.
+    bool insert(entry e)
+    {
+        auto it = files_.find(e.path);
+        if (it != files_.end()) {
+            if (it->second.size == e.size && it->second.write_time == e.write_time) {
+                return false;
+            }
+            it->second = std::move(e);
+            return true;
+        }
+
+        const auto filename = fold(e.path.lexically_relative(root_).generic_wstring());
+        by_filename_[filename].push_back(e.path);
+        by_name_[e.name].push_back(e.path);
+        files_.emplace(e.path, std::move(e));
+
+        return true;
+    }
+
+    // Removes path and everything below it. Called with the lock held.
+    void erase(const boost::filesystem::path& path)
+    {
+        const auto remove_from = [](auto& map, const std::wstring& key, const boost::filesystem::path& p) {
+            auto it = map.find(key);
+            if (it != map.end()) {
+                boost::remove_erase(it->second, p);
+                if (it->second.empty()) {
+                    map.erase(it);
+                }
+            }
+        };
+
+        auto prefix = path.generic_wstring() + L"/";
+        for (auto it = files_.lower_bound(path); it != files_.end();) {
+            auto str = it->first.generic_wstring();
+            if (it->first != path && !boost::starts_with(str, prefix)) {
+                break;
+            }
+            remove_from(by_filename_, fold(it->first.lexically_relative(root_).generic_wstring()), it->first);
+            remove_from(by_name_, it->second.name, it->first);
+            it = files_.erase(it);
+        }
+    }
+
+    void scan()
+    {
+        caspar::timer timer;
+
+        std::vector<entry>        found;
+        boost::system::error_code ec;
+        for (auto it = boost::filesystem::recursive_directory_iterator(root_, ec);
+             !ec && it != boost::filesystem::recursive_directory_iterator() && !aborted_;
+             it.increment(ec)) {
+            if (it->status().type() == boost::filesystem::regular_file) {
+                if (auto e = make_entry(it->path())) {
+                    found.push_back(std::move(*e));
+                }
+            }
+        }
+
+        std::vector<boost::filesystem::path> changed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            std::map<boost::filesystem::path, entry> previous;
+            std::swap(previous, files_);
+            by_filename_.clear();
+            by_name_.clear();
+
+            for (auto& e : found) {
+                auto it = previous.find(e.path);
+                if (it != previous.end() && it->second.size == e.size && it->second.write_time == e.write_time) {
+                    e.info = it->second.info;
+                }
+                const auto path = e.path;
+                if (insert(std::move(e)) && !files_[path].info) {
+                    changed.push_back(path);
+                }
+            }
+        }
+
+        ready_ = true;
+
+        CASPAR_LOG(info) << L"[media_index] Indexed " << found.size() << L" files below " << root_.wstring()
+                         << L" in " << static_cast<int>(timer.elapsed() * 1000.0) << L" ms.";
+
+        queue_probes(changed);
+    }
+
+    void update(const boost::filesystem::path& path)
+    {
+        if (aborted_) {
+            return;
+        }
+
+        if (path.empty()) {
+            scan();
+            return;
+        }
+
+        boost::system::error_code ec;
+        const auto                status = boost::filesystem::status(path, ec);
+
+        std::vector<entry> found;
+        if (status.type() == boost::filesystem::regular_file) {
+            if (auto e = make_entry(path)) {
+                found.push_back(std::move(*e));
+            }
+        } else if (status.type() == boost::filesystem::directory_file) {
+            for (auto it = boost::filesystem::recursive_directory_iterator(path, ec);
+                 !ec && it != boost::filesystem::recursive_directory_iterator();
+                 it.increment(ec)) {
+                if (it->status().type() == boost::filesystem::regular_file) {
+                    if (auto e = make_entry(it->path())) {
+                        found.push_back(std::move(*e));
+                    }
+                }
+            }
+        }
+
+        std::vector<boost::filesystem::path> changed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (found.empty()) {
+                erase(path);
+            }
+            for (auto& e : found) {
+                const auto p = e.path;
+                if (insert(std::move(e))) {
+                    changed.push_back(p);
+                }
+            }
+        }
+
+        queue_probes(changed);
+    }
+
+    void queue_probes(const std::vector<boost::filesystem::path>& paths)
+    {
+        to_probe_.insert(to_probe_.end(), paths.begin(), paths.end());
+        unprobed_ = to_probe_.size();
+        schedule_probe();
+    }
+
+    void schedule_probe()
+    {
+        if (probe_scheduled_ || to_probe_.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!prober_) {
+                return;
+            }
+        }
+        probe_scheduled_ = true;
+        executor_.begin_invoke([=] {
+            probe_scheduled_ = false;
+            probe_next();
+            unprobed_ = to_probe_.size();
+            schedule_probe();
+        });
+    }
+
+    // Probes one file, so that changes reported meanwhile are handled in between.
+    void probe_next()
+    {
+        if (aborted_ || to_probe_.empty()) {
+            return;
+        }
+
+        auto path = std::move(to_probe_.front());
+        to_probe_.pop_front();
+
+        entry    e;
+        prober_t prober;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = files_.find(path);
+            if (it == files_.end()) {
+                return;
+            }
+            e      = it->second;
+            prober = prober_;
+        }
+
+        probe(e, prober);
+    }
+
+    void probe(entry& e, const prober_t& prober)
+    {
+        std::shared_ptr<const media_info> info;
+        try {
+            if (auto result = prober(e.path)) {
+                info = std::make_shared<const media_info>(std::move(*result));
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = files_.find(e.path);
+        if (it != files_.end() && it->second.size == e.size && it->second.write_time == e.write_time) {
+            it->second.info = info;
+        }
+        e.info = std::move(info);
+    }
+
+    std::vector<boost::filesystem::path> find(const std::wstring& name) const
+    {
+        auto key = fold(name);
+        while (boost::starts_with(key, L"./")) {
+            key.erase(0, 2);
+        }
+
+        std::vector<boost::filesystem::path> result;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto map : {&by_filename_, &by_name_}) {
+            auto it = map->find(key);
+            if (it != map->end()) {
+                auto paths = it->second;
+                std::sort(paths.begin(), paths.end());
+                for (auto& p : paths) {
+                    if (std::find(result.begin(), result.end(), p) == result.end()) {
+                        result.push_back(p);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    std::optional<entry> get(const std::wstring& name)
+    {
+        entry    e;
+        prober_t prober;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = by_name_.find(fold(name));
+            if (it == by_name_.end()) {
+                return {};
+            }
+            e      = files_.at(*std::min_element(it->second.begin(), it->second.end()));
+            prober = prober_;
+        }
+
+        if (!e.info && prober) {
+            probe(e, prober);
+        }
+
+        return e;
+    }
+
+    std::vector<entry> entries() const
+    {
+        std::vector<entry> result;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            result.reserve(files_.size());
+            for (auto& p : files_) {
+                result.push_back(p.second);
+            }
+        }
+        std::stable_sort(
+            result.begin(), result.end(), [](const entry& a, const entry& b) { return a.name < b.name; });
+        return result;
+    }
+
+    void set_prober(prober_t prober)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            prober_ = std::move(prober);
+        }
+
+        executor_.begin_invoke([=] {
+            std::vector<boost::filesystem::path> unprobed;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto& p : files_) {
+                    if (!p.second.info) {
+                        unprobed.push_back(p.first);
+                    }
+                }
+            }
+            to_probe_.clear();
+            queue_probes(unprobed);
+        });
+    }
+};
+
+media_index::media_index(boost::filesystem::path root, bool watch)
+    : impl_(std::make_shared<impl>(std::move(root), watch))
+{
+}
+
+media_index::~media_index() {}
+
+const boost::filesystem::path& media_index::root() const { return impl_->root_; }
+
+bool media_index::ready() const { return impl_->ready_; }
+
+bool media_index::probed() const { return impl_->ready_ && impl_->unprobed_ == 0; }
+
+std::vector<boost::filesystem::path> media_index::find(const std::wstring& name) const { return impl_->find(name); }
+
+std::optional<media_index::entry> media_index::get(const std::wstring& name) const { return impl_->get(name); }
+
+std::vector<media_index::entry> media_index::entries() const { return impl_->entries(); }
+
+void media_index::set_prober(prober_t prober) { impl_->set_prober(std::move(prober)); }
+
+void register_media_index(std::shared_ptr<media_index> index)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(std::move(index));
+}
+
+void unregister_media_index(const std::shared_ptr<media_index>& index)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    boost::remove_erase(registry, index);
+}
+
+std::shared_ptr<media_index> find_media_index(const boost::filesystem::path& folder)
+{
+    const auto normalized = normalize(folder);
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& index : registry) {
+        if (index->root() == normalized) {
+            return index;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace caspar
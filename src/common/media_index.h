@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+struct media_stream_info
+{
+    std::string type; // video, audio, data, subtitle or attachment.
+    std::string codec;
+    int         width       = 0;
+    int         height      = 0;
+    std::string field_order; // progressive, tt, bb, tb or bt, empty when unknown.
+    int         sample_rate = 0;
+    int         channels    = 0;
+};
+
+struct media_info
+{
+    bool         still         = false;
+    std::int64_t duration      = 0; // In units of the time base.
+    int          time_base_num = 0;
+    int          time_base_den = 1;
+
+    std::vector<media_stream_info> streams;
+};
+
+// Index of the files below a folder, kept current by a directory_watcher. Files are found by their path relative to
+// the folder, case folded, with or without extension, without walking the folder. A prober, registered by the module
+// that understands the files, fills in media_info on a background thread.
+class media_index
+{
+  public:
+    struct entry
+    {
+        boost::filesystem::path path;
+        std::wstring            name; // Relative path without extension, upper case with / separators.
+        std::uintmax_t          size       = 0;
+        std::time_t             write_time = 0;
+
+        std::shared_ptr<const media_info> info; // nullptr until probed, or when probing failed.
+    };
+
+    using prober_t = std::function<std::optional<media_info>(const boost::filesystem::path&)>;
+
+    // Scans root on a background thread. find falls back to the directory when called before the scan is done.
+    media_index(boost::filesystem::path root, bool watch);
+    ~media_index();
+
+    media_index(const media_index&)            = delete;
+    media_index& operator=(const media_index&) = delete;
+
+    const boost::filesystem::path& root() const;
+
+    bool ready() const;
+
+    // Whether the scan is done and every file found has been probed, or failed to.
+    bool probed() const;
+
+    // Files named name relative to the root, by full file name or by name without extension, in path order.
+    std::vector<boost::filesystem::path> find(const std::wstring& name) const;
+
+    // The entry of a name without extension as listed by entries, probing it first when not yet probed.
+    std::optional<entry> get(const std::wstring& name) const;
+
+    // All files, ordered by name.
+    std::vector<entry> entries() const;
+
+    // Probes every file, and every file that changes from now on, on the background thread.
+    void set_prober(prober_t prober);
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+// Indexes consulted by find_file_within_dir_or_absolute for the folders they cover.
+void                         register_media_index(std::shared_ptr<media_index> index);
+void                         unregister_media_index(const std::shared_ptr<media_index>& index);
+std::shared_ptr<media_index> find_media_index(const boost::filesystem::path& folder);
+
+} // namespace caspar
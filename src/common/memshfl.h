@@ -33,6 +33,9 @@
 #endif
 #endif
 
+#include <cstring>
+#include <memory>
+
 namespace caspar {
 
 #ifdef _MSC_VER
@@ -52,6 +55,7 @@ static void* aligned_memshfl(void* dest, const void* source, size_t count, int m
     __m128i*       dest128   = reinterpret_cast<__m128i*>(dest);
     const __m128i* source128 = reinterpret_cast<const __m128i*>(source);
 
+    const size_t byte_count = count;
     count /= 16; // 128 bit
 
     const __m128i mask128 = _mm_set_epi32(m1, m2, m3, m4);
@@ -66,6 +70,21 @@ static void* aligned_memshfl(void* dest, const void* source, size_t count, int m
         _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm2, mask128));
         _mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm3, mask128));
     }
+
+    // The blocks left after the unrolled loop, and a last partial block shuffled through a zero padded copy.
+    for (size_t n = count / 4 * 4; n < count; ++n) {
+        _mm_storeu_si128(dest128++, _mm_shuffle_epi8(_mm_loadu_si128(source128++), mask128));
+    }
+
+    const auto tail = byte_count % 16;
+    if (tail > 0) {
+        alignas(16) char block[16] = {};
+        std::memcpy(block, source128, tail);
+        _mm_store_si128(reinterpret_cast<__m128i*>(block),
+                        _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(block)), mask128));
+        std::memcpy(dest128, block, tail);
+    }
+
     return dest;
 }
 
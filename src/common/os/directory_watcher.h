@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <functional>
+#include <memory>
+
+namespace caspar {
+
+// Watches a directory and everything below it from a thread of its own. on_change is called with each file or
+// directory that was created, written, removed or renamed, or with an empty path when events were lost and the whole
+// tree should be rescanned.
+class directory_watcher
+{
+  public:
+    directory_watcher(boost::filesystem::path root, std::function<void(const boost::filesystem::path&)> on_change);
+    ~directory_watcher();
+
+    directory_watcher(const directory_watcher&)            = delete;
+    directory_watcher& operator=(const directory_watcher&) = delete;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+} // namespace caspar
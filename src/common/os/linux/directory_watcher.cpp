@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../stdafx.h"
+
+#include "../directory_watcher.h"
+
+#include "../../except.h"
+#include "../../log.h"
+#include "../thread.h"
+
+#include <boost/filesystem.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace caspar {
+
+struct directory_watcher::impl
+{
+    static constexpr uint32_t mask = IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                     IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+    const boost::filesystem::path                               root_;
+    const std::function<void(const boost::filesystem::path&)> on_change_;
+
+    int                                    fd_      = -1;
+    int                                    wake_[2] = {-1, -1};
+    std::map<int, boost::filesystem::path> watches_;
+    bool                                   limit_logged_ = false;
+    std::thread                            thread_;
+
+    impl(boost::filesystem::path root, std::function<void(const boost::filesystem::path&)> on_change)
+        : root_(std::move(root))
+        , on_change_(std::move(on_change))
+    {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("inotify_init1 failed: " + errno_string()));
+        }
+        if (pipe(wake_) != 0) {
+            close(fd_);
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("pipe failed: " + errno_string()));
+        }
+
+        add_tree(root_);
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[directory_watcher]");
+            try {
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        char c = 0;
+        if (write(wake_[1], &c, 1) != 1) {
+            CASPAR_LOG(warning) << L"[directory_watcher] Failed to wake watcher thread.";
+        }
+        thread_.join();
+
+        close(wake_[0]);
+        close(wake_[1]);
+        close(fd_);
+    }
+
+    static std::string errno_string() { return std::strerror(errno); }
+
+    void add_watch(const boost::filesystem::path& dir)
+    {
+        const auto wd = inotify_add_watch(fd_, dir.c_str(), mask);
+        if (wd >= 0) {
+            watches_[wd] = dir;
+        } else if (!limit_logged_) {
+            CASPAR_LOG(warning) << L"[directory_watcher] Cannot watch " << dir.wstring() << L": "
+                                << std::strerror(errno) << L". Changes below it are not noticed.";
+            limit_logged_ = errno == ENOSPC;
+        }
+    }
+
+    void add_tree(const boost::filesystem::path& dir)
+    {
+        boost::system::error_code ec;
+
+        add_watch(dir);
+        for (auto it = boost::filesystem::recursive_directory_iterator(dir, ec);
+             !ec && it != boost::filesystem::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (it->status().type() == boost::filesystem::directory_file) {
+                add_watch(it->path());
+            }
+        }
+    }
+
+    void run()
+    {
+        alignas(inotify_event) char buffer[64 * 1024];
+
+        pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+
+        while (true) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("poll failed: " + errno_string()));
+            }
+            if (fds[1].revents != 0) {
+                return;
+            }
+
+            while (true) {
+                const auto size = read(fd_, buffer, sizeof(buffer));
+                if (size <= 0) {
+                    break;
+                }
+
+                for (auto pos = buffer; pos < buffer + size;) {
+                    auto event = reinterpret_cast<const inotify_event*>(pos);
+                    pos += sizeof(inotify_event) + event->len;
+
+                    handle(*event);
+                }
+            }
+        }
+    }
+
+    void handle(const inotify_event& event)
+    {
+        if (event.mask & IN_Q_OVERFLOW) {
+            on_change_(boost::filesystem::path());
+            return;
+        }
+
+        auto it = watches_.find(event.wd);
+        if (it == watches_.end()) {
+            return;
+        }
+
+        if (event.mask & IN_IGNORED) {
+            watches_.erase(it);
+            return;
+        }
+
+        if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+            on_change_(it->second);
+            return;
+        }
+
+        const auto path = event.len > 0 ? it->second / event.name : it->second;
+
+        if ((event.mask & IN_ISDIR) && (event.mask & (IN_CREATE | IN_MOVED_TO))) {
+            add_tree(path);
+        }
+
+        on_change_(path);
+    }
+};
+
+directory_watcher::directory_watcher(boost::filesystem::path                               root,
+                                     std::function<void(const boost::filesystem::path&)> on_change)
+    : impl_(new impl(std::move(root), std::move(on_change)))
+{
+}
+
+directory_watcher::~directory_watcher() {}
+
+} // namespace caspar
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../stdafx.h"
+
+#include "../directory_watcher.h"
+
+#include "../../except.h"
+#include "../../log.h"
+#include "../thread.h"
+
+#include "windows.h"
+
+#include <thread>
+
+namespace caspar {
+
+struct directory_watcher::impl
+{
+    const boost::filesystem::path                               root_;
+    const std::function<void(const boost::filesystem::path&)> on_change_;
+
+    HANDLE      dir_;
+    HANDLE      stop_;
+    std::thread thread_;
+
+    impl(boost::filesystem::path root, std::function<void(const boost::filesystem::path&)> on_change)
+        : root_(std::move(root))
+        , on_change_(std::move(on_change))
+    {
+        dir_ = CreateFileW(root_.c_str(),
+                           FILE_LIST_DIRECTORY,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr,
+                           OPEN_EXISTING,
+                           FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                           nullptr);
+        if (dir_ == INVALID_HANDLE_VALUE) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Cannot watch " + root_.wstring())
+                                                      << boost::errinfo_api_function("CreateFileW"));
+        }
+        stop_ = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[directory_watcher]");
+            try {
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        SetEvent(stop_);
+        thread_.join();
+
+        CloseHandle(stop_);
+        CloseHandle(dir_);
+    }
+
+    void run()
+    {
+        const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE |
+                             FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+        alignas(DWORD) char buffer[64 * 1024];
+
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent     = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        while (true) {
+            ResetEvent(overlapped.hEvent);
+            if (!ReadDirectoryChangesW(dir_, buffer, sizeof(buffer), TRUE, filter, nullptr, &overlapped, nullptr)) {
+                CloseHandle(overlapped.hEvent);
+                CASPAR_THROW_EXCEPTION(caspar_exception() << boost::errinfo_api_function("ReadDirectoryChangesW"));
+            }
+
+            HANDLE handles[2] = {overlapped.hEvent, stop_};
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+                CancelIoEx(dir_, &overlapped);
+                DWORD size = 0;
+                GetOverlappedResult(dir_, &overlapped, &size, TRUE);
+                CloseHandle(overlapped.hEvent);
+                return;
+            }
+
+            DWORD size = 0;
+            if (!GetOverlappedResult(dir_, &overlapped, &size, FALSE) || size == 0) {
+                // The buffer overflowed and the events are lost.
+                on_change_(boost::filesystem::path());
+                continue;
+            }
+
+            for (auto pos = buffer;;) {
+                auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(pos);
+
+                on_change_(root_ / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+
+                if (info->NextEntryOffset == 0) {
+                    break;
+                }
+                pos += info->NextEntryOffset;
+            }
+        }
+    }
+};
+
+directory_watcher::directory_watcher(boost::filesystem::path                               root,
+                                     std::function<void(const boost::filesystem::path&)> on_change)
+    : impl_(new impl(std::move(root), std::move(on_change)))
+{
+}
+
+directory_watcher::~directory_watcher() {}
+
+} // namespace caspar
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace caspar {
+
+// Move-only void() callable. Unlike std::function it accepts move-only callables (e.g. lambdas owning a
+// std::promise), and callables up to buffer_size bytes are stored inline without allocating.
+class task final
+{
+  public:
+    static constexpr std::size_t buffer_size = 64;
+
+    task() noexcept = default;
+
+    task(std::nullptr_t) noexcept {}
+
+    template <typename Func,
+              typename = std::enable_if_t<!std::is_same<std::decay_t<Func>, task>::value &&
+                                          !std::is_same<std::decay_t<Func>, std::nullptr_t>::value>>
+    task(Func&& func)
+    {
+        using func_t = std::decay_t<Func>;
+
+        if constexpr (is_inline<func_t>()) {
+            new (&buffer_) func_t(std::forward<Func>(func));
+            vtable_ = &inline_vtable<func_t>;
+        } else {
+            *reinterpret_cast<func_t**>(&buffer_) = new func_t(std::forward<Func>(func));
+            vtable_                               = &heap_vtable<func_t>;
+        }
+    }
+
+    task(task&& other) noexcept { move_from(other); }
+
+    task& operator=(task&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    task& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    task(const task&)            = delete;
+    task& operator=(const task&) = delete;
+
+    ~task() { reset(); }
+
+    void operator()() { vtable_->invoke(&buffer_); }
+
+    explicit operator bool() const noexcept { return vtable_ != nullptr; }
+
+  private:
+    struct vtable
+    {
+        void (*invoke)(void* self);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void* self) noexcept;
+    };
+
+    template <typename T>
+    static constexpr bool is_inline()
+    {
+        return sizeof(T) <= buffer_size && alignof(T) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<T>::value;
+    }
+
+    template <typename T>
+    static constexpr vtable inline_vtable = {
+        [](void* self) { (*static_cast<T*>(self))(); },
+        [](void* dst, void* src) noexcept {
+            new (dst) T(std::move(*static_cast<T*>(src)));
+            static_cast<T*>(src)->~T();
+        },
+        [](void* self) noexcept { static_cast<T*>(self)->~T(); },
+    };
+
+    template <typename T>
+    static constexpr vtable heap_vtable = {
+        [](void* self) { (**static_cast<T**>(self))(); },
+        [](void* dst, void* src) noexcept { *static_cast<T**>(dst) = *static_cast<T**>(src); },
+        [](void* self) noexcept { delete *static_cast<T**>(self); },
+    };
+
+    void move_from(task& other) noexcept
+    {
+        if (other.vtable_) {
+            other.vtable_->move(&buffer_, &other.buffer_);
+            vtable_       = other.vtable_;
+            other.vtable_ = nullptr;
+        }
+    }
+
+    void reset() noexcept
+    {
+        if (vtable_) {
+            vtable_->destroy(&buffer_);
+            vtable_ = nullptr;
+        }
+    }
+
+    std::aligned_storage_t<buffer_size, alignof(std::max_align_t)> buffer_;
+    const vtable*                                                  vtable_ = nullptr;
+};
+
+} // namespace caspar
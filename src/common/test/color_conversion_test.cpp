@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks bgra_to_yuv422: every SIMD kernel the cpu supports against the scalar kernel, and the scalar kernel against
+// swscale. Run with --benchmark to print the throughput of each kernel and of swscale for 1080p.
+
+#include <common/color_conversion.h>
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace common { namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+struct image
+{
+    int                       width;
+    int                       height;
+    bit_depth                 depth;
+    int                       linesize;
+    std::vector<std::uint8_t> data;
+};
+
+// Random pixels. With pairs set, both pixels of each horizontal pair are equal, so that the result does not depend on
+// how a converter subsamples chroma.
+image make_image(int width, int height, bit_depth depth, bool pairs, unsigned seed)
+{
+    const auto bytes = depth == bit_depth::bit8 ? 1 : 2;
+
+    image img{width, height, depth, width * 4 * bytes, {}};
+    img.data.resize(static_cast<std::size_t>(img.linesize) * height);
+
+    std::mt19937                            random(seed);
+    std::uniform_int_distribution<unsigned> sample(0, bytes == 1 ? 255 : 65535);
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                // Rows 0 and 1 hold the extremes, which is where clamping goes wrong.
+                auto value = y == 0 ? 0u : y == 1 ? (bytes == 1 ? 255u : 65535u) : sample(random);
+                if (pairs && x % 2 == 1) {
+                    value = bytes == 1 ? img.data[y * img.linesize + (x - 1) * 4 + c]
+                                       : reinterpret_cast<const std::uint16_t*>(
+                                             img.data.data() + y * img.linesize)[(x - 1) * 4 + c];
+                }
+                if (bytes == 1) {
+                    img.data[y * img.linesize + x * 4 + c] = static_cast<std::uint8_t>(value);
+                } else {
+                    reinterpret_cast<std::uint16_t*>(img.data.data() + y * img.linesize)[x * 4 + c] =
+                        static_cast<std::uint16_t>(value);
+                }
+            }
+        }
+    }
+    return img;
+}
+
+struct planes
+{
+    std::vector<std::uint8_t> data[4];
+    int                       linesize[4] = {};
+};
+
+planes make_planes(yuv_format format, int width, int height, bool alpha)
+{
+    planes result;
+    for (int p = 0; p < 4; ++p) {
+        result.linesize[p] = p == 3 && !alpha ? 0 : yuv422_linesize(format, width, p);
+        result.data[p].resize(static_cast<std::size_t>(result.linesize[p]) * height);
+    }
+    return result;
+}
+
+planes convert(const image& img, color_space space, yuv_format format, bool alpha, color_conversion_kernel kernel)
+{
+    auto          result = make_planes(format, img.width, img.height, alpha);
+    std::uint8_t* dst[4] = {};
+    for (int p = 0; p < 4; ++p) {
+        dst[p] = result.linesize[p] > 0 ? result.data[p].data() : nullptr;
+    }
+    bgra_to_yuv422(
+        img.data.data(), img.linesize, img.depth, img.width, img.height, space, format, dst, result.linesize, kernel);
+    return result;
+}
+
+// The samples of a plane as integers, with v210 words unpacked into their three 10 bit samples.
+std::vector<int> samples(yuv_format format, const std::vector<std::uint8_t>& plane)
+{
+    std::vector<int> result;
+    switch (format) {
+        case yuv_format::yuv422p8:
+        case yuv_format::uyvy:
+            result.assign(plane.begin(), plane.end());
+            break;
+        case yuv_format::yuv422p10:
+        case yuv_format::p216: {
+            const auto words = reinterpret_cast<const std::uint16_t*>(plane.data());
+            result.assign(words, words + plane.size() / 2);
+            break;
+        }
+        case yuv_format::v210: {
+            const auto words = reinterpret_cast<const std::uint32_t*>(plane.data());
+            for (std::size_t n = 0; n < plane.size() / 4; ++n) {
+                result.push_back(static_cast<int>(words[n] & 0x3ff));
+                result.push_back(static_cast<int>((words[n] >> 10) & 0x3ff));
+                result.push_back(static_cast<int>((words[n] >> 20) & 0x3ff));
+            }
+            break;
+        }
+    }
+    return result;
+}
+
+int max_difference(yuv_format format, const std::vector<std::uint8_t>& a, const std::vector<std::uint8_t>& b)
+{
+    const auto sa = samples(format, a);
+    const auto sb = samples(format, b);
+    if (sa.size() != sb.size()) {
+        return std::numeric_limits<int>::max();
+    }
+    int result = 0;
+    for (std::size_t n = 0; n < sa.size(); ++n) {
+        result = std::max(result, std::abs(sa[n] - sb[n]));
+    }
+    return result;
+}
+
+const color_conversion_kernel simd_kernels[] = {
+    color_conversion_kernel::sse41,
+    color_conversion_kernel::avx2,
+    color_conversion_kernel::avx512,
+};
+
+const yuv_format formats[] = {
+    yuv_format::yuv422p8,
+    yuv_format::yuv422p10,
+    yuv_format::p216,
+    yuv_format::uyvy,
+    yuv_format::v210,
+};
+
+const color_space spaces[] = {color_space::bt601, color_space::bt709, color_space::bt2020};
+
+const char* name(color_conversion_kernel kernel)
+{
+    switch (kernel) {
+        case color_conversion_kernel::automatic:
+            return "automatic";
+        case color_conversion_kernel::scalar:
+            return "scalar";
+        case color_conversion_kernel::sse41:
+            return "sse4.1";
+        case color_conversion_kernel::avx2:
+            return "avx2";
+        case color_conversion_kernel::avx512:
+            return "avx512";
+    }
+    return "";
+}
+
+const char* name(yuv_format format)
+{
+    switch (format) {
+        case yuv_format::yuv422p8:
+            return "yuv422p8";
+        case yuv_format::yuv422p10:
+            return "yuv422p10";
+        case yuv_format::p216:
+            return "p216";
+        case yuv_format::uyvy:
+            return "uyvy";
+        case yuv_format::v210:
+            return "v210";
+    }
+    return "";
+}
+
+const char* name(color_space space)
+{
+    switch (space) {
+        case color_space::bt601:
+            return "bt601";
+        case color_space::bt709:
+            return "bt709";
+        case color_space::bt2020:
+            return "bt2020";
+    }
+    return "";
+}
+
+std::string describe(yuv_format format, color_space space, bit_depth depth, int width, bool alpha)
+{
+    return std::string(name(format)) + ", " + name(space) + ", " + (depth == bit_depth::bit8 ? "8" : "16") +
+           " bit, width " + std::to_string(width) + (alpha ? ", alpha" : "");
+}
+
+// The SIMD kernels compute in single precision like the scalar kernel but in another order, so samples on the 16 bit
+// scale may round differently. After packing that is at most one step of the output format.
+void test_simd_matches_scalar()
+{
+    // Widths that leave every possible tail for 4, 8 and 16 pixel blocks, and ones that are not whole v210 blocks.
+    const int widths[] = {1, 2, 3, 7, 15, 17, 31, 33, 47, 48, 63, 65, 130, 1283, 1920};
+
+    for (auto kernel : simd_kernels) {
+        if (!color_conversion_supported(kernel)) {
+            std::cout << "skipping " << name(kernel) << ", not supported by this cpu" << std::endl;
+            continue;
+        }
+        for (auto depth : {bit_depth::bit8, bit_depth::bit16}) {
+            for (auto width : widths) {
+                const auto img = make_image(width, 6, depth, false, static_cast<unsigned>(width));
+                for (auto format : formats) {
+                    for (auto space : spaces) {
+                        for (auto alpha : {false, true}) {
+                            if (alpha && format != yuv_format::yuv422p8 && format != yuv_format::yuv422p10) {
+                                continue;
+                            }
+                            const auto expected = convert(img, space, format, alpha, color_conversion_kernel::scalar);
+                            const auto actual   = convert(img, space, format, alpha, kernel);
+                            for (int p = 0; p < 4; ++p) {
+                                const auto difference = max_difference(format, expected.data[p], actual.data[p]);
+                                check(difference <= 1,
+                                      std::string(name(kernel)) + " differs from scalar by " +
+                                          std::to_string(difference) + " in plane " + std::to_string(p) + ", " +
+                                          describe(format, space, depth, width, alpha));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void check_kernel_selection()
+{
+    check(color_conversion_supported(color_conversion_kernel::scalar), "scalar kernel always supported");
+    check(color_conversion_supported(color_conversion_kernel::sse41), "sse4.1 kernel always supported");
+
+    const auto img       = make_image(64, 4, bit_depth::bit8, false, 1);
+    const auto automatic =
+        convert(img, color_space::bt709, yuv_format::v210, false, color_conversion_kernel::automatic);
+
+    auto selected = color_conversion_kernel::sse41;
+    for (auto kernel : simd_kernels) {
+        if (color_conversion_supported(kernel)) {
+            selected = kernel;
+        }
+    }
+    check(automatic.data[0] == convert(img, color_space::bt709, yuv_format::v210, false, selected).data[0],
+          std::string("automatic uses ") + name(selected));
+}
+
+struct swscale_output
+{
+    std::vector<std::uint8_t> data[3];
+    int                       linesize[3] = {};
+};
+
+using sws_ptr = std::unique_ptr<SwsContext, decltype(&sws_freeContext)>;
+
+sws_ptr make_sws(const image& img, color_space space, yuv_format format)
+{
+    const auto src_format = img.depth == bit_depth::bit8 ? AV_PIX_FMT_BGRA : AV_PIX_FMT_BGRA64LE;
+    const auto dst_format = format == yuv_format::yuv422p8 ? AV_PIX_FMT_YUV422P : AV_PIX_FMT_YUV422P10LE;
+
+    sws_ptr sws(sws_getContext(img.width,
+                               img.height,
+                               src_format,
+                               img.width,
+                               img.height,
+                               dst_format,
+                               SWS_POINT | SWS_ACCURATE_RND,
+                               nullptr,
+                               nullptr,
+                               nullptr),
+                sws_freeContext);
+    if (!sws) {
+        return sws;
+    }
+
+    const auto colorspace = space == color_space::bt601   ? SWS_CS_ITU601
+                            : space == color_space::bt709 ? SWS_CS_ITU709
+                                                          : SWS_CS_BT2020;
+    const auto table      = sws_getCoefficients(colorspace);
+
+    // Full range RGB in, limited range YUV out.
+    sws_setColorspaceDetails(sws.get(), table, 1, table, 0, 0, 1 << 16, 1 << 16);
+    return sws;
+}
+
+swscale_output make_swscale_output(const image& img, yuv_format format)
+{
+    const auto sample_bytes = format == yuv_format::yuv422p8 ? 1 : 2;
+
+    swscale_output result;
+    for (int p = 0; p < 3; ++p) {
+        result.linesize[p] = (p == 0 ? img.width : (img.width + 1) / 2) * sample_bytes;
+        result.data[p].resize(static_cast<std::size_t>(result.linesize[p]) * img.height);
+    }
+    return result;
+}
+
+void convert_swscale(SwsContext* sws, const image& img, swscale_output& out)
+{
+    const std::uint8_t* src[4]      = {img.data.data()};
+    const int           src_line[4] = {img.linesize};
+    std::uint8_t*       dst[4]      = {out.data[0].data(), out.data[1].data(), out.data[2].data()};
+    const int           dst_line[4] = {out.linesize[0], out.linesize[1], out.linesize[2]};
+    sws_scale(sws, src, src_line, 0, img.height, dst, dst_line);
+}
+
+// swscale works in fixed point on its own 15 bit intermediate, so it is only expected to agree to within a step at 8
+// bit, a little more at 10 bit. Channel order, coefficient or range mistakes are off by far more.
+void test_scalar_matches_swscale()
+{
+    for (auto depth : {bit_depth::bit8, bit_depth::bit16}) {
+        for (auto width : {2, 34, 1920}) {
+            const auto img = make_image(width, 8, depth, true, static_cast<unsigned>(width + 7));
+            for (auto format : {yuv_format::yuv422p8, yuv_format::yuv422p10}) {
+                for (auto space : spaces) {
+                    auto sws = make_sws(img, space, format);
+                    check(sws != nullptr, "swscale context, " + describe(format, space, depth, width, false));
+                    if (!sws) {
+                        continue;
+                    }
+
+                    auto expected = make_swscale_output(img, format);
+                    convert_swscale(sws.get(), img, expected);
+
+                    const auto actual    = convert(img, space, format, false, color_conversion_kernel::scalar);
+                    const auto tolerance = format == yuv_format::yuv422p8 ? 1 : 4;
+                    for (int p = 0; p < 3; ++p) {
+                        const auto difference = max_difference(format, expected.data[p], actual.data[p]);
+                        check(difference <= tolerance,
+                              "scalar differs from swscale by " + std::to_string(difference) + " in plane " +
+                                  std::to_string(p) + ", " + describe(format, space, depth, width, false));
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename Func>
+double megapixels_per_second(const Func& func, int width, int height)
+{
+    const int iterations = 50;
+
+    func();
+    const auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; ++n) {
+        func();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(width) * height * iterations / elapsed.count() / 1e6;
+}
+
+void benchmark()
+{
+    const int width  = 1920;
+    const int height = 1080;
+
+    for (auto depth : {bit_depth::bit8, bit_depth::bit16}) {
+        const auto img = make_image(width, height, depth, false, 42);
+        for (auto format : {yuv_format::yuv422p10, yuv_format::v210}) {
+            for (auto kernel : {color_conversion_kernel::scalar,
+                                color_conversion_kernel::sse41,
+                                color_conversion_kernel::avx2,
+                                color_conversion_kernel::avx512}) {
+                if (!color_conversion_supported(kernel)) {
+                    continue;
+                }
+                auto out = make_planes(format, width, height, false);
+                std::uint8_t* dst[4] = {out.data[0].data(), out.data[1].data(), out.data[2].data(), nullptr};
+                const auto rate = megapixels_per_second(
+                    [&] {
+                        bgra_to_yuv422(img.data.data(),
+                                       img.linesize,
+                                       depth,
+                                       width,
+                                       height,
+                                       color_space::bt709,
+                                       format,
+                                       dst,
+                                       out.linesize,
+                                       kernel);
+                    },
+                    width,
+                    height);
+                std::cout << (depth == bit_depth::bit8 ? "8" : "16") << " bit to " << name(format) << ", "
+                          << name(kernel) << ": " << rate << " Mpixel/s" << std::endl;
+            }
+        }
+
+        auto sws = make_sws(img, color_space::bt709, yuv_format::yuv422p10);
+        if (sws) {
+            auto       out  = make_swscale_output(img, yuv_format::yuv422p10);
+            const auto rate = megapixels_per_second([&] { convert_swscale(sws.get(), img, out); }, width, height);
+            std::cout << (depth == bit_depth::bit8 ? "8" : "16") << " bit to yuv422p10, swscale: " << rate
+                      << " Mpixel/s" << std::endl;
+        }
+    }
+}
+
+}}} // namespace caspar::common
+
+int main(int argc, char** argv)
+{
+    using namespace caspar::common;
+
+    if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+        benchmark();
+        return 0;
+    }
+
+    check_kernel_selection();
+    test_simd_matches_scalar();
+    test_scalar_matches_swscale();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
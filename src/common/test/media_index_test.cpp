@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that find_file_within_dir_or_absolute answers from the media index of the folder when it has the file, and
+// falls back to scanning the folder when there is no index, the index does not have the file, or the name is absolute
+// or goes up with "..". Run with --benchmark to compare lookups through the index with scans of a large folder.
+
+#include "../filesystem.h"
+#include "../media_index.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace caspar { namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+struct fixture
+{
+    boost::filesystem::path root =
+        boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("media_index_test-%%%%-%%%%");
+
+    fixture() { boost::filesystem::create_directories(root); }
+
+    ~fixture()
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(root, ec);
+    }
+
+    void add(const std::wstring& name) const
+    {
+        const auto path = root / name;
+        boost::filesystem::create_directories(path.parent_path());
+        boost::filesystem::ofstream(path) << "media";
+    }
+
+    // Builds an index of the folder as it is now, without following changes, and registers it for the folder.
+    std::shared_ptr<media_index> index() const
+    {
+        auto index = std::make_shared<media_index>(root, false);
+        for (int n = 0; n < 1000 && !index->ready(); ++n) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        register_media_index(index);
+        return index;
+    }
+};
+
+std::optional<boost::filesystem::path> lookup(const fixture& f, const std::wstring& name)
+{
+    return find_file_within_dir_or_absolute(f.root.wstring(), name, [](const boost::filesystem::path&) {
+        return true;
+    });
+}
+
+bool is(const std::optional<boost::filesystem::path>& found, const boost::filesystem::path& expected)
+{
+    return found && boost::filesystem::equivalent(*found, expected);
+}
+
+void test_lookup()
+{
+    fixture f;
+    f.add(L"Clip.mov");
+    f.add(L"Folder/Nested.MXF");
+    f.add(L"removed.mov");
+
+    const auto index = f.index();
+    check(index->ready(), "index ready");
+
+    // Gone from the disk but still in the index, which is not following changes, so only the index can find it.
+    boost::filesystem::remove(f.root / L"removed.mov");
+    const auto hit = lookup(f, L"REMOVED");
+    check(hit && hit->filename() == L"removed.mov", "index hit");
+    const auto nested = lookup(f, L"folder/nested");
+    check(nested && nested->filename() == L"Nested.MXF", "index hit without extension in another case");
+
+    // Added after the index was built, so only the scan can find it.
+    f.add(L"Later.mov");
+    check(is(lookup(f, L"later"), f.root / L"Later.mov"), "scan fallback for a name the index lacks");
+    check(is(lookup(f, L"later.MOV"), f.root / L"Later.mov"), "scan fallback with extension");
+
+    // Names the index is not asked for.
+    check(is(lookup(f, (f.root / L"Later.mov").wstring()), f.root / L"Later.mov"), "absolute path");
+    check(!lookup(f, (f.root / L"removed.mov").wstring()), "absolute path skips the index");
+    check(!lookup(f, L"Folder/../removed"), "path going up skips the index");
+    check(is(lookup(f, L"Folder/../Clip"), f.root / L"Clip.mov"), "path going up is scanned");
+
+    // The index does not answer for files is_valid_file rejects.
+    const auto rejected = find_file_within_dir_or_absolute(
+        f.root.wstring(), L"removed", [](const boost::filesystem::path& p) { return boost::filesystem::exists(p); });
+    check(!rejected, "rejected index hit");
+
+    unregister_media_index(index);
+    check(!lookup(f, L"removed"), "no index registered");
+    check(is(lookup(f, L"clip"), f.root / L"Clip.mov"), "scan without an index");
+}
+
+void benchmark()
+{
+    const int files   = 5000;
+    const int lookups = 2000;
+
+    fixture f;
+    for (int n = 0; n < files; ++n) {
+        f.add(L"clip" + std::to_wstring(n) + L".mov");
+    }
+
+    const auto run = [&](const char* what) {
+        int        found = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < lookups; ++n) {
+            if (lookup(f, L"CLIP" + std::to_wstring(n * 7919 % files))) {
+                ++found;
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << what << ": " << found / elapsed.count() << " lookups/s in a folder of " << files << " files"
+                  << std::endl;
+    };
+
+    const auto index = f.index();
+    run("index");
+    unregister_media_index(index);
+    run("scan");
+}
+
+}} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+        benchmark();
+        return 0;
+    }
+
+    test_lookup();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -255,6 +255,7 @@ class line : public drawable
     std::atomic<float> tick_data_;
     std::atomic<bool>  tick_tag_;
     std::atomic<int>   color_;
+    std::atomic<bool>  removed_;
 
     double x_delta_ = 1.0 / (static_cast<double>(res_) - 1.0);
 
@@ -263,6 +264,7 @@ class line : public drawable
         : tick_data_(-1.0f)
         , tick_tag_(false)
         , color_(0xFFFFFFFF)
+        , removed_(false)
     {
     }
 
@@ -273,20 +275,45 @@ class line : public drawable
         , tick_data_(other.tick_data_.load())
         , tick_tag_(other.tick_tag_.load())
         , color_(other.color_.load())
+        , removed_(other.removed_.load())
         , x_delta_(other.x_delta_)
     {
     }
 
-    void set_value(float value) { tick_data_ = value; }
+    void set_value(float value)
+    {
+        tick_data_ = value;
+        removed_   = false;
+    }
 
     void set_tag() { tick_tag_ = true; }
 
-    void set_color(int color) { color_ = color; }
+    void set_color(int color)
+    {
+        color_   = color;
+        removed_ = false;
+    }
 
     int get_color() { return color_; }
 
+    // The map of lines cannot erase while it is rendered, so a removed line stays in it, hidden and without history.
+    void remove() { removed_ = true; }
+
+    bool removed() const { return removed_; }
+
+    void release()
+    {
+        line_data_.set_capacity(0);
+        line_tags_.set_capacity(0);
+    }
+
     void render(sf::RenderTarget& target, sf::RenderStates states) override
     {
+        if (line_data_.capacity() == 0) {
+            line_data_.set_capacity(res_);
+            line_tags_.set_capacity(res_);
+        }
+
         /*states.transform.translate(x_pos_, 0.f);
 
         if (line_data_.size() == res_)
@@ -387,6 +414,13 @@ struct graph
 
     void set_color(const std::string& name, int color) override { lines_[name].set_color(color); }
 
+    void remove(const std::string& name) override
+    {
+        auto it = lines_.find(name);
+        if (it != lines_.end())
+            it->second.remove();
+    }
+
     void auto_reset() override
     {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -431,6 +465,8 @@ struct graph
         float x_offset = text_margin;
 
         for (auto it = lines_.begin(); it != lines_.end(); ++it) {
+            if (it->second.removed())
+                continue;
             sf::Text line_text(it->first, get_default_font(), text_size);
             line_text.setPosition(x_offset, text_margin + text_offset / 2);
             line_text.setColor(get_sfml_color(it->second.get_color()));
@@ -482,6 +518,10 @@ struct graph
         glDisable(GL_LINE_STIPPLE);
 
         for (auto it = lines_.begin(); it != lines_.end(); ++it) {
+            if (it->second.removed()) {
+                it->second.release();
+                continue;
+            }
             target.draw(it->second, states);
             if (auto_reset)
                 it->second.set_value(0.0f);
@@ -26,8 +26,14 @@
 #include <common/array.h>
 #include <common/except.h>
 
+#include <tbb/task_arena.h>
+
 #include <cstdint>
 #include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -94,6 +100,13 @@ struct const_frame::impl
     core::pixel_format_desc                desc_     = core::pixel_format_desc(pixel_format::invalid);
     frame_geometry                         geometry_ = frame_geometry::get_default();
     std::any                               opaque_;
+    const void*                            tag_ = nullptr;
+
+    using derived_key_t   = std::pair<std::type_index, std::string>;
+    using derived_value_t = std::shared_future<std::shared_ptr<const void>>;
+
+    std::mutex                               derived_mutex_;
+    std::map<derived_key_t, derived_value_t> derived_;
 
     impl(std::vector<array<const std::uint8_t>> image_data,
          array<const std::int32_t>              audio_data,
@@ -125,6 +138,7 @@ struct const_frame::impl
         , audio_data_(std::move(other.impl_->audio_data_))
         , desc_(std::move(other.impl_->desc_))
         , geometry_(std::move(other.impl_->geometry_))
+        , tag_(other.impl_->tag_)
     {
         if (desc_.planes.size() != image_data_.size() && !other.impl_->commit_) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
@@ -176,5 +190,52 @@ std::size_t                      const_frame::height() const { return impl_->hei
 std::size_t                      const_frame::size() const { return impl_->size(); }
 const frame_geometry&            const_frame::geometry() const { return impl_->geometry_; }
 const std::any&                  const_frame::opaque() const { return impl_->opaque_; }
+const void*                      const_frame::stream_tag() const { return impl_->tag_; }
+
+std::shared_ptr<const void> const_frame::derived(std::type_index                                     type,
+                                                 const std::string&                                  key,
+                                                 const std::function<std::shared_ptr<const void>()>& make) const
+{
+    if (!impl_) {
+        return make();
+    }
+
+    const auto id = std::make_pair(type, key);
+
+    std::promise<std::shared_ptr<const void>> promise;
+    impl::derived_value_t                     future;
+    {
+        std::lock_guard<std::mutex> lock(impl_->derived_mutex_);
+
+        auto it = impl_->derived_.find(id);
+        if (it != impl_->derived_.end()) {
+            future = it->second;
+        } else {
+            impl_->derived_.emplace(id, promise.get_future().share());
+        }
+    }
+
+    if (future.valid()) {
+        return future.get();
+    }
+
+    try {
+        // make() may run parallel algorithms, and a TBB worker waiting on those executes other queued tasks meanwhile.
+        // If that was another caller's task blocking on this very representation it would wait on itself, so the
+        // wait is isolated to the tasks make() spawns.
+        auto result = tbb::this_task_arena::isolate([&] { return make(); });
+        promise.set_value(result);
+        return result;
+    } catch (...) {
+        // Let later callers try again rather than inherit the error.
+        {
+            std::lock_guard<std::mutex> lock(impl_->derived_mutex_);
+            impl_->derived_.erase(id);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
 const_frame::operator bool() const { return impl_ != nullptr && impl_->desc_.format != core::pixel_format::invalid; }
 }} // namespace caspar::core
@@ -7,6 +7,8 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
+#include <typeindex>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -81,8 +83,23 @@ class const_frame final
 
     const std::any& opaque() const;
 
+    // The tag the frame was created with, identifying the producer it came from. nullptr if unknown.
+    const void* stream_tag() const;
+
     const class frame_geometry& geometry() const;
 
+    // Returns a representation of the frame, such as a converted or scaled copy of the image, made by make the first
+    // time it is asked for and then shared by every holder of the frame until the frame is released. The key names
+    // the representation, so consumers with the same conversion do it once per frame. Callers asking for a
+    // representation that is being made wait for it.
+    template <typename T>
+    std::shared_ptr<const T> derived(const std::string&                               key,
+                                     const std::function<std::shared_ptr<const T>()>& make) const
+    {
+        return std::static_pointer_cast<const T>(
+            derived(typeid(T), key, [&]() -> std::shared_ptr<const void> { return make(); }));
+    }
+
     bool operator==(const const_frame& other) const;
     bool operator!=(const const_frame& other) const;
     bool operator<(const const_frame& other) const;
@@ -91,6 +108,10 @@ class const_frame final
     explicit operator bool() const;
 
   private:
+    std::shared_ptr<const void> derived(std::type_index                                     type,
+                                        const std::string&                                  key,
+                                        const std::function<std::shared_ptr<const void>()>& make) const;
+
     struct impl;
     std::shared_ptr<impl> impl_;
 };
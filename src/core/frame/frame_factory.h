@@ -37,6 +37,11 @@ class frame_factory
     virtual class mutable_frame create_frame(const void* video_stream_tag, const struct pixel_format_desc& desc) = 0;
     virtual class mutable_frame
     create_frame(const void* video_stream_tag, const struct pixel_format_desc& desc, common::bit_depth depth) = 0;
+
+    // Whether the mixer reads image data in place. If so a frame's planes may be replaced with any host memory, e.g.
+    // decoder output, without it being copied later on. Otherwise image data must be written to the planes
+    // create_frame allocated, as it is uploaded from those.
+    virtual bool reads_image_data_in_place() const { return false; }
 };
 
 }} // namespace caspar::core
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#include "audio_kernel.h"
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse2.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace caspar { namespace core {
+
+void accumulate(float* dst, const std::int32_t* src, std::size_t count, float gain, float step)
+{
+    std::size_t n = 0;
+
+    if (step == 0.0f) {
+        const auto g = _mm_set1_ps(gain);
+        for (; n + 4 <= count; n += 4) {
+            auto s = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n)));
+            _mm_storeu_ps(dst + n, _mm_add_ps(_mm_loadu_ps(dst + n), _mm_mul_ps(s, g)));
+        }
+    } else {
+        const auto dg = _mm_set1_ps(step);
+        const auto g0 = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(dg, _mm_setr_ps(1.0f, 2.0f, 3.0f, 4.0f)));
+        for (; n + 4 <= count; n += 4) {
+            auto g = _mm_add_ps(g0, _mm_mul_ps(dg, _mm_set1_ps(static_cast<float>(n))));
+            auto s = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n)));
+            _mm_storeu_ps(dst + n, _mm_add_ps(_mm_loadu_ps(dst + n), _mm_mul_ps(s, g)));
+        }
+    }
+
+    for (; n < count; ++n) {
+        dst[n] += static_cast<float>(src[n]) * (gain + step * static_cast<float>(n + 1));
+    }
+}
+
+void saturate(std::int32_t*                                            dst,
+              const float*                                             src,
+              std::size_t                                              count,
+              float                                                    gain,
+              float                                                    step,
+              int                                                      channels,
+              float*                                                   peaks,
+              std::vector<float, tbb::cache_aligned_allocator<float>>& lanes)
+{
+    // Samples are processed in blocks that span a whole number of both vectors and channels, so each vector lane
+    // always holds the same channel.
+    const auto block = static_cast<std::size_t>(std::lcm(4, channels));
+
+    lanes.assign(block, 0.0f);
+
+    const auto dg        = _mm_set1_ps(step);
+    const auto g0        = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(dg, _mm_setr_ps(1.0f, 2.0f, 3.0f, 4.0f)));
+    const auto abs_mask  = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const auto max_value = _mm_set1_ps(max_sample);
+    const auto min_value = _mm_set1_ps(min_sample);
+
+    std::size_t n = 0;
+    for (; n + block <= count; n += block) {
+        for (std::size_t v = 0; v < block / 4; ++v) {
+            auto i = n + v * 4;
+            auto g = _mm_add_ps(g0, _mm_mul_ps(dg, _mm_set1_ps(static_cast<float>(i))));
+            auto x = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+
+            _mm_store_ps(lanes.data() + v * 4, _mm_max_ps(_mm_load_ps(lanes.data() + v * 4), _mm_and_ps(x, abs_mask)));
+
+            x = _mm_min_ps(_mm_max_ps(x, min_value), max_value);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_cvtps_epi32(x));
+        }
+    }
+
+    std::fill(peaks, peaks + channels, 0.0f);
+
+    for (std::size_t l = 0; l < block; ++l) {
+        auto& peak = peaks[l % channels];
+        peak       = std::max(peak, lanes[l]);
+    }
+
+    for (; n < count; ++n) {
+        auto x = src[n] * (gain + step * static_cast<float>(n + 1));
+
+        auto& peak = peaks[n % channels];
+        peak       = std::max(peak, std::abs(x));
+
+        dst[n] = static_cast<std::int32_t>(std::min(std::max(x, min_sample), max_sample));
+    }
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// Largest float below 2^31, i.e. the largest float that converts to int32_t without overflowing.
+constexpr float max_sample = 2147483520.0f;
+constexpr float min_sample = -2147483648.0f;
+
+// dst[n] += src[n] * (gain + step * (n + 1)), i.e. the gain ramps linearly and reaches gain + step * count at the end
+// of the buffer.
+void accumulate(float* dst, const std::int32_t* src, std::size_t count, float gain, float step);
+
+// dst[n] = saturate(src[n] * gain(n)), with the gain ramp of accumulate. The unsaturated peak magnitude of every
+// channel is written to peaks, which must hold channels floats. lanes is scratch space for the peaks of each vector
+// lane, kept 16 byte aligned by its allocator.
+void saturate(std::int32_t*                                            dst,
+              const float*                                             src,
+              std::size_t                                              count,
+              float                                                    gain,
+              float                                                    step,
+              int                                                      channels,
+              float*                                                   peaks,
+              std::vector<float, tbb::cache_aligned_allocator<float>>& lanes);
+
+}} // namespace caspar::core
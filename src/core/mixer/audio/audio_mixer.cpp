@@ -22,6 +22,7 @@
 #include "../../StdAfx.h"
 
 #include "audio_mixer.h"
+#include "audio_kernel.h"
 
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
@@ -30,10 +31,15 @@
 #include <common/diagnostics/graph.h>
 
 #include <boost/container/flat_map.hpp>
-#include <boost/range/algorithm.hpp>
 
+#include <tbb/cache_aligned_allocator.h>
+
+#include <algorithm>
 #include <atomic>
+#include <limits>
+#include <numeric>
 #include <stack>
+#include <utility>
 #include <vector>
 
 namespace caspar { namespace core {
@@ -42,20 +48,35 @@ using namespace boost::container;
 
 struct audio_item
 {
-    audio_transform      transform;
-    array<const int32_t> samples;
+    // Identifies the stream across ticks, so that volume changes can be ramped. The second member counts how many
+    // times the same producer has already been visited during this tick.
+    std::pair<const void*, int> key;
+    audio_transform             transform;
+    array<const int32_t>        samples;
 };
 
-using audio_buffer_ps = std::vector<double>;
-
 struct audio_mixer::impl
 {
+    using stream_key = std::pair<const void*, int>;
+
     monitor::state                      state_;
     std::stack<core::audio_transform>   transform_stack_;
     std::vector<audio_item>             items_;
     std::atomic<float>                  master_volume_{1.0f};
     spl::shared_ptr<diagnostics::graph> graph_;
 
+    // Volumes reached at the end of the previous tick, the starting point of this tick's ramps.
+    flat_map<stream_key, float> volumes_;
+    flat_map<stream_key, float> next_volumes_;
+    flat_map<const void*, int>  visits_;
+    float                       last_master_volume_ = 1.0f;
+
+    // Scratch buffers, reused between ticks.
+    std::vector<float, tbb::cache_aligned_allocator<float>> mixed_;
+    std::vector<float, tbb::cache_aligned_allocator<float>> lanes_;
+    std::vector<float>                                      peaks_;
+    std::vector<std::shared_ptr<std::vector<int32_t>>>      results_;
+
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
 
@@ -74,13 +95,23 @@ struct audio_mixer::impl
 
     void visit(const const_frame& frame)
     {
-        if (transform_stack_.top().volume < 0.002 || !frame.audio_data())
+        if (!frame.audio_data())
             return;
 
+        const auto tag = frame.stream_tag();
+
         audio_item item;
+        item.key       = stream_key(tag, tag ? visits_[tag]++ : 0);
         item.transform = transform_stack_.top();
         item.samples   = frame.audio_data();
 
+        // Inaudible streams are skipped, unless they were audible on the previous tick and still need to ramp down.
+        if (item.transform.volume < 0.002) {
+            auto it = tag ? volumes_.find(item.key) : volumes_.end();
+            if (it == volumes_.end() || it->second < 0.002f)
+                return;
+        }
+
         items_.push_back(std::move(item));
     }
 
@@ -90,56 +121,90 @@ struct audio_mixer::impl
 
     float get_master_volume() { return master_volume_; }
 
+    std::shared_ptr<std::vector<int32_t>> get_result_buffer(std::size_t size)
+    {
+        // Buffers are handed out with the returned frame and come back once the consumers have released it.
+        for (auto& buffer : results_) {
+            if (buffer.use_count() == 1) {
+                buffer->resize(size);
+                return buffer;
+            }
+        }
+
+        auto buffer = std::make_shared<std::vector<int32_t>>(size);
+        if (results_.size() < 16) {
+            results_.push_back(buffer);
+        }
+        return buffer;
+    }
+
     array<const int32_t> mix(const video_format_desc& format_desc, int nb_samples)
     {
-        auto channels = format_desc.audio_channels;
-        auto items    = std::move(items_);
-        auto result   = std::vector<int32_t>(nb_samples * channels, 0);
-
-        auto mixed = std::vector<double>(nb_samples * channels, 0.0f);
-
-        for (auto& item : items) {
-            auto ptr  = item.samples.data();
-            auto size = result.size();
-            for (auto n = 0; n < size; ++n) {
-                if (n < item.samples.size()) {
-                    mixed[n] = static_cast<double>(ptr[n]) * item.transform.volume + mixed[n];
-                } else {
-                    auto offset = (item.samples.size()) - (channels - (n % channels));
-                    mixed[n]    = static_cast<double>(ptr[offset]) * item.transform.volume + mixed[n];
+        const auto channels = format_desc.audio_channels;
+        const auto size     = static_cast<std::size_t>(nb_samples) * channels;
+
+        mixed_.assign(size, 0.0f);
+        next_volumes_.clear();
+
+        for (auto& item : items_) {
+            const auto volume = static_cast<float>(item.transform.volume);
+
+            // Streams that are new or cannot be told apart start at their target volume.
+            auto prev = volume;
+            if (item.key.first) {
+                auto it = volumes_.find(item.key);
+                if (it != volumes_.end()) {
+                    prev = it->second;
                 }
+                next_volumes_[item.key] = volume;
             }
-        }
 
-        auto master_volume = master_volume_.load();
-        for (auto n = 0; n < mixed.size(); ++n) {
-            auto sample = mixed[n] * master_volume;
-            if (sample > std::numeric_limits<int32_t>::max()) {
-                result[n] = std::numeric_limits<int32_t>::max();
-            } else if (sample < std::numeric_limits<int32_t>::min()) {
-                result[n] = std::numeric_limits<int32_t>::min();
-            } else {
-                result[n] = static_cast<int32_t>(sample);
+            const auto step  = size > 0 ? (volume - prev) / static_cast<float>(size) : 0.0f;
+            const auto ptr   = item.samples.data();
+            const auto count = std::min(item.samples.size(), size);
+
+            accumulate(mixed_.data(), ptr, count, prev, step);
+
+            // Short buffers are padded by repeating their last sample frame.
+            if (count < size && item.samples.size() >= static_cast<std::size_t>(channels)) {
+                const auto last = ptr + item.samples.size() - channels;
+                for (auto n = count; n < size; ++n) {
+                    mixed_[n] += static_cast<float>(last[n % channels]) * (prev + step * static_cast<float>(n + 1));
+                }
             }
         }
 
-        auto max = std::vector<int32_t>(channels, std::numeric_limits<int32_t>::min());
-        for (size_t n = 0; n < result.size(); n += channels) {
-            for (int ch = 0; ch < channels; ++ch) {
-                max[ch] = std::max(max[ch], std::abs(result[n + ch]));
-            }
+        items_.clear();
+        visits_.clear();
+        std::swap(volumes_, next_volumes_);
+
+        const auto master_volume = master_volume_.load();
+        const auto master_step   = size > 0 ? (master_volume - last_master_volume_) / static_cast<float>(size) : 0.0f;
+
+        auto result = get_result_buffer(size);
+
+        peaks_.resize(channels);
+        saturate(
+            result->data(), mixed_.data(), size, last_master_volume_, master_step, channels, peaks_.data(), lanes_);
+
+        last_master_volume_ = master_volume;
+
+        auto max = std::vector<int32_t>(channels);
+        for (int ch = 0; ch < channels; ++ch) {
+            max[ch] = static_cast<int32_t>(std::min<double>(peaks_[ch], std::numeric_limits<int32_t>::max()));
         }
 
-        if (boost::range::count_if(max, [](auto val) { return val >= std::numeric_limits<int32_t>::max(); }) > 0) {
+        const auto peak = channels > 0 ? *std::max_element(peaks_.begin(), peaks_.end()) : 0.0f;
+        if (peak >= static_cast<float>(std::numeric_limits<int32_t>::max())) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "audio-clipping");
         }
 
         state_["volume"] = std::move(max);
 
         graph_->set_value("volume",
-                          static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
+                          std::min(1.0, static_cast<double>(peak) / std::numeric_limits<int32_t>::max()));
 
-        return std::move(result);
+        return array<const int32_t>(result->data(), result->size(), std::move(result));
     }
 };
 
@@ -25,6 +25,7 @@
 
 #include <cstdint>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <boost/container/flat_map.hpp>
@@ -37,6 +38,28 @@ using data_t = boost::
 using vector_t   = boost::container::small_vector<data_t, 2>;
 using data_map_t = boost::container::flat_map<std::string, vector_t>;
 
+namespace detail {
+
+inline void append_key(std::string& path, const std::string& key) { path += key; }
+inline void append_key(std::string& path, const char* key) { path += key; }
+
+template <typename T>
+constexpr bool is_number_key = std::is_integral<T>::value && !std::is_same<T, char>::value;
+
+template <typename T>
+std::enable_if_t<is_number_key<T>> append_key(std::string& path, T key)
+{
+    path += std::to_string(key);
+}
+
+template <typename T>
+std::enable_if_t<!is_number_key<T>> append_key(std::string& path, const T& key)
+{
+    path += boost::lexical_cast<std::string>(key);
+}
+
+} // namespace detail
+
 class state
 {
     data_map_t data_;
@@ -47,8 +70,8 @@ class state
         data_map_t& data_;
 
       public:
-        state_proxy(const std::string& key, data_map_t& data)
-            : key_(key)
+        state_proxy(std::string key, data_map_t& data)
+            : key_(std::move(key))
             , data_(data)
         {
         }
@@ -68,7 +91,10 @@ class state
         template <typename T>
         state_proxy operator[](const T& key)
         {
-            return state_proxy(key_ + "/" + boost::lexical_cast<std::string>(key), data_);
+            auto path = key_;
+            path += '/';
+            detail::append_key(path, key);
+            return state_proxy(std::move(path), data_);
         }
 
         template <typename T>
@@ -86,8 +112,12 @@ class state
 
         state_proxy& operator=(const state& other)
         {
+            auto path = key_;
+            path += '/';
             for (auto& p : other) {
-                data_[key_ + "/" + p.first] = std::move(p.second);
+                path.resize(key_.size() + 1);
+                path += p.first;
+                data_[path] = p.second;
             }
             return *this;
         }
@@ -99,6 +129,7 @@ class state
         : data_(other.data_)
     {
     }
+    state(state&& other) = default;
     state(data_map_t data)
         : data_(std::move(data))
     {
@@ -108,11 +139,14 @@ class state
         data_ = other.data_;
         return *this;
     }
+    state& operator=(state&& other) = default;
 
     template <typename T>
     state_proxy operator[](const T& key)
     {
-        return state_proxy(boost::lexical_cast<std::string>(key), data_);
+        std::string path;
+        detail::append_key(path, key);
+        return state_proxy(std::move(path), data_);
     }
 
     data_map_t::const_iterator begin() const { return data_.begin(); }
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2013 Sveriges Television AB http://casparcg.com/
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "state_store.h"
+
+namespace caspar { namespace core { namespace monitor {
+
+std::uint64_t state_store::update(const std::string& prefix, const state& state)
+{
+    // The version only moves when something changed, so an unchanged state leaves consumers with nothing to send.
+    const auto next    = version_ + 1;
+    bool       changed = false;
+
+    generation_ += 1;
+
+    // The path is built in a reused buffer, so only keys that are new to the store allocate.
+    for (auto& p : state) {
+        path_.assign(prefix).append(1, '/').append(p.first);
+
+        auto it = entries_.find(path_);
+        if (it == entries_.end()) {
+            it      = entries_.emplace(path_, entry{p.second, next, generation_}).first;
+            changed = true;
+        } else if (it->second.value != p.second) {
+            it->second.value   = p.second;
+            it->second.version = next;
+            changed            = true;
+        }
+        it->second.generation = generation_;
+    }
+
+    path_.assign(prefix).append(1, '/');
+
+    auto it = entries_.lower_bound(path_);
+    while (it != entries_.end() && it->first.compare(0, path_.size(), path_) == 0) {
+        if (it->second.generation != generation_) {
+            it      = entries_.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+
+    if (changed) {
+        version_ = next;
+    }
+    return version_;
+}
+
+data_map_t state_store::changes_since(std::uint64_t version) const
+{
+    data_map_t result;
+    for (auto& p : entries_) {
+        if (p.second.version > version) {
+            result.emplace_hint(result.end(), p.first, p.second.value);
+        }
+    }
+    return result;
+}
+
+data_map_t state_store::snapshot() const
+{
+    data_map_t result;
+    result.reserve(entries_.size());
+    for (auto& p : entries_) {
+        result.emplace_hint(result.end(), p.first, p.second.value);
+    }
+    return result;
+}
+
+}}} // namespace caspar::core::monitor
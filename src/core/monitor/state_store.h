@@ -0,0 +1,64 @@
+/*
+ * Copyright 2013 Sveriges Television AB http://casparcg.com/
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "monitor.h"
+
+#include <boost/container/flat_map.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace core { namespace monitor {
+
+// Versioned store of monitor state, merged from several sources (e.g. channels) that each own a subtree. Every key is
+// allocated once and kept across updates, and each entry records the version it last changed in, so consumers can
+// pick up only what changed since they last looked.
+class state_store final
+{
+  public:
+    // Replaces the subtree below prefix with state and returns the current version, which only moves when a key was
+    // added, changed or removed. Keys that are unchanged keep their version and keys that are missing from state are
+    // removed.
+    std::uint64_t update(const std::string& prefix, const state& state);
+
+    // Keys that changed after the given version, with their current values.
+    data_map_t changes_since(std::uint64_t version) const;
+
+    // Every key with its current value.
+    data_map_t snapshot() const;
+
+    std::uint64_t version() const { return version_; }
+
+  private:
+    struct entry
+    {
+        vector_t      value;
+        std::uint64_t version    = 0;
+        std::uint64_t generation = 0;
+    };
+
+    boost::container::flat_map<std::string, entry> entries_;
+    std::uint64_t                                   version_    = 0;
+    std::uint64_t                                   generation_ = 0;
+    std::string                                     path_;
+};
+
+}}} // namespace caspar::core::monitor
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "preloader.h"
+
+#include <common/executor.h>
+#include <common/log.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <mutex>
+#include <sstream>
+
+namespace caspar { namespace core {
+
+struct producer_preloader::impl
+{
+    struct entry
+    {
+        std::wstring                                        key;
+        std::wstring                                        params;
+        std::shared_future<spl::shared_ptr<frame_producer>> producer;
+    };
+
+    const std::size_t  capacity_;
+    mutable std::mutex mutex_;
+    std::list<entry>   entries_;
+    std::uint64_t      hits_    = 0;
+    std::uint64_t      misses_  = 0;
+    std::uint64_t      evicted_ = 0;
+
+    // Opening files blocks, so preloading gets a thread of its own instead of a strand on the worker pool.
+    executor executor_{L"producer_preloader"};
+
+    explicit impl(std::size_t capacity)
+        : capacity_(capacity)
+    {
+    }
+
+    static std::wstring
+    key(int channel_index, const frame_producer_dependencies& dependencies, const std::wstring& params)
+    {
+        // The format has to match as well, since producers are created for it.
+        std::wostringstream str;
+        str << channel_index << L"|" << dependencies.format_desc.name << L"|" << params;
+        return str.str();
+    }
+
+    static std::wstring join(const std::vector<std::wstring>& params)
+    {
+        return boost::to_upper_copy(boost::join(params, L" "));
+    }
+
+    void preload(int                                channel_index,
+                 const frame_producer_dependencies& dependencies,
+                 const std::vector<std::wstring>&   params)
+    {
+        if (capacity_ == 0) {
+            return;
+        }
+
+        auto joined = join(params);
+        auto k      = key(channel_index, dependencies, joined);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry& e) { return e.key == k; });
+        if (it != entries_.end()) {
+            entries_.splice(entries_.end(), entries_, it);
+            return;
+        }
+
+        auto producer = executor_.begin_invoke([dependencies, params] {
+            return dependencies.producer_registry->create_producer(dependencies, params);
+        });
+        entries_.push_back(entry{std::move(k), std::move(joined), producer.share()});
+
+        while (entries_.size() > capacity_) {
+            CASPAR_LOG(debug) << L"[producer_preloader] Evicted " << entries_.front().params;
+            entries_.pop_front();
+            evicted_ += 1;
+        }
+    }
+
+    std::shared_ptr<frame_producer> take(int                                channel_index,
+                                         const frame_producer_dependencies& dependencies,
+                                         const std::vector<std::wstring>&   params)
+    {
+        std::shared_future<spl::shared_ptr<frame_producer>> producer;
+        {
+            auto k = key(channel_index, dependencies, join(params));
+
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry& e) { return e.key == k; });
+            if (it != entries_.end()) {
+                producer = std::move(it->producer);
+                entries_.erase(it);
+                hits_ += 1;
+            } else {
+                misses_ += 1;
+            }
+        }
+
+        if (!producer.valid()) {
+            return nullptr;
+        }
+
+        // Rethrows if preloading failed, e.g. file_not_found.
+        return producer.get();
+    }
+
+    boost::property_tree::wptree info() const
+    {
+        boost::property_tree::wptree info;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        info.add(L"capacity", capacity_);
+        info.add(L"hits", hits_);
+        info.add(L"misses", misses_);
+        info.add(L"evicted", evicted_);
+
+        for (auto& e : entries_) {
+            std::wstring state = L"loading";
+            if (e.producer.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                try {
+                    e.producer.get();
+                    state = L"ready";
+                } catch (...) {
+                    state = L"failed";
+                }
+            }
+
+            boost::property_tree::wptree entry_info;
+            entry_info.add(L"params", e.params);
+            entry_info.add(L"state", state);
+            info.add_child(L"producers.producer", entry_info);
+        }
+
+        return info;
+    }
+};
+
+producer_preloader::producer_preloader(std::size_t capacity)
+    : impl_(new impl(capacity))
+{
+}
+
+producer_preloader::~producer_preloader() {}
+
+void producer_preloader::preload(int                                channel_index,
+                                 const frame_producer_dependencies& dependencies,
+                                 const std::vector<std::wstring>&   params)
+{
+    impl_->preload(channel_index, dependencies, params);
+}
+
+std::shared_ptr<frame_producer> producer_preloader::take(int                                channel_index,
+                                                         const frame_producer_dependencies& dependencies,
+                                                         const std::vector<std::wstring>&   params)
+{
+    return impl_->take(channel_index, dependencies, params);
+}
+
+boost::property_tree::wptree producer_preloader::info() const { return impl_->info(); }
+
+}} // namespace caspar::core
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "frame_producer.h"
+
+#include <common/memory.h>
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// Creates producers ahead of time so that loading a clip doesn't wait for the file to be opened, probed and the first
+// frames to be decoded. Preloaded producers are kept per channel, format and parameters until they are taken or, once
+// more than capacity are preloaded, evicted oldest first. The capacity is a count, not an amount of memory: a preloaded
+// producer holds its open file, its decoder and the frames it has buffered, as much as when it plays.
+class producer_preloader final
+{
+  public:
+    explicit producer_preloader(std::size_t capacity);
+    ~producer_preloader();
+
+    producer_preloader(const producer_preloader&)            = delete;
+    producer_preloader& operator=(const producer_preloader&) = delete;
+
+    // Starts creating the producer in the background, does nothing if it is already preloaded.
+    void preload(int                                channel_index,
+                 const frame_producer_dependencies& dependencies,
+                 const std::vector<std::wstring>&   params);
+
+    // Takes the preloaded producer for the same channel and parameters, waiting for it if it is still being created.
+    // Returns nullptr when nothing matching was preloaded.
+    std::shared_ptr<frame_producer> take(int                                channel_index,
+                                         const frame_producer_dependencies& dependencies,
+                                         const std::vector<std::wstring>&   params);
+
+    boost::property_tree::wptree info() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
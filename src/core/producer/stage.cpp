@@ -55,7 +55,7 @@ struct stage::impl : public std::enable_shared_from_this<impl>
     mutable std::mutex      format_desc_mutex_;
     core::video_format_desc format_desc_;
 
-    executor   executor_{L"stage " + std::to_wstring(channel_index_)};
+    executor   executor_{L"stage " + std::to_wstring(channel_index_), task_priority::high};
     std::mutex lock_;
 
   private:
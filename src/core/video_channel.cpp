@@ -37,9 +37,14 @@
 #include <common/executor.h>
 #include <common/timer.h>
 
+#include <tbb/concurrent_queue.h>
+
 #include <core/diagnostics/call_context.h>
 #include <core/mixer/image/image_mixer.h>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -49,9 +54,25 @@ namespace caspar { namespace core {
 
 bool operator<(const route_id& a, const route_id& b) { return a.mode + (a.index << 2) < b.mode + (b.index << 2); }
 
+static std::atomic<std::uint64_t> g_scheduled_task_id{0};
+
 struct video_channel::impl final
 {
-    monitor::state state_;
+    // A frame travelling from the stage through the mixer to the output.
+    struct pipeline_frame
+    {
+        stage_frames   frames;
+        const_frame    mixed_frame;
+        const_frame    mixed_frame2;
+        caspar::timer  frame_timer;
+        monitor::state stage_state; // taken on the thread that owns the state, as it is not synchronized
+        monitor::state mixer_state;
+    };
+
+    using pipeline_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<pipeline_frame>>;
+
+    monitor::state     state_;
+    mutable std::mutex state_mutex_;
 
     const int index_;
 
@@ -66,15 +87,28 @@ struct video_channel::impl final
     caspar::core::mixer          mixer_;
     std::shared_ptr<core::stage> stage_;
 
-    uint64_t frame_counter_ = 0;
+    std::atomic<uint64_t> frame_counter_{0};
+
+    // Ordered by frame number and then by id, i.e. by the order the tasks were scheduled in.
+    using schedule_key_t = std::pair<std::uint64_t, std::uint64_t>;
+
+    std::map<schedule_key_t, std::pair<std::wstring, std::function<void()>>> schedule_;
+    mutable std::mutex                                                        schedule_mutex_;
 
     std::function<void(core::monitor::state)> tick_;
 
     std::map<route_id, std::weak_ptr<core::route>> routes_;
     std::mutex                                     routes_mutex_;
 
+    const int                          pipeline_latency_;
+    pipeline_queue_t                   mix_queue_;
+    pipeline_queue_t                   consume_queue_;
+    tbb::concurrent_bounded_queue<int> in_flight_;
+
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
+    std::thread       mix_thread_;
+    std::thread       consume_thread_;
 
     std::function<void(int, const layer_frame&)> routesCb = [&](int layer, const layer_frame& layer_frame) {
         std::lock_guard<std::mutex> lock(routes_mutex_);
@@ -101,91 +135,281 @@ struct video_channel::impl final
     impl(int                                       index,
          const core::video_format_desc&            format_desc,
          std::unique_ptr<image_mixer>              image_mixer,
-         std::function<void(core::monitor::state)> tick)
+         std::function<void(core::monitor::state)> tick,
+         int                                       pipeline_latency)
         : index_(index)
         , output_(graph_, format_desc, index)
         , image_mixer_(std::move(image_mixer))
         , mixer_(index, graph_, image_mixer_)
         , stage_(std::make_shared<core::stage>(index, graph_, format_desc))
         , tick_(std::move(tick))
+        , pipeline_latency_(std::max(0, pipeline_latency))
     {
         graph_->set_color("produce-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("mix-time", caspar::diagnostics::color(1.0f, 0.0f, 0.9f, 0.8f));
         graph_->set_color("consume-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
         graph_->set_color("frame-time", caspar::diagnostics::color(1.0f, 0.4f, 0.4f, 0.8f));
         graph_->set_color("osc-time", caspar::diagnostics::color(0.3f, 0.4f, 0.0f, 0.8f));
+        if (pipeline_latency_ > 0) {
+            graph_->set_color("mix-buffer", caspar::diagnostics::color(0.7f, 0.4f, 0.9f));
+            graph_->set_color("consume-buffer", caspar::diagnostics::color(0.9f, 0.7f, 0.4f));
+        }
         graph_->set_text(print());
         caspar::diagnostics::register_graph(graph_);
 
         CASPAR_LOG(info) << print() << " Successfully Initialized.";
 
-        thread_ = std::thread([=] {
-            set_thread_realtime_priority();
-            set_thread_name(L"channel-" + std::to_wstring(index_));
+        if (pipeline_latency_ == 0) {
+            thread_ = std::thread([=] {
+                set_thread_realtime_priority();
+                set_thread_name(L"channel-" + std::to_wstring(index_));
+
+                while (!abort_request_) {
+                    try {
+                        auto frame = produce();
+                        mix(*frame);
+                        consume(*frame);
+                    } catch (...) {
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                    }
+                }
+            });
+        } else {
+            // Each stage runs on its own thread so that frame N + 1 is produced while frame N is mixed and frame
+            // N - 1 is consumed. A frame takes a slot in in_flight_ before it is produced and frees it once it is
+            // consumed or dropped, so however the frames spread over the stages and queues, at most pipeline_latency_
+            // of them are ahead of the one being consumed, which is the latency added to the sequential tick. A
+            // nullptr is passed down the pipeline on shutdown, which lets the downstream stages drain whatever is
+            // queued, freeing the slot an upstream stage may be waiting for.
+            in_flight_.set_capacity(pipeline_latency_ + 1);
+
+            thread_ = std::thread([=] {
+                set_thread_realtime_priority();
+                set_thread_name(L"channel-" + std::to_wstring(index_));
+
+                while (!abort_request_) {
+                    in_flight_.push(0);
+                    try {
+                        mix_queue_.push(produce());
+                        graph_->set_value("mix-buffer",
+                                          static_cast<double>(mix_queue_.size() + 0.001) / (pipeline_latency_ + 1));
+                    } catch (...) {
+                        release_slot();
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                    }
+                }
+                mix_queue_.push(nullptr);
+            });
+
+            mix_thread_ = std::thread([=] {
+                set_thread_realtime_priority();
+                set_thread_name(L"channel-" + std::to_wstring(index_) + L"-mix");
+
+                while (true) {
+                    std::shared_ptr<pipeline_frame> frame;
+                    mix_queue_.pop(frame);
+                    if (!frame) {
+                        break;
+                    }
+                    try {
+                        mix(*frame);
+                        consume_queue_.push(std::move(frame));
+                        graph_->set_value(
+                            "consume-buffer",
+                            static_cast<double>(consume_queue_.size() + 0.001) / (pipeline_latency_ + 1));
+                    } catch (...) {
+                        release_slot();
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                    }
+                }
+                consume_queue_.push(nullptr);
+            });
+
+            consume_thread_ = std::thread([=] {
+                set_thread_realtime_priority();
+                set_thread_name(L"channel-" + std::to_wstring(index_) + L"-consume");
+
+                while (true) {
+                    std::shared_ptr<pipeline_frame> frame;
+                    consume_queue_.pop(frame);
+                    if (!frame) {
+                        break;
+                    }
+                    try {
+                        consume(*frame);
+                    } catch (...) {
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                    }
+                    release_slot();
+                }
+            });
+        }
+    }
+
+    void release_slot()
+    {
+        int slot;
+        in_flight_.pop(slot);
+    }
 
-            while (!abort_request_) {
-                try {
-                    graph_->set_text(print());
+    std::shared_ptr<pipeline_frame> produce()
+    {
+        graph_->set_text(print());
 
-                    frame_counter_ += 1;
+        const auto frame_number = ++frame_counter_;
 
-                    caspar::timer frame_timer;
+        run_scheduled(frame_number);
 
-                    // Determine all layers that need a frame from the background producer
-                    std::vector<int> background_routes = {};
-                    {
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
+        auto frame = std::make_shared<pipeline_frame>();
 
-                        for (auto& r : routes_) {
-                            // Ensure pointer is still valid
-                            if (!r.second.lock())
-                                continue;
+        // Determine all layers that need a frame from the background producer
+        std::vector<int> background_routes = {};
+        {
+            std::lock_guard<std::mutex> lock(routes_mutex_);
 
-                            if (r.first.mode != route_mode::foreground) {
-                                background_routes.push_back(r.first.index);
-                            }
-                        }
-                    }
+            for (auto& r : routes_) {
+                // Ensure pointer is still valid
+                if (!r.second.lock())
+                    continue;
 
-                    // Produce
-                    caspar::timer produce_timer;
-                    auto          stage_frames = (*stage_)(frame_counter_, background_routes, routesCb);
-                    graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.hz * 0.5);
-
-                    // Mix
-                    caspar::timer mix_timer;
-                    auto mixed_frame = mixer_(stage_frames.frames, stage_frames.format_desc, stage_frames.nb_samples);
-                    auto mixed_frame2 =
-                        stage_frames.format_desc.field_count == 2
-                            ? mixer_(stage_frames.frames2, stage_frames.format_desc, stage_frames.nb_samples)
-                            : const_frame{};
-                    graph_->set_value("mix-time", mix_timer.elapsed() * format_desc.hz * 0.5);
-
-                    // Consume
-                    caspar::timer consume_timer;
-                    output_(mixed_frame, mixed_frame2, stage_frames.format_desc);
-                    graph_->set_value("consume-time", consume_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
-
-                    graph_->set_value("frame-time", frame_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
-
-                    monitor::state state = {};
-                    state["stage"]       = stage_->state();
-                    state["mixer"]       = mixer_.state();
-                    state["output"]      = output_.state();
-                    state["framerate"]   = {stage_frames.format_desc.framerate.numerator() *
-                                                stage_frames.format_desc.field_count,
-                                            stage_frames.format_desc.framerate.denominator()};
-                    state["format"]      = stage_frames.format_desc.name;
-                    state_               = state;
-
-                    caspar::timer osc_timer;
-                    tick_(state_);
-                    graph_->set_value("osc-time", osc_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
-                } catch (...) {
-                    CASPAR_LOG_CURRENT_EXCEPTION();
+                if (r.first.mode != route_mode::foreground) {
+                    background_routes.push_back(r.first.index);
+                }
+            }
+        }
+
+        caspar::timer produce_timer;
+        frame->frames = (*stage_)(frame_number, background_routes, routesCb);
+        graph_->set_value("produce-time", produce_timer.elapsed() * frame->frames.format_desc.hz * 0.5);
+
+        frame->stage_state = stage_->state();
+
+        return frame;
+    }
+
+    void run_scheduled(std::uint64_t frame_number)
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::lock_guard<std::mutex> lock(schedule_mutex_);
+
+                auto it = schedule_.begin();
+                if (it == schedule_.end() || it->first.first > frame_number) {
+                    break;
+                }
+                if (it->first.first < frame_number) {
+                    CASPAR_LOG(warning) << print() << L" Scheduled task " << it->first.second << L" ("
+                                        << it->second.first << L") was due at frame " << it->first.first
+                                        << L", running it at frame " << frame_number << L".";
                 }
+                task = std::move(it->second.second);
+                schedule_.erase(it);
             }
-        });
+
+            try {
+                task();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    std::uint64_t schedule(std::uint64_t frame_number, std::function<void()> task, std::wstring name)
+    {
+        const auto id = ++g_scheduled_task_id;
+
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+        schedule_.emplace(schedule_key_t(frame_number, id), std::make_pair(std::move(name), std::move(task)));
+
+        return id;
+    }
+
+    bool unschedule(std::uint64_t id)
+    {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(schedule_mutex_);
+
+            auto it = std::find_if(
+                schedule_.begin(), schedule_.end(), [&](const auto& entry) { return entry.first.second == id; });
+            if (it == schedule_.end()) {
+                return false;
+            }
+            task = std::move(it->second.second);
+            schedule_.erase(it);
+        }
+
+        // The task is destroyed outside the lock, as it may hold resources that take a while to release.
+        return true;
+    }
+
+    void clear_schedule()
+    {
+        decltype(schedule_) schedule;
+        {
+            std::lock_guard<std::mutex> lock(schedule_mutex_);
+            schedule_.swap(schedule);
+        }
+    }
+
+    std::vector<scheduled_task> scheduled() const
+    {
+        std::lock_guard<std::mutex> lock(schedule_mutex_);
+
+        std::vector<scheduled_task> result;
+        for (auto& entry : schedule_) {
+            result.push_back(scheduled_task{entry.first.second, entry.first.first, entry.second.first});
+        }
+        return result;
+    }
+
+    void mix(pipeline_frame& frame)
+    {
+        const auto& stage_frames = frame.frames;
+
+        caspar::timer mix_timer;
+        frame.mixed_frame  = mixer_(stage_frames.frames, stage_frames.format_desc, stage_frames.nb_samples);
+        frame.mixed_frame2 = stage_frames.format_desc.field_count == 2
+                                 ? mixer_(stage_frames.frames2, stage_frames.format_desc, stage_frames.nb_samples)
+                                 : const_frame{};
+        graph_->set_value("mix-time", mix_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
+
+        frame.mixer_state = mixer_.state();
+    }
+
+    void consume(pipeline_frame& frame)
+    {
+        const auto& stage_frames = frame.frames;
+
+        caspar::timer consume_timer;
+        output_(frame.mixed_frame, frame.mixed_frame2, stage_frames.format_desc);
+        graph_->set_value("consume-time", consume_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
+
+        // In pipelined mode this includes the time spent queued between the stages, i.e. the channel latency.
+        graph_->set_value("frame-time", frame.frame_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
+
+        monitor::state state = {};
+        state["stage"]       = std::move(frame.stage_state);
+        state["mixer"]       = std::move(frame.mixer_state);
+        state["output"]      = output_.state();
+        state["framerate"]   = {stage_frames.format_desc.framerate.numerator() * stage_frames.format_desc.field_count,
+                                stage_frames.format_desc.framerate.denominator()};
+        state["format"]      = stage_frames.format_desc.name;
+
+        caspar::timer osc_timer;
+        tick_(state);
+        graph_->set_value("osc-time", osc_timer.elapsed() * stage_frames.format_desc.hz * 0.5);
+
+        // Only the buffers are exchanged under the lock, the previous state is released after it.
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        std::swap(state_, state);
+    }
+
+    monitor::state state() const
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
     }
 
     ~impl()
@@ -193,6 +417,13 @@ struct video_channel::impl final
         CASPAR_LOG(info) << print() << " Uninitializing.";
         abort_request_ = true;
         thread_.join();
+        if (mix_thread_.joinable()) {
+            mix_thread_.join();
+        }
+        if (consume_thread_.joinable()) {
+            consume_thread_.join();
+        }
+        clear_schedule();
     }
 
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground)
@@ -233,8 +464,9 @@ struct video_channel::impl final
 video_channel::video_channel(int                                       index,
                              const core::video_format_desc&            format_desc,
                              std::unique_ptr<image_mixer>              image_mixer,
-                             std::function<void(core::monitor::state)> tick)
-    : impl_(new impl(index, format_desc, std::move(image_mixer), std::move(tick)))
+                             std::function<void(core::monitor::state)> tick,
+                             int                                       pipeline_latency)
+    : impl_(new impl(index, format_desc, std::move(image_mixer), std::move(tick), pipeline_latency))
 {
 }
 video_channel::~video_channel() {}
@@ -246,8 +478,17 @@ const output&                       video_channel::output() const { return impl_
 output&                             video_channel::output() { return impl_->output_; }
 spl::shared_ptr<frame_factory>      video_channel::frame_factory() { return impl_->image_mixer_; }
 int                                 video_channel::index() const { return impl_->index(); }
-core::monitor::state                video_channel::state() const { return impl_->state_; }
+core::monitor::state                video_channel::state() const { return impl_->state(); }
 
 std::shared_ptr<route> video_channel::route(int index, route_mode mode) { return impl_->route(index, mode); }
 
+std::uint64_t video_channel::frame_number() const { return impl_->frame_counter_ + 1; }
+std::uint64_t video_channel::schedule(std::uint64_t frame_number, std::function<void()> task, std::wstring name)
+{
+    return impl_->schedule(frame_number, std::move(task), std::move(name));
+}
+bool                        video_channel::unschedule(std::uint64_t id) { return impl_->unschedule(id); }
+void                        video_channel::clear_schedule() { impl_->clear_schedule(); }
+std::vector<scheduled_task> video_channel::scheduled() const { return impl_->scheduled(); }
+
 }} // namespace caspar::core
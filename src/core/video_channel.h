@@ -30,7 +30,10 @@
 
 #include <boost/signals2.hpp>
 
+#include <cstdint>
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -63,6 +66,13 @@ struct route
     std::wstring                                                      name;
 };
 
+struct scheduled_task
+{
+    std::uint64_t id;
+    std::uint64_t frame_number;
+    std::wstring  name;
+};
+
 class video_channel final
 {
     video_channel(const video_channel&);
@@ -72,7 +82,8 @@ class video_channel final
     explicit video_channel(int                                       index,
                            const video_format_desc&                  format_desc,
                            std::unique_ptr<image_mixer>              image_mixer,
-                           std::function<void(core::monitor::state)> on_tick);
+                           std::function<void(core::monitor::state)> on_tick,
+                           int                                       pipeline_latency = 0);
     ~video_channel();
 
     core::monitor::state state() const;
@@ -90,6 +101,23 @@ class video_channel final
 
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground);
 
+    // Number of the next frame the channel produces.
+    std::uint64_t frame_number() const;
+
+    // Runs task on the channel thread right before the frame numbered frame_number is produced, or before the next
+    // frame if that one has passed. Tasks due at the same frame run in the order they were scheduled. Returns an id,
+    // unique within the process, that can be passed to unschedule.
+    std::uint64_t schedule(std::uint64_t frame_number, std::function<void()> task, std::wstring name = L"");
+
+    // Drops a task that has not run yet. Returns false if there is no such task.
+    bool unschedule(std::uint64_t id);
+
+    // Drops every task that has not run yet.
+    void clear_schedule();
+
+    // Pending tasks, in the order they will run.
+    std::vector<scheduled_task> scheduled() const;
+
   private:
     struct impl;
     spl::unique_ptr<impl> impl_;
@@ -21,10 +21,13 @@
 
 #include "artnet_consumer.h"
 
+#include "../util/dmx_packet.h"
+
 #undef NOMINMAX
 // ^^ This is needed to avoid a conflict between boost asio and other header files defining NOMINMAX
 
 #include <common/array.h>
+#include <common/executor.h>
 #include <common/future.h>
 #include <common/log.h>
 #include <common/ptree.h>
@@ -39,8 +42,10 @@
 #include <boost/locale/encoding_utf.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <array>
+#include <atomic>
 #include <cmath>
-#include <thread>
+#include <map>
 #include <utility>
 #include <vector>
 
@@ -51,15 +56,27 @@ namespace caspar { namespace artnet {
 
 struct configuration
 {
+    dmx_protocol   protocol = dmx_protocol::artnet;
     int            universe = 0;
-    std::wstring   host     = L"127.0.0.1";
+    std::wstring   host     = L"127.0.0.1"; // empty to multicast each sACN universe to its own group
     unsigned short port     = 6454;
 
+    int          priority    = 100; // sACN only
+    std::wstring source_name = L"CasparCG";
+
     int refreshRate = 10;
 
     std::vector<fixture> fixtures;
 };
 
+struct universe_output
+{
+    int                                         universe;
+    std::array<std::uint8_t, dmx_universe_size> data{};
+    std::uint8_t                                sequence = 0;
+    udp::endpoint                               endpoint;
+};
+
 struct artnet_consumer : public core::frame_consumer
 {
     const configuration           config;
@@ -75,84 +92,63 @@ struct artnet_consumer : public core::frame_consumer
     {
         socket.open(udp::v4());
 
-        std::string host_ = u8(this->config.host);
-        remote_endpoint =
-            boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(host_), this->config.port);
-
         compute_fixtures();
-    }
 
-    void initialize(const core::video_format_desc& /*format_desc*/, int /*channel_index*/) override
-    {
-        thread_ = std::thread([this] {
-            long long time      = 1000 / config.refreshRate;
-            auto      last_send = std::chrono::system_clock::now();
-
-            while (!abort_request_) {
-                try {
-                    auto                          now             = std::chrono::system_clock::now();
-                    std::chrono::duration<double> elapsed_seconds = now - last_send;
-                    long long                     elapsed_ms =
-                        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_seconds).count();
-
-                    long long sleep_time = time - elapsed_ms * 1000;
-                    if (sleep_time > 0)
-                        std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time));
-
-                    last_send = now;
-
-                    frame_mutex_.lock();
-                    auto frame = last_frame_;
-
-                    frame_mutex_.unlock();
-                    if (!frame)
-                        continue; // No frame available
-
-                    uint8_t dmx_data[512];
-                    memset(dmx_data, 0, 512);
-
-                    for (auto computed_fixture : computed_fixtures) {
-                        auto     color = average_color(frame, computed_fixture.rectangle);
-                        uint8_t* ptr   = dmx_data + computed_fixture.address;
-
-                        switch (computed_fixture.type) {
-                            case FixtureType::DIMMER:
-                                ptr[0] = (uint8_t)(0.279 * color.r + 0.547 * color.g + 0.106 * color.b);
-                                break;
-                            case FixtureType::RGB:
-                                ptr[0] = color.r;
-                                ptr[1] = color.g;
-                                ptr[2] = color.b;
-                                break;
-                            case FixtureType::RGBW:
-                                uint8_t w = std::min(std::min(color.r, color.g), color.b);
-                                ptr[0]    = color.r - w;
-                                ptr[1]    = color.g - w;
-                                ptr[2]    = color.b - w;
-                                ptr[3]    = w;
-                                break;
-                        }
-                    }
-
-                    send_dmx_data(dmx_data, 512);
-                } catch (...) {
-                    CASPAR_LOG_CURRENT_EXCEPTION();
-                }
+        source_.cid      = make_sacn_cid();
+        source_.name     = u8(this->config.source_name);
+        source_.priority = static_cast<std::uint8_t>(this->config.priority);
+
+        for (auto& output : universes_) {
+            if (this->config.protocol == dmx_protocol::artnet && output.universe > artnet_max_universe)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Art-Net universes go up to " +
+                                                                std::to_wstring(artnet_max_universe)));
+            if (this->config.protocol == dmx_protocol::sacn &&
+                (output.universe < sacn_min_universe || output.universe > sacn_max_universe))
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"sACN universes go from " +
+                                                                std::to_wstring(sacn_min_universe) + L" to " +
+                                                                std::to_wstring(sacn_max_universe)));
+
+            if (this->config.host.empty()) {
+                // E1.31 multicast group of the universe, 239.255.<high byte>.<low byte>.
+                address_v4::bytes_type group{
+                    {239, 255, static_cast<std::uint8_t>(output.universe >> 8),
+                     static_cast<std::uint8_t>(output.universe & 0xff)}};
+                output.endpoint = udp::endpoint(address_v4(group), this->config.port);
+            } else {
+                output.endpoint = udp::endpoint(address::from_string(u8(this->config.host)), this->config.port);
             }
-        });
+        }
     }
 
-    ~artnet_consumer()
+    void initialize(const core::video_format_desc& format_desc, int /*channel_index*/) override
     {
-        abort_request_ = true;
-        if (thread_.joinable())
-            thread_.join();
+        fps_   = format_desc.fps;
+        phase_ = fps_;
     }
 
+    ~artnet_consumer() { executor_.stop_and_wait(); }
+
     std::future<bool> send(core::video_field field, core::const_frame frame) override
     {
-        std::lock_guard<std::mutex> lock(frame_mutex_);
-        last_frame_ = frame;
+        // Sends are paced by the channel clock rather than a timer. Every field or frame moves the phase on by the
+        // refresh rate, and a send is due each time it passes the channel rate, which spreads the sends evenly.
+        phase_ += config.refreshRate;
+        if (phase_ < fps_ || !frame)
+            return make_ready_future(true);
+        phase_ = std::fmod(phase_, fps_);
+
+        // Skip a send rather than queue it when the previous one is still in progress.
+        if (sending_.exchange(true))
+            return make_ready_future(true);
+
+        executor_.begin_invoke([this, frame] {
+            try {
+                send_frame(frame);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            sending_ = false;
+        });
 
         return make_ready_future(true);
     }
@@ -168,7 +164,9 @@ struct artnet_consumer : public core::frame_consumer
         core::monitor::state state;
         state["artnet/computed-fixtures"] = computed_fixtures.size();
         state["artnet/fixtures"]          = config.fixtures.size();
+        state["artnet/protocol"]          = config.protocol == dmx_protocol::sacn ? "sacn" : "artnet";
         state["artnet/universe"]          = config.universe;
+        state["artnet/universes"]         = universes_.size();
         state["artnet/host"]              = config.host;
         state["artnet/port"]              = config.port;
         state["artnet/refresh-rate"]      = config.refreshRate;
@@ -177,60 +175,107 @@ struct artnet_consumer : public core::frame_consumer
     }
 
   private:
-    core::const_frame last_frame_;
-    std::mutex        frame_mutex_;
+    std::vector<universe_output> universes_;
+    sacn_source                  source_;
+    summed_area_table            sums_;
 
-    std::thread       thread_;
-    std::atomic<bool> abort_request_{false};
+    double            fps_   = 0.0;
+    double            phase_ = 0.0;
+    std::atomic<bool> sending_{false};
 
-    io_service    io_service_;
-    udp::socket   socket;
-    udp::endpoint remote_endpoint;
+    io_service  io_service_;
+    udp::socket socket;
+
+    executor executor_{L"artnet_consumer"};
 
     void compute_fixtures()
     {
+        // Universes are numbered from the one of the consumer. A chain of fixtures that does not fit the rest of a
+        // universe continues at the start of the next one.
+        std::map<int, std::size_t> universe_index;
+
         computed_fixtures.clear();
         for (auto fixture : config.fixtures) {
+            int universe = config.universe + fixture.universe;
+            int address  = fixture.startAddress;
+
             for (int i = 0; i < fixture.fixtureCount; i++) {
+                if (address + fixture.fixtureChannels > dmx_universe_size) {
+                    universe++;
+                    address = 0;
+                }
+
+                auto it = universe_index.emplace(universe, universe_index.size()).first;
+
                 computed_fixture computed_fixture{};
-                computed_fixture.type    = fixture.type;
-                computed_fixture.address = fixture.startAddress + i * fixture.fixtureChannels;
+                computed_fixture.type     = fixture.type;
+                computed_fixture.universe = static_cast<int>(it->second);
+                computed_fixture.address  = static_cast<unsigned short>(address);
 
                 computed_fixture.rectangle = compute_rect(fixture.fixtureBox, i, fixture.fixtureCount);
                 computed_fixtures.push_back(computed_fixture);
+
+                address += fixture.fixtureChannels;
             }
         }
+
+        universes_.resize(universe_index.size());
+        for (auto& [universe, index] : universe_index)
+            universes_[index].universe = universe;
     }
 
-    void send_dmx_data(const std::uint8_t* data, std::size_t length)
+    void send_frame(const core::const_frame& frame)
     {
-        int universe = this->config.universe;
-
-        std::uint8_t hUni = (universe >> 8) & 0xff;
-        std::uint8_t lUni = universe & 0xff;
-
-        std::uint8_t hLen = (length >> 8) & 0xff;
-        std::uint8_t lLen = (length & 0xff);
-
-        std::uint8_t header[] = {65, 114, 116, 45, 78, 101, 116, 0, 0, 80, 0, 14, 0, 0, lUni, hUni, hLen, lLen};
-        std::uint8_t buffer[18 + 512];
-
-        for (int i = 0; i < 18 + 512; i++) {
-            if (i < 18) {
-                buffer[i] = header[i];
-                continue;
+        sums_.update(frame);
+
+        for (auto& output : universes_)
+            output.data.fill(0);
+
+        for (auto& computed_fixture : computed_fixtures) {
+            auto     color = sums_.average_color(computed_fixture.rectangle);
+            uint8_t* ptr   = universes_[computed_fixture.universe].data.data() + computed_fixture.address;
+
+            switch (computed_fixture.type) {
+                case FixtureType::DIMMER:
+                    ptr[0] = (uint8_t)(0.279 * color.r + 0.547 * color.g + 0.106 * color.b);
+                    break;
+                case FixtureType::RGB:
+                    ptr[0] = color.r;
+                    ptr[1] = color.g;
+                    ptr[2] = color.b;
+                    break;
+                case FixtureType::RGBW:
+                    uint8_t w = std::min(std::min(color.r, color.g), color.b);
+                    ptr[0]    = color.r - w;
+                    ptr[1]    = color.g - w;
+                    ptr[2]    = color.b - w;
+                    ptr[3]    = w;
+                    break;
             }
+        }
 
-            if (i - 18 < length) {
-                buffer[i] = data[i - 18];
-                continue;
-            }
+        for (auto& output : universes_)
+            send_dmx_data(output);
+    }
+
+    void send_dmx_data(universe_output& output)
+    {
+        std::array<std::uint8_t, sacn_packet_size> buffer;
+        std::size_t                                length;
 
-            buffer[i] = 0;
+        if (config.protocol == dmx_protocol::sacn) {
+            output.sequence++;
+            write_sacn_packet(buffer.data(), source_, output.universe, output.sequence, output.data.data());
+            length = sacn_packet_size;
+        } else {
+            // Art-Net reserves sequence 0 for senders that do not number their packets.
+            output.sequence = output.sequence == 255 ? 1 : output.sequence + 1;
+            write_artnet_packet(buffer.data(), output.universe, output.sequence, output.data.data());
+            length = artnet_packet_size;
         }
 
         boost::system::error_code err;
-        socket.send_to(boost::asio::buffer(buffer), remote_endpoint, 0, err);
+        socket.send_to(boost::asio::buffer(buffer.data(), length), output.endpoint, 0, err);
         if (err)
             CASPAR_THROW_EXCEPTION(io_error() << msg_info(err.message()));
     }
@@ -251,8 +296,17 @@ std::vector<fixture> get_fixtures_ptree(const boost::property_tree::wptree& ptre
         if (startAddress < 1)
             CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Fixture start address must be specified"));
 
+        if (startAddress > dmx_universe_size)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Fixture start address must be at most 512"));
+
         f.startAddress = startAddress - 1;
 
+        int universe = xml_channel.second.get(L"universe", 0);
+        if (universe < 0)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Fixture universe must not be negative"));
+
+        f.universe = universe;
+
         int fixtureCount = xml_channel.second.get(L"fixture-count", -1);
         if (fixtureCount < 1)
             CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Fixture count must be specified"));
@@ -280,6 +334,8 @@ std::vector<fixture> get_fixtures_ptree(const boost::property_tree::wptree& ptre
             CASPAR_THROW_EXCEPTION(
                 user_error() << msg_info(
                     L"Fixture channel count must be at least enough channels for current color mode"));
+        if (fixtureChannels > dmx_universe_size)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Fixture channel count must be at most 512"));
 
         f.fixtureChannels = fixtureChannels;
 
@@ -319,11 +375,35 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
     if (depth != common::bit_depth::bit8)
         CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Artnet consumer only supports 8-bit color depth."));
 
+    auto protocol = ptree.get(L"protocol", L"artnet");
+    if (boost::iequals(protocol, L"artnet")) {
+        config.protocol = dmx_protocol::artnet;
+    } else if (boost::iequals(protocol, L"sacn")) {
+        config.protocol = dmx_protocol::sacn;
+        config.universe = sacn_min_universe;
+        config.host     = L"";
+        config.port     = 5568;
+    } else {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown protocol, expected artnet or sacn"));
+    }
+
     config.universe    = ptree.get(L"universe", config.universe);
     config.host        = ptree.get(L"host", config.host);
     config.port        = ptree.get(L"port", config.port);
     config.refreshRate = ptree.get(L"refresh-rate", config.refreshRate);
 
+    config.priority    = ptree.get(L"priority", config.priority);
+    config.source_name = ptree.get(L"source-name", config.source_name);
+
+    if (config.universe < 0)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Universe must not be negative"));
+
+    if (config.host.empty() && config.protocol != dmx_protocol::sacn)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Host must be specified for Art-Net"));
+
+    if (config.priority < 0 || config.priority > 200)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"sACN priority must be between 0 and 200"));
+
     if (config.refreshRate < 1)
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Refresh rate must be at least 1"));
 
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that fixtures sampled from the summed area table get the same colour as the per pixel scan the consumer used
+// before, for rotated fixtures and for fixtures partly or wholly outside the frame, and that unrotated fixtures get the
+// average of their box. Run with --benchmark to time building the table and sampling 10k fixtures on a 1080p frame,
+// against the scan.
+
+#include "../util/fixture_calculation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace artnet { namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+struct image
+{
+    int                       width;
+    int                       height;
+    std::vector<std::uint8_t> bgra;
+};
+
+image make_image(int width, int height, unsigned seed)
+{
+    std::mt19937                       random(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    image result{width, height, std::vector<std::uint8_t>(static_cast<std::size_t>(width) * height * 4)};
+    for (auto& b : result.bgra)
+        b = static_cast<std::uint8_t>(byte(random));
+    return result;
+}
+
+// The per pixel scan the consumer sampled each fixture with before the summed area table, over the same spans.
+color scan_average(const image& img, const rect& rectangle)
+{
+    const int width  = img.width;
+    const int height = img.height;
+
+    float x_values[] = {rectangle.p1.x, rectangle.p2.x, rectangle.p3.x, rectangle.p4.x};
+    float y_values[] = {rectangle.p1.y, rectangle.p2.y, rectangle.p3.y, rectangle.p4.y};
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 3; j > i; j--) {
+            if (y_values[j] < y_values[j - 1] || (y_values[j] == y_values[j - 1] && x_values[j] < x_values[j - 1])) {
+                std::swap(x_values[j], x_values[j - 1]);
+                std::swap(y_values[j], y_values[j - 1]);
+            }
+        }
+    }
+
+    const int indices[3][4] = {{0, 1, 0, 2}, {0, 2, 1, 3}, {1, 3, 2, 3}};
+
+    const int y_min = std::max(0, std::min(height - 1, (int)y_values[0]));
+    const int y_max = std::max(0, std::min(height - 1, (int)y_values[3]));
+
+    unsigned long long tr = 0;
+    unsigned long long tg = 0;
+    unsigned long long tb = 0;
+
+    unsigned long long count = 0;
+
+    for (int y = y_min; y <= y_max; y++) {
+        int index = 0;
+        if (y >= (int)y_values[1])
+            index = 1;
+        if (y >= (int)y_values[2])
+            index = 2;
+
+        const int* l  = indices[index];
+        const auto at = [&](int a, int b) {
+            const float d = (x_values[b] - x_values[a]) / (y_values[b] - y_values[a]);
+            return std::max(0, std::min(width - 1, (int)(x_values[a] + ((float)y - y_values[a]) * d)));
+        };
+
+        const int x1 = at(l[0], l[1]);
+        const int x2 = at(l[2], l[3]);
+
+        for (int x = std::min(x1, x2); x <= std::max(x1, x2); x++) {
+            const std::uint8_t* p = img.bgra.data() + (static_cast<std::size_t>(y) * width + x) * 4;
+
+            const float a = (float)p[3] / 255.0f;
+
+            tr += (unsigned long long)((float)p[2] * a);
+            tg += (unsigned long long)((float)p[1] * a);
+            tb += (unsigned long long)((float)p[0] * a);
+
+            count++;
+        }
+    }
+
+    return color{(std::uint8_t)(tr / count), (std::uint8_t)(tg / count), (std::uint8_t)(tb / count)};
+}
+
+// The average of the pixels of an axis aligned box, clamped to the image.
+color box_average(const image& img, int x1, int y1, int x2, int y2)
+{
+    x1 = std::max(0, std::min(img.width - 1, x1));
+    x2 = std::max(0, std::min(img.width - 1, x2));
+    y1 = std::max(0, std::min(img.height - 1, y1));
+    y2 = std::max(0, std::min(img.height - 1, y2));
+
+    unsigned long long total[3] = {};
+    unsigned long long count    = 0;
+    for (int y = y1; y <= y2; y++) {
+        for (int x = x1; x <= x2; x++) {
+            const std::uint8_t* p = img.bgra.data() + (static_cast<std::size_t>(y) * img.width + x) * 4;
+            const float         a = (float)p[3] / 255.0f;
+            for (int c = 0; c < 3; c++)
+                total[c] += (unsigned long long)((float)p[c] * a);
+            count++;
+        }
+    }
+
+    return color{(std::uint8_t)(total[2] / count), (std::uint8_t)(total[1] / count), (std::uint8_t)(total[0] / count)};
+}
+
+bool operator==(const color& a, const color& b) { return a.r == b.r && a.g == b.g && a.b == b.b; }
+
+// Boxes across the frame and a little beyond it. Rotations that are a multiple of 90 degrees are left to the unrotated
+// test, as the old scan took a whole frame line for them.
+std::vector<box> random_boxes(int width, int height, int count, bool rotated, unsigned seed)
+{
+    std::mt19937                          random(seed);
+    std::uniform_real_distribution<float> x(-50.0f, (float)width + 50.0f);
+    std::uniform_real_distribution<float> y(-50.0f, (float)height + 50.0f);
+    std::uniform_real_distribution<float> size(1.0f, 200.0f);
+    std::uniform_real_distribution<float> rotation(0.0f, 360.0f);
+
+    std::vector<box> boxes;
+    while (static_cast<int>(boxes.size()) < count) {
+        box b{x(random), y(random), size(random), size(random), rotated ? rotation(random) : 0.0f};
+        if (rotated && std::fmod(b.rotation, 90.0f) < 0.5f)
+            continue;
+        boxes.push_back(b);
+    }
+    return boxes;
+}
+
+void test_rotated()
+{
+    const auto img = make_image(320, 180, 1);
+
+    summed_area_table sums;
+    sums.update(img.bgra.data(), img.width, img.height);
+
+    int mismatches = 0;
+    for (const auto& b : random_boxes(img.width, img.height, 2000, true, 2)) {
+        for (int i = 0; i < 3; i++) {
+            const auto rectangle = compute_rect(b, i, 3);
+            if (!(sums.average_color(rectangle) == scan_average(img, rectangle)))
+                mismatches++;
+        }
+    }
+    check(mismatches == 0, std::to_string(mismatches) + " rotated fixtures differ from the scan");
+}
+
+void test_unrotated()
+{
+    const auto img = make_image(320, 180, 3);
+
+    summed_area_table sums;
+    sums.update(img.bgra.data(), img.width, img.height);
+
+    int mismatches = 0;
+    for (const auto& b : random_boxes(img.width, img.height, 2000, false, 4)) {
+        const auto rectangle = compute_rect(b, 0, 1);
+        const auto expected  = box_average(img,
+                                          (int)std::min(rectangle.p1.x, rectangle.p2.x),
+                                          (int)std::min(rectangle.p1.y, rectangle.p4.y),
+                                          (int)std::max(rectangle.p1.x, rectangle.p2.x),
+                                          (int)std::max(rectangle.p1.y, rectangle.p4.y));
+        if (!(sums.average_color(rectangle) == expected))
+            mismatches++;
+    }
+    check(mismatches == 0, std::to_string(mismatches) + " unrotated fixtures differ from their box");
+
+    // A whole 4K frame of white does not overflow the sums.
+    image white{3840, 2160, std::vector<std::uint8_t>(3840 * 2160 * 4, 255)};
+    sums.update(white.bgra.data(), white.width, white.height);
+    const auto c = sums.average_color(compute_rect(box{1920.0f, 1080.0f, 3840.0f, 2160.0f, 0.0f}, 0, 1));
+    check(c == color{255, 255, 255}, "whole 4K frame");
+
+    summed_area_table empty;
+    check(empty.average_color(compute_rect(box{0.0f, 0.0f, 10.0f, 10.0f, 0.0f}, 0, 1)) == color{0, 0, 0},
+          "no frame yet");
+}
+
+void benchmark()
+{
+    const auto img = make_image(1920, 1080, 5);
+
+    // 100 chains of 100 fixtures, half of them rotated.
+    std::vector<rect> rectangles;
+    auto              boxes = random_boxes(img.width, img.height, 50, false, 6);
+    for (const auto& b : random_boxes(img.width, img.height, 50, true, 7))
+        boxes.push_back(b);
+    for (auto b : boxes) {
+        b.width *= 4.0f;
+        for (int i = 0; i < 100; i++)
+            rectangles.push_back(compute_rect(b, i, 100));
+    }
+
+    const int frames = 20;
+
+    summed_area_table sums;
+    volatile unsigned sink = 0; // keeps the sampling from being optimized away
+
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int n = 0; n < frames; n++)
+        sums.update(img.bgra.data(), img.width, img.height);
+    const auto t1 = std::chrono::steady_clock::now();
+    for (int n = 0; n < frames; n++)
+        for (const auto& rectangle : rectangles)
+            sink = sink + sums.average_color(rectangle).r;
+    const auto t2 = std::chrono::steady_clock::now();
+    for (const auto& rectangle : rectangles)
+        sink = sink + scan_average(img, rectangle).r;
+    const auto t3 = std::chrono::steady_clock::now();
+
+    const auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+    std::cout << rectangles.size() << " fixtures on a " << img.width << "x" << img.height << " frame" << std::endl;
+    std::cout << "summed area table: " << ms(t1 - t0) / frames << " ms per frame" << std::endl;
+    std::cout << "sampling:          " << ms(t2 - t1) / frames << " ms per frame" << std::endl;
+    std::cout << "per pixel scan:    " << ms(t3 - t2) << " ms per frame" << std::endl;
+}
+
+}}} // namespace caspar::artnet
+
+int main(int argc, char** argv)
+{
+    using namespace caspar::artnet;
+
+    if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+        benchmark();
+        return 0;
+    }
+
+    test_rotated();
+    test_unrotated();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dmx_packet.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace caspar { namespace artnet {
+
+namespace {
+
+void put16(std::uint8_t* ptr, int value)
+{
+    ptr[0] = static_cast<std::uint8_t>((value >> 8) & 0xff);
+    ptr[1] = static_cast<std::uint8_t>(value & 0xff);
+}
+
+void put32(std::uint8_t* ptr, std::uint32_t value)
+{
+    put16(ptr, static_cast<int>(value >> 16));
+    put16(ptr + 2, static_cast<int>(value & 0xffff));
+}
+
+// PDU flags and length, counted from the start of the PDU to the end of the packet.
+void put_pdu_length(std::uint8_t* ptr, std::size_t offset)
+{
+    put16(ptr + offset, 0x7000 | static_cast<int>(sacn_packet_size - offset));
+}
+
+} // namespace
+
+std::array<std::uint8_t, 16> make_sacn_cid()
+{
+    std::random_device                      device;
+    std::uniform_int_distribution<unsigned> distribution(0, 255);
+    std::array<std::uint8_t, 16>            cid{};
+    for (auto& byte : cid) {
+        byte = static_cast<std::uint8_t>(distribution(device));
+    }
+    cid[6] = static_cast<std::uint8_t>((cid[6] & 0x0f) | 0x40);
+    cid[8] = static_cast<std::uint8_t>((cid[8] & 0x3f) | 0x80);
+    return cid;
+}
+
+void write_artnet_packet(std::uint8_t* packet, int universe, std::uint8_t sequence, const std::uint8_t* data)
+{
+    static const std::uint8_t id[] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+
+    std::memcpy(packet, id, sizeof(id));
+    packet[8]  = 0x00; // OpDmx, little endian
+    packet[9]  = 0x50;
+    packet[10] = 0; // protocol version 14, big endian
+    packet[11] = 14;
+    packet[12] = sequence;
+    packet[13] = 0; // physical port
+    packet[14] = static_cast<std::uint8_t>(universe & 0xff);        // sub-net and universe
+    packet[15] = static_cast<std::uint8_t>((universe >> 8) & 0x7f); // net
+    put16(packet + 16, dmx_universe_size);
+    std::memcpy(packet + 18, data, dmx_universe_size);
+}
+
+void write_sacn_packet(std::uint8_t*       packet,
+                       const sacn_source&  source,
+                       int                 universe,
+                       std::uint8_t        sequence,
+                       const std::uint8_t* data)
+{
+    static const std::uint8_t acn_id[] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+
+    std::memset(packet, 0, sacn_packet_size);
+
+    // Root layer.
+    put16(packet, 0x0010); // preamble size
+    put16(packet + 2, 0);  // postamble size
+    std::memcpy(packet + 4, acn_id, sizeof(acn_id));
+    put_pdu_length(packet, 16);
+    put32(packet + 18, 0x00000004); // VECTOR_ROOT_E131_DATA
+    std::memcpy(packet + 22, source.cid.data(), source.cid.size());
+
+    // Framing layer.
+    put_pdu_length(packet, 38);
+    put32(packet + 40, 0x00000002); // VECTOR_E131_DATA_PACKET
+    std::memcpy(packet + 44, source.name.data(), std::min<std::size_t>(source.name.size(), 63));
+    packet[108] = source.priority;
+    put16(packet + 109, 0); // synchronization address
+    packet[111] = sequence;
+    packet[112] = 0; // options
+    put16(packet + 113, universe);
+
+    // DMP layer.
+    put_pdu_length(packet, 115);
+    packet[117] = 0x02; // VECTOR_DMP_SET_PROPERTY
+    packet[118] = 0xa1; // address and data type
+    put16(packet + 119, 0);                     // first property address
+    put16(packet + 121, 1);                     // address increment
+    put16(packet + 123, dmx_universe_size + 1); // property value count, including the start code
+    packet[125] = 0;                            // DMX start code
+    std::memcpy(packet + 126, data, dmx_universe_size);
+}
+
+}} // namespace caspar::artnet
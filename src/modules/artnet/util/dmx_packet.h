@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace artnet {
+
+enum class dmx_protocol
+{
+    artnet, // Art-Net 4 ArtDmx
+    sacn,   // ANSI E1.31 streaming ACN
+};
+
+constexpr int dmx_universe_size = 512;
+
+constexpr std::size_t artnet_packet_size = 18 + dmx_universe_size;
+constexpr std::size_t sacn_packet_size   = 126 + dmx_universe_size;
+
+constexpr int artnet_max_universe = 32767;
+constexpr int sacn_min_universe   = 1;
+constexpr int sacn_max_universe   = 63999;
+
+struct sacn_source
+{
+    std::array<std::uint8_t, 16> cid{}; // identifies the sender to receivers, the same for all of its universes
+    std::string                  name;  // UTF-8, at most 63 bytes are sent
+    std::uint8_t                 priority = 100;
+};
+
+// A random version 4 UUID, for use as the CID of an sACN source.
+std::array<std::uint8_t, 16> make_sacn_cid();
+
+// Writes an ArtDmx packet of artnet_packet_size bytes carrying the 512 channels of data. A sequence of 0 tells the
+// receiver not to reorder packets.
+void write_artnet_packet(std::uint8_t* packet, int universe, std::uint8_t sequence, const std::uint8_t* data);
+
+// Writes an E1.31 data packet of sacn_packet_size bytes carrying the 512 channels of data.
+void write_sacn_packet(std::uint8_t*       packet,
+                       const sacn_source&  source,
+                       int                 universe,
+                       std::uint8_t        sequence,
+                       const std::uint8_t* data);
+
+}} // namespace caspar::artnet
@@ -21,6 +21,21 @@
 
 #include "fixture_calculation.h"
 
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse2.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
 #define M_PI 3.14159265358979323846 /* pi */
 
 namespace caspar { namespace artnet {
@@ -84,10 +99,91 @@ rect compute_rect(box fixtureBox, int index, int count)
     return rectangle;
 }
 
-color average_color(const core::const_frame& frame, rect& rectangle)
+namespace {
+
+// The x of the edge from a to b at y, or the x of a when the edge is horizontal.
+float edge_x(float ax, float ay, float bx, float by, float y)
+{
+    if (by == ay)
+        return ax;
+
+    float d = (bx - ax) / (by - ay);
+    return ax + (y - ay) * d;
+}
+
+const std::uint32_t* entry(const std::vector<std::uint32_t>& sums, int stride, int x, int y)
 {
-    int width  = (int)frame.width();
-    int height = (int)frame.height();
+    return sums.data() + (static_cast<std::size_t>(y) * stride + x) * 4;
+}
+
+__m128i load(const std::uint32_t* ptr) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)); }
+
+// Sum of the pixels from x1, y1 to x2, y2 inclusive.
+__m128i box_sum(const std::vector<std::uint32_t>& sums, int stride, int x1, int y1, int x2, int y2)
+{
+    auto a = load(entry(sums, stride, x2 + 1, y2 + 1));
+    auto b = load(entry(sums, stride, x1, y2 + 1));
+    auto c = load(entry(sums, stride, x2 + 1, y1));
+    auto d = load(entry(sums, stride, x1, y1));
+    return _mm_add_epi32(_mm_sub_epi32(_mm_sub_epi32(a, b), c), d);
+}
+
+} // namespace
+
+void summed_area_table::update(const std::uint8_t* bgra, int width, int height)
+{
+    // The same alpha factors as the per pixel sampling used before, so the averages are unchanged.
+    static const auto alpha = [] {
+        std::array<float, 256> result{};
+        for (int n = 0; n < 256; ++n)
+            result[n] = (float)n / 255.0f;
+        return result;
+    }();
+
+    width_  = width;
+    height_ = height;
+
+    const int stride = width_ + 1;
+    sums_.resize(static_cast<std::size_t>(stride) * (height_ + 1) * 4);
+    std::fill_n(sums_.begin(), static_cast<std::size_t>(stride) * 4, 0);
+
+    const std::uint8_t* value_ptr = bgra;
+
+    const auto zero = _mm_setzero_si128();
+    const auto mask = _mm_setr_epi32(-1, -1, -1, 0);
+
+    // Each entry is the entry above it plus the running sum of its line, all four channels at once.
+    for (int y = 0; y < height_; y++) {
+        const std::uint8_t*  line  = value_ptr + static_cast<std::size_t>(y) * width_ * 4;
+        const std::uint32_t* above = entry(sums_, stride, 0, y);
+        std::uint32_t*       row   = sums_.data() + static_cast<std::size_t>(y + 1) * stride * 4;
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row), zero);
+
+        auto running = zero;
+        for (int x = 0; x < width_; x++) {
+            const std::uint8_t* base_ptr = line + x * 4;
+
+            int bgra;
+            std::memcpy(&bgra, base_ptr, sizeof(bgra));
+
+            auto pixel = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bgra), zero), zero));
+            auto value = _mm_cvttps_epi32(_mm_mul_ps(pixel, _mm_set1_ps(alpha[base_ptr[3]])));
+
+            running = _mm_add_epi32(running, _mm_and_si128(value, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + (x + 1) * 4),
+                             _mm_add_epi32(load(above + (x + 1) * 4), running));
+        }
+    }
+}
+
+color summed_area_table::average_color(const rect& rectangle) const
+{
+    int width  = width_;
+    int height = height_;
+
+    if (width == 0 || height == 0)
+        return color{0, 0, 0};
 
     float x_values[] = {rectangle.p1.x, rectangle.p2.x, rectangle.p3.x, rectangle.p4.x};
     float y_values[] = {rectangle.p1.y, rectangle.p2.y, rectangle.p3.y, rectangle.p4.y};
@@ -119,100 +215,62 @@ color average_color(const core::const_frame& frame, rect& rectangle)
         }
     }
 
-    // Below is a rasterization algorithm that goes through the pixels in rectangle
-    // and calculates the average color
+    const int stride = width + 1;
 
-    // Which lines to use for the rasterization
-    // in the format [a, b, c, d] => a -> b, c -> d
-    // the numbers are indices into the x_values, y_values arrays
-    const int indices[3][4] = {
-        {0, 1, 0, 2}, // Line 1, Line 2
-        {0, 2, 1, 3}, // Line 2, Line 3
-        {1, 3, 2, 3}, // Line 3, Line 4
-    };
+    auto clamp_x = [&](float x) { return std::max(0, std::min(width - 1, (int)x)); };
 
     // The y values of the top and bottom of the rectangle, clamped to the image size
     int y_min = std::max(0, std::min(height - 1, (int)y_values[0]));
     int y_max = std::max(0, std::min(height - 1, (int)y_values[3]));
 
-    const array<const std::uint8_t>& values    = frame.image_data(0);
-    const std::uint8_t*              value_ptr = values.data();
-
     // Total color values, as well as the number of pixels in the rectangle
     // used to calculate the average without loss of precision
-    unsigned long long tr = 0;
-    unsigned long long tg = 0;
-    unsigned long long tb = 0;
-
+    __m128i            total = _mm_setzero_si128();
     unsigned long long count = 0;
 
-    // Go through the vertical lines of the rectangle, and then through the pixels in the line
-    // that are inside the rectangle
-    for (int y = y_min; y <= y_max; y++) {
-        // Determine which lines to use for the rasterization, if one line has passed we should use the next one
-        int index = 0;
-        if (y >= (int)y_values[1])
-            index = 1;
-        if (y >= (int)y_values[2])
-            index = 2;
-
-        // The x and y values of the first line
-        float ax1 = x_values[indices[index][0]];
-        float ay1 = y_values[indices[index][0]];
-
-        float bx1 = x_values[indices[index][1]];
-        float by1 = y_values[indices[index][1]];
-
-        // The x and y values of the second line
-        float ax2 = x_values[indices[index][2]];
-        float ay2 = y_values[indices[index][2]];
-
-        float bx2 = x_values[indices[index][3]];
-        float by2 = y_values[indices[index][3]];
-
-        int x1 = 0;
-        int x2 = width - 1;
-
-        // If the lines are horizontal, we can skip the calculations
-        // This only happens if the box is oriented in 90 degree increments
-        if (by2 != ay2) {
-            // The slopes of the lines
-            float d1 = (bx1 - ax1) / (by1 - ay1);
-            float d2 = (bx2 - ax2) / (by2 - ay2);
-
-            // The x values of the lines at the current y value
-            auto x1_ = (int)(ax1 + ((float)y - ay1) * d1);
-            auto x2_ = (int)(ax2 + ((float)y - ay2) * d2);
-
-            // The clamped x values
-            x1 = std::max(0, std::min(width - 1, x1_));
-            x2 = std::max(0, std::min(width - 1, x2_));
-        }
-
-        // The left and right x values
-        int min_x = std::min(x1, x2);
-        int max_x = std::max(x1, x2);
-
-        // Go through the pixels in the line
-        for (int x = min_x; x <= max_x; x++) {
-            int                 pos      = y * width + x;
-            const std::uint8_t* base_ptr = value_ptr + pos * 4;
-
-            float a = (float)base_ptr[3] / 255.0f;
-
-            float r = (float)base_ptr[2] * a;
-            float g = (float)base_ptr[1] * a;
-            float b = (float)base_ptr[0] * a;
-
-            tr += (unsigned long long)(r);
-            tg += (unsigned long long)(g);
-            tb += (unsigned long long)(b);
-
-            count++;
+    if (y_values[0] == y_values[1] && y_values[2] == y_values[3] && x_values[0] == x_values[2] &&
+        x_values[1] == x_values[3]) {
+        // An unrotated rectangle is a single lookup.
+        int min_x = clamp_x(x_values[0]);
+        int max_x = clamp_x(x_values[1]);
+
+        total = box_sum(sums_, stride, min_x, y_min, max_x, y_max);
+        count = (unsigned long long)(max_x - min_x + 1) * (y_max - y_min + 1);
+    } else {
+        // Which lines bound each line of pixels, in the format [a, b, c, d] => a -> b, c -> d
+        // the numbers are indices into the x_values, y_values arrays
+        const int indices[3][4] = {
+            {0, 1, 0, 2}, // Line 1, Line 2
+            {0, 2, 1, 3}, // Line 2, Line 3
+            {1, 3, 2, 3}, // Line 3, Line 4
+        };
+
+        for (int y = y_min; y <= y_max; y++) {
+            // Determine which lines to use, if one line has passed we should use the next one
+            int index = 0;
+            if (y >= (int)y_values[1])
+                index = 1;
+            if (y >= (int)y_values[2])
+                index = 2;
+
+            const int* l = indices[index];
+
+            // The x values of the lines at the current y value, clamped
+            int x1 = clamp_x(edge_x(x_values[l[0]], y_values[l[0]], x_values[l[1]], y_values[l[1]], (float)y));
+            int x2 = clamp_x(edge_x(x_values[l[2]], y_values[l[2]], x_values[l[3]], y_values[l[3]], (float)y));
+
+            int min_x = std::min(x1, x2);
+            int max_x = std::max(x1, x2);
+
+            total = _mm_add_epi32(total, box_sum(sums_, stride, min_x, y, max_x, y));
+            count += max_x - min_x + 1;
         }
     }
 
-    color c{(std::uint8_t)(tr / count), (std::uint8_t)(tg / count), (std::uint8_t)(tb / count)};
+    alignas(16) std::uint32_t t[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(t), total);
+
+    color c{(std::uint8_t)(t[2] / count), (std::uint8_t)(t[1] / count), (std::uint8_t)(t[0] / count)};
 
     return c;
 }
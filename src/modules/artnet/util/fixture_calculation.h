@@ -24,7 +24,9 @@
 #include <core/frame/frame.h>
 
 #include <cmath>
+#include <cstdint>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace artnet {
 
@@ -52,7 +54,8 @@ struct rect
 struct computed_fixture
 {
     FixtureType    type;
-    unsigned short address;
+    int            universe; // offset from the first universe of the consumer
+    unsigned short address;  // DMX address of the first channel within the universe
 
     rect rectangle;
 };
@@ -78,6 +81,7 @@ struct box
 struct fixture
 {
     FixtureType    type;
+    unsigned short universe;        // offset from the first universe of the consumer
     unsigned short startAddress;    // DMX address of the first channel in the fixture
     unsigned short fixtureCount;    // number of fixtures in the chain, dividing along the width
     unsigned short fixtureChannels; // number of channels per fixture
@@ -85,7 +89,28 @@ struct fixture
     box fixtureBox;
 };
 
-rect  compute_rect(box fixtureBox, int index, int count);
-color average_color(const core::const_frame& frame, rect& rectangle);
+rect compute_rect(box fixtureBox, int index, int count);
+
+// Running sums of the alpha premultiplied colour of a BGRA frame, built in one pass over the frame. The sum over any
+// span of a line, or any axis aligned rectangle, takes four lookups, so sampling a fixture no longer depends on its
+// area. The sums are kept modulo 2^32, which is exact for the sum of any rectangle of frames up to 4K.
+class summed_area_table
+{
+  public:
+    void update(const core::const_frame& frame)
+    {
+        update(frame.image_data(0).data(), static_cast<int>(frame.width()), static_cast<int>(frame.height()));
+    }
+
+    void update(const std::uint8_t* bgra, int width, int height);
+
+    // Average colour of the pixels within the rectangle, clamped to the frame.
+    color average_color(const rect& rectangle) const;
+
+  private:
+    int                        width_  = 0;
+    int                        height_ = 0;
+    std::vector<std::uint32_t> sums_; // (width + 1) * (height + 1) entries of B, G, R and an unused word
+};
 
 }} // namespace caspar::artnet
\ No newline at end of file
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pixel_kernels.h"
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/ssse3.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+#if !defined(USE_SIMDE) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define CASPAR_PIXEL_KERNELS_AVX
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CASPAR_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CASPAR_TARGET(isa)
+#endif
+
+#include <cstring>
+
+namespace caspar { namespace decklink {
+
+namespace {
+
+// Each kernel converts pixels from x on and returns the number of pixels done. The SIMD kernels stop at the last whole
+// block and leave the rest to the scalar kernel.
+using rgbx10_kernel = int (*)(const std::uint8_t* src, std::uint32_t* dst, int x, int width, bool key);
+using bgra8_kernel  = int (*)(const std::uint8_t* src, std::uint8_t* dst, int x, int width);
+
+std::uint32_t rgbx10(std::uint32_t r, std::uint32_t g, std::uint32_t b) { return r << 22 | g << 12 | b << 2; }
+
+int pack_rgbx10_c(const std::uint8_t* src, std::uint32_t* dst, int x, int width, bool key)
+{
+    const auto px = reinterpret_cast<const std::uint16_t*>(src);
+    for (; x < width; ++x) {
+        if (key) {
+            const auto a = static_cast<std::uint32_t>(px[x * 4 + 3] >> 6);
+            dst[x]       = rgbx10(a, a, a);
+        } else {
+            dst[x] = rgbx10(px[x * 4 + 2] >> 6, px[x * 4 + 1] >> 6, px[x * 4 + 0] >> 6);
+        }
+    }
+    return x;
+}
+
+int key_bgra8_c(const std::uint8_t* src, std::uint8_t* dst, int x, int width)
+{
+    for (; x < width; ++x) {
+        std::memset(dst + x * 4, src[x * 4 + 3], 4);
+    }
+    return x;
+}
+
+// SSSE3, 4 pixels per iteration.
+
+// The words of two pixels shifted to 10 bits, multiplied and summed in pairs give B << 2 | G << 12 and R, or A with
+// key set. Returns the R or A of four pixels in hi and the rest in lo.
+inline void split_sse(__m128i p0, __m128i p1, bool key, __m128i& lo, __m128i& hi)
+{
+    const auto factors = key ? _mm_setr_epi16(0, 0, 0, 1, 0, 0, 0, 1) : _mm_setr_epi16(4, 4096, 1, 0, 4, 4096, 1, 0);
+
+    const auto m0 = _mm_castsi128_ps(_mm_madd_epi16(_mm_srli_epi16(p0, 6), factors));
+    const auto m1 = _mm_castsi128_ps(_mm_madd_epi16(_mm_srli_epi16(p1, 6), factors));
+
+    lo = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)));
+    hi = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+int pack_rgbx10_sse(const std::uint8_t* src, std::uint32_t* dst, int x, int width, bool key)
+{
+    for (; x + 4 <= width; x += 4) {
+        const auto p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 8));
+        const auto p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 8 + 16));
+
+        __m128i lo;
+        __m128i hi;
+        split_sse(p0, p1, key, lo, hi);
+
+        const auto value = key ? _mm_or_si128(_mm_or_si128(_mm_slli_epi32(hi, 22), _mm_slli_epi32(hi, 12)),
+                                              _mm_slli_epi32(hi, 2))
+                               : _mm_or_si128(_mm_slli_epi32(hi, 22), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), value);
+    }
+    return x;
+}
+
+int key_bgra8_sse(const std::uint8_t* src, std::uint8_t* dst, int x, int width)
+{
+    const auto alpha = _mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+    for (; x + 4 <= width; x += 4) {
+        const auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_shuffle_epi8(p, alpha));
+    }
+    return x;
+}
+
+#ifdef CASPAR_PIXEL_KERNELS_AVX
+
+// AVX2, 8 pixels per iteration.
+
+CASPAR_TARGET("avx2")
+int pack_rgbx10_avx2(const std::uint8_t* src, std::uint32_t* dst, int x, int width, bool key)
+{
+    const auto factors = key ? _mm256_setr_epi16(0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1)
+                             : _mm256_setr_epi16(4, 4096, 1, 0, 4, 4096, 1, 0, 4, 4096, 1, 0, 4, 4096, 1, 0);
+
+    for (; x + 8 <= width; x += 8) {
+        const auto p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 8));
+        const auto p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 8 + 32));
+
+        const auto m0 = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_srli_epi16(p0, 6), factors));
+        const auto m1 = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_srli_epi16(p1, 6), factors));
+
+        // Shuffles stay within 128 bit lanes, leaving the pixels in the order 0, 1, 4, 5, 2, 3, 6, 7.
+        const auto lo = _mm256_castps_si256(_mm256_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)));
+        const auto hi = _mm256_castps_si256(_mm256_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        const auto value = key ? _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(hi, 22), _mm256_slli_epi32(hi, 12)),
+                                                 _mm256_slli_epi32(hi, 2))
+                               : _mm256_or_si256(_mm256_slli_epi32(hi, 22), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x),
+                            _mm256_permute4x64_epi64(value, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    return x;
+}
+
+CASPAR_TARGET("avx2")
+int key_bgra8_avx2(const std::uint8_t* src, std::uint8_t* dst, int x, int width)
+{
+    const auto alpha = _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15,
+                                        3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+    for (; x + 8 <= width; x += 8) {
+        const auto p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), _mm256_shuffle_epi8(p, alpha));
+    }
+    return x;
+}
+
+#endif
+
+struct kernels
+{
+    const char*   isa    = "ssse3";
+    rgbx10_kernel rgbx10 = pack_rgbx10_sse;
+    bgra8_kernel  key8   = key_bgra8_sse;
+
+    kernels()
+    {
+#ifdef CASPAR_PIXEL_KERNELS_AVX
+        if (supports_avx2()) {
+            isa    = "avx2";
+            rgbx10 = pack_rgbx10_avx2;
+            key8   = key_bgra8_avx2;
+        }
+#endif
+    }
+
+#ifdef CASPAR_PIXEL_KERNELS_AVX
+#ifdef _MSC_VER
+    static bool supports_avx2()
+    {
+        int info[4];
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x06) != 0x06) {
+            return false;
+        }
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+#else
+    static bool supports_avx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+#endif
+};
+
+const kernels& get_kernels()
+{
+    static const kernels instance;
+    return instance;
+}
+
+} // namespace
+
+void pack_rgbx10_row(const std::uint8_t* src, std::uint32_t* dst, int width, bool key)
+{
+    const auto x = get_kernels().rgbx10(src, dst, 0, width, key);
+    pack_rgbx10_c(src, dst, x, width, key);
+}
+
+void copy_bgra8_row(const std::uint8_t* src, std::uint8_t* dst, int width, bool key)
+{
+    if (!key) {
+        std::memcpy(dst, src, static_cast<std::size_t>(width) * 4);
+        return;
+    }
+    const auto x = get_kernels().key8(src, dst, 0, width);
+    key_bgra8_c(src, dst, x, width);
+}
+
+const char* pixel_kernels_isa() { return get_kernels().isa; }
+
+}} // namespace caspar::decklink
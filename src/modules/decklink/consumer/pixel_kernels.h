@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// Row kernels for the frames handed to DeckLink cards. They take no DeckLink types, so they can be used and checked
+// without a card. Every kernel uses the widest instruction set the cpu supports (AVX2 or SSSE3) for whole blocks of
+// pixels and plain C++ for the rest, so any width is converted in full.
+
+namespace caspar { namespace decklink {
+
+// Packs width R16G16B16A16 pixels, stored as B, G, R and A words, into little endian 10 bit RGBX words as
+// bmdFormat10BitRGBXLE expects. With key set the alpha channel is written to R, G and B instead.
+void pack_rgbx10_row(const std::uint8_t* src, std::uint32_t* dst, int width, bool key);
+
+// Copies width BGRA pixels. With key set the alpha channel is written to all four bytes instead.
+void copy_bgra8_row(const std::uint8_t* src, std::uint8_t* dst, int width, bool key);
+
+// Name of the instruction set used by the kernels.
+const char* pixel_kernels_isa();
+
+}} // namespace caspar::decklink
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the DeckLink row kernels, the 10 bit RGBX packing and the 8 bit fill and key copies, and the tail of
+// aligned_memshfl against plain per pixel references, without a DeckLink card. Run with --benchmark to print the
+// throughput of the kernels for a UHD row band.
+
+#include "../consumer/pixel_kernels.h"
+
+#include <common/memshfl.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace decklink { namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+std::vector<std::uint8_t> random_bytes(std::size_t size, unsigned seed)
+{
+    std::mt19937                            random(seed);
+    std::uniform_int_distribution<unsigned> byte(0, 255);
+
+    std::vector<std::uint8_t> result(size);
+    for (auto& b : result) {
+        b = static_cast<std::uint8_t>(byte(random));
+    }
+    return result;
+}
+
+// bmdFormat10BitRGBXLE: R in bits 22-31, G in 12-21, B in 2-11, from the top 10 bits of the B, G, R, A words.
+std::vector<std::uint32_t> reference_rgbx10(const std::vector<std::uint8_t>& src, int width, bool key)
+{
+    std::vector<std::uint32_t> result(width);
+    for (int x = 0; x < width; ++x) {
+        std::uint16_t px[4];
+        std::memcpy(px, src.data() + x * 8, sizeof(px));
+
+        const std::uint32_t b = key ? px[3] >> 6 : px[0] >> 6;
+        const std::uint32_t g = key ? px[3] >> 6 : px[1] >> 6;
+        const std::uint32_t r = key ? px[3] >> 6 : px[2] >> 6;
+        result[x]             = r << 22 | g << 12 | b << 2;
+    }
+    return result;
+}
+
+std::vector<std::uint8_t> reference_bgra8(const std::vector<std::uint8_t>& src, int width, bool key)
+{
+    std::vector<std::uint8_t> result(src.begin(), src.begin() + width * 4);
+    if (key) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                result[x * 4 + c] = src[x * 4 + 3];
+            }
+        }
+    }
+    return result;
+}
+
+// Widths that leave every possible tail for 4 and 8 pixel blocks, and full HD and UHD rows.
+const int widths[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 1283, 1920, 3840};
+
+void test_rgbx10()
+{
+    for (auto width : widths) {
+        // Extremes first, which is where the shift and the packing go wrong.
+        auto src = random_bytes(static_cast<std::size_t>(width) * 8, static_cast<unsigned>(width));
+        if (width > 1) {
+            std::memset(src.data(), 0x00, 8);
+            std::memset(src.data() + 8, 0xff, 8);
+        }
+
+        for (auto key : {false, true}) {
+            // One extra word, which must be left alone.
+            std::vector<std::uint32_t> dst(width + 1, 0xdeadbeef);
+            pack_rgbx10_row(src.data(), dst.data(), width, key);
+
+            const auto expected = reference_rgbx10(src, width, key);
+            check(std::equal(expected.begin(), expected.end(), dst.begin()),
+                  "pack_rgbx10_row, width " + std::to_string(width) + (key ? ", key" : ""));
+            check(dst[width] == 0xdeadbeef, "pack_rgbx10_row writes past width " + std::to_string(width));
+        }
+    }
+}
+
+void test_bgra8()
+{
+    for (auto width : widths) {
+        const auto src = random_bytes(static_cast<std::size_t>(width) * 4, static_cast<unsigned>(width + 1));
+
+        for (auto key : {false, true}) {
+            std::vector<std::uint8_t> dst(width * 4 + 4, 0xa5);
+            copy_bgra8_row(src.data(), dst.data(), width, key);
+
+            const auto expected = reference_bgra8(src, width, key);
+            check(std::equal(expected.begin(), expected.end(), dst.begin()),
+                  "copy_bgra8_row, width " + std::to_string(width) + (key ? ", key" : ""));
+            check(dst[width * 4] == 0xa5, "copy_bgra8_row writes past width " + std::to_string(width));
+        }
+    }
+}
+
+// The shuffle used for key only output, every byte of a pixel taken from its alpha.
+void test_memshfl()
+{
+    for (std::size_t size : {0, 4, 16, 20, 48, 60, 64, 68, 124, 128, 132, 1000, 7680}) {
+        const auto src = random_bytes(size, static_cast<unsigned>(size));
+
+        // 64 byte aligned like the frames, with room for a guard after size.
+        auto in  = create_aligned_buffer(size + 64);
+        auto out = create_aligned_buffer(size + 64);
+        std::memcpy(in.get(), src.data(), size);
+        std::memset(out.get(), 0xa5, size + 64);
+
+        aligned_memshfl(out.get(), in.get(), size, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+
+        const auto dst      = static_cast<const std::uint8_t*>(out.get());
+        const auto expected = reference_bgra8(src, static_cast<int>(size / 4), true);
+        check(std::equal(expected.begin(), expected.end(), dst), "aligned_memshfl, size " + std::to_string(size));
+        check(dst[size] == 0xa5, "aligned_memshfl writes past size " + std::to_string(size));
+    }
+}
+
+template <typename Func>
+double megapixels_per_second(const Func& func, int width, int height)
+{
+    const int iterations = 50;
+
+    func();
+    const auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; ++n) {
+        func();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(width) * height * iterations / elapsed.count() / 1e6;
+}
+
+void benchmark()
+{
+    const int width  = 3840;
+    const int height = 64;
+
+    const auto src16 = random_bytes(static_cast<std::size_t>(width) * height * 8, 1);
+    const auto src8  = random_bytes(static_cast<std::size_t>(width) * height * 4, 2);
+
+    std::vector<std::uint32_t> dst10(static_cast<std::size_t>(width) * height);
+    std::vector<std::uint8_t>  dst8(static_cast<std::size_t>(width) * height * 4);
+
+    std::cout << "kernels: " << pixel_kernels_isa() << std::endl;
+
+    for (auto key : {false, true}) {
+        const auto rgbx10 = megapixels_per_second(
+            [&] {
+                for (int y = 0; y < height; ++y) {
+                    pack_rgbx10_row(src16.data() + y * width * 8, dst10.data() + y * width, width, key);
+                }
+            },
+            width,
+            height);
+        std::cout << "pack_rgbx10_row" << (key ? ", key" : "") << ": " << rgbx10 << " Mpixel/s" << std::endl;
+
+        const auto bgra8 = megapixels_per_second(
+            [&] {
+                for (int y = 0; y < height; ++y) {
+                    copy_bgra8_row(src8.data() + y * width * 4, dst8.data() + y * width * 4, width, key);
+                }
+            },
+            width,
+            height);
+        std::cout << "copy_bgra8_row" << (key ? ", key" : "") << ": " << bgra8 << " Mpixel/s" << std::endl;
+    }
+}
+
+}}} // namespace caspar::decklink
+
+int main(int argc, char** argv)
+{
+    using namespace caspar::decklink;
+
+    if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+        benchmark();
+        return 0;
+    }
+
+    test_rgbx10();
+    test_bgra8();
+    test_memshfl();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,395 @@
+#include "av_output.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/log.h>
+#include <common/scope_exit.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+
+namespace caspar { namespace ffmpeg {
+
+struct Output::Segment
+{
+    std::shared_ptr<AVFormatContext> oc;
+    std::string                      path;
+    int64_t                          index       = 0;
+    int64_t                          header_size = 0;
+    std::vector<int64_t>             packets;
+    double                           start = 0.0;
+    double                           end   = 0.0;
+};
+
+Output::Output(std::string                         path,
+               std::string                         format,
+               const AVFormatContext*              layout,
+               Segmenting                          segmenting,
+               std::map<std::string, std::string>& options,
+               spl::shared_ptr<diagnostics::graph> graph,
+               std::string                         name,
+               double                              fps)
+    : path_(std::move(path))
+    , format_(std::move(format))
+    , segmenting_(std::move(segmenting))
+    , graph_(std::move(graph))
+    , name_(std::move(name))
+    , fps_(fps)
+{
+    key_stream_ = -1;
+    for (unsigned n = 0; n < layout->nb_streams; ++n) {
+        const auto st = layout->streams[n];
+
+        auto par = std::shared_ptr<AVCodecParameters>(avcodec_parameters_alloc(),
+                                                      [](AVCodecParameters* ptr) { avcodec_parameters_free(&ptr); });
+        if (!par) {
+            FF_RET(AVERROR(ENOMEM), "avcodec_parameters_alloc");
+        }
+        FF(avcodec_parameters_copy(par.get(), st->codecpar));
+        // Let the muxer pick the tag, as it may not be the format of the layout.
+        par->codec_tag = 0;
+
+        codecpars_.push_back(std::move(par));
+        time_bases_.emplace_back(st->time_base.num, st->time_base.den);
+
+        if (key_stream_ < 0 && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            key_stream_ = static_cast<int>(n);
+        }
+    }
+    key_stream_ = std::max(0, key_stream_);
+
+    graph_->set_color(name_ + "-write", diagnostics::color(0.9f, 0.5f, 0.9f));
+
+    options_ = options;
+
+    if (!segmenting_.enabled()) {
+        current_ = open(0, options);
+        return;
+    }
+
+    {
+        const auto oformat = av_guess_format(format_.empty() ? nullptr : format_.c_str(), path_.c_str(), nullptr);
+        const auto name    = std::string(oformat ? oformat->name : "");
+        fragmented_        = boost::contains(name, "mp4") || boost::contains(name, "mov");
+    }
+
+    // Every fragmented segment starts with a header describing the streams but no samples, which the playlist refers
+    // to as the segment's init section.
+    if (fragmented_ && options_.find("movflags") == options_.end()) {
+        options_["movflags"] = "+frag_keyframe+empty_moov+default_base_moof";
+        options["movflags"]  = options_["movflags"];
+    }
+
+    graph_->set_color(name_ + "-rate", diagnostics::color(0.4f, 0.9f, 0.9f));
+    graph_->set_color(name_ + "-segment", diagnostics::color(0.4f, 0.9f, 0.4f));
+    graph_->set_color(name_ + "-stall", diagnostics::color(1.0f, 0.3f, 0.3f));
+
+    // The first segment is opened at once to report errors in the arguments early.
+    current_  = open(0, options);
+    executor_ = std::make_unique<executor>(L"ffmpeg-output");
+    next_     = executor_->begin_invoke([this] {
+        auto options = options_;
+        return open(1, options);
+    });
+}
+
+Output::~Output()
+{
+    try {
+        close();
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+}
+
+std::string Output::segment_path(int64_t index) const
+{
+    if (!segmenting_.enabled()) {
+        return path_;
+    }
+
+    char buf[4096];
+    if (av_get_frame_filename2(buf, sizeof(buf), path_.c_str(), static_cast<int>(index), 0) >= 0) {
+        return buf;
+    }
+
+    const auto path = boost::filesystem::path(path_);
+    return (path.parent_path() /
+            (path.stem().string() + (boost::format("-%05d") % index).str() + path.extension().string()))
+        .string();
+}
+
+std::shared_ptr<Output::Segment> Output::open(int64_t index, std::map<std::string, std::string>& options)
+{
+    auto segment   = std::make_shared<Segment>();
+    segment->path  = segment_path(index);
+    segment->index = index;
+    segment->packets.resize(codecpars_.size());
+
+    {
+        AVFormatContext* oc = nullptr;
+        FF(avformat_alloc_output_context2(
+            &oc, nullptr, format_.empty() ? nullptr : format_.c_str(), segment->path.c_str()));
+        segment->oc = std::shared_ptr<AVFormatContext>(oc, [](AVFormatContext* ptr) {
+            if (!(ptr->oformat->flags & AVFMT_NOFILE)) {
+                avio_closep(&ptr->pb);
+            }
+            avformat_free_context(ptr);
+        });
+    }
+
+    for (auto n = 0; n < codecpars_.size(); ++n) {
+        auto st = avformat_new_stream(segment->oc.get(), nullptr);
+        if (!st) {
+            FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
+        }
+        FF(avcodec_parameters_copy(st->codecpar, codecpars_[n].get()));
+        st->time_base = {time_bases_[n].first, time_bases_[n].second};
+    }
+
+    if (!(segment->oc->oformat->flags & AVFMT_NOFILE)) {
+        // TODO (fix) interrupt_cb
+        auto dict = to_dict(std::move(options));
+        CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+        FF(avio_open2(&segment->oc->pb, segment->path.c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
+        options = to_map(&dict);
+    }
+
+    {
+        auto dict = to_dict(std::move(options));
+        CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+        FF(avformat_write_header(segment->oc.get(), &dict));
+        options = to_map(&dict);
+    }
+
+    if (segment->oc->pb) {
+        avio_flush(segment->oc->pb);
+        segment->header_size = avio_tell(segment->oc->pb);
+    }
+
+    return segment;
+}
+
+void Output::write(const AVPacket* pkt)
+{
+    const auto n  = pkt->stream_index;
+    const auto tb = AVRational{time_bases_[n].first, time_bases_[n].second};
+    const auto ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+
+    if (ts != AV_NOPTS_VALUE) {
+        const auto time = ts * av_q2d(tb);
+
+        // Segments only start at keyframes of the video stream, so no frame is dropped or written twice.
+        if (n == key_stream_ && (pkt->flags & AV_PKT_FLAG_KEY) && segmenting_.enabled()) {
+            if (!started_) {
+                current_->start = time;
+                started_        = true;
+            } else if ((segmenting_.time > 0.0 && time - current_->start >= segmenting_.time - 0.001) ||
+                       (segmenting_.size > 0 && current_->oc->pb &&
+                        avio_tell(current_->oc->pb) - current_->header_size >= segmenting_.size)) {
+                roll(time);
+            }
+        }
+
+        last_ = std::max(last_, (ts + pkt->duration) * av_q2d(tb));
+    }
+
+    auto packet = alloc_packet();
+    FF(av_packet_ref(packet.get(), pkt));
+    av_packet_rescale_ts(packet.get(), tb, current_->oc->streams[n]->time_base);
+
+    current_->packets[n] += 1;
+
+    caspar::timer write_timer;
+    FF(av_interleaved_write_frame(current_->oc.get(), packet.get()));
+    graph_->set_value(name_ + "-write", write_timer.elapsed() * fps_ * 0.5);
+}
+
+void Output::roll(double time)
+{
+    if (next_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        graph_->set_tag(diagnostics::tag_severity::WARNING, name_ + "-stall");
+    }
+
+    // The current segment is only handed over once the next one is open, so that if opening it failed, close() still
+    // writes the trailer of the current segment and adds it to the playlist.
+    auto next = next_.get();
+
+    auto finished   = std::move(current_);
+    finished->end   = time;
+    current_        = std::move(next);
+    current_->start = time;
+    graph_->set_tag(diagnostics::tag_severity::INFO, name_ + "-segment");
+
+    executor_->begin_invoke([this, finished] {
+        try {
+            finish(finished);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+    next_ = executor_->begin_invoke([this, index = current_->index + 1] {
+        auto options = options_;
+        return open(index, options);
+    });
+}
+
+void Output::finish(const std::shared_ptr<Segment>& segment)
+{
+    // The trailer is only written when every stream got packets, as some muxers fail otherwise.
+    const auto complete = std::all_of(segment->packets.begin(), segment->packets.end(), [](auto n) { return n > 0; });
+    if (complete) {
+        FF(av_write_trailer(segment->oc.get()));
+    }
+
+    const auto size = segment->oc->pb ? avio_tell(segment->oc->pb) : 0;
+    segment->oc.reset();
+
+    if (!segmenting_.enabled()) {
+        return;
+    }
+
+    const auto duration = std::max(0.0, segment->end - segment->start);
+    if (duration > 0.0) {
+        // Centered on the average rate of the output so far.
+        total_bytes_ += static_cast<double>(size);
+        total_duration_ += duration;
+        graph_->set_value(name_ + "-rate",
+                          (size / duration) / std::max(1.0, 2.0 * total_bytes_ / total_duration_));
+    }
+
+    CASPAR_LOG(debug) << L"ffmpeg[" << u16(segment->path) << L"] Segment closed, " << size << L" bytes, "
+                      << static_cast<int64_t>(duration > 0.0 ? size / duration : 0.0) << L" bytes/s.";
+
+    if (segmenting_.playlist.empty()) {
+        return;
+    }
+
+    Entry entry;
+    entry.index       = segment->index;
+    entry.duration    = duration;
+    entry.header_size = segment->header_size;
+    entry.size        = size;
+
+    const auto segment_path  = boost::filesystem::path(segment->path);
+    const auto playlist_path = boost::filesystem::path(segmenting_.playlist);
+    entry.uri = segment_path.parent_path() == playlist_path.parent_path() ? segment_path.filename().string()
+                                                                          : segment_path.string();
+
+    playlist_.push_back(std::move(entry));
+    while (segmenting_.playlist_size > 0 && playlist_.size() > static_cast<std::size_t>(segmenting_.playlist_size)) {
+        playlist_.pop_front();
+    }
+    target_duration_ = std::max(target_duration_, static_cast<int>(std::ceil(duration)));
+
+    write_playlist(false);
+}
+
+void Output::discard(const std::shared_ptr<Segment>& segment)
+{
+    const auto path = segment->path;
+    segment->oc.reset();
+
+    boost::system::error_code ec;
+    boost::filesystem::remove(path, ec);
+}
+
+void Output::write_playlist(bool end)
+{
+    const auto path = segmenting_.playlist;
+    const auto tmp  = path + ".tmp";
+
+    {
+        std::ofstream file(tmp, std::ios::out | std::ios::trunc);
+
+        file << "#EXTM3U\n";
+        file << "#EXT-X-VERSION:" << (fragmented_ ? 7 : 3) << "\n";
+        file << "#EXT-X-TARGETDURATION:" << std::max(1, target_duration_) << "\n";
+        file << "#EXT-X-MEDIA-SEQUENCE:" << (playlist_.empty() ? 0 : playlist_.front().index) << "\n";
+        if (segmenting_.playlist_size == 0) {
+            file << "#EXT-X-PLAYLIST-TYPE:" << (end ? "VOD" : "EVENT") << "\n";
+        }
+
+        for (auto& entry : playlist_) {
+            if (fragmented_) {
+                file << "#EXT-X-MAP:URI=\"" << entry.uri << "\",BYTERANGE=\"" << entry.header_size << "@0\"\n";
+            }
+            file << "#EXTINF:" << (boost::format("%.3f") % entry.duration).str() << ",\n";
+            if (fragmented_) {
+                file << "#EXT-X-BYTERANGE:" << entry.size - entry.header_size << "@" << entry.header_size << "\n";
+            }
+            file << entry.uri << "\n";
+        }
+
+        if (end) {
+            file << "#EXT-X-ENDLIST\n";
+        }
+
+        if (!file) {
+            CASPAR_LOG(warning) << L"ffmpeg[" << u16(path) << L"] Failed to write playlist.";
+            return;
+        }
+    }
+
+    // Readers only ever see a complete playlist.
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        CASPAR_LOG(warning) << L"ffmpeg[" << u16(path) << L"] Failed to replace playlist. " << u16(ec.message());
+    }
+}
+
+void Output::close()
+{
+    if (closed_ || !current_) {
+        return;
+    }
+    closed_ = true;
+
+    if (!executor_) {
+        finish(current_);
+        return;
+    }
+
+    current_->end = last_;
+    auto finished = executor_->begin_invoke([this, segment = std::move(current_)] { finish(segment); });
+
+    try {
+        if (next_.valid()) {
+            auto next = next_.get();
+            executor_->begin_invoke([this, next] { discard(next); });
+        }
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+
+    if (!segmenting_.playlist.empty()) {
+        executor_->begin_invoke([this] { write_playlist(true); });
+    }
+    executor_->wait();
+
+    finished.get();
+}
+
+}} // namespace caspar::ffmpeg
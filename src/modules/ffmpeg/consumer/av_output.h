@@ -0,0 +1,105 @@
+#pragma once
+
+#include <common/diagnostics/graph.h>
+#include <common/executor.h>
+#include <common/memory.h>
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct AVCodecParameters;
+struct AVFormatContext;
+struct AVPacket;
+
+namespace caspar { namespace ffmpeg {
+
+// Writes the packets of a rendition to a file or url. With a segment time or size the output is rolled over at video
+// keyframes into numbered segments, optionally listed in an HLS playlist. The next segment is opened and its header
+// written ahead of time on a thread of its own, where finished segments are also closed, so a rollover never waits
+// for i/o.
+class Output
+{
+  public:
+    struct Segmenting
+    {
+        double      time          = 0.0; // Seconds, 0 for no limit.
+        int64_t     size          = 0;   // Bytes, 0 for no limit.
+        int         playlist_size = 0;   // Segments listed in the playlist, 0 for all of them.
+        std::string playlist;            // HLS playlist path, empty for none.
+
+        bool enabled() const { return time > 0.0 || size > 0; }
+    };
+
+    // Streams are copied from layout. The format is guessed from the path when empty. Options not consumed by the
+    // muxer or the i/o context are left in options.
+    Output(std::string                         path,
+           std::string                         format,
+           const AVFormatContext*              layout,
+           Segmenting                          segmenting,
+           std::map<std::string, std::string>& options,
+           spl::shared_ptr<diagnostics::graph> graph,
+           std::string                         name,
+           double                              fps);
+    ~Output();
+
+    Output(const Output&)            = delete;
+    Output& operator=(const Output&) = delete;
+
+    // Writes a packet of the layout stream pkt->stream_index, timestamped in that stream's time base.
+    void write(const AVPacket* pkt);
+
+    // Writes the trailer, finishes the playlist and waits for pending segments.
+    void close();
+
+  private:
+    struct Segment;
+
+    struct Entry
+    {
+        std::string uri;
+        int64_t     index       = 0;
+        double      duration    = 0.0;
+        int64_t     header_size = 0;
+        int64_t     size        = 0;
+    };
+
+    std::shared_ptr<Segment> open(int64_t index, std::map<std::string, std::string>& options);
+    void                     roll(double time);
+    void                     finish(const std::shared_ptr<Segment>& segment);
+    void                     discard(const std::shared_ptr<Segment>& segment);
+    void                     write_playlist(bool end);
+    std::string              segment_path(int64_t index) const;
+
+    const std::string                   path_;
+    const std::string                   format_;
+    const Segmenting                    segmenting_;
+    std::map<std::string, std::string>  options_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    const std::string                   name_;
+    const double                        fps_;
+
+    std::vector<std::shared_ptr<AVCodecParameters>> codecpars_;
+    std::vector<std::pair<int, int>>                time_bases_;
+    int                                             key_stream_ = 0;
+    bool                                            fragmented_ = false;
+
+    std::shared_ptr<Segment>              current_;
+    std::future<std::shared_ptr<Segment>> next_;
+    bool                                  started_ = false;
+    bool                                  closed_  = false;
+    double                                last_    = 0.0;
+
+    std::deque<Entry> playlist_;
+    int               target_duration_ = 0;
+    double            total_bytes_     = 0.0;
+    double            total_duration_  = 0.0;
+
+    std::unique_ptr<executor> executor_;
+};
+
+}} // namespace caspar::ffmpeg
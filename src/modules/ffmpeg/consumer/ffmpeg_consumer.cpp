@@ -21,10 +21,13 @@
 
 #include "ffmpeg_consumer.h"
 
+#include "av_output.h"
+
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
 #include <common/bit_depth.h>
+#include <common/color_conversion.h>
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/executor.h>
@@ -60,28 +63,33 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
-#include <libswscale/swscale.h>
 }
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
 #include <tbb/concurrent_queue.h>
-#include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <thread>
+#include <vector>
 
 namespace caspar { namespace ffmpeg {
 
-// TODO multiple output streams
-// TODO multiple output files
-// TODO run video filter, video encoder, audio filter, audio encoder in separate threads.
 // TODO realtime with smaller buffer?
 
+// Filters and encodes one output stream. The filter graph and the encoder run on their own threads, connected by
+// bounded queues, and end of stream is passed down the stages as nullptr.
 struct Stream
 {
     std::shared_ptr<AVFilterGraph> graph  = nullptr;
@@ -91,17 +99,29 @@ struct Stream
     std::shared_ptr<AVCodecContext> enc = nullptr;
     AVStream*                       st  = nullptr;
 
-    tbb::concurrent_bounded_queue<std::shared_ptr<SwsContext>> sws_;
-
     int64_t pts = 0;
 
+    // Keyframes are forced every keyint channel frames so that the GOPs of all renditions line up.
+    int        keyint   = 0;
+    int64_t    next_key = 0;
+    AVRational frame_tb = {0, 1};
+
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVFrame>> filter_buffer;
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVFrame>> encode_buffer;
+    std::thread                                             filter_thread;
+    std::thread                                             encode_thread;
+    bool                                                    eof = false;
+
     Stream(AVFormatContext*                    oc,
            std::string                         suffix,
            AVCodecID                           codec_id,
            const core::video_format_desc&      format_desc,
            bool                                realtime,
            common::bit_depth                   depth,
+           int                                 keyint,
            std::map<std::string, std::string>& options)
+        : keyint(keyint)
+        , frame_tb({format_desc.duration, format_desc.time_scale * format_desc.field_count})
     {
         std::map<std::string, std::string> stream_options;
 
@@ -281,6 +301,10 @@ struct Stream
             enc->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(sink);
             enc->time_base           = st->time_base;
             enc->pix_fmt             = static_cast<AVPixelFormat>(av_buffersink_get_format(sink));
+
+            if (keyint > 0) {
+                enc->gop_size = static_cast<int>(std::max<int64_t>(1, av_rescale_q(keyint, frame_tb, enc->time_base)));
+            }
         } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
             st->time_base = {1, av_buffersink_get_sample_rate(sink)};
 
@@ -321,128 +345,421 @@ struct Stream
         }
     }
 
-    std::shared_ptr<SwsContext> get_sws(int width, int height)
+    ~Stream()
     {
-        std::shared_ptr<SwsContext> sws;
-
-        if (sws_.try_pop(sws)) {
-            return sws;
+        if (filter_thread.joinable()) {
+            if (!eof) {
+                filter_buffer.push(nullptr);
+            }
+            filter_thread.join();
+            encode_thread.join();
         }
+    }
 
-        sws.reset(sws_getContext(
-                      width, height, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_YUVA422P, 0, nullptr, nullptr, nullptr),
-                  [](SwsContext* ptr) { sws_freeContext(ptr); });
+    Stream(const Stream&)            = delete;
+    Stream& operator=(const Stream&) = delete;
 
-        if (!sws) {
-            CASPAR_THROW_EXCEPTION(caspar_exception());
-        }
+    // Packets are passed to cb, followed by nullptr once the encoder is flushed. After a failure the stages keep
+    // draining their queues so that neither the producer of frames nor the muxer is ever left waiting.
+    void start(std::size_t                                    depth,
+               std::function<void(std::shared_ptr<AVPacket>)> cb,
+               std::function<void(double)>                    on_encoded,
+               std::function<void(std::exception_ptr)>        on_error)
+    {
+        filter_buffer.set_capacity(depth);
+        encode_buffer.set_capacity(depth);
 
-        int        brigthness;
-        int        contrast;
-        int        saturation;
-        int        in_full;
-        int        out_full;
-        const int* inv_table;
-        const int* table;
+        filter_thread = std::thread([=] {
+            auto failed = false;
+            auto done   = false;
 
-        sws_getColorspaceDetails(
-            sws.get(), (int**)&inv_table, &in_full, (int**)&table, &out_full, &brigthness, &contrast, &saturation);
+            std::shared_ptr<AVFrame> frame;
+            do {
+                filter_buffer.pop(frame);
+                if (!failed && !done) {
+                    try {
+                        done = filter(frame);
+                    } catch (...) {
+                        failed = true;
+                        on_error(std::current_exception());
+                    }
+                }
+            } while (frame);
 
-        inv_table = sws_getCoefficients(AVCOL_SPC_RGB);
-        table     = sws_getCoefficients(AVCOL_SPC_BT709);
+            if (!done) {
+                encode_buffer.push(nullptr);
+            }
+        });
 
-        in_full  = AVCOL_RANGE_JPEG;
-        out_full = AVCOL_RANGE_MPEG;
+        encode_thread = std::thread([=] {
+            auto failed = false;
 
-        sws_setColorspaceDetails(sws.get(), inv_table, in_full, table, out_full, brigthness, contrast, saturation);
+            std::shared_ptr<AVFrame> frame;
+            do {
+                encode_buffer.pop(frame);
+                if (!failed) {
+                    try {
+                        caspar::timer encode_timer;
+                        encode(frame, cb);
+                        on_encoded(encode_timer.elapsed());
+                    } catch (...) {
+                        failed = true;
+                        on_error(std::current_exception());
+                    }
+                }
+            } while (frame);
 
-        return std::shared_ptr<SwsContext>(sws.get(), [this, sws](SwsContext*) { sws_.push(sws); });
+            cb(nullptr);
+        });
     }
 
-    void send(core::const_frame&                             in_frame,
-              const core::video_format_desc&                 format_desc,
-              std::function<void(std::shared_ptr<AVPacket>)> cb)
+    void push(std::shared_ptr<AVFrame> frame)
     {
-        std::shared_ptr<AVFrame>  frame;
-        std::shared_ptr<AVPacket> pkt;
-
-        if (in_frame) {
-            if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-                frame = make_av_video_frame(in_frame, format_desc);
-
-                {
-                    auto frame2                 = alloc_frame();
-                    frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
-                    frame2->width               = frame->width;
-                    frame2->height              = frame->height;
-                    frame2->format              = AV_PIX_FMT_YUVA422P;
-                    frame2->colorspace          = AVCOL_SPC_BT709;
-                    frame2->color_primaries     = AVCOL_PRI_BT709;
-                    frame2->color_range         = AVCOL_RANGE_MPEG;
-                    frame2->color_trc           = AVCOL_TRC_BT709;
-                    av_frame_get_buffer(frame2.get(), 64);
-
-                    int h = frame->height / 8;
-                    tbb::parallel_for(0, 8, [&](int i) {
-                        auto sws = get_sws(frame->width, h);
-
-                        uint8_t* src[4] = {};
-                        src[0]          = frame->data[0] + frame->linesize[0] * (i * h);
-
-                        uint8_t* dst[4] = {};
-                        dst[0]          = frame2->data[0] + frame2->linesize[0] * (i * h);
-                        dst[1]          = frame2->data[1] + frame2->linesize[1] * (i * h);
-                        dst[2]          = frame2->data[2] + frame2->linesize[2] * (i * h);
-                        dst[3]          = frame2->data[3] + frame2->linesize[3] * (i * h);
-
-                        sws_scale(sws.get(), src, frame->linesize, 0, h, dst, frame2->linesize);
-                    });
-
-                    int i = frame->height - h;
-                    if (i > 0) {
-                        // TODO
-                    }
+        eof = !frame;
+        filter_buffer.push(std::move(frame));
+    }
 
-                    frame = std::move(frame2);
-                }
+    // Frames are only pushed from one thread, so a queue that is not full stays so until that thread pushes.
+    bool full() const { return filter_buffer.size() >= filter_buffer.capacity(); }
 
-                frame->pts = pts;
-                pts += 1;
-            } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
-                frame      = make_av_audio_frame(in_frame, format_desc);
-                frame->pts = pts;
-                pts += frame->nb_samples;
-            } else {
-                // TODO
-            }
+  private:
+    // Returns true once the sink has reached end of stream.
+    bool filter(const std::shared_ptr<AVFrame>& frame)
+    {
+        if (frame) {
+            pts = frame->pts + (enc->codec_type == AVMEDIA_TYPE_AUDIO ? frame->nb_samples : 1);
             FF(av_buffersrc_write_frame(source, frame.get()));
         } else {
             FF(av_buffersrc_close(source, pts, 0));
         }
 
         while (true) {
-            pkt     = alloc_packet();
-            int ret = avcodec_receive_packet(enc.get(), pkt.get());
-
+            auto filtered = alloc_frame();
+            auto ret      = av_buffersink_get_frame(sink, filtered.get());
             if (ret == AVERROR(EAGAIN)) {
-                frame = alloc_frame();
-                ret   = av_buffersink_get_frame(sink, frame.get());
-                if (ret == AVERROR(EAGAIN)) {
-                    return;
-                }
-                if (ret == AVERROR_EOF) {
-                    FF(avcodec_send_frame(enc.get(), nullptr));
+                return false;
+            }
+            if (ret == AVERROR_EOF) {
+                encode_buffer.push(nullptr);
+                return true;
+            }
+            FF_RET(ret, "av_buffersink_get_frame");
+
+            if (enc->codec_type == AVMEDIA_TYPE_VIDEO && keyint > 0 && filtered->pts != AV_NOPTS_VALUE) {
+                const auto n = av_rescale_q(filtered->pts, av_buffersink_get_time_base(sink), frame_tb);
+                if (n >= next_key) {
+                    filtered->pict_type = AV_PICTURE_TYPE_I;
+                    next_key            = (n / keyint + 1) * keyint;
                 } else {
-                    FF_RET(ret, "av_buffersink_get_frame");
-                    FF(avcodec_send_frame(enc.get(), frame.get()));
+                    filtered->pict_type = AV_PICTURE_TYPE_NONE;
                 }
-            } else if (ret == AVERROR_EOF) {
+            }
+
+            encode_buffer.push(std::move(filtered));
+        }
+    }
+
+    void encode(const std::shared_ptr<AVFrame>& frame, const std::function<void(std::shared_ptr<AVPacket>)>& cb)
+    {
+        FF(avcodec_send_frame(enc.get(), frame.get()));
+
+        while (true) {
+            auto pkt = alloc_packet();
+            auto ret = avcodec_receive_packet(enc.get(), pkt.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                 return;
-            } else {
-                FF_RET(ret, "avcodec_receive_packet");
-                pkt->stream_index = st->index;
-                av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
-                cb(std::move(pkt));
+            }
+            FF_RET(ret, "avcodec_receive_packet");
+            pkt->stream_index = st->index;
+            av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
+            cb(std::move(pkt));
+        }
+    }
+};
+
+std::map<std::string, std::string> parse_options(const std::string& args)
+{
+    std::map<std::string, std::string> options;
+
+    static boost::regex opt_exp("-(?<NAME>[^\\s]+)(\\s+(?<VALUE>[^\\s]+))?");
+    for (auto it = boost::sregex_iterator(args.begin(), args.end(), opt_exp); it != boost::sregex_iterator(); ++it) {
+        options[(*it)["NAME"].str().c_str()] = (*it)["VALUE"].matched ? (*it)["VALUE"].str().c_str() : "";
+    }
+
+    return options;
+}
+
+std::string take_option(std::map<std::string, std::string>& options, const std::string& name)
+{
+    std::string value;
+
+    const auto it = options.find(name);
+    if (it != options.end()) {
+        value = std::move(it->second);
+        options.erase(it);
+    }
+
+    return value;
+}
+
+// Bytes, with an optional K, M or G suffix.
+int64_t parse_size(const std::string& str)
+{
+    char* end  = nullptr;
+    auto  size = std::strtod(str.c_str(), &end);
+    switch (end && *end ? std::toupper(*end) : 0) {
+        case 'G':
+            size *= 1024.0;
+        case 'M':
+            size *= 1024.0;
+        case 'K':
+            size *= 1024.0;
+        default:
+            break;
+    }
+    return static_cast<int64_t>(size);
+}
+
+// Local paths are made absolute, relative to the media folder, and their folders created. Urls are left as they are.
+std::string resolve_path(const std::string& path, bool replace)
+{
+    boost::filesystem::path full_path = path;
+
+    static boost::regex prot_exp("^.+:.*");
+    if (!boost::regex_match(path, prot_exp)) {
+        if (!full_path.is_complete()) {
+            full_path = u8(env::media_folder()) + path;
+        }
+
+        // TODO -y?
+        if (replace && boost::filesystem::exists(full_path)) {
+            boost::filesystem::remove(full_path);
+        }
+
+        boost::filesystem::create_directories(full_path.parent_path());
+    }
+
+    return full_path.string();
+}
+
+struct RenditionDesc
+{
+    std::string path;
+    std::string args;
+};
+
+// A converted channel frame, shared by reference between the renditions. Both empty marks end of stream.
+struct ConvertedFrame
+{
+    std::shared_ptr<AVFrame> video;
+    std::shared_ptr<AVFrame> audio;
+};
+
+// A single output of the consumer with its own muxer thread and streams. The renditions are fed the same converted
+// frames and only differ in their filter graphs and encoder settings.
+class Rendition
+{
+    const int                           index_;
+    const std::string                   path_;
+    const core::video_format_desc       format_desc_;
+    const bool                          realtime_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    std::string                         encode_name_;
+    std::string                         queue_name_;
+
+    std::shared_ptr<AVFormatContext>     oc_;
+    std::optional<Stream>                video_stream_;
+    std::optional<Stream>                audio_stream_;
+    std::vector<std::unique_ptr<Output>> outputs_;
+
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer_;
+    std::thread                                              mux_thread_;
+    std::function<void(std::exception_ptr)>                  on_error_;
+
+  public:
+    Rendition(int                                     index,
+              const RenditionDesc&                    desc,
+              const core::video_format_desc&          format_desc,
+              bool                                    realtime,
+              common::bit_depth                       depth,
+              int                                     keyint,
+              std::size_t                             queue_depth,
+              spl::shared_ptr<diagnostics::graph>     graph,
+              std::function<void(std::exception_ptr)> on_error)
+        : index_(index)
+        , path_(desc.path)
+        , format_desc_(format_desc)
+        , realtime_(realtime)
+        , graph_(std::move(graph))
+        , encode_name_((boost::format("encode-%d") % index).str())
+        , queue_name_((boost::format("queue-%d") % index).str())
+        , on_error_(std::move(on_error))
+    {
+        const auto hue = static_cast<float>(index % 4) * 0.2f;
+        graph_->set_color(encode_name_, diagnostics::color(0.2f + hue, 0.6f, 1.0f - hue));
+        graph_->set_color(queue_name_, diagnostics::color(0.8f - hue, 0.8f, 0.2f + hue));
+
+        auto options = parse_options(desc.args);
+
+        const auto format = take_option(options, "format");
+
+        Output::Segmenting segmenting;
+        segmenting.time          = std::atof(take_option(options, "segment_time").c_str());
+        segmenting.size          = parse_size(take_option(options, "segment_size"));
+        segmenting.playlist      = take_option(options, "segment_list");
+        segmenting.playlist_size = std::atoi(take_option(options, "segment_list_size").c_str());
+        if (!segmenting.playlist.empty()) {
+            segmenting.playlist = resolve_path(segmenting.playlist, false);
+        }
+
+        std::vector<std::string> copies;
+        {
+            const auto copy_to = take_option(options, "copy_to");
+            if (!copy_to.empty()) {
+                boost::split(copies, copy_to, boost::is_any_of("|"), boost::token_compress_on);
+            }
+        }
+
+        const auto full_path = resolve_path(path_, !segmenting.enabled());
+
+        {
+            // Streams are set up on a context that is never written, the outputs copy them.
+            AVFormatContext* oc = nullptr;
+            FF(avformat_alloc_output_context2(
+                &oc, nullptr, !format.empty() ? format.c_str() : nullptr, full_path.c_str()));
+            oc_ = std::shared_ptr<AVFormatContext>(oc, [](AVFormatContext* ptr) { avformat_free_context(ptr); });
+        }
+
+        if (oc_->oformat->video_codec != AV_CODEC_ID_NONE) {
+            if (oc_->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end()) {
+                options["preset:v"] = "veryfast";
+            }
+            video_stream_.emplace(
+                oc_.get(), ":v", oc_->oformat->video_codec, format_desc, realtime_, depth, keyint, options);
+        }
+
+        if (oc_->oformat->audio_codec != AV_CODEC_ID_NONE) {
+            audio_stream_.emplace(
+                oc_.get(), ":a", oc_->oformat->audio_codec, format_desc, realtime_, depth, 0, options);
+        }
+
+        {
+            const auto output_options = options;
+
+            outputs_.push_back(std::make_unique<Output>(full_path,
+                                                        oc_->oformat->name,
+                                                        oc_.get(),
+                                                        segmenting,
+                                                        options,
+                                                        graph_,
+                                                        (boost::format("output-%d") % index_).str(),
+                                                        format_desc_.fps));
+
+            // Copies get the same packets, muxed into the format of their own file names.
+            for (auto n = 0; n < static_cast<int>(copies.size()); ++n) {
+                auto copy_options = output_options;
+                outputs_.push_back(std::make_unique<Output>(resolve_path(copies[n], true),
+                                                            "",
+                                                            oc_.get(),
+                                                            Output::Segmenting{},
+                                                            copy_options,
+                                                            graph_,
+                                                            (boost::format("output-%d.%d") % index_ % (n + 1)).str(),
+                                                            format_desc_.fps));
+            }
+        }
+
+        for (auto& p : options) {
+            CASPAR_LOG(warning) << print() << " Unused option " << p.first << "=" << p.second;
+        }
+
+        packet_buffer_.set_capacity(realtime_ ? 1 : 128);
+        mux_thread_ = std::thread([this] { mux(); });
+
+        auto packet_cb = [this](std::shared_ptr<AVPacket> pkt) { packet_buffer_.push(std::move(pkt)); };
+        if (video_stream_) {
+            video_stream_->start(
+                queue_depth,
+                packet_cb,
+                [this](double elapsed) { graph_->set_value(encode_name_, elapsed * format_desc_.fps * 0.5); },
+                on_error_);
+        }
+        if (audio_stream_) {
+            audio_stream_->start(queue_depth, packet_cb, [](double) {}, on_error_);
+        }
+    }
+
+    ~Rendition()
+    {
+        // The streams flush their encoders into the muxer before it is joined.
+        if (mux_thread_.joinable()) {
+            video_stream_.reset();
+            audio_stream_.reset();
+            mux_thread_.join();
+        }
+    }
+
+    Rendition(const Rendition&)            = delete;
+    Rendition& operator=(const Rendition&) = delete;
+
+    void push(ConvertedFrame frame)
+    {
+        const auto eof = !frame.video && !frame.audio;
+
+        // In realtime mode the video and audio of a frame are dropped together, as dropping only one of them would
+        // leave the other stream ahead and the output out of sync.
+        const auto full = (video_stream_ && video_stream_->full()) || (audio_stream_ && audio_stream_->full());
+        if (realtime_ && !eof && full) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            return;
+        }
+
+        if (video_stream_) {
+            video_stream_->push(std::move(frame.video));
+        }
+        if (audio_stream_) {
+            audio_stream_->push(std::move(frame.audio));
+        }
+
+        if (video_stream_) {
+            graph_->set_value(queue_name_,
+                              static_cast<double>(video_stream_->filter_buffer.size() + 0.001) /
+                                  video_stream_->filter_buffer.capacity());
+        }
+    }
+
+    double fps() const { return video_stream_ ? av_q2d(av_buffersink_get_frame_rate(video_stream_->sink)) : 0.0; }
+
+    std::wstring print() const { return L"ffmpeg[" + u16(path_) + L"]"; }
+
+  private:
+    void mux()
+    {
+        auto failed = false;
+
+        // Every stream ends with a nullptr packet, and all of them are consumed even after a failed write.
+        for (auto streams = (video_stream_ ? 1 : 0) + (audio_stream_ ? 1 : 0); streams > 0;) {
+            std::shared_ptr<AVPacket> pkt;
+            packet_buffer_.pop(pkt);
+            if (!pkt) {
+                streams -= 1;
+            } else if (!failed) {
+                try {
+                    for (auto& output : outputs_) {
+                        output->write(pkt.get());
+                    }
+                } catch (...) {
+                    failed = true;
+                    on_error_(std::current_exception());
+                }
+            }
+        }
+
+        for (auto& output : outputs_) {
+            try {
+                output->close();
+            } catch (...) {
+                on_error_(std::current_exception());
             }
         }
     }
@@ -458,8 +775,7 @@ struct ffmpeg_consumer : public core::frame_consumer
 
     spl::shared_ptr<diagnostics::graph> graph_;
 
-    std::string path_;
-    std::string args_;
+    std::vector<RenditionDesc> renditions_;
 
     std::exception_ptr exception_;
     std::mutex         exception_mutex_;
@@ -470,18 +786,20 @@ struct ffmpeg_consumer : public core::frame_consumer
     common::bit_depth depth_;
 
   public:
-    ffmpeg_consumer(std::string path, std::string args, bool realtime, common::bit_depth depth)
+    ffmpeg_consumer(std::vector<RenditionDesc> renditions, bool realtime, common::bit_depth depth)
         : channel_index_([&] {
             boost::crc_16_type result;
-            result.process_bytes(path.data(), path.length());
+            result.process_bytes(renditions.at(0).path.data(), renditions.at(0).path.length());
             return result.checksum();
         }())
         , realtime_(realtime)
-        , path_(std::move(path))
-        , args_(std::move(args))
+        , renditions_(std::move(renditions))
         , depth_(depth)
     {
-        state_["file/path"] = u8(path_);
+        state_["file/path"] = u8(renditions_[0].path);
+        for (auto n = 1; n < renditions_.size(); ++n) {
+            state_["file/rendition/" + std::to_string(n) + "/path"] = u8(renditions_[n].path);
+        }
 
         frame_buffer_.set_capacity(realtime_ ? 1 : 64);
 
@@ -514,139 +832,40 @@ struct ffmpeg_consumer : public core::frame_consumer
 
         frame_thread_ = std::thread([=] {
             try {
-                std::map<std::string, std::string> options;
-                {
-                    static boost::regex opt_exp("-(?<NAME>[^\\s]+)(\\s+(?<VALUE>[^\\s]+))?");
-                    for (auto it = boost::sregex_iterator(args_.begin(), args_.end(), opt_exp);
-                         it != boost::sregex_iterator();
-                         ++it) {
-                        options[(*it)["NAME"].str().c_str()] =
-                            (*it)["VALUE"].matched ? (*it)["VALUE"].str().c_str() : "";
-                    }
-                }
-
-                boost::filesystem::path full_path = path_;
-
-                static boost::regex prot_exp("^.+:.*");
-                if (!boost::regex_match(path_, prot_exp)) {
-                    if (!full_path.is_complete()) {
-                        full_path = u8(env::media_folder()) + path_;
-                    }
-
-                    // TODO -y?
-                    if (boost::filesystem::exists(full_path)) {
-                        boost::filesystem::remove(full_path);
-                    }
-
-                    boost::filesystem::create_directories(full_path.parent_path());
-                }
-
-                AVFormatContext* oc = nullptr;
-
-                {
-                    std::string format;
-                    {
-                        const auto format_it = options.find("format");
-                        if (format_it != options.end()) {
-                            format = std::move(format_it->second);
-                            options.erase(format_it);
-                        }
-                    }
-
-                    FF(avformat_alloc_output_context2(
-                        &oc, nullptr, !format.empty() ? format.c_str() : nullptr, path_.c_str()));
+                // With several renditions every encoder is given the same keyframe interval, taken from the first
+                // rendition or defaulting to two seconds, so that segments can be cut at the same points.
+                auto keyint = 0;
+                if (renditions_.size() > 1) {
+                    const auto options = parse_options(renditions_[0].args);
+                    const auto it      = options.find("g:v");
+                    keyint             = it != options.end() ? std::max(1, std::atoi(it->second.c_str()))
+                                                             : static_cast<int>(std::ceil(format_desc.fps * 2.0));
                 }
 
-                CASPAR_SCOPE_EXIT { avformat_free_context(oc); };
-
-                std::optional<Stream> video_stream;
-                if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
-                    if (oc->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end()) {
-                        options["preset:v"] = "veryfast";
+                auto on_error = [this](std::exception_ptr ex) {
+                    std::lock_guard<std::mutex> lock(exception_mutex_);
+                    if (!exception_) {
+                        exception_ = std::move(ex);
                     }
-                    video_stream.emplace(oc, ":v", oc->oformat->video_codec, format_desc, realtime_, depth_, options);
-
-                    {
-                        std::lock_guard<std::mutex> lock(state_mutex_);
-                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(video_stream->sink));
-                    }
-                }
-
-                std::optional<Stream> audio_stream;
-                if (oc->oformat->audio_codec != AV_CODEC_ID_NONE) {
-                    audio_stream.emplace(oc, ":a", oc->oformat->audio_codec, format_desc, realtime_, depth_, options);
-                }
+                };
 
-                if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                    // TODO (fix) interrupt_cb
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avio_open2(&oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
-                    options = to_map(&dict);
-                }
+                const auto queue_depth =
+                    std::max<std::size_t>(1, env::properties().get(L"configuration.ffmpeg.consumer.queue-depth", 4U));
 
-                {
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avformat_write_header(oc, &dict));
-                    options = to_map(&dict);
+                std::vector<std::unique_ptr<Rendition>> renditions;
+                for (auto n = 0; n < renditions_.size(); ++n) {
+                    renditions.push_back(std::make_unique<Rendition>(
+                        n, renditions_[n], format_desc, realtime_, depth_, keyint, queue_depth, graph_, on_error));
                 }
 
                 {
-                    for (auto& p : options) {
-                        CASPAR_LOG(warning) << print() << " Unused option " << p.first << "=" << p.second;
-                    }
+                    std::lock_guard<std::mutex> lock(state_mutex_);
+                    state_["file/fps"] = renditions[0]->fps();
                 }
 
-                tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer;
-                packet_buffer.set_capacity(realtime_ ? 1 : 128);
-                auto packet_thread = std::thread([&] {
-                    try {
-                        CASPAR_SCOPE_EXIT
-                        {
-                            if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                                FF(avio_closep(&oc->pb));
-                            }
-                        };
-
-                        std::map<int, int64_t> count;
-
-                        std::shared_ptr<AVPacket> pkt;
-                        while (true) {
-                            packet_buffer.pop(pkt);
-                            if (!pkt) {
-                                break;
-                            }
-                            count[pkt->stream_index] += 1;
-                            FF(av_interleaved_write_frame(oc, pkt.get()));
-                        }
-
-                        auto video_st = video_stream ? video_stream->st : nullptr;
-                        auto audio_st = audio_stream ? audio_stream->st : nullptr;
-
-                        if ((!video_st || count[video_st->index]) && (!audio_st || count[audio_st->index])) {
-                            FF(av_write_trailer(oc));
-                        }
-
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
-                        // TODO
-                        packet_buffer.abort();
-                    }
-                });
-                CASPAR_SCOPE_EXIT
-                {
-                    if (packet_thread.joinable()) {
-                        // TODO Is nullptr needed?
-                        packet_buffer.push(nullptr);
-                        packet_buffer.abort();
-                        packet_thread.join();
-                    }
-                };
-
-                auto packet_cb = [&](std::shared_ptr<AVPacket>&& pkt) { packet_buffer.push(std::move(pkt)); };
-
                 std::int32_t frame_number = 0;
+                int64_t      video_pts    = 0;
+                int64_t      audio_pts    = 0;
                 while (true) {
                     {
                         std::lock_guard<std::mutex> lock(state_mutex_);
@@ -659,26 +878,31 @@ struct ffmpeg_consumer : public core::frame_consumer
                                       static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
 
                     caspar::timer frame_timer;
-                    tbb::parallel_invoke(
-                        [&] {
-                            if (video_stream) {
-                                video_stream->send(frame, format_desc, packet_cb);
-                            }
-                        },
-                        [&] {
-                            if (audio_stream) {
-                                audio_stream->send(frame, format_desc, packet_cb);
-                            }
-                        });
+
+                    ConvertedFrame converted;
+                    if (frame) {
+                        tbb::parallel_invoke(
+                            [&] {
+                                converted.video      = convert_video(frame, format_desc);
+                                converted.video->pts = video_pts;
+                                video_pts += 1;
+                            },
+                            [&] {
+                                converted.audio      = make_av_audio_frame(frame, format_desc);
+                                converted.audio->pts = audio_pts;
+                                audio_pts += converted.audio->nb_samples;
+                            });
+                    }
+
+                    for (auto& rendition : renditions) {
+                        rendition->push(converted);
+                    }
                     graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
 
                     if (!frame) {
-                        packet_buffer.push(nullptr);
                         break;
                     }
                 }
-
-                packet_thread.join();
             } catch (...) {
                 std::lock_guard<std::mutex> lock(exception_mutex_);
                 exception_ = std::current_exception();
@@ -705,7 +929,7 @@ struct ffmpeg_consumer : public core::frame_consumer
         return make_ready_future(true);
     }
 
-    std::wstring print() const override { return L"ffmpeg[" + u16(path_) + L"]"; }
+    std::wstring print() const override { return L"ffmpeg[" + u16(renditions_[0].path) + L"]"; }
 
     std::wstring name() const override { return L"ffmpeg"; }
 
@@ -718,8 +942,84 @@ struct ffmpeg_consumer : public core::frame_consumer
         std::lock_guard<std::mutex> lock(state_mutex_);
         return state_;
     }
+
+  private:
+    // The converted image is kept with the frame, so other ffmpeg consumers on the channel at the same depth reuse
+    // it. Each gets its own reference to timestamp, the buffers are shared.
+    std::shared_ptr<AVFrame> convert_video(const core::const_frame&       in_frame,
+                                           const core::video_format_desc& format_desc)
+    {
+        const auto& plane = in_frame.pixel_format_desc().planes.at(0);
+
+        const auto sar = boost::rational<int>(format_desc.square_width, format_desc.square_height) /
+                         boost::rational<int>(format_desc.width, format_desc.height);
+
+        const auto pix_fmt = depth_ == common::bit_depth::bit8 ? AV_PIX_FMT_YUVA422P : AV_PIX_FMT_YUVA422P10;
+        const auto key =
+            (boost::format("ffmpeg-%s-%d:%d") % av_get_pix_fmt_name(pix_fmt) % sar.numerator() % sar.denominator()).str();
+
+        const auto converted = in_frame.derived<AVFrame>(key, [&]() -> std::shared_ptr<const AVFrame> {
+            auto frame                 = alloc_frame();
+            frame->sample_aspect_ratio = {sar.numerator(), sar.denominator()};
+            frame->width               = plane.width;
+            frame->height              = plane.height;
+            frame->format              = pix_fmt;
+            frame->colorspace          = AVCOL_SPC_BT709;
+            frame->color_primaries     = AVCOL_PRI_BT709;
+            frame->color_range         = AVCOL_RANGE_MPEG;
+            frame->color_trc           = AVCOL_TRC_BT709;
+            FF(av_frame_get_buffer(frame.get(), 64));
+
+            common::bgra_to_yuv422(in_frame.image_data(0).data(),
+                                   plane.linesize,
+                                   plane.depth,
+                                   frame->width,
+                                   frame->height,
+                                   common::color_space::bt709,
+                                   depth_ == common::bit_depth::bit8 ? common::yuv_format::yuv422p8
+                                                                     : common::yuv_format::yuv422p10,
+                                   frame->data,
+                                   frame->linesize);
+
+            return frame;
+        });
+
+        const auto frame = std::shared_ptr<AVFrame>(av_frame_clone(converted.get()), [](AVFrame* ptr) {
+            av_frame_free(&ptr);
+        });
+        if (!frame) {
+            FF_RET(AVERROR(ENOMEM), "av_frame_clone");
+        }
+
+        return frame;
+    }
 };
 
+// Splits the arguments on RENDITION, each of which is followed by the path and arguments of another output fed by
+// the same conversion, e.g. "out.ts -codec:v libx264 RENDITION out_720.ts -filter:v scale=1280:720".
+std::vector<RenditionDesc> parse_renditions(const std::vector<std::wstring>& params, std::size_t offset)
+{
+    std::vector<RenditionDesc> renditions;
+    std::vector<std::string>   args;
+
+    for (auto n = offset; n < params.size(); ++n) {
+        if (boost::iequals(params[n], L"RENDITION") && !renditions.empty() && n + 1 < params.size()) {
+            renditions.back().args = boost::join(args, " ");
+            args.clear();
+            renditions.push_back(RenditionDesc{u8(params[++n]), ""});
+        } else if (renditions.empty()) {
+            renditions.push_back(RenditionDesc{u8(params[n]), ""});
+        } else {
+            args.emplace_back(u8(params[n]));
+        }
+    }
+    if (!renditions.empty()) {
+        renditions.back().args = boost::join(args, " ");
+    }
+
+    return renditions;
+}
+
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
                                                       const core::video_format_repository& format_repository,
                                                       const std::vector<spl::shared_ptr<core::video_channel>>& channels,
@@ -728,13 +1028,8 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     if (params.size() < 2 || (!boost::iequals(params.at(0), L"STREAM") && !boost::iequals(params.at(0), L"FILE")))
         return core::frame_consumer::empty();
 
-    auto                     path = u8(params.at(1));
-    std::vector<std::string> args;
-    for (auto n = 2; n < params.size(); ++n) {
-        args.emplace_back(u8(params[n]));
-    }
     return spl::make_shared<ffmpeg_consumer>(
-        path, boost::join(args, " "), boost::iequals(params.at(0), L"STREAM"), depth);
+        parse_renditions(params, 1), boost::iequals(params.at(0), L"STREAM"), depth);
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -743,9 +1038,15 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
                               const std::vector<spl::shared_ptr<core::video_channel>>& channels,
                               common::bit_depth                                        depth)
 {
-    return spl::make_shared<ffmpeg_consumer>(u8(ptree.get<std::wstring>(L"path", L"")),
-                                             u8(ptree.get<std::wstring>(L"args", L"")),
-                                             ptree.get(L"realtime", false),
-                                             depth);
+    std::vector<RenditionDesc> renditions;
+    renditions.push_back(
+        RenditionDesc{u8(ptree.get<std::wstring>(L"path", L"")), u8(ptree.get<std::wstring>(L"args", L""))});
+
+    for (auto& xml_rendition : ptree.get_child(L"renditions", boost::property_tree::wptree())) {
+        renditions.push_back(RenditionDesc{u8(xml_rendition.second.get<std::wstring>(L"path", L"")),
+                                           u8(xml_rendition.second.get<std::wstring>(L"args", L""))});
+    }
+
+    return spl::make_shared<ffmpeg_consumer>(std::move(renditions), ptree.get(L"realtime", false), depth);
 }
 }} // namespace caspar::ffmpeg
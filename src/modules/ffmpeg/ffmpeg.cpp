@@ -24,9 +24,12 @@
 #include "ffmpeg.h"
 
 #include "consumer/ffmpeg_consumer.h"
+#include "producer/av_frame_cache.h"
 #include "producer/ffmpeg_producer.h"
 
+#include <common/env.h>
 #include <common/log.h>
+#include <common/media_index.h>
 
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
@@ -127,10 +130,17 @@ void init(const core::module_dependencies& dependencies)
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ffmpeg", create_preconfigured_consumer);
 
     dependencies.producer_registry->register_producer_factory(L"FFmpeg Producer", create_producer);
+
+    if (auto index = find_media_index(env::media_folder())) {
+        index->set_prober(probe_media);
+    }
 }
 
 void uninit()
 {
+    // The cached frames hold textures of the accelerator, which is destroyed before static objects are.
+    FrameCache::instance().clear();
+
     // avfilter_uninit();
     avformat_network_deinit();
 }
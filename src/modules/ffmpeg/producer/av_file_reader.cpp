@@ -0,0 +1,229 @@
+#include "av_file_reader.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/timer.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+FileReader::FileReader(const std::string& path, std::function<bool()> interrupted)
+    : path_(path)
+    , interrupted_(std::move(interrupted))
+    , file_(path, std::ios::in | std::ios::binary)
+{
+    if (!file_) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(path));
+    }
+
+    size_ = static_cast<int64_t>(boost::filesystem::file_size(path));
+
+    const int buffer_size = 64 * 1024;
+    auto      buffer      = static_cast<unsigned char*>(av_malloc(buffer_size));
+    if (!buffer) {
+        CASPAR_THROW_EXCEPTION(bad_alloc());
+    }
+
+    auto context = avio_alloc_context(buffer, buffer_size, 0, this, &FileReader::read, nullptr, &FileReader::seek);
+    if (!context) {
+        av_free(buffer);
+        CASPAR_THROW_EXCEPTION(bad_alloc());
+    }
+
+    context_ = std::shared_ptr<AVIOContext>(context, [](AVIOContext* ctx) {
+        av_freep(&ctx->buffer);
+        avio_context_free(&ctx);
+    });
+
+    thread_ = std::thread([this] { run(); });
+}
+
+FileReader::~FileReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abort_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+FileReader::Stats FileReader::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::exchange(stats_, Stats{});
+}
+
+void FileReader::run()
+{
+    set_thread_name(L"[ffmpeg::av_producer::FileReader]");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!abort_) {
+        const auto first = position_ / block_size;
+        const auto last  = std::min(first + block_count, (size_ + block_size - 1) / block_size);
+
+        // Keep the block before the position for short backward seeks, drop everything else outside the window.
+        for (auto it = blocks_.begin(); it != blocks_.end();) {
+            it = it->first < first - 1 || it->first >= last ? blocks_.erase(it) : std::next(it);
+        }
+
+        auto next = first;
+        while (next < last && blocks_.count(next) > 0) {
+            next += 1;
+        }
+
+        if (next >= last || error_) {
+            cond_.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+
+        caspar::timer timer;
+
+        auto block = std::make_shared<std::vector<uint8_t>>(block_size);
+        file_.clear();
+        file_.seekg(next * block_size);
+        file_.read(reinterpret_cast<char*>(block->data()), block_size);
+        block->resize(static_cast<std::size_t>(std::max<std::streamsize>(0, file_.gcount())));
+
+        const auto read_time = timer.elapsed();
+
+        lock.lock();
+
+        if (file_.bad() || (block->empty() && next * block_size < size_)) {
+            CASPAR_LOG(error) << "[ffmpeg::FileReader] Failed to read " << path_;
+            error_ = true;
+        } else {
+            blocks_[next] = std::move(block);
+            stats_.bytes += static_cast<int64_t>(blocks_[next]->size());
+            stats_.read_time += read_time;
+        }
+
+        cond_.notify_all();
+    }
+}
+
+bool FileReader::refresh_size()
+{
+    // Files that are still being written grow while they play.
+    boost::system::error_code ec;
+    const auto                size = static_cast<int64_t>(boost::filesystem::file_size(path_, ec));
+    if (ec || size <= size_) {
+        return false;
+    }
+
+    // The last block was read short, fetch it again.
+    blocks_.erase(size_ / block_size);
+    size_ = size;
+    cond_.notify_all();
+    return true;
+}
+
+int FileReader::read(void* opaque, uint8_t* buf, int size)
+{
+    auto self = static_cast<FileReader*>(opaque);
+
+    std::unique_lock<std::mutex> lock(self->mutex_);
+
+    if (self->position_ >= self->size_ && !self->refresh_size()) {
+        return AVERROR_EOF;
+    }
+
+    const auto index = self->position_ / block_size;
+
+    auto it = self->blocks_.find(index);
+    if (it == self->blocks_.end()) {
+        caspar::timer timer;
+
+        self->cond_.notify_all();
+        while ((it = self->blocks_.find(index)) == self->blocks_.end()) {
+            if (self->error_) {
+                return AVERROR(EIO);
+            }
+            if (self->interrupted_()) {
+                return AVERROR_EXIT;
+            }
+            self->cond_.wait_for(lock, std::chrono::milliseconds(10));
+        }
+
+        self->stats_.stall_time += timer.elapsed();
+    }
+
+    const auto& block  = *it->second;
+    const auto  offset = self->position_ - index * block_size;
+    const auto  count  = std::min<int64_t>(size, static_cast<int64_t>(block.size()) - offset);
+    if (count <= 0) {
+        return AVERROR_EOF;
+    }
+
+    std::memcpy(buf, block.data() + offset, static_cast<std::size_t>(count));
+    self->position_ += count;
+
+    if (self->position_ / block_size != index) {
+        // Moved into the next block, let the reader slide the window.
+        self->cond_.notify_all();
+    }
+
+    return static_cast<int>(count);
+}
+
+int64_t FileReader::seek(void* opaque, int64_t offset, int whence)
+{
+    auto self = static_cast<FileReader*>(opaque);
+
+    std::lock_guard<std::mutex> lock(self->mutex_);
+
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return self->size_;
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += self->position_;
+            break;
+        case SEEK_END:
+            offset += self->size_;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    if (offset < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    const auto moved = offset / block_size != self->position_ / block_size;
+
+    self->position_ = offset;
+
+    if (moved) {
+        // Start fetching around the target right away.
+        self->cond_.notify_all();
+    }
+
+    return offset;
+}
+
+}} // namespace caspar::ffmpeg
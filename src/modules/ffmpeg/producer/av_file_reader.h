@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+// Reads a local file ahead of the demuxer in large sequential blocks on a thread of its own, and serves the demuxer's
+// reads from memory through a custom AVIOContext. Seeking moves the read-ahead window, so the blocks around a seek
+// target are fetched as soon as the demuxer seeks, before it asks for them.
+class FileReader
+{
+  public:
+    struct Stats
+    {
+        int64_t bytes      = 0;
+        double  read_time  = 0.0; // Seconds spent in file reads.
+        double  stall_time = 0.0; // Seconds the demuxer waited for data.
+    };
+
+    FileReader(const std::string& path, std::function<bool()> interrupted);
+    ~FileReader();
+
+    FileReader(const FileReader&)            = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    // The context is owned by the reader and must not outlive it.
+    AVIOContext* context() const { return context_.get(); }
+
+    // Returns the counters accumulated since the last call.
+    Stats stats();
+
+  private:
+    static constexpr int64_t block_size  = 2 * 1024 * 1024;
+    static constexpr int64_t block_count = 8;
+
+    static int     read(void* opaque, uint8_t* buf, int size);
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+
+    void run();
+    bool refresh_size();
+
+    const std::string           path_;
+    const std::function<bool()> interrupted_;
+
+    std::mutex                                               mutex_;
+    std::condition_variable                                  cond_;
+    int64_t                                                  size_     = 0;
+    int64_t                                                  position_ = 0;
+    std::map<int64_t, std::shared_ptr<std::vector<uint8_t>>> blocks_;
+    bool                                                     error_ = false;
+    bool                                                     abort_ = false;
+    Stats                                                    stats_;
+
+    std::ifstream                file_;
+    std::shared_ptr<AVIOContext> context_;
+    std::thread                  thread_;
+};
+
+}} // namespace caspar::ffmpeg
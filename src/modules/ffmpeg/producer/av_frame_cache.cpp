@@ -0,0 +1,83 @@
+#include "av_frame_cache.h"
+
+#include <common/env.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <functional>
+
+namespace caspar { namespace ffmpeg {
+
+std::size_t FrameCache::KeyHash::operator()(const Key& key) const
+{
+    auto hash = std::hash<std::string>()(key.stream);
+    hash ^= std::hash<int64_t>()(key.origin) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<int64_t>()(key.frame_number) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+FrameCache::FrameCache(std::size_t capacity)
+    : capacity_(capacity)
+{
+}
+
+FrameCache& FrameCache::instance()
+{
+    static FrameCache cache(env::properties().get(L"configuration.ffmpeg.producer.cache-size", 1024ULL) * 1024 *
+                            1024);
+    return cache;
+}
+
+std::optional<FrameCache::Entry> FrameCache::get(const std::string& stream, int64_t origin, int64_t frame_number)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(Key{stream, origin, frame_number});
+    if (it == index_.end()) {
+        return {};
+    }
+
+    items_.splice(items_.begin(), items_, it->second);
+
+    return it->second->entry;
+}
+
+void FrameCache::put(const std::string& stream, int64_t origin, int64_t frame_number, Entry entry, std::size_t size)
+{
+    if (size > capacity_) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto key = Key{stream, origin, frame_number};
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        items_.splice(items_.begin(), items_, it->second);
+        return;
+    }
+
+    while (!items_.empty() && size_ + size > capacity_) {
+        size_ -= items_.back().size;
+        index_.erase(items_.back().key);
+        items_.pop_back();
+    }
+
+    items_.push_front(Item{key, std::move(entry), size});
+    index_.emplace(std::move(key), items_.begin());
+    size_ += size;
+}
+
+void FrameCache::clear()
+{
+    std::list<Item> items;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index_.clear();
+        items_.swap(items);
+        size_ = 0;
+    }
+}
+
+}} // namespace caspar::ffmpeg
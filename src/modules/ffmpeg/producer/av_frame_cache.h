@@ -0,0 +1,75 @@
+#pragma once
+
+#include <core/frame/draw_frame.h>
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace caspar { namespace ffmpeg {
+
+// Decoded and filtered frames shared by every producer playing the same clip, so that loops and replays of short
+// clips play from memory after the first pass. Frames are keyed by stream (file, filters and channel format), the
+// position decoding started from and the frame number from there. The least recently used frames are evicted once
+// the memory budget is exceeded, counting the device memory of frames uploaded to the GPU as well as host memory.
+class FrameCache
+{
+  public:
+    struct Entry
+    {
+        core::draw_frame frame;
+        int64_t          start_time = 0;
+        int64_t          pts        = 0;
+        int64_t          duration   = 0;
+    };
+
+    explicit FrameCache(std::size_t capacity);
+
+    // Process wide instance, sized by configuration.ffmpeg.producer.cache-size (MB).
+    static FrameCache& instance();
+
+    std::optional<Entry> get(const std::string& stream, int64_t origin, int64_t frame_number);
+    void put(const std::string& stream, int64_t origin, int64_t frame_number, Entry entry, std::size_t size);
+
+    // Releases every frame, which must be done before the accelerator the frames were made by goes away.
+    void clear();
+
+    std::size_t capacity() const { return capacity_; }
+
+  private:
+    struct Key
+    {
+        std::string stream;
+        int64_t     origin;
+        int64_t     frame_number;
+
+        bool operator==(const Key& other) const
+        {
+            return origin == other.origin && frame_number == other.frame_number && stream == other.stream;
+        }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& key) const;
+    };
+
+    struct Item
+    {
+        Key         key;
+        Entry       entry;
+        std::size_t size;
+    };
+
+    const std::size_t capacity_;
+
+    std::mutex                                                  mutex_;
+    std::size_t                                                 size_ = 0;
+    std::list<Item>                                             items_;
+    std::unordered_map<Key, std::list<Item>::iterator, KeyHash> index_;
+};
+
+}} // namespace caspar::ffmpeg
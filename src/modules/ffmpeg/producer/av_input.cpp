@@ -1,4 +1,5 @@
 #include "av_input.h"
+#include "av_file_reader.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
@@ -7,10 +8,12 @@
 #include <common/os/thread.h>
 #include <common/param.h>
 #include <common/scope_exit.h>
+#include <common/timer.h>
 
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/filesystem.hpp>
 
+#include <algorithm>
 #include <set>
 
 #ifdef _MSC_VER
@@ -26,20 +29,47 @@ extern "C" {
 
 namespace caspar { namespace ffmpeg {
 
+namespace {
+
+// The packet buffer holds read-ahead seconds of the stream, within the byte bounds. The read-ahead starts at
+// MIN_READ_AHEAD and grows every time the buffer runs dry after having been full.
+const double  MIN_READ_AHEAD     = 2.0;
+const double  MAX_READ_AHEAD     = 10.0;
+const int64_t MIN_BUFFER_SIZE    = 4 * 1024 * 1024;
+const int64_t MAX_BUFFER_SIZE    = 256 * 1024 * 1024;
+const int     MAX_BUFFER_PACKETS = 4096;
+
+} // namespace
+
 Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, std::optional<bool> seekable)
     : filename_(filename)
     , graph_(graph)
     , seekable_(seekable)
+    , buffer_target_(MIN_BUFFER_SIZE)
+    , read_ahead_(MIN_READ_AHEAD)
 {
     graph_->set_color("seek", diagnostics::color(1.0f, 0.5f, 0.0f));
     graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+    graph_->set_color("io-throughput", diagnostics::color(0.4f, 0.7f, 0.4f));
+    graph_->set_color("io-stall", diagnostics::color(0.9f, 0.2f, 0.2f));
+    graph_->set_color("input-underflow", diagnostics::color(0.9f, 0.6f, 0.3f));
 
-    buffer_.set_capacity(256);
+    buffer_.set_capacity(MAX_BUFFER_PACKETS);
     thread_ = boost::thread([=] {
         try {
             set_thread_name(L"[ffmpeg::av_producer::Input]");
 
+            caspar::timer stats_timer;
+
             while (true) {
+                {
+                    // Only one end of file marker is queued at a time.
+                    std::unique_lock<std::mutex> lock(buffer_mutex_);
+                    buffer_cond_.wait(lock, [&] {
+                        return (buffer_size_ < buffer_target_ && !(eof_ && !buffer_.empty())) || abort_request_;
+                    });
+                }
+
                 auto packet = alloc_packet();
 
                 {
@@ -50,7 +80,7 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
                         break;
                     }
 
-                    // TODO (perf) Non blocking av_read_frame when possible.
+                    // Local files are read ahead by reader_, so this only blocks when the read-ahead runs dry.
                     auto ret = av_read_frame(ic_.get(), packet.get());
 
                     if (ret == AVERROR_EXIT) {
@@ -63,10 +93,28 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
                     } else {
                         FF_RET(ret, "av_read_frame");
                     }
+
+                    const auto bytes_per_second = ic_->bit_rate > 0 ? ic_->bit_rate / 8 : INT64_C(0);
+                    const auto target           = static_cast<int64_t>(bytes_per_second * read_ahead_);
+                    buffer_target_              = std::clamp(target, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+
+                    if (reader_ && stats_timer.elapsed() > 1.0) {
+                        // Throughput is drawn relative to the stream bitrate at 1/10 scale, i.e. 0.1 is real time.
+                        const auto stats   = reader_->stats();
+                        const auto elapsed = stats_timer.elapsed();
+                        if (bytes_per_second > 0) {
+                            graph_->set_value("io-throughput",
+                                              stats.bytes / elapsed / static_cast<double>(bytes_per_second) * 0.1);
+                        }
+                        graph_->set_value("io-stall", stats.stall_time / elapsed);
+                        stats_timer.restart();
+                    }
                 }
 
+                const auto size = packet ? packet->size : 0;
                 buffer_.push(std::move(packet));
-                graph_->set_value("input", (static_cast<double>(buffer_.size()) / buffer_.capacity()));
+                buffer_size_ += size;
+                update_graph();
             }
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
@@ -80,9 +128,8 @@ Input::~Input()
     abort_request_ = true;
     ic_cond_.notify_all();
 
-    std::shared_ptr<AVPacket> packet;
-    while (buffer_.try_pop(packet))
-        ;
+    notify_buffer();
+    flush();
 
     thread_.join();
 }
@@ -96,10 +143,49 @@ int Input::interrupt_cb(void* ctx)
 bool Input::try_pop(std::shared_ptr<AVPacket>& packet)
 {
     auto result = buffer_.try_pop(packet);
-    graph_->set_value("input", (static_cast<double>(buffer_.size()) / buffer_.capacity()));
+
+    if (result) {
+        if (packet) {
+            filled_ = filled_ || buffer_size_ >= buffer_target_;
+            buffer_size_ -= packet->size;
+        }
+        notify_buffer();
+    } else if (!eof_ && filled_) {
+        // Ran dry after having been full, the storage can't keep up with the current read-ahead.
+        read_ahead_ = std::min(read_ahead_ * 1.5, MAX_READ_AHEAD);
+        filled_     = false;
+        graph_->set_tag(diagnostics::tag_severity::WARNING, "input-underflow");
+    }
+
+    update_graph();
     return result;
 }
 
+void Input::flush()
+{
+    std::shared_ptr<AVPacket> packet;
+    while (buffer_.try_pop(packet)) {
+        if (packet) {
+            buffer_size_ -= packet->size;
+        }
+    }
+    notify_buffer();
+}
+
+void Input::notify_buffer()
+{
+    // Taking the lock orders the updates of the atomics with the predicate check in the reader thread.
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+    }
+    buffer_cond_.notify_all();
+}
+
+void Input::update_graph()
+{
+    graph_->set_value("input", static_cast<double>(buffer_size_) / static_cast<double>(buffer_target_));
+}
+
 AVFormatContext*       Input::operator->() { return ic_.get(); }
 AVFormatContext* const Input::operator->() const { return ic_.get(); }
 
@@ -107,10 +193,9 @@ void Input::abort()
 {
     abort_request_ = true;
     ic_cond_.notify_all();
+    notify_buffer();
 
-    std::shared_ptr<AVPacket> packet;
-    while (buffer_.try_pop(packet))
-        ;
+    flush();
 }
 
 void Input::reset()
@@ -150,7 +235,16 @@ void Input::internal_reset()
         FF(av_dict_set(&options, "seekable", *seekable_ ? "1" : "0", 0));
     }
 
-    if (input_format == nullptr) {
+    std::shared_ptr<FileReader> reader;
+    if (input_format == nullptr && !seekable_ && (url_parts.first.empty() || url_parts.first == L"file")) {
+        const auto                path = u8(url_parts.second);
+        boost::system::error_code ec;
+        if (boost::filesystem::is_regular_file(path, ec)) {
+            reader = std::make_shared<FileReader>(path, [this] { return abort_request_.load(); });
+        }
+    }
+
+    if (input_format == nullptr && !reader) {
         // TODO (fix) timeout?
         FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
     }
@@ -159,8 +253,14 @@ void Input::internal_reset()
     ic->interrupt_callback.callback = Input::interrupt_cb;
     ic->interrupt_callback.opaque   = this;
 
+    if (reader) {
+        ic->pb = reader->context();
+        ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
     FF(avformat_open_input(&ic, filename_.c_str(), input_format, &options));
-    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    auto ic2 =
+        std::shared_ptr<AVFormatContext>(ic, [reader](AVFormatContext* ctx) { avformat_close_input(&ctx); });
 
     for (auto& p : to_map(&options)) {
         CASPAR_LOG(warning) << "av_input[" + filename_ + "]"
@@ -168,7 +268,8 @@ void Input::internal_reset()
     }
 
     FF(avformat_find_stream_info(ic2.get(), nullptr));
-    ic_ = std::move(ic2);
+    ic_     = std::move(ic2);
+    reader_ = std::move(reader);
     ic_cond_.notify_all();
 }
 
@@ -184,12 +285,13 @@ void Input::seek(int64_t ts, bool flush)
         internal_reset();
     }
 
+    eof_ = false;
+
     if (flush) {
-        std::shared_ptr<AVPacket> packet;
-        while (buffer_.try_pop(packet))
-            ;
+        this->flush();
+    } else {
+        notify_buffer();
     }
-    eof_ = false;
 
     graph_->set_tag(diagnostics::tag_severity::INFO, "seek");
 }
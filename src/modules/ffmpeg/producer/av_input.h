@@ -21,6 +21,8 @@ struct AVFormatContext;
 
 namespace caspar { namespace ffmpeg {
 
+class FileReader;
+
 class Input
 {
   public:
@@ -42,6 +44,9 @@ class Input
 
   private:
     void internal_reset();
+    void flush();
+    void notify_buffer();
+    void update_graph();
 
     std::optional<bool> seekable_;
 
@@ -52,7 +57,17 @@ class Input
     std::shared_ptr<AVFormatContext> ic_;
     std::condition_variable          ic_cond_;
 
+    std::shared_ptr<FileReader> reader_;
+
+    // The packet buffer is bounded by bytes, sized from the stream bitrate and a read-ahead duration which grows when
+    // the buffer runs dry.
     tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> buffer_;
+    std::atomic<int64_t>                                     buffer_size_{0};
+    std::atomic<int64_t>                                     buffer_target_;
+    std::atomic<double>                                      read_ahead_;
+    std::atomic<bool>                                        filled_{false};
+    std::mutex                                               buffer_mutex_;
+    std::condition_variable                                  buffer_cond_;
 
     std::atomic<bool> eof_{false};
 
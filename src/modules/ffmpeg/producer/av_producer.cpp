@@ -1,11 +1,13 @@
 #include "av_producer.h"
 
+#include "av_frame_cache.h"
 #include "av_input.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
 #include <boost/exception/exception.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/range/algorithm/rotate.hpp>
@@ -39,6 +41,7 @@ extern "C" {
 #include <libavutil/avutil.h>
 #include <libavutil/channel_layout.h>
 #include <libavutil/error.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
@@ -56,6 +59,7 @@ extern "C" {
 #include <sstream>
 #include <string>
 #include <thread>
+#include <typeinfo>
 
 namespace caspar { namespace ffmpeg {
 
@@ -660,6 +664,17 @@ struct AVProducer::Impl
 
     int latency_ = 0;
 
+    // Frame cache. Frames are numbered from the position decoding started from (cache_origin_), and
+    // decoder_stale_ is set while frames are served from the cache and the decoder is left behind.
+    const bool           cache_;
+    const std::string    cache_stream_;
+    int64_t              cache_origin_  = 0;
+    bool                 decoder_stale_ = false;
+    std::atomic<int64_t> cache_hits_{0};
+    std::atomic<int64_t> cache_misses_{0};
+
+    std::atomic<int64_t> copy_bytes_{0};
+
     boost::thread thread_;
 
     Impl(std::shared_ptr<core::frame_factory> frame_factory,
@@ -672,7 +687,8 @@ struct AVProducer::Impl
          std::optional<int64_t>               seek,
          std::optional<int64_t>               duration,
          bool                                 loop,
-         int                                  seekable)
+         int                                  seekable,
+         bool                                 cache)
         : frame_factory_(frame_factory)
         , format_desc_(format_desc)
         , format_tb_({format_desc.duration, format_desc.time_scale * format_desc.field_count})
@@ -685,14 +701,20 @@ struct AVProducer::Impl
         , afilter_(afilter)
         , vfilter_(vfilter)
         , seekable_(seekable)
-        , video_executor_(L"video-executor")
-        , audio_executor_(L"audio-executor")
+        , video_executor_(std::in_place, L"video-executor", task_priority::normal)
+        , audio_executor_(std::in_place, L"audio-executor", task_priority::normal)
+        , cache_(cache && FrameCache::instance().capacity() > 0)
+        , cache_stream_(cache_stream_id())
     {
         diagnostics::register_graph(graph_);
         graph_->set_color("underflow", diagnostics::color(0.6f, 0.3f, 0.9f));
         graph_->set_color("frame-time", diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("decode-time", diagnostics::color(0.0f, 1.0f, 1.0f));
         graph_->set_color("buffer", diagnostics::color(1.0f, 1.0f, 0.0f));
+        graph_->set_color("copy", diagnostics::color(0.8f, 0.4f, 0.2f));
+        if (cache_) {
+            graph_->set_color("cache-hit", diagnostics::color(0.2f, 0.6f, 1.0f));
+        }
 
         state_["file/name"] = u8(name_);
         state_["file/path"] = u8(path_);
@@ -810,12 +832,21 @@ struct AVProducer::Impl
                 // check whether the next frame will last beyond the end time
                 auto time = next_pts ? next_pts + frame.duration : 0;
 
-                buffer_eof_ = (video_filter_.eof && audio_filter_.eof) || time > end;
+                // The decoder's eof only applies while it is in step with playback.
+                buffer_eof_ = (!decoder_stale_ && video_filter_.eof && audio_filter_.eof) || time > end;
 
                 if (buffer_eof_) {
                     if (loop_ && frame_count_ > 2) {
                         frame = Frame{};
-                        seek_internal(start);
+                        if (cache_ && FrameCache::instance().get(cache_stream_, start, 0)) {
+                            // Replay from the cache instead of seeking, the decoder catches up on the first miss.
+                            frame_count_   = 0;
+                            cache_origin_  = start;
+                            buffer_eof_    = false;
+                            decoder_stale_ = true;
+                        } else {
+                            seek_internal(start);
+                        }
                     } else {
                         std::this_thread::sleep_for(std::chrono::milliseconds(10));
                     }
@@ -824,6 +855,35 @@ struct AVProducer::Impl
                 }
             }
 
+            if (cache_) {
+                if (auto entry = FrameCache::instance().get(cache_stream_, cache_origin_, frame_count_)) {
+                    cache_hits_ += 1;
+                    decoder_stale_ = true;
+
+                    frame             = Frame{};
+                    frame.frame       = entry->frame;
+                    frame.start_time  = entry->start_time;
+                    frame.pts         = entry->pts;
+                    frame.duration    = entry->duration;
+                    frame.frame_count = frame_count_++;
+
+                    push_frame(frame, frame_timer, decode_timer, audio_cadence);
+                    continue;
+                }
+
+                if (decoder_stale_) {
+                    // Continue decoding from the first frame missing in the cache.
+                    const auto origin       = cache_origin_;
+                    const auto frame_number = frame_count_;
+                    const auto frame_flush  = frame_flush_;
+                    seek_internal(frame.pts != AV_NOPTS_VALUE ? frame.pts + frame.duration : origin);
+                    cache_origin_ = origin;
+                    frame_count_  = frame_number;
+                    frame_flush_  = frame_flush;
+                    continue;
+                }
+            }
+
             bool progress = false;
             {
                 progress |= schedule();
@@ -889,32 +949,103 @@ struct AVProducer::Impl
                 frame.duration   = av_rescale_q(frame.audio->nb_samples, {1, sr}, TIME_BASE_Q);
             }
 
-            frame.frame = core::draw_frame(
-                make_frame(this, *frame_factory_, frame.video, frame.audio, get_color_space(frame.video)));
-            frame.frame_count = frame_count_++;
+            std::size_t copied_bytes = 0;
+            frame.frame              = core::draw_frame(make_frame(this,
+                                                                   *frame_factory_,
+                                                                   frame.video,
+                                                                   frame.audio,
+                                                                   get_color_space(frame.video),
+                                                                   video_planes::shared,
+                                                                   &copied_bytes));
+            frame.frame_count        = frame_count_++;
+
+            graph_->set_value("copy", static_cast<double>(copied_bytes) / std::max<double>(1.0, frame_size(frame)));
+            copy_bytes_ = static_cast<int64_t>(copied_bytes);
+
+            if (cache_) {
+                cache_misses_ += 1;
+                FrameCache::instance().put(cache_stream_,
+                                           cache_origin_,
+                                           frame.frame_count,
+                                           FrameCache::Entry{frame.frame, frame.start_time, frame.pts, frame.duration},
+                                           cache_size(frame));
+            }
 
             graph_->set_value("decode-time", decode_timer.elapsed() * format_desc_.fps * 0.5);
 
-            {
-                boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
-                buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_; });
-                if (seek_ == AV_NOPTS_VALUE) {
-                    buffer_.push_back(frame);
-                }
-            }
+            push_frame(frame, frame_timer, decode_timer, audio_cadence);
+        }
+    }
 
-            if (format_desc_.field_count != 2 || frame_count_ % 2 == 1) {
-                // Update the frame-time every other frame when interlaced
-                graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.hz * 0.5);
-                frame_timer.restart();
+    void push_frame(const Frame& frame, timer& frame_timer, timer& decode_timer, std::vector<int>& audio_cadence)
+    {
+        {
+            boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
+            buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_; });
+            if (seek_ == AV_NOPTS_VALUE) {
+                buffer_.push_back(frame);
             }
+        }
 
-            decode_timer.restart();
+        if (format_desc_.field_count != 2 || frame_count_ % 2 == 1) {
+            // Update the frame-time every other frame when interlaced
+            graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.hz * 0.5);
+            frame_timer.restart();
+        }
 
-            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+        decode_timer.restart();
 
-            boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
+        graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+
+        if (cache_) {
+            const auto hits = static_cast<double>(cache_hits_);
+            graph_->set_value("cache-hit", hits / (hits + static_cast<double>(cache_misses_)));
+        }
+
+        boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
+    }
+
+    std::string cache_stream_id() const
+    {
+        // Frames are only shared between producers that decode them identically into the same kind of frame.
+        std::ostringstream str;
+        str << path_ << '|' << vfilter_ << '|' << afilter_ << '|' << u8(format_desc_.name) << '|'
+            << format_desc_.audio_channels << '|' << typeid(*frame_factory_).name();
+
+        boost::system::error_code ec;
+        auto                      write_time = boost::filesystem::last_write_time(path_, ec);
+        if (!ec) {
+            str << '|' << write_time;
+        }
+        return str.str();
+    }
+
+    static std::size_t image_size(const Frame& frame)
+    {
+        if (!frame.video) {
+            return 0;
+        }
+        return std::max(0,
+                        av_image_get_buffer_size(static_cast<AVPixelFormat>(frame.video->format),
+                                                 frame.video->width,
+                                                 frame.video->height,
+                                                 1));
+    }
+
+    static std::size_t frame_size(const Frame& frame)
+    {
+        auto size = image_size(frame);
+        if (frame.audio) {
+            size += static_cast<std::size_t>(frame.audio->nb_samples) * frame.audio->channels * sizeof(int32_t);
         }
+        return size;
+    }
+
+    // Memory a cached frame holds. The frames of a factory that uploads their image data also hold a texture of about
+    // the same size on the device, next to the host copy.
+    std::size_t cache_size(const Frame& frame) const
+    {
+        return frame_size(frame) + (frame_factory_->reads_image_data_in_place() ? 0 : image_size(frame));
     }
 
     void update_state()
@@ -924,6 +1055,11 @@ struct AVProducer::Impl
         state_["file/clip"] = {start().value_or(0) / format_desc_.fps, duration().value_or(0) / format_desc_.fps};
         state_["file/time"] = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
         state_["loop"]      = loop_;
+        if (cache_) {
+            state_["cache/hits"]   = cache_hits_.load();
+            state_["cache/misses"] = cache_misses_.load();
+        }
+        state_["frame/copy-bytes"] = copy_bytes_.load();
     }
 
     core::draw_frame prev_frame(const core::video_field field)
@@ -1158,9 +1294,11 @@ struct AVProducer::Impl
         if (seekable_) {
             input_.seek(time);
         }
-        frame_flush_ = true;
-        frame_count_ = 0;
-        buffer_eof_  = false;
+        frame_flush_   = true;
+        frame_count_   = 0;
+        buffer_eof_    = false;
+        cache_origin_  = time - (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+        decoder_stale_ = false;
 
         decoders_.clear();
 
@@ -1214,7 +1352,8 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                        std::optional<int64_t>               seek,
                        std::optional<int64_t>               duration,
                        std::optional<bool>                  loop,
-                       int                                  seekable)
+                       int                                  seekable,
+                       bool                                 cache)
     : impl_(new Impl(std::move(frame_factory),
                      std::move(format_desc),
                      std::move(name),
@@ -1225,7 +1364,8 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                      std::move(seek),
                      std::move(duration),
                      std::move(loop.value_or(false)),
-                     seekable))
+                     seekable,
+                     cache))
 {
 }
 
@@ -24,7 +24,8 @@ class AVProducer
                std::optional<int64_t>               seek,
                std::optional<int64_t>               duration,
                std::optional<bool>                  loop,
-               int                                  seekable);
+               int                                  seekable,
+               bool                                 cache = false);
 
     core::draw_frame prev_frame(const core::video_field field);
     core::draw_frame next_frame(const core::video_field field);
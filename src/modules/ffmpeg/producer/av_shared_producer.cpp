@@ -0,0 +1,107 @@
+#include "av_shared_producer.h"
+
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <map>
+
+namespace caspar { namespace ffmpeg {
+
+SharedProducer::SharedProducer(std::shared_ptr<AVProducer> producer)
+    : producer_(std::move(producer))
+{
+}
+
+std::shared_ptr<SharedProducer> SharedProducer::get(const std::string&                                  key,
+                                                    const std::function<std::shared_ptr<AVProducer>()>& factory)
+{
+    // A session is created outside the lock, as opening and probing the clip takes a while. Loads of the same key
+    // that arrive meanwhile wait for that session rather than opening the clip again.
+    struct session_entry
+    {
+        std::weak_ptr<SharedProducer>                       session;
+        std::shared_future<std::shared_ptr<SharedProducer>> pending;
+    };
+
+    static std::mutex                           mutex;
+    static std::map<std::string, session_entry> sessions;
+
+    std::promise<std::shared_ptr<SharedProducer>>       promise;
+    std::shared_future<std::shared_ptr<SharedProducer>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            it = it->second.session.expired() && !it->second.pending.valid() ? sessions.erase(it) : std::next(it);
+        }
+
+        auto& entry = sessions[key];
+        if (auto session = entry.session.lock()) {
+            return session;
+        }
+        if (entry.pending.valid()) {
+            pending = entry.pending;
+        } else {
+            entry.pending = promise.get_future().share();
+        }
+    }
+
+    if (pending.valid()) {
+        return pending.get();
+    }
+
+    std::shared_ptr<SharedProducer> session;
+    try {
+        session = std::make_shared<SharedProducer>(factory());
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.erase(key);
+        throw;
+    }
+
+    promise.set_value(session);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto&                       entry = sessions[key];
+    entry.session                     = session;
+    entry.pending                     = {};
+    return session;
+}
+
+int64_t SharedProducer::subscribe()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_position_;
+}
+
+void SharedProducer::seek(int64_t time)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Frames kept from before the seek are dropped, so that every subscriber continues from the new position.
+    producer_->seek(time);
+    frames_.clear();
+}
+
+core::draw_frame SharedProducer::next_frame(int64_t& position, const core::video_field field)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The first subscriber to reach a position pulls the frame from the decoder, the others get the same frame.
+    while (frames_.empty() || frames_.back().first < position) {
+        frames_.emplace_back(next_position_++, producer_->next_frame(field));
+        if (frames_.size() > window_size) {
+            frames_.pop_front();
+        }
+    }
+
+    // A subscriber that fell behind the window (e.g. paused) continues from the oldest frame kept.
+    position = std::max(position, frames_.front().first);
+
+    auto frame = frames_.at(static_cast<std::size_t>(position - frames_.front().first)).second;
+    position += 1;
+    return frame;
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "av_producer.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/video_format.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace caspar { namespace ffmpeg {
+
+// Decode session shared by every producer loaded with the same clip, parameters and channel format, so the clip is
+// decoded, filtered and uploaded once however many layers and channels show it. Each subscriber keeps its own
+// position and is handed the frame the session produced for it, which keeps subscribers that tick together on the same
+// frame. Frames are kept for a short window so that channels ticking slightly apart still see every frame.
+class SharedProducer
+{
+  public:
+    explicit SharedProducer(std::shared_ptr<AVProducer> producer);
+
+    // Returns the session for key, creating it with factory if no producer currently holds one. Sessions for different
+    // keys are created concurrently.
+    static std::shared_ptr<SharedProducer> get(const std::string&                                  key,
+                                               const std::function<std::shared_ptr<AVProducer>()>& factory);
+
+    // Position of the first frame for a new subscriber.
+    int64_t subscribe();
+
+    core::draw_frame next_frame(int64_t& position, const core::video_field field);
+
+    // Seeks the decoder and drops the frames kept from before the seek.
+    void seek(int64_t time);
+
+    const std::shared_ptr<AVProducer>& producer() const { return producer_; }
+
+  private:
+    static constexpr std::size_t window_size = 8;
+
+    const std::shared_ptr<AVProducer> producer_;
+
+    std::mutex                                       mutex_;
+    int64_t                                          next_position_ = 0;
+    std::deque<std::pair<int64_t, core::draw_frame>> frames_;
+};
+
+}} // namespace caspar::ffmpeg
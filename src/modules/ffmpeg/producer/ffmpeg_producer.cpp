@@ -24,6 +24,7 @@
 #include "ffmpeg_producer.h"
 
 #include "av_producer.h"
+#include "av_shared_producer.h"
 
 #include <common/env.h>
 #include <common/os/filesystem.h>
@@ -31,6 +32,7 @@
 
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_factory.h>
+#include <core/mixer/image/image_mixer.h>
 #include <core/producer/frame_producer.h>
 #include <core/video_format.h>
 
@@ -39,12 +41,17 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/logic/tribool.hpp>
 #include <common/filesystem.h>
+#include <common/media_index.h>
+
+#include <sstream>
+#include <typeinfo>
 
 #pragma warning(push, 1)
 
 extern "C" {
 #define __STDC_CONSTANT_MACROS
 #define __STDC_LIMIT_MACROS
+#include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 }
 
@@ -60,7 +67,9 @@ struct ffmpeg_producer : public core::frame_producer
     spl::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
 
-    std::shared_ptr<AVProducer> producer_;
+    std::shared_ptr<AVProducer>     producer_;
+    std::shared_ptr<SharedProducer> shared_;
+    int64_t                         position_ = 0;
 
   public:
     explicit ffmpeg_producer(spl::shared_ptr<core::frame_factory> frame_factory,
@@ -73,28 +82,53 @@ struct ffmpeg_producer : public core::frame_producer
                              std::optional<int64_t>               seek,
                              std::optional<int64_t>               duration,
                              std::optional<bool>                  loop,
-                             int                                  seekable)
+                             int                                  seekable,
+                             bool                                 cache,
+                             bool                                 shared)
         : filename_(filename)
         , frame_factory_(frame_factory)
         , format_desc_(format_desc)
-        , producer_(new AVProducer(frame_factory_,
-                                   format_desc_,
-                                   u8(path),
-                                   u8(filename),
-                                   u8(vfilter),
-                                   u8(afilter),
-                                   start,
-                                   seek,
-                                   duration,
-                                   loop,
-                                   seekable))
     {
+        auto create = [&] {
+            return std::make_shared<AVProducer>(frame_factory_,
+                                                format_desc_,
+                                                u8(path),
+                                                u8(filename),
+                                                u8(vfilter),
+                                                u8(afilter),
+                                                start,
+                                                seek,
+                                                duration,
+                                                loop,
+                                                seekable,
+                                                cache);
+        };
+
+        if (shared) {
+            // The frames of a session are made by the frame factory of the channel that created it, so they are only
+            // shared with channels whose mixers are of the same kind, CPU or OpenGL, and draw at the same depth.
+            const auto& factory = *frame_factory_;
+            auto        mixer   = dynamic_cast<const core::image_mixer*>(&factory);
+
+            std::ostringstream key;
+            key << u8(filename) << '|' << u8(vfilter) << '|' << u8(afilter) << '|' << start.value_or(-1) << '|'
+                << seek.value_or(-1) << '|' << duration.value_or(-1) << '|' << loop.value_or(false) << '|' << seekable
+                << '|' << cache << '|' << u8(format_desc_.name) << '|' << typeid(factory).name() << '|'
+                << (mixer ? static_cast<int>(mixer->depth()) : -1);
+
+            shared_   = SharedProducer::get(key.str(), create);
+            producer_ = shared_->producer();
+            position_ = shared_->subscribe();
+        } else {
+            producer_ = create();
+        }
     }
 
     ~ffmpeg_producer()
     {
-        std::thread([producer = std::move(producer_)]() mutable {
+        std::thread([producer = std::move(producer_), shared = std::move(shared_)]() mutable {
             try {
+                shared.reset();
                 producer.reset();
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
@@ -108,7 +142,7 @@ struct ffmpeg_producer : public core::frame_producer
 
     core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
     {
-        return producer_->next_frame(field);
+        return shared_ ? shared_->next_frame(position_, field) : producer_->next_frame(field);
     }
 
     std::uint32_t frame_number() const override
@@ -176,7 +210,11 @@ struct ffmpeg_producer : public core::frame_producer
                 seek += boost::lexical_cast<int64_t>(params.at(2));
             }
 
-            producer_->seek(seek);
+            if (shared_) {
+                shared_->seek(seek);
+            } else {
+                producer_->seek(seek);
+            }
 
             result = std::to_wstring(seek);
         } else {
@@ -275,6 +313,95 @@ bool is_valid_file(const boost::filesystem::path& filename)
     return av_probe_input_format2(&pb, true, &score) != nullptr;
 }
 
+std::optional<media_info> probe_media(const boost::filesystem::path& path)
+{
+    if (!is_valid_file(path)) {
+        return {};
+    }
+
+    AVFormatContext* ctx = nullptr;
+    if (avformat_open_input(&ctx, u8(path.wstring()).c_str(), nullptr, nullptr) < 0) {
+        return {};
+    }
+    std::shared_ptr<AVFormatContext> guard(ctx, [](AVFormatContext* ptr) { avformat_close_input(&ptr); });
+
+    if (avformat_find_stream_info(ctx, nullptr) < 0) {
+        return {};
+    }
+
+    media_info      info;
+    const AVStream* video = nullptr;
+    const AVStream* audio = nullptr;
+
+    for (unsigned n = 0; n < ctx->nb_streams; ++n) {
+        const auto st  = ctx->streams[n];
+        const auto par = st->codecpar;
+
+        media_stream_info stream;
+        if (auto type = av_get_media_type_string(par->codec_type)) {
+            stream.type = type;
+        }
+        stream.codec = avcodec_get_name(par->codec_id);
+
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            stream.width  = par->width;
+            stream.height = par->height;
+            switch (par->field_order) {
+                case AV_FIELD_PROGRESSIVE:
+                    stream.field_order = "progressive";
+                    break;
+                case AV_FIELD_TT:
+                    stream.field_order = "tt";
+                    break;
+                case AV_FIELD_BB:
+                    stream.field_order = "bb";
+                    break;
+                case AV_FIELD_TB:
+                    stream.field_order = "tb";
+                    break;
+                case AV_FIELD_BT:
+                    stream.field_order = "bt";
+                    break;
+                default:
+                    break;
+            }
+            if (!video && !(st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+                video = st;
+            }
+        } else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+            stream.sample_rate = par->sample_rate;
+            stream.channels    = par->channels;
+            if (!audio) {
+                audio = st;
+            }
+        }
+
+        info.streams.push_back(std::move(stream));
+    }
+
+    const auto duration = ctx->duration != AV_NOPTS_VALUE ? ctx->duration : 0;
+    const auto format   = std::string(ctx->iformat->name);
+
+    if (video) {
+        auto rate = video->avg_frame_rate.num > 0 ? video->avg_frame_rate : video->r_frame_rate;
+        if (format == "image2" || boost::algorithm::ends_with(format, "_pipe") || rate.num <= 0) {
+            info.still = true;
+        } else {
+            info.time_base_num = rate.den;
+            info.time_base_den = rate.num;
+            info.duration      = av_rescale(duration, rate.num, static_cast<int64_t>(rate.den) * AV_TIME_BASE);
+        }
+    } else if (audio && audio->codecpar->sample_rate > 0) {
+        info.time_base_num = 1;
+        info.time_base_den = audio->codecpar->sample_rate;
+        info.duration      = av_rescale(duration, audio->codecpar->sample_rate, AV_TIME_BASE);
+    } else {
+        return {};
+    }
+
+    return info;
+}
+
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params)
 {
@@ -300,6 +427,10 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
 
     auto loop = contains_param(L"LOOP", params);
 
+    auto cache = contains_param(L"CACHE", params);
+
+    auto shared = contains_param(L"SHARED", params);
+
     auto seek = get_param(L"SEEK", params, static_cast<uint32_t>(0));
     auto in   = get_param(L"IN", params, seek);
 
@@ -350,7 +481,9 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
                                                           seek2,
                                                           duration,
                                                           loop,
-                                                          seekable);
+                                                          seekable,
+                                                          cache,
+                                                          shared);
         return core::create_destroy_proxy(std::move(producer));
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
@@ -21,10 +21,14 @@
 
 #pragma once
 
+#include <common/media_index.h>
 #include <common/memory.h>
 
 #include <core/fwd.h>
 
+#include <boost/filesystem/path.hpp>
+
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -33,4 +37,7 @@ namespace caspar { namespace ffmpeg {
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params);
 
+// Duration, streams and codecs of a file ffmpeg can play, for the media index.
+std::optional<media_info> probe_media(const boost::filesystem::path& path);
+
 }} // namespace caspar::ffmpeg
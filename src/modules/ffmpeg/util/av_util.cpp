@@ -20,6 +20,7 @@ extern "C" {
 #endif
 
 #include <array>
+#include <atomic>
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
 
@@ -47,7 +48,9 @@ core::mutable_frame make_frame(void*                    tag,
                                core::frame_factory&     frame_factory,
                                std::shared_ptr<AVFrame> video,
                                std::shared_ptr<AVFrame> audio,
-                               core::color_space        color_space)
+                               core::color_space        color_space,
+                               video_planes             planes,
+                               std::size_t*             copied_bytes)
 {
     std::vector<int> data_map; // TODO(perf) when using data_map, avoid uploading duplicate planes
 
@@ -58,17 +61,28 @@ core::mutable_frame make_frame(void*                    tag,
 
     auto frame = frame_factory.create_frame(tag, pix_desc);
 
+    std::atomic<std::size_t> copied{0};
+
     tbb::parallel_invoke(
         [&]() {
             if (video) {
                 for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
                     auto frame_plan_index = data_map.empty() ? n : data_map.at(n);
 
+                    if (planes == video_planes::shared && frame_factory.reads_image_data_in_place() && video->buf[0] &&
+                        video->linesize[frame_plan_index] == pix_desc.planes[n].linesize) {
+                        // The plane is already packed, reference it instead of copying.
+                        frame.image_data(n) = array<std::uint8_t>(
+                            video->data[frame_plan_index], static_cast<std::size_t>(pix_desc.planes[n].size), video);
+                        continue;
+                    }
+
                     tbb::parallel_for(0, pix_desc.planes[n].height, [&](int y) {
                         std::memcpy(frame.image_data(n).begin() + y * pix_desc.planes[n].linesize,
                                     video->data[frame_plan_index] + y * video->linesize[frame_plan_index],
                                     pix_desc.planes[n].linesize);
                     });
+                    copied += static_cast<std::size_t>(pix_desc.planes[n].linesize) * pix_desc.planes[n].height;
                 }
             }
         },
@@ -92,9 +106,14 @@ core::mutable_frame make_frame(void*                    tag,
                         }
                     }
                 }
+                copied += sizeof(int32_t) * audio->nb_samples * std::min(channel_count, audio->channels);
             }
         });
 
+    if (copied_bytes) {
+        *copied_bytes = copied;
+    }
+
     return frame;
 }
 
@@ -5,6 +5,7 @@
 #include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
+#include <cstddef>
 #include <map>
 #include <memory>
 #include <vector>
@@ -25,11 +26,25 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat     pix_fmt,
                                           int               height,
                                           std::vector<int>& data_map,
                                           core::color_space color_space = core::color_space::bt709);
-core::mutable_frame     make_frame(void*                    tag,
-                                   core::frame_factory&     frame_factory,
-                                   std::shared_ptr<AVFrame> video,
-                                   std::shared_ptr<AVFrame> audio,
-                                   core::color_space        color_space = core::color_space::bt709);
+
+// Video planes are either copied into frame_factory memory or, with video_planes::shared, referenced from the AVFrame
+// when they already have the packed layout the mixer expects and the mixer reads image data in place. Mixers that
+// upload from their own buffers always get a copy, as sharing would only move that copy elsewhere. Shared planes keep
+// the AVFrame buffers alive for as long as the frame, so only use it for frames from decoders and filters with growable
+// buffer pools. copied_bytes is set to the number of image and audio bytes copied.
+enum class video_planes
+{
+    copy,
+    shared,
+};
+
+core::mutable_frame make_frame(void*                    tag,
+                               core::frame_factory&     frame_factory,
+                               std::shared_ptr<AVFrame> video,
+                               std::shared_ptr<AVFrame> audio,
+                               core::color_space        color_space  = core::color_space::bt709,
+                               video_planes             planes       = video_planes::copy,
+                               std::size_t*             copied_bytes = nullptr);
 
 std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
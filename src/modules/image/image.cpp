@@ -27,7 +27,9 @@
 #include "consumer/image_consumer.h"
 #include "producer/image_producer.h"
 #include "producer/image_scroll_producer.h"
+#include "util/image_cache.h"
 
+#include <common/env.h>
 #include <common/utf.h>
 
 namespace caspar { namespace image {
@@ -37,11 +39,16 @@ std::wstring version() { return u16(FreeImage_GetVersion()); }
 void init(const core::module_dependencies& dependencies)
 {
     FreeImage_Initialise();
+    set_image_cache_size(env::properties().get(L"configuration.image.cache-size", 256) * std::size_t{1024 * 1024});
     dependencies.producer_registry->register_producer_factory(L"Image Scroll Producer", create_scroll_producer);
     dependencies.producer_registry->register_producer_factory(L"Image Producer", create_producer);
     dependencies.consumer_registry->register_consumer_factory(L"Image Consumer", create_consumer);
 }
 
-void uninit() { FreeImage_DeInitialise(); }
+void uninit()
+{
+    set_image_cache_size(0);
+    FreeImage_DeInitialise();
+}
 
 }} // namespace caspar::image
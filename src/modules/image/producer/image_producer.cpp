@@ -28,6 +28,8 @@
 #endif
 #include <FreeImage.h>
 
+#include "../util/image_algorithms.h"
+#include "../util/image_cache.h"
 #include "../util/image_loader.h"
 
 #include <core/video_format.h>
@@ -41,34 +43,91 @@
 
 #include <common/array.h>
 #include <common/env.h>
+#include <common/except.h>
+#include <common/executor.h>
 #include <common/filesystem.h>
 #include <common/log.h>
 #include <common/os/filesystem.h>
 #include <common/param.h>
+#include <common/utf.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/exception/errinfo_file_name.hpp>
 #include <boost/filesystem.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
 #include <set>
 #include <utility>
 
 namespace caspar { namespace image {
 
+namespace {
+
+core::draw_frame
+make_frame(const void* tag, const spl::shared_ptr<core::frame_factory>& frame_factory, const decoded_image& image)
+{
+    auto bitmap = image.bitmap.get();
+    auto width  = static_cast<int>(FreeImage_GetWidth(bitmap));
+    auto height = static_cast<int>(FreeImage_GetHeight(bitmap));
+    auto pitch  = static_cast<std::ptrdiff_t>(FreeImage_GetPitch(bitmap));
+
+    core::pixel_format_desc desc(core::pixel_format::bgra);
+    desc.planes.emplace_back(width, height, 4);
+    auto frame = frame_factory->create_frame(tag, desc);
+
+    // FreeImage stores the rows bottom up, so the flip, the premultiply and the copy are one pass over the pixels.
+    copy_pixels(FreeImage_GetBits(bitmap) + (height - 1) * pitch,
+                -pitch,
+                frame.image_data(0).data(),
+                static_cast<std::ptrdiff_t>(width) * 4,
+                width,
+                height,
+                image.premultiply);
+
+    return core::draw_frame(std::move(frame));
+}
+
+} // namespace
+
 struct image_producer : public core::frame_producer
 {
     core::monitor::state                       state_;
     const std::wstring                         description_;
     const spl::shared_ptr<core::frame_factory> frame_factory_;
     const uint32_t                             length_ = 0;
-    core::draw_frame                           frame_;
+
+    std::mutex                    frame_mutex_;
+    std::future<core::draw_frame> future_frame_;
+    core::draw_frame              frame_;
+    std::atomic<bool>             failed_{false};
 
     image_producer(const spl::shared_ptr<core::frame_factory>& frame_factory, std::wstring description, uint32_t length)
         : description_(std::move(description))
         , frame_factory_(frame_factory)
         , length_(length)
     {
-        load(load_image(description_));
+        if (!boost::filesystem::exists(description_))
+            CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(description_)));
+
+        // The header is read here, so that a file that is not a supported image fails to load. The pixels are decoded,
+        // or taken from the still cache, on the worker pool, and the producer is not ready until its frame is done.
+        read_image_size(description_);
+
+        auto promise  = std::make_shared<std::promise<core::draw_frame>>();
+        future_frame_ = promise->get_future();
+
+        enqueue_task(task_priority::normal,
+                     [promise, frame_factory = frame_factory_, filename = description_, tag = this] {
+                         try {
+                             promise->set_value(make_frame(tag, frame_factory, *get_cached_image(filename)));
+                         } catch (...) {
+                             promise->set_exception(std::current_exception());
+                         }
+                     });
 
         CASPAR_LOG(info) << print() << L" Initialized";
     }
@@ -81,34 +140,49 @@ struct image_producer : public core::frame_producer
         , frame_factory_(frame_factory)
         , length_(length)
     {
-        load(load_png_from_memory(png_data, size));
+        frame_ = make_frame(this, frame_factory_, decoded_image{load_png_from_memory(png_data, size), false});
 
         CASPAR_LOG(info) << print() << L" Initialized";
     }
 
-    void load(const std::shared_ptr<FIBITMAP>& bitmap)
+    core::draw_frame frame()
     {
-        FreeImage_FlipVertical(bitmap.get());
-        core::pixel_format_desc desc(core::pixel_format::bgra);
-        desc.planes.emplace_back(FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()), 4);
-        auto frame = frame_factory_->create_frame(this, desc);
+        std::lock_guard<std::mutex> lock(frame_mutex_);
+
+        if (future_frame_.valid() && future_frame_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            try {
+                frame_ = future_frame_.get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(error) << print() << L" Failed to load image.";
+                failed_ = true;
+            }
+        }
 
-        std::copy_n(FreeImage_GetBits(bitmap.get()), frame.image_data(0).size(), frame.image_data(0).begin());
-        frame_ = core::draw_frame(std::move(frame));
+        return frame_;
     }
 
     // frame_producer
 
-    core::draw_frame last_frame(const core::video_field field) override { return frame_; }
+    core::draw_frame last_frame(const core::video_field field) override { return frame(); }
 
-    core::draw_frame first_frame(const core::video_field field) override { return frame_; }
+    core::draw_frame first_frame(const core::video_field field) override { return frame(); }
 
-    bool is_ready() override { return true; }
+    bool is_ready() override
+    {
+        frame();
+
+        std::lock_guard<std::mutex> lock(frame_mutex_);
+        return !future_frame_.valid();
+    }
 
     core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
     {
-        state_["file/path"] = description_;
-        return frame_;
+        auto result = frame();
+
+        state_["file/path"]   = description_;
+        state_["file/failed"] = failed_.load();
+        return result;
     }
 
     uint32_t nb_frames() const override { return length_; }
@@ -30,8 +30,10 @@
 #include <FreeImage.h>
 
 #include "../util/image_algorithms.h"
+#include "../util/image_cache.h"
 #include "../util/image_loader.h"
-#include "../util/image_view.h"
+#include "../util/png_row_reader.h"
+#include "../util/scroll_layout.h"
 
 #include <core/video_format.h>
 
@@ -45,6 +47,7 @@
 #include <common/array.h>
 #include <common/env.h>
 #include <common/except.h>
+#include <common/executor.h>
 #include <common/filesystem.h>
 #include <common/future.h>
 #include <common/log.h>
@@ -56,11 +59,16 @@
 #include <boost/date_time.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/scoped_array.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <future>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <utility>
 
@@ -106,15 +114,151 @@ class speed_tweener
     }
 };
 
+// The frames of the scroll are made from screen sized tiles of the image as they come near the screen, and dropped
+// once they have passed it, so the frame and GPU memory kept do not depend on the size of the image. Vertical scrolls
+// of PNG files read the rows of the tiles from the file as they are needed, anything else is decoded whole, up to
+// configuration.image.scroll-max-size, as FreeImage cannot decode part of an image. Tiles are started this far ahead of
+// the scroll.
+constexpr double prefetch_seconds = 1.0;
+
+// The rows of a PNG file, read by one tile at a time.
+struct streamed_image
+{
+    std::mutex     mutex;
+    png_row_reader reader;
+
+    streamed_image(const std::wstring& filename, int checkpoint_interval, int keep_rows)
+        : reader(filename, checkpoint_interval, keep_rows)
+    {
+    }
+};
+
+// Where the tiles take their pixels from, the whole decoded image or a streamed one, and how they are processed.
+struct tile_source
+{
+    std::shared_ptr<const decoded_image> image;
+    std::shared_ptr<streamed_image>      stream;
+    int                                  width       = 0;
+    int                                  height      = 0;
+    int                                  premultiply = 0; // times the color is multiplied with alpha
+    std::vector<std::uint8_t>            blur_weights;    // of the motion trail, empty for no motion blur
+    int                                  blur_dx = 0;
+    int                                  blur_dy = 0;
+
+    // Copies the pixels at x, y top down to dst, multiplied with alpha once when premultiply is set.
+    void read(int x, int y, int w, int h, std::uint8_t* dst, std::ptrdiff_t dst_pitch, bool premultiply) const
+    {
+        if (stream) {
+            {
+                std::lock_guard<std::mutex> lock(stream->mutex);
+                stream->reader.read(x, y, w, h, dst, dst_pitch);
+            }
+            if (premultiply)
+                copy_pixels(dst, dst_pitch, dst, dst_pitch, w, h, true);
+        } else {
+            auto bitmap = image->bitmap.get();
+            auto pitch  = static_cast<std::ptrdiff_t>(FreeImage_GetPitch(bitmap));
+
+            // FreeImage stores the rows bottom up, so row y from the top is found backwards from the last row.
+            const std::uint8_t* top = FreeImage_GetBits(bitmap) + (height - 1) * pitch;
+
+            copy_pixels(top - y * pitch + x * 4, -pitch, dst, dst_pitch, w, h, premultiply);
+        }
+    }
+};
+
+core::draw_frame make_tile(const void*                                 tag,
+                           const spl::shared_ptr<core::frame_factory>& frame_factory,
+                           const tile_source&                          source,
+                           const scroll_tile&                          t,
+                           int                                         frame_width,
+                           int                                         frame_height,
+                           bool                                        vertical)
+{
+    core::pixel_format_desc desc(core::pixel_format::bgra);
+    desc.planes.emplace_back(frame_width, frame_height, 4);
+    auto frame = frame_factory->create_frame(tag, desc);
+
+    if (t.width != frame_width || t.height != frame_height)
+        std::memset(frame.image_data(0).data(), 0, frame.image_data(0).size());
+
+    const auto dst_pitch = static_cast<std::ptrdiff_t>(frame_width) * 4;
+    const auto dst       = frame.image_data(0).data() + t.frame_y * dst_pitch + t.frame_x * 4;
+
+    if (source.premultiply == 0 && source.blur_weights.empty()) {
+        source.read(t.x, t.y, t.width, t.height, dst, dst_pitch, false);
+    } else {
+        // The tile and the part of the image its motion trail reaches, premultiplied before the blur.
+        const int margin = static_cast<int>(source.blur_weights.size());
+
+        int x0 = t.x;
+        int y0 = t.y;
+        int x1 = t.x + t.width;
+        int y1 = t.y + t.height;
+        if (source.blur_dx < 0)
+            x0 = std::max(0, x0 - margin);
+        if (source.blur_dx > 0)
+            x1 = std::min(source.width, x1 + margin);
+        if (source.blur_dy < 0)
+            y0 = std::max(0, y0 - margin);
+        if (source.blur_dy > 0)
+            y1 = std::min(source.height, y1 + margin);
+
+        const auto                scratch_pitch = static_cast<std::ptrdiff_t>(x1 - x0) * 4;
+        std::vector<std::uint8_t> scratch(scratch_pitch * (y1 - y0));
+
+        source.read(x0, y0, x1 - x0, y1 - y0, scratch.data(), scratch_pitch, source.premultiply > 0);
+        for (int n = 1; n < source.premultiply; ++n)
+            copy_pixels(scratch.data(), scratch_pitch, scratch.data(), scratch_pitch, x1 - x0, y1 - y0, true);
+
+        if (source.blur_weights.empty()) {
+            copy_pixels(scratch.data() + (t.y - y0) * scratch_pitch + (t.x - x0) * 4,
+                        scratch_pitch,
+                        dst,
+                        dst_pitch,
+                        t.width,
+                        t.height,
+                        false);
+        } else {
+            motion_blur(scratch.data(),
+                        scratch_pitch,
+                        x1 - x0,
+                        y1 - y0,
+                        t.x - x0,
+                        t.y - y0,
+                        t.width,
+                        t.height,
+                        source.blur_dx,
+                        source.blur_dy,
+                        source.blur_weights,
+                        dst,
+                        dst_pitch);
+        }
+    }
+
+    core::draw_frame draw_frame(std::move(frame));
+
+    // Set the relative position to the other image fragments
+    draw_frame.transform().image_transform.fill_translation[vertical ? 1 : 0] = t.translation;
+
+    return draw_frame;
+}
+
 struct image_scroll_producer : public core::frame_producer
 {
     core::monitor::state state_;
 
-    const std::wstring            filename_;
-    std::vector<core::draw_frame> frames_;
-    core::video_format_desc       format_desc_;
-    int                           width_;
-    int                           height_;
+    const std::wstring                         filename_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::video_format_desc                    format_desc_;
+    const scroll_layout                        layout_;
+    const int                                  width_;
+    const int                                  height_;
+
+    std::future<std::shared_ptr<const tile_source>>     future_source_;
+    std::shared_ptr<const tile_source>                  source_;
+    bool                                                failed_ = false;
+    std::map<int, std::shared_future<core::draw_frame>> tiles_;
 
     double                                  delta_ = 0.0;
     speed_tweener                           speed_;
@@ -130,10 +274,15 @@ struct image_scroll_producer : public core::frame_producer
                                    double                                      s,
                                    double                                      duration,
                                    std::optional<boost::posix_time::ptime>     end_time,
+                                   std::size_t                                 max_decoded_size,
                                    int                                         motion_blur_px         = 0,
                                    bool                                        premultiply_with_alpha = false)
         : filename_(std::move(filename))
+        , frame_factory_(frame_factory)
         , format_desc_(std::move(format_desc))
+        , layout_(read_layout(filename_, format_desc_))
+        , width_(layout_.image_width())
+        , height_(layout_.image_height())
         , end_time_(std::move(end_time))
     {
         double speed = s;
@@ -141,12 +290,6 @@ struct image_scroll_producer : public core::frame_producer
         if (end_time_)
             speed = -1.0;
 
-        auto bitmap = load_image(filename_);
-        FreeImage_FlipVertical(bitmap.get());
-
-        width_  = FreeImage_GetWidth(bitmap.get());
-        height_ = FreeImage_GetHeight(bitmap.get());
-
         bool vertical   = width_ == format_desc_.width;
         bool horizontal = height_ == format_desc_.height;
 
@@ -154,6 +297,13 @@ struct image_scroll_producer : public core::frame_producer
             CASPAR_THROW_EXCEPTION(caspar::user_error()
                                    << msg_info("Neither width nor height matched the video resolution"));
 
+        // Streaming the rows of a horizontal scroll would read the whole file for every tile.
+        bool streamed = vertical && png_row_reader::can_read(filename_);
+
+        if (!streamed && static_cast<std::size_t>(width_) * static_cast<std::size_t>(height_) * 4 > max_decoded_size)
+            CASPAR_THROW_EXCEPTION(caspar::user_error()
+                                   << msg_info("Image too large to decode for a scroll, see image scroll-max-size"));
+
         if (duration != 0.0)
             speed = speed_from_duration(duration);
 
@@ -170,97 +320,143 @@ struct image_scroll_producer : public core::frame_producer
 
         speed_ = speed_tweener(speed, speed, 0, tweener(L"linear"));
 
-        auto                   bytes = FreeImage_GetBits(bitmap.get());
-        auto                   count = width_ * height_ * 4;
-        image_view<bgra_pixel> original_view(bytes, width_, height_);
+        tile_source options;
+        options.width  = width_;
+        options.height = height_;
 
         if (premultiply_with_alpha)
-            premultiply(original_view);
-
-        boost::scoped_array<uint8_t> blurred_copy;
+            options.premultiply = 1;
 
         if (motion_blur_px > 0) {
-            double angle = 3.14159265 / 2; // Up
-
-            if (horizontal && speed < 0)
-                angle *= 2; // Left
-            else if (vertical && speed > 0)
-                angle *= 3; // Down
-            else if (horizontal && speed > 0)
-                angle = 0.0; // Right
-
-            blurred_copy.reset(new uint8_t[count]);
-            image_view<bgra_pixel> blurred_view(blurred_copy.get(), width_, height_);
-            caspar::tweener        blur_tweener(L"easeInQuad");
-            blur(original_view, blurred_view, angle, motion_blur_px, blur_tweener);
-            bytes = blurred_copy.get();
-            bitmap.reset();
+            // Up
+            options.blur_dy = -1;
+
+            if (horizontal && speed < 0) {
+                options.blur_dx = -1; // Left
+                options.blur_dy = 0;
+            } else if (vertical && speed > 0) {
+                options.blur_dy = 1; // Down
+            } else if (horizontal && speed > 0) {
+                options.blur_dx = 1; // Right
+                options.blur_dy = 0;
+            }
+
+            caspar::tweener blur_tweener(L"easeInQuad");
+            options.blur_weights = get_tweened_values<uint8_t>(blur_tweener, motion_blur_px + 2, 255, 0);
+            options.blur_weights.pop_back();
+            options.blur_weights.erase(options.blur_weights.begin());
         }
 
-        if (vertical) {
-            int n = 1;
-
-            while (count > 0) {
-                core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
-                desc.planes.emplace_back(width_, format_desc_.height, 4);
-                auto frame = frame_factory->create_frame(this, desc);
-
-                if (count >= frame.image_data(0).size()) {
-                    std::copy_n(bytes + count - frame.image_data(0).size(),
-                                frame.image_data(0).size(),
-                                frame.image_data(0).begin());
-                    count -= static_cast<int>(frame.image_data(0).size());
-                } else {
-                    memset(frame.image_data(0).begin(), 0, frame.image_data(0).size());
-                    std::copy_n(bytes, count, frame.image_data(0).begin() + format_desc_.size - count);
-                    count = 0;
-                }
-
-                core::draw_frame draw_frame(std::move(frame));
-
-                // Set the relative position to the other image fragments
-                draw_frame.transform().image_transform.fill_translation[1] = -n++;
-
-                frames_.push_back(draw_frame);
-            }
-        } else if (horizontal) {
-            int i = 0;
-            while (count > 0) {
-                core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
-                desc.planes.emplace_back(format_desc_.width, height_, 4);
-                auto frame = frame_factory->create_frame(this, desc);
-                if (count >= frame.image_data(0).size()) {
-                    for (int y = 0; y < height_; ++y)
-                        std::copy_n(bytes + i * format_desc_.width * 4 + y * width_ * 4,
-                                    format_desc_.width * 4,
-                                    frame.image_data(0).begin() + y * format_desc_.width * 4);
-
-                    ++i;
-                    count -= static_cast<int>(frame.image_data(0).size());
-                } else {
-                    memset(frame.image_data(0).begin(), 0, frame.image_data(0).size());
-                    auto width2 = width_ % format_desc_.width;
-                    for (int y = 0; y < height_; ++y)
-                        std::copy_n(bytes + i * format_desc_.width * 4 + y * width_ * 4,
-                                    width2 * 4,
-                                    frame.image_data(0).begin() + y * format_desc_.width * 4);
-
-                    count = 0;
-                }
-
-                frames_.emplace_back(std::move(frame));
-            }
+        auto promise   = std::make_shared<std::promise<std::shared_ptr<const tile_source>>>();
+        future_source_ = promise->get_future();
+
+        // A streamed image keeps its inflate state at every tile, and the rows of a motion trail that reaches into the
+        // next tile.
+        auto interval  = format_desc_.height;
+        auto keep_rows = static_cast<int>(options.blur_weights.size()) + 1;
+
+        enqueue_task(task_priority::normal,
+                     [promise,
+                      options  = std::move(options),
+                      filename = filename_,
+                      streamed,
+                      interval,
+                      keep_rows]() mutable {
+                         try {
+                             auto source = std::make_shared<tile_source>(std::move(options));
+                             if (streamed) {
+                                 // PNG, so straight alpha as FreeImage would decode it.
+                                 source->stream = std::make_shared<streamed_image>(filename, interval, keep_rows);
+                                 source->premultiply += 1;
+                             } else {
+                                 source->image = get_cached_image(filename);
+                                 if (source->image->premultiply)
+                                     source->premultiply += 1;
+                             }
+                             promise->set_value(std::move(source));
+                         } catch (...) {
+                             promise->set_exception(std::current_exception());
+                         }
+                     });
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // Only the header is read here, the image is decoded or streamed on the worker pool.
+    static scroll_layout read_layout(const std::wstring& filename, const core::video_format_desc& format_desc)
+    {
+        auto [width, height] = read_image_size(filename);
+        return scroll_layout(width, height, format_desc.width, format_desc.height);
+    }
 
-            std::reverse(frames_.begin(), frames_.end());
+    bool is_vertical() const { return layout_.vertical(); }
 
-            // Set the relative positions of the image fragments.
-            for (size_t n = 0; n < frames_.size(); ++n) {
-                double translation                                         = -(static_cast<double>(n) + 1.0);
-                frames_[n].transform().image_transform.fill_translation[0] = translation;
+    double motion_offset_in_screens() const
+    {
+        if (is_vertical())
+            return (static_cast<double>(start_offset_y_) + delta_) / static_cast<double>(format_desc_.height);
+        else
+            return (static_cast<double>(start_offset_x_) + delta_) / static_cast<double>(format_desc_.width);
+    }
+
+    // Starts the tiles that are on or coming onto the screen and drops those that have left it. Returns false while
+    // the image is still being opened.
+    bool update_tiles()
+    {
+        if (!source_ && !failed_) {
+            if (future_source_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return false;
+
+            try {
+                source_ = future_source_.get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(error) << print() << L" Failed to load image.";
+                failed_ = true;
             }
         }
 
-        CASPAR_LOG(info) << print() << L" Initialized";
+        if (failed_)
+            return true;
+
+        auto live = layout_.live_tiles(motion_offset_in_screens(), speed_.fetch(), format_desc_.fps * prefetch_seconds);
+
+        for (auto it = tiles_.begin(); it != tiles_.end();) {
+            if (std::find(live.begin(), live.end(), it->first) == live.end())
+                it = tiles_.erase(it);
+            else
+                ++it;
+        }
+
+        auto frame_width  = is_vertical() ? width_ : format_desc_.width;
+        auto frame_height = is_vertical() ? format_desc_.height : height_;
+
+        for (auto index : live) {
+            if (tiles_.count(index) > 0)
+                continue;
+
+            auto promise = std::make_shared<std::promise<core::draw_frame>>();
+            tiles_.emplace(index, promise->get_future().share());
+
+            enqueue_task(task_priority::normal,
+                         [promise,
+                          tag           = static_cast<const void*>(this),
+                          frame_factory = frame_factory_,
+                          source        = source_,
+                          t             = layout_.tile(index),
+                          frame_width,
+                          frame_height,
+                          vertical = is_vertical()] {
+                             try {
+                                 promise->set_value(
+                                     make_tile(tag, frame_factory, *source, t, frame_width, frame_height, vertical));
+                             } catch (...) {
+                                 promise->set_exception(std::current_exception());
+                             }
+                         });
+        }
+
+        return true;
     }
 
     double get_total_num_pixels() const
@@ -295,42 +491,45 @@ struct image_scroll_producer : public core::frame_producer
         return make_ready_future<std::wstring>(L"");
     }
 
+    // The visible tiles that are ready, never waiting for the others on the channel's thread.
     std::vector<core::draw_frame> get_visible()
     {
         std::vector<core::draw_frame> result;
-        result.reserve(frames_.size());
-
-        for (auto& frame : frames_) {
-            auto& fill_translation = frame.transform().image_transform.fill_translation;
-
-            if (width_ == format_desc_.width) {
-                auto motion_offset_in_screens =
-                    (static_cast<double>(start_offset_y_) + delta_) / static_cast<double>(format_desc_.height);
-                auto vertical_offset = fill_translation[1] + motion_offset_in_screens;
-
-                if (vertical_offset < -1.0 || vertical_offset > 1.0) {
-                    continue;
-                }
-            } else {
-                auto motion_offset_in_screens =
-                    (static_cast<double>(start_offset_x_) + delta_) / static_cast<double>(format_desc_.width);
-                auto horizontal_offset = fill_translation[0] + motion_offset_in_screens;
-
-                if (horizontal_offset < -1.0 || horizontal_offset > 1.0) {
-                    continue;
-                }
+        result.reserve(tiles_.size());
+
+        auto motion = motion_offset_in_screens();
+
+        for (auto& [index, frame] : tiles_) {
+            if (!layout_.visible(index, motion) ||
+                frame.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;
+
+            try {
+                result.push_back(frame.get());
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
             }
+        }
 
-            result.push_back(frame);
+        return result;
+    }
+
+    bool is_visible_ready()
+    {
+        auto motion = motion_offset_in_screens();
+
+        for (auto& [index, frame] : tiles_) {
+            if (layout_.visible(index, motion) && frame.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return false;
         }
 
-        return std::move(result);
+        return true;
     }
 
     // frame_producer
     core::draw_frame render_frame(bool allow_eof)
     {
-        if (frames_.empty())
+        if (failed_ || layout_.tile_count() == 0)
             return core::draw_frame::empty();
 
         core::draw_frame result(get_visible());
@@ -355,6 +554,14 @@ struct image_scroll_producer : public core::frame_producer
 
     core::draw_frame render_frame(bool allow_eof, bool advance_delta)
     {
+        if (!update_tiles())
+            return core::draw_frame{};
+
+        // Tiles are started well ahead, so this only happens when the scroll has outrun the worker pool. The last
+        // frame is shown again and the scroll holds until the tiles have caught up.
+        if (frame_ && !is_visible_ready())
+            return frame_;
+
         auto result = render_frame(allow_eof);
 
         if (advance_delta) {
@@ -403,7 +610,7 @@ struct image_scroll_producer : public core::frame_producer
 
     core::monitor::state state() const override { return state_; }
 
-    bool is_ready() override { return !frames_.empty(); }
+    bool is_ready() override { return update_tiles() && is_visible_ready(); }
 };
 
 spl::shared_ptr<core::frame_producer> create_scroll_producer(const core::frame_producer_dependencies& dependencies,
@@ -439,6 +646,9 @@ spl::shared_ptr<core::frame_producer> create_scroll_producer(const core::frame_p
 
     int motion_blur_px = get_param(L"BLUR", params, 0);
 
+    auto max_decoded_size =
+        env::properties().get(L"configuration.image.scroll-max-size", 1024) * std::size_t{1024 * 1024};
+
     bool premultiply_with_alpha = contains_param(L"PREMULTIPLY", params);
 
     return spl::make_shared<image_scroll_producer>(dependencies.frame_factory,
@@ -447,6 +657,7 @@ spl::shared_ptr<core::frame_producer> create_scroll_producer(const core::frame_p
                                                    -speed,
                                                    -duration,
                                                    end_time,
+                                                   max_decoded_size,
                                                    motion_blur_px,
                                                    premultiply_with_alpha);
 }
@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks how the image scroll producer cuts an image into tiles and schedules them: the tiles cover the image
+// exactly, every tile is started before it reaches the screen and dropped once it has left it, and the number held
+// does not grow with the image. Then checks the streamed PNG reader against the pixels it was written from, for every
+// color type, bit depth and filter, read forwards and in random order. Run with --benchmark to print the throughput
+// of the reader for a credits sized image.
+
+#include "../util/png_row_reader.h"
+#include "../util/scroll_layout.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace image { namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+void test_tiles_cover_image()
+{
+    for (int height : {1080, 1081, 5000, 21600}) {
+        scroll_layout layout(1920, height, 1920, 1080);
+
+        std::vector<int> rows(height, 0);
+        for (int index = 0; index < layout.tile_count(); ++index) {
+            auto t = layout.tile(index);
+            check(t.height > 0 && t.height <= 1080, "vertical tile height");
+            check(t.frame_y + t.height == 1080, "vertical tile aligned to the bottom of its frame");
+            check(t.translation == -(index + 1), "vertical tile translation");
+            for (int y = t.y; y < t.y + t.height; ++y)
+                rows[y] += 1;
+        }
+        check(std::all_of(rows.begin(), rows.end(), [](int n) { return n == 1; }),
+              "vertical tiles cover " + std::to_string(height) + " rows once");
+    }
+
+    for (int width : {1920, 3000, 19200}) {
+        scroll_layout layout(width, 1080, 1920, 1080);
+
+        std::vector<int> columns(width, 0);
+        for (int index = 0; index < layout.tile_count(); ++index) {
+            auto t = layout.tile(index);
+            check(t.width > 0 && t.width <= 1920 && t.height == 1080, "horizontal tile size");
+            for (int x = t.x; x < t.x + t.width; ++x)
+                columns[x] += 1;
+        }
+        check(std::all_of(columns.begin(), columns.end(), [](int n) { return n == 1; }),
+              "horizontal tiles cover " + std::to_string(width) + " columns once");
+    }
+}
+
+// Runs a scroll the way the producer does, at the given speed in pixels per frame, and checks the tiles it holds.
+void run_scroll(int image_width, int image_height, double speed, double ahead, const std::string& what)
+{
+    const int     screen_width  = 1920;
+    const int     screen_height = 1080;
+    scroll_layout layout(image_width, image_height, screen_width, screen_height);
+
+    const bool   vertical = layout.vertical();
+    const double screen   = vertical ? screen_height : screen_width;
+
+    // As image_scroll_producer places the start of the scroll.
+    double start = 0.0;
+    if (vertical)
+        start = speed < 0.0 ? image_height + screen_height : 0.0;
+    else
+        start = screen_width - (image_width % screen_width) + (speed < 0.0 ? image_width + screen_width : 0);
+    const double length = vertical ? image_height + screen_height : image_width + screen_width;
+
+    std::map<int, int> started; // frame each tile was started at
+    std::map<int, int> dropped;
+    std::size_t        most_held = 0;
+    double             delta     = 0.0;
+
+    for (int frame = 0; std::abs(delta) < length; ++frame, delta += speed) {
+        const double motion = (start + delta) / screen;
+        const auto   live   = layout.live_tiles(motion, speed, ahead);
+
+        most_held = std::max(most_held, live.size());
+
+        auto ordered = live;
+        std::sort(ordered.begin(), ordered.end());
+        if (vertical)
+            std::reverse(ordered.begin(), ordered.end());
+        check(ordered == live, what + ": tiles in the order of their rows");
+
+        for (int index = 0; index < layout.tile_count(); ++index) {
+            const bool held = std::find(live.begin(), live.end(), index) != live.end();
+
+            if (layout.visible(index, motion))
+                check(held, what + ": visible tile " + std::to_string(index) + " held");
+
+            if (held && started.count(index) == 0) {
+                started[index] = frame;
+                check(dropped.count(index) == 0, what + ": tile " + std::to_string(index) + " started again");
+                // Unless already close at the start, a tile is started a prefetch ahead of the screen, give or take a
+                // frame.
+                const double offset = layout.translation(index) + motion;
+                if (frame > 0)
+                    check(std::abs(offset) > 1.0 + std::abs(speed) * (ahead - 2) / screen,
+                          what + ": tile " + std::to_string(index) + " started late");
+            }
+            if (!held && started.count(index) > 0 && dropped.count(index) == 0)
+                dropped[index] = frame;
+        }
+    }
+
+    check(static_cast<int>(started.size()) == layout.tile_count(), what + ": every tile started");
+
+    // The screen spans two tile offsets, plus the tiles within reach and one for rounding.
+    const auto bound = static_cast<std::size_t>(std::ceil(std::abs(speed) * ahead / screen)) + 3;
+    check(most_held <= bound, what + ": held " + std::to_string(most_held) + " tiles at most");
+}
+
+void test_schedule()
+{
+    const double ahead = 50.0; // a second of 50p
+
+    for (int height : {1080, 10000, 200000})
+        for (double speed : {-4.0, 4.0, -60.0, 60.0})
+            run_scroll(
+                1920, height, speed, ahead, "vertical " + std::to_string(height) + " at " + std::to_string(speed));
+
+    for (double speed : {-8.0, 8.0})
+        run_scroll(40000, 1080, speed, ahead, "horizontal at " + std::to_string(speed));
+}
+
+// A PNG of random samples, each row stored with a random filter in several IDAT chunks, and the BGRA it decodes to.
+struct test_png
+{
+    std::vector<std::uint8_t> file;
+    std::vector<std::uint8_t> bgra;
+};
+
+void put_be32(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<std::uint8_t>(value >> shift));
+}
+
+void put_chunk(std::vector<std::uint8_t>& out, const char* type, const std::vector<std::uint8_t>& data)
+{
+    put_be32(out, static_cast<std::uint32_t>(data.size()));
+    std::vector<std::uint8_t> crc_data(type, type + 4);
+    crc_data.insert(crc_data.end(), data.begin(), data.end());
+    out.insert(out.end(), crc_data.begin(), crc_data.end());
+    put_be32(out, static_cast<std::uint32_t>(crc32(0, crc_data.data(), static_cast<uInt>(crc_data.size()))));
+}
+
+int predict(int filter, int left, int up, int up_left)
+{
+    switch (filter) {
+        case 1:
+            return left;
+        case 2:
+            return up;
+        case 3:
+            return (left + up) / 2;
+        case 4: {
+            const int p  = left + up - up_left;
+            const int pa = std::abs(p - left);
+            const int pb = std::abs(p - up);
+            const int pc = std::abs(p - up_left);
+            return pa <= pb && pa <= pc ? left : pb <= pc ? up : up_left;
+        }
+        default:
+            return 0;
+    }
+}
+
+test_png make_png(int width, int height, int color_type, int depth, bool key, unsigned seed)
+{
+    std::mt19937 random(seed);
+
+    const int channels  = color_type == 0 || color_type == 3 ? 1 : color_type == 4 ? 2 : color_type == 2 ? 3 : 4;
+    const int max       = (1 << depth) - 1;
+    const int row_bytes = (width * channels * depth + 7) / 8;
+    const int bpp       = std::max(1, channels * depth / 8);
+    const int colors    = 1 << std::min(depth, 8);
+
+    std::uniform_int_distribution<int> sample(0, color_type == 3 ? std::min(max, 99) : max);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> filter(0, 4);
+
+    std::vector<std::uint8_t> palette(colors * 4, 0);
+    for (int n = 0; n < 100 && n < colors; ++n)
+        for (int c = 0; c < 4; ++c)
+            palette[n * 4 + c] = static_cast<std::uint8_t>(byte(random));
+    for (int n = 100; n < colors; ++n)
+        palette[n * 4 + 3] = 255;
+
+    // A few samples repeat the transparent color, so the key is checked.
+    std::vector<int> key_color = {sample(random), sample(random), sample(random)};
+
+    test_png                  png;
+    std::vector<std::uint8_t> raw(static_cast<std::size_t>(row_bytes) * height, 0);
+    png.bgra.resize(static_cast<std::size_t>(width) * height * 4);
+
+    for (int y = 0; y < height; ++y) {
+        auto row = raw.data() + static_cast<std::size_t>(y) * row_bytes;
+        auto out = png.bgra.data() + static_cast<std::size_t>(y) * width * 4;
+
+        for (int x = 0; x < width; ++x) {
+            std::vector<int> values(channels);
+            for (auto& value : values)
+                value = sample(random);
+            if (key && byte(random) < 32)
+                std::copy(key_color.begin(), key_color.begin() + channels, values.begin());
+
+            for (int c = 0; c < channels; ++c) {
+                const int n = x * channels + c;
+                if (depth == 16) {
+                    row[n * 2]     = static_cast<std::uint8_t>(values[c] >> 8);
+                    row[n * 2 + 1] = static_cast<std::uint8_t>(values[c]);
+                } else if (depth == 8) {
+                    row[n] = static_cast<std::uint8_t>(values[c]);
+                } else {
+                    const int bit = n * depth;
+                    row[bit / 8] |= static_cast<std::uint8_t>(values[c] << (8 - depth - bit % 8));
+                }
+            }
+
+            auto to8 = [&](int value) {
+                return static_cast<std::uint8_t>(depth == 16 ? value >> 8 : value * 255 / max);
+            };
+            const bool keyed = key && std::equal(values.begin(), values.end(), key_color.begin());
+
+            switch (color_type) {
+                case 0:
+                    out[x * 4 + 0] = out[x * 4 + 1] = out[x * 4 + 2] = to8(values[0]);
+                    out[x * 4 + 3]                                   = keyed ? 0 : 255;
+                    break;
+                case 2:
+                    out[x * 4 + 0] = to8(values[2]);
+                    out[x * 4 + 1] = to8(values[1]);
+                    out[x * 4 + 2] = to8(values[0]);
+                    out[x * 4 + 3] = keyed ? 0 : 255;
+                    break;
+                case 3:
+                    std::memcpy(out + x * 4, palette.data() + values[0] * 4, 4);
+                    break;
+                case 4:
+                    out[x * 4 + 0] = out[x * 4 + 1] = out[x * 4 + 2] = to8(values[0]);
+                    out[x * 4 + 3]                                   = to8(values[1]);
+                    break;
+                default:
+                    out[x * 4 + 0] = to8(values[2]);
+                    out[x * 4 + 1] = to8(values[1]);
+                    out[x * 4 + 2] = to8(values[0]);
+                    out[x * 4 + 3] = to8(values[3]);
+                    break;
+            }
+        }
+    }
+
+    std::vector<std::uint8_t> filtered;
+    for (int y = 0; y < height; ++y) {
+        const auto row   = raw.data() + static_cast<std::size_t>(y) * row_bytes;
+        const auto prior = y > 0 ? row - row_bytes : nullptr;
+        const int  type  = filter(random);
+
+        filtered.push_back(static_cast<std::uint8_t>(type));
+        for (int n = 0; n < row_bytes; ++n) {
+            const int left    = n >= bpp ? row[n - bpp] : 0;
+            const int up      = prior ? prior[n] : 0;
+            const int up_left = prior && n >= bpp ? prior[n - bpp] : 0;
+            filtered.push_back(static_cast<std::uint8_t>(row[n] - predict(type, left, up, up_left)));
+        }
+    }
+
+    std::vector<std::uint8_t> compressed(compressBound(static_cast<uLong>(filtered.size())));
+    auto                      size = static_cast<uLongf>(compressed.size());
+    compress2(compressed.data(), &size, filtered.data(), static_cast<uLong>(filtered.size()), 6);
+    compressed.resize(size);
+
+    const std::uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    png.file.assign(signature, signature + sizeof(signature));
+
+    std::vector<std::uint8_t> ihdr;
+    put_be32(ihdr, width);
+    put_be32(ihdr, height);
+    ihdr.insert(ihdr.end(), {static_cast<std::uint8_t>(depth), static_cast<std::uint8_t>(color_type), 0, 0, 0});
+    put_chunk(png.file, "IHDR", ihdr);
+
+    if (color_type == 3) {
+        std::vector<std::uint8_t> plte;
+        std::vector<std::uint8_t> trns;
+        for (int n = 0; n < colors; ++n) {
+            plte.insert(plte.end(), {palette[n * 4 + 2], palette[n * 4 + 1], palette[n * 4 + 0]});
+            trns.push_back(palette[n * 4 + 3]);
+        }
+        put_chunk(png.file, "PLTE", plte);
+        put_chunk(png.file, "tRNS", trns);
+    } else if (key) {
+        std::vector<std::uint8_t> trns;
+        for (int c = 0; c < channels; ++c)
+            trns.insert(trns.end(),
+                        {static_cast<std::uint8_t>(key_color[c] >> 8), static_cast<std::uint8_t>(key_color[c])});
+        put_chunk(png.file, "tRNS", trns);
+    }
+
+    for (std::size_t offset = 0; offset < compressed.size(); offset += 997) {
+        auto end = std::min(compressed.size(), offset + 997);
+        put_chunk(png.file, "IDAT", std::vector<std::uint8_t>(compressed.begin() + offset, compressed.begin() + end));
+    }
+    put_chunk(png.file, "IEND", {});
+
+    return png;
+}
+
+boost::filesystem::path write_temp(const std::vector<std::uint8_t>& data)
+{
+    auto path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("scroll-test-%%%%%%%%.png");
+    boost::filesystem::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return path;
+}
+
+bool same_rect(const test_png& png, int width, int x, int y, int w, int h, const std::vector<std::uint8_t>& pixels)
+{
+    for (int row = 0; row < h; ++row) {
+        auto expected = png.bgra.data() + (static_cast<std::size_t>(y + row) * width + x) * 4;
+        if (std::memcmp(expected, pixels.data() + static_cast<std::size_t>(row) * w * 4, w * 4) != 0)
+            return false;
+    }
+    return true;
+}
+
+void test_png_reader()
+{
+    struct format
+    {
+        int  color_type;
+        int  depth;
+        bool key;
+    };
+    const format formats[] = {{0, 1, false},
+                              {0, 2, false},
+                              {0, 4, true},
+                              {0, 8, true},
+                              {0, 16, true},
+                              {2, 8, true},
+                              {2, 16, true},
+                              {3, 1, false},
+                              {3, 2, false},
+                              {3, 4, false},
+                              {3, 8, false},
+                              {4, 8, false},
+                              {4, 16, false},
+                              {6, 8, false},
+                              {6, 16, false}};
+
+    const int width  = 37;
+    const int height = 301;
+
+    unsigned seed = 1;
+    for (const auto& f : formats) {
+        const auto what = "color type " + std::to_string(f.color_type) + " depth " + std::to_string(f.depth);
+        const auto png  = make_png(width, height, f.color_type, f.depth, f.key, seed++);
+        const auto path = write_temp(png.file);
+
+        check(png_row_reader::can_read(path.wstring()), what + ": readable");
+
+        png_row_reader reader(path.wstring(), 64, 3);
+        check(reader.width() == width && reader.height() == height, what + ": size");
+
+        std::vector<std::uint8_t> pixels(static_cast<std::size_t>(width) * height * 4);
+        reader.read(0, 0, width, height, pixels.data(), width * 4);
+        check(same_rect(png, width, 0, 0, width, height, pixels), what + ": forwards");
+
+        // Backwards, across checkpoints and overlapping the rows kept from the read before.
+        std::mt19937 random(seed);
+        for (int n = 0; n < 40; ++n) {
+            const int x = std::uniform_int_distribution<int>(0, width - 1)(random);
+            const int y = std::uniform_int_distribution<int>(0, height - 1)(random);
+            const int w = std::uniform_int_distribution<int>(1, width - x)(random);
+            const int h = std::uniform_int_distribution<int>(1, std::min(height - y, 80))(random);
+
+            reader.read(x, y, w, h, pixels.data(), w * 4);
+            check(same_rect(png, width, x, y, w, h, pixels),
+                  what + ": rect at " + std::to_string(x) + ", " + std::to_string(y));
+        }
+
+        boost::filesystem::remove(path);
+    }
+
+    // Interlaced, which would need the whole image for any row, and anything not a PNG.
+    auto interlaced = make_png(8, 8, 6, 8, false, 99);
+    interlaced.file[8 + 8 + 12] = 1;
+    auto path                   = write_temp(interlaced.file);
+    check(!png_row_reader::can_read(path.wstring()), "interlaced rejected");
+    boost::filesystem::remove(path);
+
+    path = write_temp({'G', 'I', 'F', '8', '9', 'a', 0, 0, 0, 0, 0, 0});
+    check(!png_row_reader::can_read(path.wstring()), "not a png rejected");
+    boost::filesystem::remove(path);
+}
+
+void benchmark()
+{
+    const int  width  = 1920;
+    const int  height = 1080 * 10;
+    const auto png    = make_png(width, height, 6, 8, false, 7);
+    const auto path   = write_temp(png.file);
+
+    std::vector<std::uint8_t> tile(static_cast<std::size_t>(width) * 1080 * 4);
+
+    const auto     start = std::chrono::steady_clock::now();
+    png_row_reader reader(path.wstring(), 1080, 1);
+    for (int y = 0; y < height; y += 1080)
+        reader.read(0, y, width, 1080, tile.data(), width * 4);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "png rows, 1920x" << height << " rgba: " << width * static_cast<double>(height) / elapsed.count() / 1e6
+              << " Mpixel/s" << std::endl;
+
+    boost::filesystem::remove(path);
+}
+
+}}} // namespace caspar::image
+
+int main(int argc, char** argv)
+{
+    using namespace caspar::image;
+
+    if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+        benchmark();
+        return 0;
+    }
+
+    test_tiles_cover_image();
+    test_schedule();
+    test_png_reader();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
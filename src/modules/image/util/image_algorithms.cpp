@@ -21,8 +21,23 @@
 
 #include "image_algorithms.h"
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#ifdef USE_SIMDE
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#include <simde/x86/sse4.1.h>
+#else
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
+
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <vector>
 
 namespace caspar { namespace image {
@@ -46,4 +61,199 @@ std::vector<std::pair<int, int>> get_line_points(int num_pixels, double angle_ra
     return std::move(line_points);
 }
 
+namespace {
+
+// x * a / 255 for the 16 bit products of 8 channels, exact for all 8 bit x and a.
+__m128i div255(__m128i product) { return _mm_srli_epi16(_mm_mulhi_epu16(product, _mm_set1_epi16(-32639)), 7); }
+
+void premultiply_row(const std::uint8_t* src, std::uint8_t* dst, int width)
+{
+    const auto zero  = _mm_setzero_si128();
+    const auto alpha = _mm_setr_epi8(6, -1, 6, -1, 6, -1, -1, -1, 14, -1, 14, -1, 14, -1, -1, -1);
+    const auto keep  = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+
+        // Alpha is multiplied with 255 and so left unchanged.
+        auto lo = _mm_unpacklo_epi8(pixels, zero);
+        auto hi = _mm_unpackhi_epi8(pixels, zero);
+        lo      = div255(_mm_mullo_epi16(lo, _mm_or_si128(_mm_shuffle_epi8(lo, alpha), keep)));
+        hi      = div255(_mm_mullo_epi16(hi, _mm_or_si128(_mm_shuffle_epi8(hi, alpha), keep)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(lo, hi));
+    }
+
+    for (; x < width; ++x) {
+        const int a = src[x * 4 + 3];
+        for (int n = 0; n < 3; ++n)
+            dst[x * 4 + n] = static_cast<std::uint8_t>(src[x * 4 + n] * a / 255);
+        dst[x * 4 + 3] = static_cast<std::uint8_t>(a);
+    }
+}
+
+// The weighted average of the pixel at p and the n pixels of its trail, step bytes apart.
+void blur_pixel(const std::uint8_t* p,
+                std::ptrdiff_t      step,
+                int                 n,
+                const std::uint8_t* weights,
+                std::uint32_t       total_weight,
+                std::uint8_t*       out)
+{
+    std::uint32_t sum[4];
+    for (int c = 0; c < 4; ++c)
+        sum[c] = 255u * p[c];
+
+    for (int k = 1; k <= n; ++k) {
+        for (int c = 0; c < 4; ++c)
+            sum[c] += weights[k - 1] * p[k * step + c];
+    }
+
+    for (int c = 0; c < 4; ++c)
+        out[c] = static_cast<std::uint8_t>(sum[c] / total_weight);
+}
+
+// blur_pixel for the 4 pixels from p, which all have n pixels of trail.
+void blur_pixels(const std::uint8_t* p,
+                 std::ptrdiff_t      step,
+                 int                 n,
+                 const std::uint8_t* weights,
+                 std::uint32_t       total_weight,
+                 std::uint8_t*       out)
+{
+    const auto zero = _mm_setzero_si128();
+
+    __m128i sum[4] = {zero, zero, zero, zero};
+
+    const auto add = [&](const std::uint8_t* pixels, int weight) {
+        const auto values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+        const auto w      = _mm_set1_epi16(static_cast<short>(weight));
+
+        // The products of 8 bit values and weights fit 16 bits, the sums are kept in 32.
+        const auto lo = _mm_mullo_epi16(_mm_unpacklo_epi8(values, zero), w);
+        const auto hi = _mm_mullo_epi16(_mm_unpackhi_epi8(values, zero), w);
+
+        sum[0] = _mm_add_epi32(sum[0], _mm_unpacklo_epi16(lo, zero));
+        sum[1] = _mm_add_epi32(sum[1], _mm_unpackhi_epi16(lo, zero));
+        sum[2] = _mm_add_epi32(sum[2], _mm_unpacklo_epi16(hi, zero));
+        sum[3] = _mm_add_epi32(sum[3], _mm_unpackhi_epi16(hi, zero));
+    };
+
+    add(p, 255);
+    for (int k = 1; k <= n; ++k)
+        add(p + k * step, weights[k - 1]);
+
+    // The float quotient is at most one off, the integer products tell which way.
+    const auto total  = _mm_set1_epi32(static_cast<int>(total_weight));
+    const auto totalf = _mm_set1_ps(static_cast<float>(total_weight));
+    const auto ones   = _mm_set1_epi32(-1);
+
+    __m128i quotient[4];
+    for (int i = 0; i < 4; ++i) {
+        auto q       = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sum[i]), totalf));
+        auto product = _mm_mullo_epi32(q, total);
+        q            = _mm_add_epi32(q, _mm_cmpgt_epi32(product, sum[i]));
+        product      = _mm_mullo_epi32(q, total);
+        q            = _mm_sub_epi32(q, _mm_xor_si128(_mm_cmpgt_epi32(_mm_add_epi32(product, total), sum[i]), ones));
+        quotient[i]  = q;
+    }
+
+    const auto result = _mm_packus_epi16(_mm_packs_epi32(quotient[0], quotient[1]),
+                                         _mm_packs_epi32(quotient[2], quotient[3]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), result);
+}
+
+} // namespace
+
+void motion_blur(const std::uint8_t*              src,
+                 std::ptrdiff_t                   src_pitch,
+                 int                              src_width,
+                 int                              src_height,
+                 int                              x,
+                 int                              y,
+                 int                              width,
+                 int                              height,
+                 int                              dx,
+                 int                              dy,
+                 const std::vector<std::uint8_t>& weights,
+                 std::uint8_t*                    dst,
+                 std::ptrdiff_t                   dst_pitch)
+{
+    const int taps = static_cast<int>(weights.size());
+
+    // The total weight of a pixel with n pixels of trail.
+    std::vector<std::uint32_t> total_weight(taps + 1, 255);
+    for (int n = 0; n < taps; ++n)
+        total_weight[n + 1] = total_weight[n] + weights[n];
+
+    // The pixels of trail left between a pixel and the edge of the source.
+    const auto trail = [&](int px, int py) {
+        int n = taps;
+        if (dx > 0)
+            n = std::min(n, src_width - 1 - px);
+        if (dx < 0)
+            n = std::min(n, px);
+        if (dy > 0)
+            n = std::min(n, src_height - 1 - py);
+        if (dy < 0)
+            n = std::min(n, py);
+        return n;
+    };
+
+    const auto step = dy * src_pitch + dx * 4;
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height, 16), [&](const tbb::blocked_range<int>& rows) {
+        for (int row = rows.begin(); row != rows.end(); ++row) {
+            const int  py   = y + row;
+            const auto line = src + py * src_pitch;
+            const auto out  = dst + row * dst_pitch;
+
+            int col = 0;
+            for (; col + 4 <= width; col += 4) {
+                const int px = x + col;
+                const int n  = trail(px, py);
+
+                if (trail(px + 3, py) == n) {
+                    blur_pixels(line + px * 4, step, n, weights.data(), total_weight[n], out + col * 4);
+                    continue;
+                }
+
+                // Near the end of a line the pixels have trails of different lengths.
+                for (int m = 0; m < 4; ++m) {
+                    const int k = trail(px + m, py);
+                    blur_pixel(line + (px + m) * 4, step, k, weights.data(), total_weight[k], out + (col + m) * 4);
+                }
+            }
+
+            for (; col < width; ++col) {
+                const int n = trail(x + col, py);
+                blur_pixel(line + (x + col) * 4, step, n, weights.data(), total_weight[n], out + col * 4);
+            }
+        }
+    });
+}
+
+void copy_pixels(const std::uint8_t* src,
+                 std::ptrdiff_t      src_pitch,
+                 std::uint8_t*       dst,
+                 std::ptrdiff_t      dst_pitch,
+                 int                 width,
+                 int                 height,
+                 bool                premultiply)
+{
+    tbb::parallel_for(tbb::blocked_range<int>(0, height, 64), [&](const tbb::blocked_range<int>& rows) {
+        for (int y = rows.begin(); y != rows.end(); ++y) {
+            auto src_row = src + y * src_pitch;
+            auto dst_row = dst + y * dst_pitch;
+
+            if (premultiply) {
+                premultiply_row(src_row, dst_row, width);
+            } else if (src_row != dst_row) {
+                std::memcpy(dst_row, src_row, static_cast<std::size_t>(width) * 4);
+            }
+        }
+    });
+}
+
 }} // namespace caspar::image
@@ -24,7 +24,9 @@
 #include <common/tweener.h>
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
 namespace caspar { namespace image {
 
@@ -196,6 +198,69 @@ void premultiply(SrcDstView& view_to_modify)
     });
 }
 
+/**
+ * Copy rows of 8bit BGRA pixels, multiplying the color channels with alpha on
+ * the way when premultiply is set, with the same result as premultiply(). The
+ * rows are spread over the available cores and converted 4 pixels at a time.
+ * <p>
+ * A negative source pitch walks the source bottom up, which turns a bottom up
+ * FreeImage bitmap into a top down frame in the same pass. The source and the
+ * destination may be the same memory when the pitches are equal.
+ *
+ * @param src         The first source row.
+ * @param src_pitch   The bytes from one source row to the next.
+ * @param dst         The first destination row.
+ * @param dst_pitch   The bytes from one destination row to the next.
+ * @param width       The number of pixels in a row.
+ * @param height      The number of rows.
+ * @param premultiply Whether to multiply the color channels with alpha.
+ */
+void copy_pixels(const std::uint8_t* src,
+                 std::ptrdiff_t      src_pitch,
+                 std::uint8_t*       dst,
+                 std::ptrdiff_t      dst_pitch,
+                 int                 width,
+                 int                 height,
+                 bool                premultiply);
+
+/**
+ * Motion blur 8bit BGRA pixels along a straight line up, down, left or right,
+ * with the same result as blur() along the get_line_points() of that angle.
+ * Each destination pixel is the weighted average of its source pixel, with
+ * weight 255, and of the following pixels of the trail in the direction of
+ * dx and dy, each with the next weight, stopping at the edge of the source.
+ * Unlike blur(), a horizontal trail stops at the end of the line instead of
+ * continuing on the next one. The rows are spread over the available cores
+ * and blurred 4 pixels at a time.
+ *
+ * @param src        The first row of the source, top down.
+ * @param src_pitch  The bytes from one source row to the next.
+ * @param src_width  The width of the source in pixels.
+ * @param src_height The height of the source in pixels.
+ * @param x          The left of the region to blur within the source.
+ * @param y          The top of the region to blur within the source.
+ * @param width      The width of the region to blur.
+ * @param height     The height of the region to blur.
+ * @param dx         The horizontal step of the trail, -1, 0 or 1.
+ * @param dy         The vertical step of the trail, -1, 0 or 1.
+ * @param weights    The weights of the pixels of the trail, nearest first.
+ * @param dst        The first row of the destination, top down.
+ * @param dst_pitch  The bytes from one destination row to the next.
+ */
+void motion_blur(const std::uint8_t*              src,
+                 std::ptrdiff_t                   src_pitch,
+                 int                              src_width,
+                 int                              src_height,
+                 int                              x,
+                 int                              y,
+                 int                              width,
+                 int                              height,
+                 int                              dx,
+                 int                              dy,
+                 const std::vector<std::uint8_t>& weights,
+                 std::uint8_t*                    dst,
+                 std::ptrdiff_t                   dst_pitch);
+
 /**
  * Un-multiply with alpha for each pixel in an ImageView. The modifications is
  * done in place. The pixel type of the ImageView must model the RGBAPixel
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_cache.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#include <FreeImage.h>
+
+#include <boost/filesystem.hpp>
+
+#include <ctime>
+#include <future>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace caspar { namespace image {
+
+namespace {
+
+using image_ptr = std::shared_ptr<const decoded_image>;
+
+struct file_stamp
+{
+    std::uintmax_t size       = 0;
+    std::time_t    write_time = 0;
+
+    bool operator==(const file_stamp& other) const { return size == other.size && write_time == other.write_time; }
+};
+
+class image_cache
+{
+    struct entry
+    {
+        std::wstring path;
+        file_stamp   stamp;
+        image_ptr    image;
+        std::size_t  bytes;
+    };
+
+    struct pending_decode
+    {
+        file_stamp                    stamp;
+        std::shared_future<image_ptr> image;
+    };
+
+    std::mutex                                                   mutex_;
+    std::size_t                                                  capacity_ = 256 * 1024 * 1024;
+    std::size_t                                                  size_     = 0;
+    std::list<entry>                                             entries_; // most recently used first
+    std::unordered_map<std::wstring, std::list<entry>::iterator> index_;
+    std::unordered_map<std::wstring, pending_decode>             pending_;
+
+  public:
+    image_ptr get(const std::wstring& filename)
+    {
+        if (!boost::filesystem::exists(filename))
+            return std::make_shared<decoded_image>(decode_image(filename)); // Throws file_not_found.
+
+        file_stamp stamp{boost::filesystem::file_size(filename), boost::filesystem::last_write_time(filename)};
+
+        std::promise<image_ptr>                      promise;
+        std::optional<std::shared_future<image_ptr>> other;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = index_.find(filename);
+            if (it != index_.end()) {
+                if (it->second->stamp == stamp) {
+                    entries_.splice(entries_.begin(), entries_, it->second);
+                    return it->second->image;
+                }
+                erase(it);
+            }
+
+            auto pending = pending_.find(filename);
+            if (pending != pending_.end() && pending->second.stamp == stamp) {
+                other = pending->second.image;
+            } else {
+                pending_[filename] = pending_decode{stamp, promise.get_future().share()};
+            }
+        }
+
+        if (other) {
+            return other->get();
+        }
+
+        image_ptr image;
+        try {
+            image = std::make_shared<decoded_image>(decode_image(filename));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            finish(filename, stamp, nullptr);
+            throw;
+        }
+
+        promise.set_value(image);
+        finish(filename, stamp, image);
+
+        return image;
+    }
+
+    void set_capacity(std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = bytes;
+        evict();
+    }
+
+  private:
+    void finish(const std::wstring& filename, const file_stamp& stamp, const image_ptr& image)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto pending = pending_.find(filename);
+        if (pending != pending_.end() && pending->second.stamp == stamp) {
+            pending_.erase(pending);
+        }
+
+        if (!image) {
+            return;
+        }
+
+        auto bytes = static_cast<std::size_t>(FreeImage_GetPitch(image->bitmap.get())) *
+                     FreeImage_GetHeight(image->bitmap.get());
+        if (bytes > capacity_ || index_.find(filename) != index_.end()) {
+            return;
+        }
+
+        entries_.push_front(entry{filename, stamp, image, bytes});
+        index_[filename] = entries_.begin();
+        size_ += bytes;
+        evict();
+    }
+
+    void erase(std::unordered_map<std::wstring, std::list<entry>::iterator>::iterator it)
+    {
+        size_ -= it->second->bytes;
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+
+    void evict()
+    {
+        while (size_ > capacity_) {
+            erase(index_.find(entries_.back().path));
+        }
+    }
+};
+
+image_cache& get_image_cache()
+{
+    static image_cache cache;
+    return cache;
+}
+
+} // namespace
+
+std::shared_ptr<const decoded_image> get_cached_image(const std::wstring& filename)
+{
+    return get_image_cache().get(filename);
+}
+
+void set_image_cache_size(std::size_t bytes) { get_image_cache().set_capacity(bytes); }
+
+}} // namespace caspar::image
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "image_loader.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace image {
+
+// Decoded stills shared by the image producers of every channel. Entries are keyed by path, size and last write time,
+// so a file that changes is decoded again, and the least recently used are dropped once the cache is over its size.
+
+// The decoded image of filename, from the cache or decoded and added to it. Concurrent calls for the same file share
+// one decode. Blocks while decoding, so call it from the worker pool rather than a channel or AMCP thread.
+std::shared_ptr<const decoded_image> get_cached_image(const std::wstring& filename);
+
+// Maximum bytes of decoded pixels kept, 0 disables the cache.
+void set_image_cache_size(std::size_t bytes);
+
+}} // namespace caspar::image
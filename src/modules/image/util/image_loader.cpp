@@ -40,11 +40,25 @@
 #include <boost/filesystem.hpp>
 
 #include "image_algorithms.h"
-#include "image_view.h"
 
 namespace caspar { namespace image {
 
-std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
+namespace {
+
+void premultiply_bitmap(const std::shared_ptr<FIBITMAP>& bitmap)
+{
+    auto bits  = FreeImage_GetBits(bitmap.get());
+    auto pitch = static_cast<std::ptrdiff_t>(FreeImage_GetPitch(bitmap.get()));
+    copy_pixels(bits,
+                pitch,
+                bits,
+                pitch,
+                static_cast<int>(FreeImage_GetWidth(bitmap.get())),
+                static_cast<int>(FreeImage_GetHeight(bitmap.get())),
+                true);
+}
+
+FREE_IMAGE_FORMAT get_format(const std::wstring& filename)
 {
     if (!boost::filesystem::exists(filename))
         CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(filename)));
@@ -65,6 +79,15 @@ std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
     if (fif == FIF_UNKNOWN || (FreeImage_FIFSupportsReading(fif) == 0))
         CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
 
+    return fif;
+}
+
+} // namespace
+
+decoded_image decode_image(const std::wstring& filename)
+{
+    auto fif = get_format(filename);
+
 #ifdef WIN32
     auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_LoadU(fif, filename.c_str(), 0), FreeImage_Unload);
 #else
@@ -78,13 +101,33 @@ std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
     }
 
     // PNG-images need to be premultiplied with their alpha
-    if (fif == FIF_PNG) {
-        image_view<bgra_pixel> original_view(
-            FreeImage_GetBits(bitmap.get()), FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()));
-        premultiply(original_view);
-    }
+    return decoded_image{bitmap, fif == FIF_PNG};
+}
 
-    return bitmap;
+std::pair<int, int> read_image_size(const std::wstring& filename)
+{
+    auto fif   = get_format(filename);
+    auto flags = FreeImage_FIFSupportsNoPixels(fif) ? FIF_LOAD_NOPIXELS : 0;
+
+#ifdef WIN32
+    auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_LoadU(fif, filename.c_str(), flags), FreeImage_Unload);
+#else
+    auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_Load(fif, u8(filename).c_str(), flags), FreeImage_Unload);
+#endif
+
+    if (!bitmap)
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
+
+    return {static_cast<int>(FreeImage_GetWidth(bitmap.get())), static_cast<int>(FreeImage_GetHeight(bitmap.get()))};
+}
+
+std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
+{
+    auto image = decode_image(filename);
+    if (image.premultiply)
+        premultiply_bitmap(image.bitmap);
+
+    return image.bitmap;
 }
 
 std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size_t size)
@@ -104,9 +147,7 @@ std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size
     }
 
     // PNG-images need to be premultiplied with their alpha
-    image_view<bgra_pixel> original_view(
-        FreeImage_GetBits(bitmap.get()), FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()));
-    premultiply(original_view);
+    premultiply_bitmap(bitmap);
     return bitmap;
 }
 
@@ -24,6 +24,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
 
 #include <boost/filesystem.hpp>
 
@@ -31,9 +32,20 @@ struct FIBITMAP;
 
 namespace caspar { namespace image {
 
+// A 32 bit bitmap as FreeImage decodes it, bottom up, with straight alpha when premultiply is set.
+struct decoded_image
+{
+    std::shared_ptr<FIBITMAP> bitmap;
+    bool                      premultiply = false;
+};
+
+decoded_image             decode_image(const std::wstring& filename);
 std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename);
 std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size_t size);
 
+// Width and height of an image, read from its header without decoding it when the format allows.
+std::pair<int, int> read_image_size(const std::wstring& filename);
+
 bool is_valid_file(const boost::filesystem::path& filename);
 
 }} // namespace caspar::image
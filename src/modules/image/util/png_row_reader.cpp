@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "png_row_reader.h"
+
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <boost/exception/errinfo_file_name.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <vector>
+
+namespace caspar { namespace image {
+
+namespace {
+
+struct png_header
+{
+    int            width      = 0;
+    int            height     = 0;
+    int            bit_depth  = 0;
+    int            color_type = 0;
+    int            channels   = 0;
+    std::streamoff first_data = 0; // of the first IDAT chunk
+    std::uint32_t  first_size = 0;
+
+    std::array<std::uint8_t, 256 * 4> palette{}; // BGRA
+    bool                              has_key = false;
+    std::array<unsigned, 3>           key{}; // transparent gray or RGB sample, at the bit depth of the file
+};
+
+std::uint32_t read_be32(const std::uint8_t* p)
+{
+    return static_cast<std::uint32_t>(p[0]) << 24 | static_cast<std::uint32_t>(p[1]) << 16 |
+           static_cast<std::uint32_t>(p[2]) << 8 | static_cast<std::uint32_t>(p[3]);
+}
+
+int channels_of(int color_type, int bit_depth)
+{
+    switch (color_type) {
+        case 0:
+            return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 || bit_depth == 16 ? 1 : 0;
+        case 2:
+            return bit_depth == 8 || bit_depth == 16 ? 3 : 0;
+        case 3:
+            return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 ? 1 : 0;
+        case 4:
+            return bit_depth == 8 || bit_depth == 16 ? 2 : 0;
+        case 6:
+            return bit_depth == 8 || bit_depth == 16 ? 4 : 0;
+        default:
+            return 0;
+    }
+}
+
+// Reads the chunks up to the first IDAT. Returns false for anything that is not a non interlaced PNG of a known
+// color type and bit depth.
+bool read_header(std::istream& file, png_header& header)
+{
+    static const std::uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+    std::uint8_t head[8];
+    if (!file.read(reinterpret_cast<char*>(head), sizeof(head)) || std::memcmp(head, signature, sizeof(head)) != 0)
+        return false;
+
+    bool has_ihdr = false;
+    for (;;) {
+        if (!file.read(reinterpret_cast<char*>(head), 8))
+            return false;
+
+        const auto size = read_be32(head);
+        const auto type = std::string(reinterpret_cast<const char*>(head + 4), 4);
+
+        if (type == "IDAT") {
+            if (!has_ihdr)
+                return false;
+            header.first_data = file.tellg();
+            header.first_size = size;
+            return true;
+        }
+
+        if (size > 1 << 24)
+            return false;
+
+        std::vector<std::uint8_t> data(size);
+        if (!file.read(reinterpret_cast<char*>(data.data()), size) || !file.ignore(4)) // the CRC
+            return false;
+
+        if (type == "IHDR") {
+            // Compression, filter method and interlacing, which would need the whole image for every row.
+            if (size != 13 || data[10] != 0 || data[11] != 0 || data[12] != 0)
+                return false;
+
+            header.width      = static_cast<int>(std::min<std::uint32_t>(read_be32(data.data()), 1 << 30));
+            header.height     = static_cast<int>(std::min<std::uint32_t>(read_be32(data.data() + 4), 1 << 30));
+            header.bit_depth  = data[8];
+            header.color_type = data[9];
+            header.channels   = channels_of(header.color_type, header.bit_depth);
+
+            if (header.width == 0 || header.height == 0 || header.channels == 0)
+                return false;
+            has_ihdr = true;
+        } else if (type == "PLTE") {
+            for (std::uint32_t n = 0; n < std::min<std::uint32_t>(size / 3, 256); ++n) {
+                header.palette[n * 4 + 0] = data[n * 3 + 2];
+                header.palette[n * 4 + 1] = data[n * 3 + 1];
+                header.palette[n * 4 + 2] = data[n * 3 + 0];
+                header.palette[n * 4 + 3] = 255;
+            }
+        } else if (type == "tRNS") {
+            if (header.color_type == 3) {
+                for (std::uint32_t n = 0; n < std::min<std::uint32_t>(size, 256); ++n)
+                    header.palette[n * 4 + 3] = data[n];
+            } else if (header.color_type == 0 && size >= 2) {
+                header.has_key = true;
+                header.key[0]  = data[0] << 8 | data[1];
+            } else if (header.color_type == 2 && size >= 6) {
+                header.has_key = true;
+                for (int n = 0; n < 3; ++n)
+                    header.key[n] = data[n * 2] << 8 | data[n * 2 + 1];
+            }
+        } else if (type == "IEND") {
+            return false;
+        }
+    }
+}
+
+struct inflater_deleter
+{
+    void operator()(z_stream* stream) const
+    {
+        inflateEnd(stream);
+        delete stream;
+    }
+};
+
+using inflater = std::unique_ptr<z_stream, inflater_deleter>;
+
+std::uint8_t paeth(int a, int b, int c)
+{
+    const int p  = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return static_cast<std::uint8_t>(a);
+    return static_cast<std::uint8_t>(pb <= pc ? b : c);
+}
+
+} // namespace
+
+struct png_row_reader::impl
+{
+    // Where the stream was when the row was reached: enough to decode on from there without the rows above.
+    struct checkpoint
+    {
+        inflater                  stream;
+        std::streamoff            position   = 0;
+        std::uint32_t             chunk_left = 0;
+        std::vector<std::uint8_t> prior;
+    };
+
+    const std::wstring filename_;
+    const int          checkpoint_interval_;
+    const int          keep_rows_;
+
+    boost::filesystem::ifstream file_;
+    png_header                  header_;
+    std::size_t                 row_bytes_ = 0; // without the filter type byte
+    std::size_t                 bpp_       = 0; // bytes between the samples the filters predict from
+
+    inflater                  stream_;
+    std::vector<std::uint8_t> input_ = std::vector<std::uint8_t>(64 * 1024);
+    std::streamoff            input_position_ = 0; // of input_[0] in the file
+    std::streamoff            position_       = 0; // of the next byte to read into input_
+    std::uint32_t             chunk_left_     = 0; // of the current IDAT chunk, from position_
+
+    std::vector<std::uint8_t> prior_;   // the last row decoded, unfiltered
+    std::vector<std::uint8_t> current_; // filter type byte and the row being decoded
+    std::vector<std::uint8_t> rows_;    // the last keep_rows_ rows as BGRA, row n at n % keep_rows_
+    int                       next_row_ = 0;
+    int                       kept_     = 0;
+
+    std::map<int, checkpoint> checkpoints_;
+
+    impl(const std::wstring& filename, int checkpoint_interval, int keep_rows)
+        : filename_(filename)
+        , checkpoint_interval_(std::max(1, checkpoint_interval))
+        , keep_rows_(std::max(1, keep_rows))
+        , file_(boost::filesystem::path(filename), std::ios::binary)
+    {
+        if (!file_)
+            CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(filename_)));
+
+        if (!read_header(file_, header_))
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported PNG format.")
+                                                      << boost::errinfo_file_name(u8(filename_)));
+
+        row_bytes_ = (static_cast<std::size_t>(header_.width) * header_.channels * header_.bit_depth + 7) / 8;
+        bpp_       = std::max<std::size_t>(1, header_.channels * header_.bit_depth / 8);
+        current_.resize(row_bytes_ + 1);
+        rows_.resize(static_cast<std::size_t>(keep_rows_) * header_.width * 4);
+
+        restart();
+    }
+
+    [[noreturn]] void corrupt() const
+    {
+        CASPAR_THROW_EXCEPTION(file_read_error() << msg_info("Corrupt or truncated PNG data.")
+                                                 << boost::errinfo_file_name(u8(filename_)));
+    }
+
+    void restart()
+    {
+        stream_.reset(new z_stream{});
+        if (inflateInit(stream_.get()) != Z_OK)
+            CASPAR_THROW_EXCEPTION(bad_alloc());
+
+        position_   = header_.first_data;
+        chunk_left_ = header_.first_size;
+        prior_.assign(row_bytes_, 0);
+        next_row_ = 0;
+        kept_     = 0;
+    }
+
+    void save(int row)
+    {
+        checkpoint saved;
+        saved.stream.reset(new z_stream{});
+        if (inflateCopy(saved.stream.get(), stream_.get()) != Z_OK) {
+            // Not copied, so there is nothing for inflateEnd to free.
+            delete saved.stream.release();
+            return;
+        }
+        saved.position   = stream_->avail_in > 0 ? input_position_ + (stream_->next_in - input_.data()) : position_;
+        saved.chunk_left = chunk_left_ + stream_->avail_in;
+        saved.prior      = prior_;
+
+        checkpoints_.emplace(row, std::move(saved));
+    }
+
+    void restore(int row, const checkpoint& saved)
+    {
+        inflater stream(new z_stream{});
+        if (inflateCopy(stream.get(), saved.stream.get()) != Z_OK) {
+            delete stream.release();
+            CASPAR_THROW_EXCEPTION(bad_alloc());
+        }
+        stream->next_in  = nullptr;
+        stream->avail_in = 0;
+
+        stream_     = std::move(stream);
+        position_   = saved.position;
+        chunk_left_ = saved.chunk_left;
+        prior_      = saved.prior;
+        next_row_   = row;
+        kept_       = 0;
+    }
+
+    // Reads on into input_, through to the next IDAT chunk when this one is done.
+    void refill()
+    {
+        while (chunk_left_ == 0) {
+            std::uint8_t head[8];
+            file_.clear();
+            file_.seekg(position_ + 4); // past the CRC
+            if (!file_.read(reinterpret_cast<char*>(head), sizeof(head)) || std::memcmp(head + 4, "IDAT", 4) != 0)
+                corrupt();
+
+            position_ += 12;
+            chunk_left_ = read_be32(head);
+        }
+
+        const auto size = std::min<std::size_t>(input_.size(), chunk_left_);
+
+        file_.clear();
+        file_.seekg(position_);
+        if (!file_.read(reinterpret_cast<char*>(input_.data()), static_cast<std::streamsize>(size)))
+            corrupt();
+
+        input_position_ = position_;
+        position_ += size;
+        chunk_left_ -= static_cast<std::uint32_t>(size);
+
+        stream_->next_in  = input_.data();
+        stream_->avail_in = static_cast<uInt>(size);
+    }
+
+    void decode_row()
+    {
+        stream_->next_out  = current_.data();
+        stream_->avail_out = static_cast<uInt>(current_.size());
+
+        while (stream_->avail_out > 0) {
+            const auto result = inflate(stream_.get(), Z_NO_FLUSH);
+
+            if (result == Z_STREAM_END) {
+                if (stream_->avail_out > 0)
+                    corrupt();
+                break;
+            }
+            if (result != Z_OK && (result != Z_BUF_ERROR || stream_->avail_in > 0))
+                corrupt();
+            if (stream_->avail_out > 0 && stream_->avail_in == 0)
+                refill();
+        }
+
+        unfilter();
+        std::copy(current_.begin() + 1, current_.end(), prior_.begin());
+
+        to_bgra(prior_.data(), rows_.data() + static_cast<std::size_t>(next_row_ % keep_rows_) * header_.width * 4);
+
+        next_row_ += 1;
+        kept_ = std::min(kept_ + 1, keep_rows_);
+    }
+
+    void unfilter()
+    {
+        auto       row   = current_.data() + 1;
+        const auto prior = prior_.data();
+        const auto size  = row_bytes_;
+        const auto bpp   = bpp_;
+
+        switch (current_[0]) {
+            case 0:
+                break;
+            case 1:
+                for (std::size_t n = bpp; n < size; ++n)
+                    row[n] = static_cast<std::uint8_t>(row[n] + row[n - bpp]);
+                break;
+            case 2:
+                for (std::size_t n = 0; n < size; ++n)
+                    row[n] = static_cast<std::uint8_t>(row[n] + prior[n]);
+                break;
+            case 3:
+                for (std::size_t n = 0; n < size; ++n) {
+                    const int left = n >= bpp ? row[n - bpp] : 0;
+                    row[n]         = static_cast<std::uint8_t>(row[n] + ((left + prior[n]) >> 1));
+                }
+                break;
+            case 4:
+                for (std::size_t n = 0; n < size; ++n) {
+                    const int left    = n >= bpp ? row[n - bpp] : 0;
+                    const int up_left = n >= bpp ? prior[n - bpp] : 0;
+                    row[n]            = static_cast<std::uint8_t>(row[n] + paeth(left, prior[n], up_left));
+                }
+                break;
+            default:
+                corrupt();
+        }
+    }
+
+    void to_bgra(const std::uint8_t* src, std::uint8_t* dst) const
+    {
+        const int  width = header_.width;
+        const int  depth = header_.bit_depth;
+        const auto max   = (1u << std::min(depth, 8)) - 1;
+
+        // The sample at the bit depth of the file, and as 8 bits.
+        auto sample = [&](int n) -> unsigned {
+            if (depth == 16)
+                return src[n * 2] << 8 | src[n * 2 + 1];
+            if (depth == 8)
+                return src[n];
+            const int bit = n * depth;
+            return (src[bit >> 3] >> (8 - depth - (bit & 7))) & max;
+        };
+        auto scale = [&](unsigned value) {
+            return static_cast<std::uint8_t>(depth == 16 ? value >> 8 : value * 255 / max);
+        };
+
+        switch (header_.color_type) {
+            case 0:
+                for (int x = 0; x < width; ++x) {
+                    const auto value = sample(x);
+                    const auto gray  = scale(value);
+                    dst[x * 4 + 0]   = gray;
+                    dst[x * 4 + 1]   = gray;
+                    dst[x * 4 + 2]   = gray;
+                    dst[x * 4 + 3]   = header_.has_key && value == header_.key[0] ? 0 : 255;
+                }
+                break;
+            case 2:
+                for (int x = 0; x < width; ++x) {
+                    const auto r   = sample(x * 3 + 0);
+                    const auto g   = sample(x * 3 + 1);
+                    const auto b   = sample(x * 3 + 2);
+                    dst[x * 4 + 0] = scale(b);
+                    dst[x * 4 + 1] = scale(g);
+                    dst[x * 4 + 2] = scale(r);
+                    dst[x * 4 + 3] =
+                        header_.has_key && r == header_.key[0] && g == header_.key[1] && b == header_.key[2] ? 0 : 255;
+                }
+                break;
+            case 3:
+                for (int x = 0; x < width; ++x)
+                    std::memcpy(dst + x * 4, header_.palette.data() + sample(x) * 4, 4);
+                break;
+            case 4:
+                for (int x = 0; x < width; ++x) {
+                    const auto gray = scale(sample(x * 2 + 0));
+                    dst[x * 4 + 0]  = gray;
+                    dst[x * 4 + 1]  = gray;
+                    dst[x * 4 + 2]  = gray;
+                    dst[x * 4 + 3]  = scale(sample(x * 2 + 1));
+                }
+                break;
+            case 6:
+                for (int x = 0; x < width; ++x) {
+                    dst[x * 4 + 0] = scale(sample(x * 4 + 2));
+                    dst[x * 4 + 1] = scale(sample(x * 4 + 1));
+                    dst[x * 4 + 2] = scale(sample(x * 4 + 0));
+                    dst[x * 4 + 3] = scale(sample(x * 4 + 3));
+                }
+                break;
+        }
+    }
+
+    // The row as BGRA, decoded on from the nearest checkpoint at or above it unless it is still kept.
+    const std::uint8_t* row(int y, bool first)
+    {
+        if (y >= next_row_ || y < next_row_ - kept_) {
+            auto it   = checkpoints_.upper_bound(y);
+            auto from = it != checkpoints_.begin() ? std::prev(it) : checkpoints_.end();
+
+            if (from != checkpoints_.end() && (y < next_row_ || from->first > next_row_))
+                restore(from->first, from->second);
+            else if (y < next_row_)
+                restart();
+
+            while (next_row_ <= y) {
+                if (next_row_ > 0 && (next_row_ % checkpoint_interval_ == 0 || (first && next_row_ == y)) &&
+                    checkpoints_.count(next_row_) == 0)
+                    save(next_row_);
+                decode_row();
+            }
+        }
+
+        return rows_.data() + static_cast<std::size_t>(y % keep_rows_) * header_.width * 4;
+    }
+
+    void read(int x, int y, int width, int height, std::uint8_t* dst, std::ptrdiff_t dst_pitch)
+    {
+        if (x < 0 || y < 0 || width < 0 || height < 0 || x + width > header_.width || y + height > header_.height)
+            CASPAR_THROW_EXCEPTION(out_of_range() << msg_info("Read outside the image."));
+
+        for (int n = 0; n < height; ++n)
+            std::memcpy(dst + n * dst_pitch, row(y + n, n == 0) + x * 4, static_cast<std::size_t>(width) * 4);
+    }
+};
+
+bool png_row_reader::can_read(const std::wstring& filename)
+{
+    boost::filesystem::ifstream file(boost::filesystem::path(filename), std::ios::binary);
+    png_header                  header;
+    return file && read_header(file, header);
+}
+
+png_row_reader::png_row_reader(const std::wstring& filename, int checkpoint_interval, int keep_rows)
+    : impl_(new impl(filename, checkpoint_interval, keep_rows))
+{
+}
+
+png_row_reader::~png_row_reader() {}
+
+int png_row_reader::width() const { return impl_->header_.width; }
+
+int png_row_reader::height() const { return impl_->header_.height; }
+
+void png_row_reader::read(int x, int y, int width, int height, std::uint8_t* dst, std::ptrdiff_t dst_pitch)
+{
+    impl_->read(x, y, width, height, dst, dst_pitch);
+}
+
+}} // namespace caspar::image
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace image {
+
+// Reads the rows of a non interlaced PNG file as top down BGRA with straight alpha, decoding only as far down as it
+// is asked to, so an image too large to hold decoded can be read a strip at a time. The inflate state is kept every
+// checkpoint_interval rows and at the start of each read, so going back up decodes at most that many rows again, and
+// the last keep_rows rows stay decoded for reads that overlap the one before. Not thread safe.
+class png_row_reader
+{
+  public:
+    // Whether the file is a PNG this reader can decode, judged from its header.
+    static bool can_read(const std::wstring& filename);
+
+    png_row_reader(const std::wstring& filename, int checkpoint_interval, int keep_rows);
+    ~png_row_reader();
+
+    png_row_reader(const png_row_reader&)            = delete;
+    png_row_reader& operator=(const png_row_reader&) = delete;
+
+    int width() const;
+    int height() const;
+
+    // Copies the width by height pixels at x, y to dst, top down.
+    void read(int x, int y, int width, int height, std::uint8_t* dst, std::ptrdiff_t dst_pitch);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::image
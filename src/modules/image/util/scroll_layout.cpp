@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "scroll_layout.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace caspar { namespace image {
+
+scroll_layout::scroll_layout(int image_width, int image_height, int screen_width, int screen_height)
+    : image_width_(image_width)
+    , image_height_(image_height)
+    , screen_width_(screen_width)
+    , screen_height_(screen_height)
+    , vertical_(image_width == screen_width)
+    , tile_count_(vertical_ ? (image_height + screen_height - 1) / screen_height
+                            : (image_width + screen_width - 1) / screen_width)
+{
+}
+
+int scroll_layout::translation(int index) const { return vertical_ ? -(index + 1) : -(tile_count_ - index); }
+
+scroll_tile scroll_layout::tile(int index) const
+{
+    scroll_tile t;
+    t.translation = translation(index);
+
+    if (vertical_) {
+        // Counted from the bottom of the image, the top tile is aligned to the bottom of its frame.
+        int bottom = image_height_ - index * screen_height_;
+        int top    = bottom - screen_height_;
+
+        t.y       = std::max(0, top);
+        t.width   = image_width_;
+        t.height  = bottom - t.y;
+        t.frame_y = t.y - top;
+    } else {
+        t.x      = index * screen_width_;
+        t.width  = std::min(screen_width_, image_width_ - t.x);
+        t.height = image_height_;
+    }
+
+    return t;
+}
+
+bool scroll_layout::visible(int index, double motion) const
+{
+    auto offset = translation(index) + motion;
+    return offset >= -1.0 && offset <= 1.0;
+}
+
+std::vector<int> scroll_layout::live_tiles(double motion, double speed, double ahead) const
+{
+    auto screen = static_cast<double>(vertical_ ? screen_height_ : screen_width_);
+    auto reach  = std::abs(speed) * ahead / screen;
+
+    // Tiles move towards higher offsets when the speed is positive.
+    auto min_offset = -1.0 - (speed > 0.0 ? reach : 0.0);
+    auto max_offset = 1.0 + (speed < 0.0 ? reach : 0.0);
+
+    std::vector<int> result;
+    for (int index = 0; index < tile_count_; ++index) {
+        auto offset = translation(index) + motion;
+        if (offset >= min_offset && offset <= max_offset)
+            result.push_back(index);
+    }
+
+    // Vertical tiles are counted from the bottom.
+    if (vertical_)
+        std::reverse(result.begin(), result.end());
+
+    return result;
+}
+
+}} // namespace caspar::image
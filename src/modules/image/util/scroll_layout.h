@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+
+namespace caspar { namespace image {
+
+// A screen sized part of the image in top down image coordinates, clipped to the image, and where it goes in its frame.
+struct scroll_tile
+{
+    int x           = 0;
+    int y           = 0;
+    int width       = 0;
+    int height      = 0;
+    int frame_x     = 0;
+    int frame_y     = 0;
+    int translation = 0; // in screens, relative to the start of the scroll
+};
+
+// How a scrolled image is cut into screen sized tiles. Vertical scrolls count their tiles from the bottom of the
+// image, horizontal ones from the left. A tile is on screen while its offset, its translation plus the motion of the
+// scroll in screens, is within [-1, 1].
+class scroll_layout
+{
+    int  image_width_;
+    int  image_height_;
+    int  screen_width_;
+    int  screen_height_;
+    bool vertical_;
+    int  tile_count_;
+
+  public:
+    scroll_layout(int image_width, int image_height, int screen_width, int screen_height);
+
+    int  image_width() const { return image_width_; }
+    int  image_height() const { return image_height_; }
+    bool vertical() const { return vertical_; }
+    int  tile_count() const { return tile_count_; }
+
+    int         translation(int index) const;
+    scroll_tile tile(int index) const;
+
+    bool visible(int index, double motion) const;
+
+    // The tiles to hold at the given motion: those on screen and those the given speed, in pixels per frame, brings
+    // onto it within ahead frames. In the order of their rows in the image, so that a streamed image is read forwards.
+    std::vector<int> live_tiles(double motion, double speed, double ahead) const;
+};
+
+}} // namespace caspar::image
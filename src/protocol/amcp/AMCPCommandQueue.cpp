@@ -26,22 +26,179 @@
 #include <boost/lexical_cast.hpp>
 #include <common/except.h>
 #include <common/future.h>
+#include <common/os/thread.h>
 #include <common/timer.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 namespace caspar { namespace protocol { namespace amcp {
 
+namespace {
+
+// Upper bounds in seconds of the latency histogram buckets, the last one catching the rest.
+const double latency_bounds[] = {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0, 1e9};
+
+std::mutex                     queues_mutex;
+std::vector<AMCPCommandQueue*> queues;
+
+} // namespace
+
+// Sends the replies of commands that had not finished when they were executed, all from one thread per queue rather
+// than a thread per command. Results are pushed as they are executed, and the thread sleeps on a condition variable
+// until there is one, then waits for the oldest to be fulfilled and runs its continuation right away, so replies go
+// out as soon as they are ready and in the order the commands were executed. Results still pending when the queue is
+// stopped are completed if they are ready and failed otherwise, so that no client is left without a reply.
+struct AMCPCommandQueue::completion_queue
+{
+    struct pending_result
+    {
+        std::shared_future<std::wstring> result;
+        std::function<void(bool)>        continuation;
+    };
+
+    std::mutex                 mutex_;
+    std::condition_variable    cond_;
+    std::deque<pending_result> pending_;
+    bool                       stop_ = false;
+    std::atomic<std::size_t>   size_{0};
+    std::thread                thread_;
+
+    explicit completion_queue(const std::wstring& name)
+        : thread_([this, name] {
+            set_thread_name(name);
+            run();
+        })
+    {
+    }
+
+    ~completion_queue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_one();
+        thread_.join();
+    }
+
+    void push(std::shared_future<std::wstring> result, std::function<void(bool)> continuation)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(pending_result{std::move(result), std::move(continuation)});
+            size_ += 1;
+        }
+        cond_.notify_one();
+    }
+
+    std::size_t size() const { return size_; }
+
+    static void complete(pending_result& p, bool completed)
+    {
+        try {
+            p.continuation(completed);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    void run()
+    {
+        while (true) {
+            pending_result p;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return stop_ || !pending_.empty(); });
+                if (stop_) {
+                    break;
+                }
+                p = std::move(pending_.front());
+                pending_.pop_front();
+            }
+
+            p.result.wait();
+            complete(p, true);
+            size_ -= 1;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& p : pending_) {
+            complete(p, is_ready(p.result));
+            size_ -= 1;
+        }
+        pending_.clear();
+    }
+};
+
 AMCPCommandQueue::AMCPCommandQueue(const std::wstring&                                  name,
                                    const spl::shared_ptr<std::vector<channel_context>>& channels)
-    : executor_(L"AMCPCommandQueue " + name)
+    : name_(name)
+    , completions_(std::make_unique<completion_queue>(L"AMCPCommandQueue " + name + L" completions"))
+    , latency_(std::size(latency_bounds))
+    , executor_(L"AMCPCommandQueue " + name)
     , channels_(channels)
 {
+    std::lock_guard<std::mutex> lock(queues_mutex);
+    queues.push_back(this);
 }
 
-AMCPCommandQueue::~AMCPCommandQueue() {}
+AMCPCommandQueue::~AMCPCommandQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(queues_mutex);
+        queues.erase(std::remove(queues.begin(), queues.end(), this), queues.end());
+    }
 
-std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>                         cmd,
-                           const spl::shared_ptr<std::vector<channel_context>>& channels,
-                           bool                                                 reply_without_req_id)
+    // Commands still queued may hand their results to the completion queue, which must outlive them.
+    executor_.stop_and_wait();
+    completions_.reset();
+}
+
+void AMCPCommandQueue::record_latency(double latency)
+{
+    const auto bucket = std::lower_bound(std::begin(latency_bounds), std::end(latency_bounds), latency);
+    latency_[std::min<std::size_t>(bucket - std::begin(latency_bounds), latency_.size() - 1)] += 1;
+    replied_ += 1;
+
+    auto max = max_latency_.load();
+    while (latency > max && !max_latency_.compare_exchange_weak(max, latency)) {
+    }
+}
+
+AMCPCommandQueue::statistics AMCPCommandQueue::stats() const
+{
+    statistics result;
+    result.name        = name_;
+    result.queued      = executor_.size();
+    result.pending     = completions_->size();
+    result.replied     = replied_;
+    result.max_latency = max_latency_;
+    for (std::size_t n = 0; n < latency_.size(); ++n) {
+        result.latency.emplace_back(latency_bounds[n], latency_[n].load());
+    }
+    return result;
+}
+
+std::vector<AMCPCommandQueue::statistics> AMCPCommandQueue::all_stats()
+{
+    std::lock_guard<std::mutex> lock(queues_mutex);
+
+    std::vector<statistics> result;
+    for (auto queue : queues) {
+        result.push_back(queue->stats());
+    }
+    return result;
+}
+
+std::future<bool> AMCPCommandQueue::exec_cmd(std::shared_ptr<AMCPCommand>                         cmd,
+                                             const spl::shared_ptr<std::vector<channel_context>>& channels,
+                                             bool                                                 reply_without_req_id,
+                                             const caspar::timer&                                 queued)
 {
     try {
         try {
@@ -51,12 +208,38 @@ std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>
             CASPAR_LOG(debug) << "Executing command: " << name;
 
             auto res = cmd->Execute(channels).share();
-            return std::async(std::launch::async, [cmd, res, reply_without_req_id, timer, name]() -> bool {
+
+            // Most commands are done when they return, so reply at once.
+            if (res.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
                 cmd->SendReply(res.get(), reply_without_req_id);
+                record_latency(queued.elapsed());
+
+                CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << name;
+                return make_ready_future(true);
+            }
+
+            // The others reply when their result is ready, from the completion queue.
+            auto replied = std::make_shared<std::promise<bool>>();
+            auto reply   = [this, cmd, res, reply_without_req_id, timer, queued, name, replied](bool completed) {
+                auto ok = true;
+                try {
+                    if (!completed) {
+                        CASPAR_THROW_EXCEPTION(operation_failed() << msg_info("Command queue stopped."));
+                    }
+                    cmd->SendReply(res.get(), reply_without_req_id);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    CASPAR_LOG(error) << "Failed to execute command: " << name;
+                    cmd->SendReply(L"501 " + name + L" FAILED\r\n", reply_without_req_id);
+                    ok = false;
+                }
+                record_latency(queued.elapsed());
+                replied->set_value(ok);
 
                 CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << name;
-                return true;
-            });
+            };
+            completions_->push(res, std::move(reply));
+            return replied->get_future();
 
         } catch (file_not_found&) {
             CASPAR_LOG(error) << " File not found.";
@@ -101,9 +284,10 @@ void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentComm
         return;
     }
 
+    const caspar::timer queued;
     executor_.begin_invoke([=] {
         try {
-            Execute(pCurrentCommand);
+            Execute(pCurrentCommand, queued);
 
             CASPAR_LOG(trace) << "Ready for a new command";
         } catch (...) {
@@ -112,14 +296,14 @@ void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentComm
     });
 }
 
-void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
+void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd, const caspar::timer& queued)
 {
     if (cmd->Commands().empty())
         return;
 
     // Shortcut for commands which are either not a batch, or don't need to be
     if (cmd->Commands().size() == 1) {
-        exec_cmd(cmd->Commands().at(0), channels_, true);
+        exec_cmd(cmd->Commands().at(0), channels_, true, queued);
         return;
     }
 
@@ -140,7 +324,7 @@ void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
 
         // 'execute' aka queue all comamnds
         for (auto& cmd2 : cmd->Commands()) {
-            results.push_back(exec_cmd(cmd2, delayed_channels, cmd->HasClient()));
+            results.push_back(exec_cmd(cmd2, delayed_channels, cmd->HasClient(), queued));
         }
 
         // lock all the channels needed
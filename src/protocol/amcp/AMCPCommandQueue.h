@@ -25,6 +25,15 @@
 
 #include <common/executor.h>
 #include <common/memory.h>
+#include <common/timer.h>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace caspar { namespace protocol { namespace amcp {
 
@@ -33,13 +42,45 @@ class AMCPCommandQueue
   public:
     using ptr_type = spl::shared_ptr<AMCPCommandQueue>;
 
+    struct statistics
+    {
+        std::wstring  name;
+        std::size_t   queued;   // Commands waiting to be executed.
+        std::size_t   pending;  // Executed commands waiting for their result.
+        std::uint64_t replied;  // Commands replied to since the queue was created.
+        double        max_latency;
+
+        // Number of commands replied to within each upper bound in seconds, from being queued to the reply.
+        std::vector<std::pair<double, std::uint64_t>> latency;
+    };
+
     AMCPCommandQueue(const std::wstring& name, const spl::shared_ptr<std::vector<channel_context>>& channels);
     ~AMCPCommandQueue();
 
     void AddCommand(std::shared_ptr<AMCPGroupCommand> command);
-    void Execute(std::shared_ptr<AMCPGroupCommand> cmd) const;
+    void Execute(std::shared_ptr<AMCPGroupCommand> cmd, const caspar::timer& queued);
+
+    statistics stats() const;
+
+    // Statistics of every queue in the process.
+    static std::vector<statistics> all_stats();
 
   private:
+    struct completion_queue;
+
+    std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>                         cmd,
+                               const spl::shared_ptr<std::vector<channel_context>>& channels,
+                               bool                                                 reply_without_req_id,
+                               const caspar::timer&                                 queued);
+
+    void record_latency(double latency);
+
+    const std::wstring                 name_;
+    std::unique_ptr<completion_queue>  completions_;
+    std::vector<std::atomic<uint64_t>> latency_;
+    std::atomic<uint64_t>              replied_{0};
+    std::atomic<double>                max_latency_{0.0};
+
     executor                                            executor_;
     const spl::shared_ptr<std::vector<channel_context>> channels_;
 };
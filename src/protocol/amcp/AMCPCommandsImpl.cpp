@@ -38,6 +38,7 @@
 #include <common/filesystem.h>
 #include <common/future.h>
 #include <common/log.h>
+#include <common/media_index.h>
 #include <common/os/filesystem.h>
 #include <common/param.h>
 
@@ -49,22 +50,29 @@
 #include <core/producer/cg_proxy.h>
 #include <core/producer/color/color_producer.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/preloader.h>
 #include <core/producer/stage.h>
 #include <core/producer/transition/sting_producer.h>
 #include <core/producer/transition/transition_producer.h>
+#include <core/video_channel.h>
 #include <core/video_format.h>
 
 #include <protocol/osc/client.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <future>
+#include <list>
 #include <memory>
+#include <mutex>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/regex.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/insert_linebreaks.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -206,6 +214,49 @@ core::frame_producer_dependencies get_producer_dependencies(const std::shared_pt
                                              ctx.static_context->cg_registry);
 }
 
+// Strips the parameters that only concern loading, so that PRELOAD and the following LOAD or LOADBG match regardless of
+// transition, AUTO and CLEAR_ON_404.
+std::vector<std::wstring> get_producer_params(const std::vector<std::wstring>& params)
+{
+    static const boost::wregex transition(L"CUT|PUSH|SLIDE|WIPE|MIX", boost::regex::icase);
+    static const boost::wregex duration(L"\\d+");
+    static const boost::wregex tween(L"LINEAR|EASE\\S*", boost::regex::icase);
+    static const boost::wregex direction(L"FROMLEFT|FROMRIGHT|LEFT|RIGHT", boost::regex::icase);
+
+    std::vector<std::wstring> result;
+    for (std::size_t n = 0; n < params.size(); ++n) {
+        if (boost::iequals(params[n], L"AUTO") || boost::iequals(params[n], L"CLEAR_ON_404")) {
+            continue;
+        }
+        if (n > 0 && n + 1 < params.size() && boost::regex_match(params[n], transition) &&
+            boost::regex_match(params[n + 1], duration)) {
+            n += 1;
+            if (n + 1 < params.size() && boost::regex_match(params[n + 1], tween)) {
+                n += 1;
+            }
+            if (n + 1 < params.size() && boost::regex_match(params[n + 1], direction)) {
+                n += 1;
+            }
+            continue;
+        }
+        result.push_back(params[n]);
+    }
+    return result;
+}
+
+spl::shared_ptr<core::frame_producer> create_producer(const std::shared_ptr<core::video_channel>& channel,
+                                                      const command_context&                      ctx)
+{
+    auto dependencies = get_producer_dependencies(channel, ctx);
+
+    if (auto producer =
+            ctx.static_context->preloader->take(channel->index(), dependencies, get_producer_params(ctx.parameters))) {
+        return spl::make_shared_ptr(producer);
+    }
+
+    return ctx.static_context->producer_registry->create_producer(dependencies, ctx.parameters);
+}
+
 bool try_match_sting(const std::vector<std::wstring>& params, sting_info& stingInfo)
 {
     auto match = std::find_if(params.begin(), params.end(), param_comparer(L"STING"));
@@ -282,8 +333,7 @@ std::wstring loadbg_command(command_context& ctx)
     bool auto_play = contains_param(L"AUTO", ctx.parameters);
 
     try {
-        auto new_producer = ctx.static_context->producer_registry->create_producer(
-            get_producer_dependencies(channel, ctx), ctx.parameters);
+        auto new_producer = create_producer(channel, ctx);
 
         if (new_producer == frame_producer::empty())
             CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(!ctx.parameters.empty() ? ctx.parameters[0] : L""));
@@ -331,8 +381,7 @@ std::wstring load_command(command_context& ctx)
         ctx.channel.stage->preview(ctx.layer_index());
     } else {
         try {
-            auto new_producer = ctx.static_context->producer_registry->create_producer(
-                get_producer_dependencies(ctx.channel.raw_channel, ctx), ctx.parameters);
+            auto new_producer        = create_producer(ctx.channel.raw_channel, ctx);
             auto transition_producer = create_transition_producer(new_producer, transition_info{});
 
             ctx.channel.stage->load(ctx.layer_index(), transition_producer, true);
@@ -348,6 +397,15 @@ std::wstring load_command(command_context& ctx)
     return L"202 LOAD OK\r\n";
 }
 
+std::wstring preload_command(command_context& ctx)
+{
+    ctx.static_context->preloader->preload(ctx.channel.raw_channel->index(),
+                                           get_producer_dependencies(ctx.channel.raw_channel, ctx),
+                                           get_producer_params(ctx.parameters));
+
+    return L"202 PRELOAD OK\r\n";
+}
+
 std::wstring play_command(command_context& ctx)
 {
     try {
@@ -1446,18 +1504,394 @@ std::wstring thumbnail_generateall_command(command_context& ctx)
     return make_request(ctx, "/thumbnail/generate", L"501 THUMBNAIL GENERATE_ALL FAILED\r\n");
 }
 
+// Schedule Commands
+
+// Frame number of <frame>, +<frames> from now, or the time of day hh:mm:ss:ff on the server clock, on the channel.
+std::uint64_t parse_schedule_time(const std::wstring& str, const core::video_channel& channel)
+{
+    const auto now = channel.frame_number();
+
+    if (!str.empty() && str[0] == L'+') {
+        return now + boost::lexical_cast<std::uint64_t>(str.substr(1));
+    }
+
+    std::vector<std::wstring> parts;
+    boost::split(parts, str, boost::is_any_of(L":;."));
+    if (parts.size() == 1) {
+        return boost::lexical_cast<std::uint64_t>(str);
+    }
+    if (parts.size() != 4) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid timecode " + str));
+    }
+
+    const auto framerate = channel.stage()->video_format_desc().framerate;
+    const auto fps       = boost::rational_cast<double>(framerate);
+
+    const auto target = ((boost::lexical_cast<int>(parts[0]) * 60 + boost::lexical_cast<int>(parts[1])) * 60 +
+                         boost::lexical_cast<int>(parts[2])) +
+                        boost::lexical_cast<int>(parts[3]) / fps;
+    const auto time_of_day = boost::posix_time::microsec_clock::local_time().time_of_day();
+    const auto current     = time_of_day.total_microseconds() / 1000000.0;
+
+    // A time that has passed today is taken to be tomorrow.
+    auto delta = target - current;
+    if (delta < 0.0) {
+        delta += 24.0 * 60.0 * 60.0;
+    }
+
+    return now + static_cast<std::uint64_t>(std::llround(delta * fps));
+}
+
+// Records the stage operations of a scheduled command as closures, which the channel runs in order from its schedule
+// right before the frame is produced. The futures handed out are fulfilled as the operations are run, and broken if
+// the command is removed from the schedule before it is.
+class scheduled_stage final : public core::stage_base
+{
+    // Weak, as the operations are kept in the schedule of the channel itself.
+    std::weak_ptr<core::video_channel> channel_;
+    std::mutex                         mutex_;
+    std::vector<std::function<void()>> operations_;
+
+    std::shared_ptr<core::stage> stage() const
+    {
+        auto channel = channel_.lock();
+        if (!channel) {
+            CASPAR_THROW_EXCEPTION(operation_failed() << msg_info("Channel destroyed."));
+        }
+        return channel->stage();
+    }
+
+    static std::shared_ptr<core::stage_base> underlying(const std::shared_ptr<stage_base>& other)
+    {
+        const auto scheduled = std::dynamic_pointer_cast<scheduled_stage>(other);
+        return scheduled ? scheduled->stage() : other;
+    }
+
+    template <typename T, typename Func>
+    static void fulfil(std::promise<T>& promise, const Func& func)
+    {
+        promise.set_value(func().get());
+    }
+
+    template <typename Func>
+    static void fulfil(std::promise<void>& promise, const Func& func)
+    {
+        func().get();
+        promise.set_value();
+    }
+
+    template <typename Func>
+    auto defer(Func func) -> std::future<decltype(func(std::shared_ptr<core::stage>()).get())>
+    {
+        using result_type = decltype(func(std::shared_ptr<core::stage>()).get());
+
+        auto promise = std::make_shared<std::promise<result_type>>();
+        auto future  = promise->get_future();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        operations_.push_back([this, promise, func] {
+            try {
+                fulfil(*promise, [&] { return func(stage()); });
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+
+        return future;
+    }
+
+  public:
+    explicit scheduled_stage(const std::shared_ptr<core::video_channel>& channel)
+        : channel_(channel)
+    {
+    }
+
+    void apply()
+    {
+        std::vector<std::function<void()>> operations;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::swap(operations, operations_);
+        }
+
+        for (auto& operation : operations) {
+            operation();
+        }
+    }
+
+    std::future<void> apply_transforms(const std::vector<transform_tuple_t>& transforms) override
+    {
+        return defer([=](auto stage) { return stage->apply_transforms(transforms); });
+    }
+    std::future<void> apply_transform(int                     index,
+                                      const transform_func_t& transform,
+                                      unsigned int            mix_duration,
+                                      const tweener&          tween) override
+    {
+        return defer([=](auto stage) { return stage->apply_transform(index, transform, mix_duration, tween); });
+    }
+    std::future<void> clear_transforms(int index) override
+    {
+        return defer([=](auto stage) { return stage->clear_transforms(index); });
+    }
+    std::future<void> clear_transforms() override
+    {
+        return defer([=](auto stage) { return stage->clear_transforms(); });
+    }
+    std::future<core::frame_transform> get_current_transform(int index) override
+    {
+        return defer([=](auto stage) { return stage->get_current_transform(index); });
+    }
+    std::future<void>
+    load(int index, const spl::shared_ptr<core::frame_producer>& producer, bool preview, bool auto_play) override
+    {
+        return defer([=](auto stage) { return stage->load(index, producer, preview, auto_play); });
+    }
+    std::future<void> preview(int index) override
+    {
+        return defer([=](auto stage) { return stage->preview(index); });
+    }
+    std::future<void> pause(int index) override
+    {
+        return defer([=](auto stage) { return stage->pause(index); });
+    }
+    std::future<void> resume(int index) override
+    {
+        return defer([=](auto stage) { return stage->resume(index); });
+    }
+    std::future<void> play(int index) override
+    {
+        return defer([=](auto stage) { return stage->play(index); });
+    }
+    std::future<void> stop(int index) override
+    {
+        return defer([=](auto stage) { return stage->stop(index); });
+    }
+    std::future<std::wstring> call(int index, const std::vector<std::wstring>& params) override
+    {
+        return defer([=](auto stage) { return stage->call(index, params); });
+    }
+    std::future<std::wstring> callbg(int index, const std::vector<std::wstring>& params) override
+    {
+        return defer([=](auto stage) { return stage->callbg(index, params); });
+    }
+    std::future<void> clear(int index) override
+    {
+        return defer([=](auto stage) { return stage->clear(index); });
+    }
+    std::future<void> clear() override
+    {
+        return defer([=](auto stage) { return stage->clear(); });
+    }
+    std::future<void> swap_layers(const std::shared_ptr<stage_base>& other, bool swap_transforms) override
+    {
+        return defer([=](auto stage) { return stage->swap_layers(underlying(other), swap_transforms); });
+    }
+    std::future<void> swap_layer(int index, int other_index, bool swap_transforms) override
+    {
+        return defer([=](auto stage) { return stage->swap_layer(index, other_index, swap_transforms); });
+    }
+    std::future<void>
+    swap_layer(int index, int other_index, const std::shared_ptr<stage_base>& other, bool swap_transforms) override
+    {
+        return defer(
+            [=](auto stage) { return stage->swap_layer(index, other_index, underlying(other), swap_transforms); });
+    }
+    std::future<void> execute(std::function<void()> k) override
+    {
+        return defer([=](auto stage) { return stage->execute(k); });
+    }
+    std::future<std::shared_ptr<core::frame_producer>> foreground(int index) override
+    {
+        return defer([=](auto stage) { return stage->foreground(index); });
+    }
+    std::future<std::shared_ptr<core::frame_producer>> background(int index) override
+    {
+        return defer([=](auto stage) { return stage->background(index); });
+    }
+};
+
+std::wstring schedule_set_command(command_context& ctx)
+{
+    // The scheduled command, with an optional REQ <id> used to tag its reply when it has run.
+    std::list<std::wstring> tokens(ctx.parameters.begin() + 1, ctx.parameters.end());
+    std::wstring            request_id;
+    if (tokens.size() > 1 && boost::iequals(tokens.front(), L"REQ")) {
+        tokens.pop_front();
+        request_id = tokens.front();
+        tokens.pop_front();
+    }
+
+    const auto command = ctx.static_context->parser->parse_command(ctx.client, tokens, request_id);
+    if (!command || command->channel_index() < 0) {
+        return L"400 SCHEDULE SET ERROR\r\n";
+    }
+    if (!ctx.static_context->parser->check_channel_lock(ctx.client, command->channel_index())) {
+        return L"503 SCHEDULE SET FAILED\r\n";
+    }
+
+    const auto& channel = ctx.channels->at(command->channel_index());
+    const auto  frame   = parse_schedule_time(ctx.parameters.at(0), *channel.raw_channel);
+
+    // The command is executed now, so that producers are created ahead of time, against a stage that records its
+    // operations. The channel runs them right before the frame is produced.
+    auto stage = std::make_shared<scheduled_stage>(channel.raw_channel);
+
+    spl::shared_ptr<std::vector<channel_context>> channels;
+    for (auto& ch : *ctx.channels) {
+        const auto st = &ch == &channel ? std::shared_ptr<core::stage_base>(stage) : ch.stage;
+        channels->emplace_back(ch.raw_channel, st, ch.lifecycle_key_);
+    }
+
+    const auto result = command->Execute(channels).share();
+
+    auto name = command->name();
+    for (auto& param : command->parameters()) {
+        name += L" " + param;
+    }
+
+    const auto id = channel.raw_channel->schedule(
+        frame,
+        [stage, command, result] {
+            stage->apply();
+
+            // The operations the result waits on have all run, so it is there now, also when it is deferred.
+            try {
+                command->SendReply(result.get(), true);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(error) << "Failed to execute scheduled command: " << command->name();
+                command->SendReply(L"501 " + command->name() + L" FAILED\r\n", true);
+            }
+        },
+        name);
+
+    return L"201 SCHEDULE SET OK\r\n" + std::to_wstring(id) + L" " + std::to_wstring(frame) + L"\r\n";
+}
+
+std::wstring schedule_remove_command(command_context& ctx)
+{
+    const auto id = boost::lexical_cast<std::uint64_t>(ctx.parameters.at(0));
+
+    for (auto& ch : *ctx.channels) {
+        if (ch.raw_channel->unschedule(id)) {
+            return L"202 SCHEDULE REMOVE OK\r\n";
+        }
+    }
+
+    return L"404 SCHEDULE REMOVE FAILED\r\n";
+}
+
+std::wstring schedule_clear_command(command_context& ctx)
+{
+    for (auto& ch : *ctx.channels) {
+        ch.raw_channel->clear_schedule();
+    }
+
+    return L"202 SCHEDULE CLEAR OK\r\n";
+}
+
+std::wstring schedule_list_command(command_context& ctx)
+{
+    std::wstringstream replyString;
+    replyString << L"200 SCHEDULE LIST OK\r\n";
+
+    for (auto& ch : *ctx.channels) {
+        for (auto& task : ch.raw_channel->scheduled()) {
+            replyString << task.id << L" " << ch.raw_channel->index() << L" " << task.frame_number << L" " << task.name
+                        << L"\r\n";
+        }
+    }
+
+    replyString << L"\r\n";
+
+    return replyString.str();
+}
+
 // Query Commands
 
+// Modification time in local time, as YYYYMMDDhhmmss.
+std::wstring format_write_time(std::time_t time)
+{
+    using adjustor = boost::date_time::c_local_adjustor<boost::posix_time::ptime>;
+
+    auto str = boost::posix_time::to_iso_wstring(adjustor::utc_to_local(boost::posix_time::from_time_t(time)));
+    boost::erase_all(str, L"T");
+    return str.substr(0, 14);
+}
+
+// A line of CLS or CINF in the format of the media scanner: name, type, size, time, duration and time base.
+std::wstring media_line(const media_index::entry& entry)
+{
+    const auto& info = *entry.info;
+
+    auto has_video = std::any_of(
+        info.streams.begin(), info.streams.end(), [](const media_stream_info& s) { return s.type == "video"; });
+
+    std::wstringstream line;
+    line << L"\"" << entry.name << L"\" " << (info.still ? L"STILL" : has_video ? L"MOVIE" : L"AUDIO") << L" "
+         << entry.size << L" " << format_write_time(entry.write_time) << L" " << info.duration << L" "
+         << info.time_base_num << L"/" << info.time_base_den << L"\r\n";
+    return line.str();
+}
+
 std::wstring cinf_command(command_context& ctx)
 {
-    return make_request(ctx, "/cinf/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 CINF FAILED\r\n");
+    auto index = find_media_index(env::media_folder());
+    if (!index || !index->ready()) {
+        return make_request(ctx, "/cinf/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 CINF FAILED\r\n");
+    }
+
+    auto entry = index->get(ctx.parameters.at(0));
+    if (!entry || !entry->info) {
+        return L"404 CINF ERROR\r\n";
+    }
+
+    return L"201 CINF OK\r\n" + media_line(*entry);
 }
 
-std::wstring cls_command(command_context& ctx) { return make_request(ctx, "/cls", L"501 CLS FAILED\r\n"); }
+std::wstring cls_command(command_context& ctx)
+{
+    // The media scanner answers until every file has been probed, so that the list is never partial.
+    auto index = find_media_index(env::media_folder());
+    if (!index || !index->probed()) {
+        return make_request(ctx, "/cls", L"501 CLS FAILED\r\n");
+    }
+
+    std::wstringstream replyString;
+    replyString << L"200 CLS OK\r\n";
+    for (auto& entry : index->entries()) {
+        if (entry.info) {
+            replyString << media_line(entry);
+        }
+    }
+    replyString << L"\r\n";
+
+    return replyString.str();
+}
 
 std::wstring fls_command(command_context& ctx) { return make_request(ctx, "/fls", L"501 FLS FAILED\r\n"); }
 
-std::wstring tls_command(command_context& ctx) { return make_request(ctx, "/tls", L"501 TLS FAILED\r\n"); }
+std::wstring tls_command(command_context& ctx)
+{
+    auto index = find_media_index(env::template_folder());
+    if (!index || !index->ready()) {
+        return make_request(ctx, "/tls", L"501 TLS FAILED\r\n");
+    }
+
+    std::wstringstream replyString;
+    replyString << L"200 TLS OK\r\n";
+    for (auto& entry : index->entries()) {
+        auto extension = boost::to_lower_copy(entry.path.extension().wstring());
+        if (extension == L".ft" || extension == L".wt" || extension == L".ct" || extension == L".html") {
+            replyString << L"\"" << entry.name << L"\" " << entry.size << L" " << format_write_time(entry.write_time)
+                        << L"\r\n";
+        }
+    }
+    replyString << L"\r\n";
+
+    return replyString.str();
+}
 
 std::wstring version_command(command_context& ctx) { return L"201 VERSION OK\r\n" + env::version() + L"\r\n"; }
 
@@ -1536,6 +1970,36 @@ std::wstring info_command(command_context& ctx)
     return replyString.str();
 }
 
+std::wstring info_queues_command(command_context& ctx)
+{
+    boost::property_tree::wptree info;
+
+    for (auto& stats : AMCPCommandQueue::all_stats()) {
+        auto& queue = info.add(L"queues.queue", L"");
+        queue.add(L"name", stats.name);
+        queue.add(L"queued", stats.queued);
+        queue.add(L"pending", stats.pending);
+        queue.add(L"replied", stats.replied);
+        queue.add(L"max-latency", stats.max_latency);
+
+        for (auto& bucket : stats.latency) {
+            auto& node = queue.add(L"latency.bucket", bucket.second);
+            if (bucket.first < 1e9) {
+                node.add(L"<xmlattr>.le", bucket.first);
+            }
+        }
+    }
+
+    std::wstringstream replyString;
+    replyString << L"201 INFO QUEUES OK\r\n";
+
+    pt::xml_writer_settings<std::wstring> w(' ', 3);
+    pt::xml_parser::write_xml(replyString, info, w);
+
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
 std::wstring info_config_command(command_context& ctx)
 {
     std::wstringstream replyString;
@@ -1570,6 +2034,21 @@ std::wstring info_paths_command(command_context& ctx)
     return replyString.str();
 }
 
+std::wstring info_preload_command(command_context& ctx)
+{
+    boost::property_tree::wptree info;
+    info.add_child(L"preload", ctx.static_context->preloader->info());
+
+    std::wstringstream replyString;
+    replyString << L"201 INFO PRELOAD OK\r\n";
+
+    pt::xml_writer_settings<std::wstring> w(' ', 3);
+    pt::xml_parser::write_xml(replyString, info, w);
+
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
 std::wstring diag_command(command_context& ctx)
 {
     core::diagnostics::osd::show_graphs(true);
@@ -1680,8 +2159,27 @@ std::wstring osc_subscribe_command(command_context& ctx)
         return L"403 OSC SUBSCRIBE BAD PORT\r\n";
     }
 
+    // OSC SUBSCRIBE <port> [FILTER <glob>]... [RATE <hz>]
+    protocol::osc::subscription_options options;
+    for (std::size_t n = 1; n < ctx.parameters.size(); n += 2) {
+        if (n + 1 >= ctx.parameters.size()) {
+            return L"403 OSC SUBSCRIBE ERROR\r\n";
+        }
+        if (boost::iequals(ctx.parameters[n], L"FILTER")) {
+            options.filters.push_back(u8(ctx.parameters[n + 1]));
+        } else if (boost::iequals(ctx.parameters[n], L"RATE")) {
+            try {
+                options.max_rate = std::stod(ctx.parameters[n + 1]);
+            } catch (...) {
+                return L"403 OSC SUBSCRIBE BAD RATE\r\n";
+            }
+        } else {
+            return L"403 OSC SUBSCRIBE ERROR\r\n";
+        }
+    }
+
     auto subscription = ctx.static_context->osc_client->get_subscription_token(
-        udp::endpoint(address_v4::from_string(u8(ctx.client->address())), port));
+        udp::endpoint(address_v4::from_string(u8(ctx.client->address())), port), options);
 
     ctx.client->add_lifecycle_bound_object(get_osc_subscription_token(port), subscription);
 
@@ -1707,6 +2205,7 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_channel_command(L"Basic Commands", L"LOADBG", loadbg_command, 1);
     repo->register_channel_command(L"Basic Commands", L"CALLBG", callbg_command, 1);
     repo->register_channel_command(L"Basic Commands", L"LOAD", load_command, 0);
+    repo->register_channel_command(L"Basic Commands", L"PRELOAD", preload_command, 1);
     repo->register_channel_command(L"Basic Commands", L"PLAY", play_command, 0);
     repo->register_channel_command(L"Basic Commands", L"PAUSE", pause_command, 0);
     repo->register_channel_command(L"Basic Commands", L"RESUME", resume_command, 0);
@@ -1763,6 +2262,11 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE", thumbnail_generate_command, 1);
     repo->register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE_ALL", thumbnail_generateall_command, 0);
 
+    repo->register_command(L"Schedule Commands", L"SCHEDULE SET", schedule_set_command, 2);
+    repo->register_command(L"Schedule Commands", L"SCHEDULE REMOVE", schedule_remove_command, 1);
+    repo->register_command(L"Schedule Commands", L"SCHEDULE CLEAR", schedule_clear_command, 0);
+    repo->register_command(L"Schedule Commands", L"SCHEDULE LIST", schedule_list_command, 0);
+
     repo->register_command(L"Query Commands", L"CINF", cinf_command, 1);
     repo->register_command(L"Query Commands", L"CLS", cls_command, 0);
     repo->register_command(L"Query Commands", L"FLS", fls_command, 0);
@@ -1776,6 +2280,8 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_command(L"Query Commands", L"INFO", info_command, 0);
     repo->register_command(L"Query Commands", L"INFO CONFIG", info_config_command, 0);
     repo->register_command(L"Query Commands", L"INFO PATHS", info_paths_command, 0);
+    repo->register_command(L"Query Commands", L"INFO PRELOAD", info_preload_command, 0);
+    repo->register_command(L"Query Commands", L"INFO QUEUES", info_queues_command, 0);
     repo->register_command(L"Query Commands", L"GL INFO", gl_info_command, 0);
     repo->register_command(L"Query Commands", L"GL GC", gl_gc_command, 0);
 
@@ -33,6 +33,8 @@
 #include "../util/tokenize.h"
 
 #include <algorithm>
+#include <string_view>
+#include <vector>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/log/keywords/delimiter.hpp>
@@ -121,48 +123,53 @@ class AMCPProtocolStrategy
 
     // The parser method expects message to be complete messages with the delimiter stripped away.
     // Thesefore the AMCPProtocolStrategy should be decorated with a delimiter_based_chunking_strategy
-    void
-    parse(const std::wstring& message, const ClientInfoPtr& client, const std::shared_ptr<AMCPClientBatchInfo>& batch)
+    // The tokens are views of buffer. Both belong to the client and are reused for every message.
+    void parse(const std::wstring&                         message,
+               const ClientInfoPtr&                        client,
+               const std::shared_ptr<AMCPClientBatchInfo>& batch,
+               std::wstring&                               buffer,
+               std::vector<std::wstring_view>&             tokens)
     {
-        std::list<std::wstring> tokens;
-        IO::tokenize(message, tokens);
+        IO::tokenize(message, buffer, tokens);
 
         if (!tokens.empty() && boost::iequals(tokens.front(), L"PING")) {
-            tokens.pop_front();
-            std::wstringstream answer;
-            answer << L"PONG";
+            std::wstring answer = L"PONG";
 
-            for (auto t : tokens)
-                answer << L" " << t;
+            for (auto it = tokens.begin() + 1; it != tokens.end(); ++it) {
+                answer += L" ";
+                answer += *it;
+            }
 
-            answer << "\r\n";
-            client->send(answer.str(), true);
+            answer += L"\r\n";
+            client->send(std::move(answer), true);
             return;
         }
 
         CASPAR_LOG(info) << L"Received message from " << client->address() << ": " << message << L"\\r\\n";
 
-        std::wstring request_id;
-        std::wstring command_name;
-        error_state  err = parse_command_string(client, batch, tokens, request_id, command_name);
+        std::wstring      request_id;
+        std::wstring_view command_name;
+        error_state       err = parse_command_string(client, batch, tokens, request_id, command_name);
         if (err != error_state::no_error) {
             std::wstringstream answer;
 
             if (!request_id.empty())
                 answer << L"RES " << request_id << L" ";
 
+            const auto name = boost::to_upper_copy(std::wstring(command_name));
+
             switch (err) {
                 case error_state::command_error:
                     answer << L"400 ERROR\r\n" << message << "\r\n";
                     break;
                 case error_state::channel_error:
-                    answer << L"401 " << command_name << " ERROR\r\n";
+                    answer << L"401 " << name << " ERROR\r\n";
                     break;
                 case error_state::parameters_error:
-                    answer << L"402 " << command_name << " ERROR\r\n";
+                    answer << L"402 " << name << " ERROR\r\n";
                     break;
                 case error_state::access_error:
-                    answer << L"503 " << command_name << " FAILED\r\n";
+                    answer << L"503 " << name << " FAILED\r\n";
                     break;
                 case error_state::unknown_error:
                     answer << L"500 FAILED\r\n";
@@ -178,31 +185,33 @@ class AMCPProtocolStrategy
   private:
     error_state parse_command_string(const ClientInfoPtr&                        client,
                                      const std::shared_ptr<AMCPClientBatchInfo>& batch,
-                                     std::list<std::wstring>                     tokens,
+                                     const std::vector<std::wstring_view>&       tokens,
                                      std::wstring&                               request_id,
-                                     std::wstring&                               command_name)
+                                     std::wstring_view&                          command_name)
     {
         try {
+            auto begin = tokens.begin();
+
             // Discard GetSwitch
-            if (!tokens.empty() && tokens.front().at(0) == L'/')
-                tokens.pop_front();
+            if (begin != tokens.end() && !begin->empty() && begin->front() == L'/')
+                ++begin;
 
-            error_state error = parse_request_token(tokens, request_id);
+            error_state error = parse_request_token(begin, tokens.end(), request_id);
             if (error != error_state::no_error) {
                 return error;
             }
 
             // Fail if no more tokens.
-            if (tokens.empty()) {
+            if (begin == tokens.end()) {
                 return error_state::command_error;
             }
 
-            if (parse_batch_commands(batch, tokens, request_id, error)) {
+            if (parse_batch_commands(batch, *begin, request_id, error)) {
                 return error;
             }
 
-            command_name                               = boost::to_upper_copy(tokens.front());
-            const std::shared_ptr<AMCPCommand> command = repo_->parse_command(client, tokens, request_id);
+            command_name                               = *begin;
+            const std::shared_ptr<AMCPCommand> command = repo_->parse_command(client, begin, tokens.end(), request_id);
             if (!command) {
                 return error_state::command_error;
             }
@@ -230,30 +239,29 @@ class AMCPProtocolStrategy
         }
     }
 
-    static error_state parse_request_token(std::list<std::wstring>& tokens, std::wstring& request_id)
+    static error_state parse_request_token(token_iterator& begin, token_iterator end, std::wstring& request_id)
     {
-        if (tokens.empty() || !boost::iequals(tokens.front(), L"REQ")) {
+        if (begin == end || !boost::iequals(*begin, L"REQ")) {
             return error_state::no_error;
         }
 
-        tokens.pop_front();
+        ++begin;
 
-        if (tokens.empty()) {
+        if (begin == end) {
             return error_state::parameters_error;
         }
 
-        request_id = std::move(tokens.front());
-        tokens.pop_front();
+        request_id = std::wstring(*begin++);
 
         return error_state::no_error;
     }
 
     bool parse_batch_commands(const std::shared_ptr<AMCPClientBatchInfo>& batch,
-                              std::list<std::wstring>&                    tokens,
+                              std::wstring_view                           command,
                               std::wstring&                               request_id,
                               error_state&                                error)
     {
-        if (boost::iequals(tokens.front(), L"COMMIT")) {
+        if (boost::iequals(command, L"COMMIT")) {
             if (!batch->in_progress()) {
                 error = error_state::command_error;
                 return true;
@@ -263,7 +271,7 @@ class AMCPProtocolStrategy
             error = error_state::no_error;
             return true;
         }
-        if (boost::iequals(tokens.front(), L"BEGIN")) {
+        if (boost::iequals(command, L"BEGIN")) {
             if (batch->in_progress()) {
                 error = error_state::command_error;
                 return true;
@@ -273,7 +281,7 @@ class AMCPProtocolStrategy
             error = error_state::no_error;
             return true;
         }
-        if (boost::iequals(tokens.front(), L"DISCARD")) {
+        if (boost::iequals(command, L"DISCARD")) {
             if (!batch->in_progress()) {
                 error = error_state::command_error;
                 return true;
@@ -293,6 +301,8 @@ class AMCPClientStrategy : public IO::protocol_strategy<wchar_t>
     const std::shared_ptr<AMCPProtocolStrategy> strategy_;
     const std::shared_ptr<AMCPClientBatchInfo>  batch_;
     ClientInfoPtr                               client_info_;
+    std::wstring                                buffer_;
+    std::vector<std::wstring_view>              tokens_;
 
   public:
     AMCPClientStrategy(const std::shared_ptr<AMCPProtocolStrategy>& strategy,
@@ -303,7 +313,10 @@ class AMCPClientStrategy : public IO::protocol_strategy<wchar_t>
     {
     }
 
-    void parse(const std::basic_string<wchar_t>& data) override { strategy_->parse(data, client_info_, batch_); }
+    void parse(const std::basic_string<wchar_t>& data) override
+    {
+        strategy_->parse(data, client_info_, batch_, buffer_, tokens_);
+    }
 };
 
 class amcp_client_strategy_factory : public IO::protocol_strategy_factory<wchar_t>
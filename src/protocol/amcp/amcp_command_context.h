@@ -27,6 +27,7 @@
 #include <accelerator/accelerator.h>
 #include <common/forward.h>
 #include <core/consumer/frame_consumer.h>
+#include <core/producer/preloader.h>
 #include <future>
 #include <utility>
 
@@ -46,6 +47,7 @@ struct amcp_command_static_context
     const std::string                                          proxy_port;
     std::weak_ptr<accelerator::accelerator_device>             ogl_device;
     const spl::shared_ptr<osc::client>                         osc_client;
+    const spl::shared_ptr<core::producer_preloader>            preloader;
 
     amcp_command_static_context(core::video_format_repository                               format_repository,
                                 const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
@@ -56,7 +58,8 @@ struct amcp_command_static_context
                                 std::string                                                 proxy_host,
                                 std::string                                                 proxy_port,
                                 std::weak_ptr<accelerator::accelerator_device>              ogl_device,
-                                const spl::shared_ptr<osc::client>&                         osc_client)
+                                const spl::shared_ptr<osc::client>&                         osc_client,
+                                std::size_t                                                 preload_capacity)
         : format_repository(std::move(format_repository))
         , cg_registry(cg_registry)
         , producer_registry(producer_registry)
@@ -67,6 +70,7 @@ struct amcp_command_static_context
         , proxy_port(std::move(proxy_port))
         , ogl_device(std::move(ogl_device))
         , osc_client(osc_client)
+        , preloader(spl::make_shared<core::producer_preloader>(preload_capacity))
     {
     }
 };
@@ -22,176 +22,109 @@
 #include "../StdAfx.h"
 
 #include "amcp_command_repository.h"
+#include "amcp_command_table.h"
 
 #include <common/env.h>
 
-#include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
-
-#include <map>
+#include <iterator>
+#include <string_view>
+#include <vector>
 
 namespace caspar { namespace protocol { namespace amcp {
 
-AMCPCommand::ptr_type make_cmd(amcp_command_func        func,
-                               const std::wstring&      name,
-                               const std::wstring&      id,
-                               IO::ClientInfoPtr        client,
-                               unsigned int             channel_index,
-                               int                      layer_index,
-                               std::list<std::wstring>& tokens)
+namespace {
+
+AMCPCommand::ptr_type make_cmd(const command_table::entry& command,
+                               const std::wstring&         id,
+                               IO::ClientInfoPtr           client,
+                               int                         channel_index,
+                               int                         layer_index,
+                               token_iterator              begin,
+                               token_iterator              end)
 {
-    const std::vector<std::wstring> parameters(tokens.begin(), tokens.end());
-    const command_context_simple    ctx(std::move(client), channel_index, layer_index, std::move(parameters));
+    std::vector<std::wstring> parameters;
+    parameters.reserve(std::distance(begin, end));
+    for (auto it = begin; it != end; ++it) {
+        parameters.emplace_back(*it);
+    }
 
-    return std::make_shared<AMCPCommand>(ctx, func, name, id);
+    return std::make_shared<AMCPCommand>(
+        command_context_simple(std::move(client), channel_index, layer_index, std::move(parameters)),
+        command.func,
+        command.name,
+        id);
 }
 
-AMCPCommand::ptr_type find_command(const std::map<std::wstring, std::pair<amcp_command_func, int>>& commands,
-                                   const std::wstring&                                              name,
-                                   const std::wstring&                                              request_id,
-                                   IO::ClientInfoPtr                                                client,
-                                   int                                                              channel_index,
-                                   int                                                              layer_index,
-                                   std::list<std::wstring>&                                         tokens)
+AMCPCommand::ptr_type find_command(const command_table&     commands,
+                                   std::wstring_view        name,
+                                   const std::wstring&      request_id,
+                                   const IO::ClientInfoPtr& client,
+                                   int                      channel_index,
+                                   int                      layer_index,
+                                   token_iterator           begin,
+                                   token_iterator           end)
 {
-    std::wstring subcommand;
-
-    if (!tokens.empty())
-        subcommand = boost::to_upper_copy(tokens.front());
+    const auto num_params = static_cast<int>(std::distance(begin, end));
 
     // Start with subcommand syntax like MIXER CLEAR etc
-    if (!subcommand.empty()) {
-        const auto fullname = name + L" " + subcommand;
-        const auto subcmd   = commands.find(fullname);
-
-        if (subcmd != commands.end()) {
-            tokens.pop_front();
-
-            if (tokens.size() >= subcmd->second.second) {
-                return make_cmd(
-                    subcmd->second.first, fullname, request_id, std::move(client), channel_index, layer_index, tokens);
-            }
+    if (begin != end) {
+        auto subcmd = commands.find(name, *begin);
+        if (subcmd && num_params - 1 >= subcmd->min_num_params) {
+            return make_cmd(*subcmd, request_id, client, channel_index, layer_index, begin + 1, end);
         }
     }
 
     // Resort to ordinary command
-    const auto command = commands.find(name);
-
-    if (command != commands.end() && tokens.size() >= command->second.second) {
-        return make_cmd(command->second.first, name, request_id, std::move(client), channel_index, layer_index, tokens);
+    auto command = commands.find(name);
+    if (command && num_params >= command->min_num_params) {
+        return make_cmd(*command, request_id, client, channel_index, layer_index, begin, end);
     }
 
     return nullptr;
 }
 
-template <typename Out, typename In>
-bool try_lexical_cast(const In& input, Out& result)
-{
-    Out        saved   = result;
-    const bool success = boost::conversion::detail::try_lexical_convert(input, result);
-
-    if (!success)
-        result = saved; // Needed because of how try_lexical_convert is implemented.
-
-    return success;
-}
-
-static void
-parse_channel_id(std::list<std::wstring>& tokens, std::wstring& channel_spec, int& channel_index, int& layer_index)
-{
-    if (!tokens.empty()) {
-        channel_spec                            = tokens.front();
-        std::wstring              channelid_str = boost::trim_copy(channel_spec);
-        std::vector<std::wstring> split;
-        boost::split(split, channelid_str, boost::is_any_of("-"));
-
-        // Use non_throwing lexical cast to not hit exception break point all the time.
-        if (try_lexical_cast(split[0], channel_index)) {
-            --channel_index;
-
-            if (split.size() > 1)
-                try_lexical_cast(split[1], layer_index);
-
-            // Consume channel-spec
-            tokens.pop_front();
-        }
-    }
-}
+} // namespace
 
 struct amcp_command_repository::impl
 {
     const spl::shared_ptr<std::vector<channel_context>> channels_;
 
-    std::map<std::wstring, std::pair<amcp_command_func, int>> commands{};
-    std::map<std::wstring, std::pair<amcp_command_func, int>> channel_commands{};
+    command_table commands;
+    command_table channel_commands;
 
     impl(const spl::shared_ptr<std::vector<channel_context>>& channels)
         : channels_(channels)
     {
     }
 
-    AMCPCommand::ptr_type create_command(const std::wstring&      name,
-                                         const std::wstring&      id,
-                                         IO::ClientInfoPtr        client,
-                                         std::list<std::wstring>& tokens) const
+    std::shared_ptr<AMCPCommand> parse_command(const IO::ClientInfoPtr& client,
+                                               token_iterator           begin,
+                                               token_iterator           end,
+                                               const std::wstring&      request_id) const
     {
-        auto command = find_command(commands, name, id, std::move(client), -1, -1, tokens);
-
-        if (command)
-            return command;
-
-        return nullptr;
-    }
-
-    AMCPCommand::ptr_type create_channel_command(const std::wstring&      name,
-                                                 const std::wstring&      id,
-                                                 IO::ClientInfoPtr        client,
-                                                 unsigned int             channel_index,
-                                                 int                      layer_index,
-                                                 std::list<std::wstring>& tokens) const
-    {
-        if (channels_->size() <= channel_index)
+        if (begin == end) {
             return nullptr;
+        }
 
-        auto command = find_command(channel_commands, name, id, std::move(client), channel_index, layer_index, tokens);
-
-        if (command)
-            return command;
-
-        return nullptr;
-    }
-
-    std::shared_ptr<AMCPCommand>
-    parse_command(IO::ClientInfoPtr client, std::list<std::wstring> tokens, const std::wstring& request_id) const
-    {
         // Consume command name
-        const std::basic_string<wchar_t> command_name = boost::to_upper_copy(tokens.front());
-        tokens.pop_front();
+        const auto command_name = *begin++;
 
         // Determine whether the next parameter is a channel spec or not
-        int          channel_index = -1;
-        int          layer_index   = -1;
-        std::wstring channel_spec;
-        parse_channel_id(tokens, channel_spec, channel_index, layer_index);
-
-        // Create command instance
-        std::shared_ptr<AMCPCommand> command;
-        if (channel_index >= 0) {
-            command = create_channel_command(command_name, request_id, client, channel_index, layer_index, tokens);
-
-            if (!command) // Might be a non channel command, although the first argument is numeric
-            {
-                // Restore backed up channel spec string.
-                tokens.push_front(channel_spec);
+        int channel_index = -1;
+        int layer_index   = -1;
+        if (begin != end && parse_channel_id(*begin, channel_index, layer_index)) {
+            if (channel_index >= 0 && static_cast<std::size_t>(channel_index) < channels_->size()) {
+                auto command = find_command(
+                    channel_commands, command_name, request_id, client, channel_index, layer_index, begin + 1, end);
+                if (command) {
+                    return command;
+                }
             }
+            // Might be a non channel command, although the first argument is numeric
         }
 
         // Create global instance
-        if (!command) {
-            command = create_command(command_name, request_id, client, tokens);
-        }
-
-        return std::move(command);
+        return find_command(commands, command_name, request_id, client, -1, -1, begin, end);
     }
 
     bool check_channel_lock(IO::ClientInfoPtr client, int channel_index) const
@@ -218,7 +151,16 @@ std::shared_ptr<AMCPCommand> amcp_command_repository::parse_command(IO::ClientIn
                                                                     std::list<std::wstring> tokens,
                                                                     const std::wstring&     request_id) const
 {
-    return impl_->parse_command(client, tokens, request_id);
+    const std::vector<std::wstring_view> views(tokens.begin(), tokens.end());
+    return impl_->parse_command(client, views.begin(), views.end(), request_id);
+}
+
+std::shared_ptr<AMCPCommand> amcp_command_repository::parse_command(const IO::ClientInfoPtr& client,
+                                                                    token_iterator           begin,
+                                                                    token_iterator           end,
+                                                                    const std::wstring&      request_id) const
+{
+    return impl_->parse_command(client, begin, end, request_id);
 }
 
 bool amcp_command_repository::check_channel_lock(IO::ClientInfoPtr client, int channel_index) const
@@ -231,7 +173,7 @@ void amcp_command_repository::register_command(std::wstring      category,
                                                amcp_command_func command,
                                                int               min_num_params)
 {
-    impl_->commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    impl_->commands.insert(std::move(name), std::move(command), min_num_params);
 }
 
 void amcp_command_repository::register_channel_command(std::wstring      category,
@@ -239,7 +181,7 @@ void amcp_command_repository::register_channel_command(std::wstring      categor
                                                        amcp_command_func command,
                                                        int               min_num_params)
 {
-    impl_->channel_commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    impl_->channel_commands.insert(std::move(name), std::move(command), min_num_params);
 }
 
 }}} // namespace caspar::protocol::amcp
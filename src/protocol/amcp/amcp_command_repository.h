@@ -27,16 +27,28 @@
 #include <common/memory.h>
 
 #include <functional>
+#include <list>
+#include <string_view>
+#include <vector>
 
 namespace caspar { namespace protocol { namespace amcp {
 
+using token_iterator = std::vector<std::wstring_view>::const_iterator;
+
 class amcp_command_repository
 {
   public:
     amcp_command_repository(const spl::shared_ptr<std::vector<channel_context>>& channels);
 
     std::shared_ptr<AMCPCommand>
-         parse_command(IO::ClientInfoPtr client, std::list<std::wstring> tokens, const std::wstring& request_id) const;
+    parse_command(IO::ClientInfoPtr client, std::list<std::wstring> tokens, const std::wstring& request_id) const;
+
+    // Same as above, for tokens viewing a buffer of the caller.
+    std::shared_ptr<AMCPCommand> parse_command(const IO::ClientInfoPtr& client,
+                                               token_iterator           begin,
+                                               token_iterator           end,
+                                               const std::wstring&      request_id) const;
+
     bool check_channel_lock(IO::ClientInfoPtr client, int channel_index) const;
 
     const spl::shared_ptr<std::vector<channel_context>>& channels() const;
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "amcp_command_table.h"
+
+#include <cwctype>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+wchar_t to_upper(wchar_t c) { return c >= L'a' && c <= L'z' ? static_cast<wchar_t>(c - (L'a' - L'A')) : c; }
+
+bool iequals(std::wstring_view a, std::wstring_view b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t n = 0; n < a.size(); ++n) {
+        if (to_upper(a[n]) != to_upper(b[n])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// FNV-1a of the upper case name.
+std::uint32_t hash(std::uint32_t h, std::wstring_view str)
+{
+    for (auto c : str) {
+        h = (h ^ static_cast<std::uint32_t>(to_upper(c))) * 16777619u;
+    }
+    return h;
+}
+
+bool parse_int(std::wstring_view str, int& result)
+{
+    if (str.empty() || str.size() > 9) {
+        return false;
+    }
+
+    int value = 0;
+    for (auto c : str) {
+        if (c < L'0' || c > L'9') {
+            return false;
+        }
+        value = value * 10 + (c - L'0');
+    }
+
+    result = value;
+    return true;
+}
+
+} // namespace
+
+bool parse_channel_id(std::wstring_view spec, int& channel_index, int& layer_index)
+{
+    while (!spec.empty() && std::iswspace(spec.front())) {
+        spec.remove_prefix(1);
+    }
+    while (!spec.empty() && std::iswspace(spec.back())) {
+        spec.remove_suffix(1);
+    }
+
+    int channel = 0;
+    int layer   = -1;
+
+    const auto dash = spec.find(L'-');
+    if (!parse_int(spec.substr(0, dash), channel)) {
+        return false;
+    }
+
+    if (dash != std::wstring_view::npos) {
+        const auto layer_spec = spec.substr(dash + 1);
+        if (!parse_int(layer_spec.substr(0, layer_spec.find(L'-')), layer)) {
+            return false;
+        }
+    }
+
+    channel_index = channel - 1;
+    layer_index   = layer;
+    return true;
+}
+
+void command_table::insert(std::wstring name, amcp_command_func func, int min_num_params)
+{
+    for (auto& e : entries_) {
+        if (iequals(e.name, name)) {
+            return;
+        }
+    }
+    entries_.push_back(entry{std::move(name), std::move(func), min_num_params});
+    rebuild();
+}
+
+const command_table::entry* command_table::find(std::wstring_view name) const
+{
+    return find(name, hash(seed_, name), {});
+}
+
+const command_table::entry* command_table::find(std::wstring_view name, std::wstring_view subcommand) const
+{
+    if (subcommand.empty()) {
+        return nullptr;
+    }
+    return find(name, hash(hash(hash(seed_, name), L" "), subcommand), subcommand);
+}
+
+const command_table::entry*
+command_table::find(std::wstring_view name, std::uint32_t h, std::wstring_view subcommand) const
+{
+    if (slots_.empty()) {
+        return nullptr;
+    }
+
+    const auto index = slots_[h & (slots_.size() - 1)];
+    if (index < 0) {
+        return nullptr;
+    }
+
+    const auto&       e        = entries_[index];
+    const std::size_t expected = subcommand.empty() ? name.size() : name.size() + 1 + subcommand.size();
+    if (e.name.size() != expected) {
+        return nullptr;
+    }
+
+    const std::wstring_view entry_name(e.name);
+    if (!iequals(entry_name.substr(0, name.size()), name)) {
+        return nullptr;
+    }
+    if (!subcommand.empty() &&
+        (entry_name[name.size()] != L' ' || !iequals(entry_name.substr(name.size() + 1), subcommand))) {
+        return nullptr;
+    }
+
+    return &e;
+}
+
+void command_table::rebuild()
+{
+    for (std::size_t size = 16;; size *= 2) {
+        if (size < entries_.size() * 2) {
+            continue;
+        }
+
+        for (std::uint32_t seed = 2166136261u, n = 0; n < 256; ++n, seed = seed * 16777619u + n) {
+            std::vector<int> slots(size, -1);
+
+            auto perfect = true;
+            for (std::size_t i = 0; i < entries_.size() && perfect; ++i) {
+                auto& slot = slots[hash(seed, entries_[i].name) & (size - 1)];
+                perfect    = slot < 0;
+                slot       = static_cast<int>(i);
+            }
+
+            if (perfect) {
+                seed_  = seed;
+                slots_ = std::move(slots);
+                return;
+            }
+        }
+    }
+}
+
+}}} // namespace caspar::protocol::amcp
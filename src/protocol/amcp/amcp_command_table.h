@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "amcp_shared.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// Parses a channel spec such as 1 or 1-10 into a zero based channel index and a layer index, -1 when there is no
+// layer. A spec with a channel or layer that is not a number of at most 9 digits, such as 1-abc, is not a channel spec.
+bool parse_channel_id(std::wstring_view spec, int& channel_index, int& layer_index);
+
+// Commands by name, e.g. "MIXER CLEAR". The names are placed by a seeded hash, with the seed and table size chosen
+// when a command is added so that no two names share a slot. Finding a command then takes one hash of the tokens and
+// one comparison, without building the name. Names are compared without regard to ASCII case.
+class command_table
+{
+  public:
+    struct entry
+    {
+        std::wstring      name;
+        amcp_command_func func;
+        int               min_num_params;
+    };
+
+    // Adds the command unless one with the same name already exists.
+    void insert(std::wstring name, amcp_command_func func, int min_num_params);
+
+    const entry* find(std::wstring_view name) const;
+
+    // Finds "name subcommand", or nullptr when subcommand is empty.
+    const entry* find(std::wstring_view name, std::wstring_view subcommand) const;
+
+  private:
+    const entry* find(std::wstring_view name, std::uint32_t h, std::wstring_view subcommand) const;
+
+    void rebuild();
+
+    std::vector<entry> entries_;
+    std::vector<int>   slots_;
+    std::uint32_t      seed_ = 2166136261u;
+};
+
+}}} // namespace caspar::protocol::amcp
@@ -36,14 +36,14 @@ struct command_context_simple
 
     int layer_index(int default_ = 0) const { return layer_id == -1 ? default_ : layer_id; }
 
-    command_context_simple(IO::ClientInfoPtr                client,
-                           int                              channel_index,
-                           int                              layer_id,
-                           const std::vector<std::wstring>& parameters)
+    command_context_simple(IO::ClientInfoPtr         client,
+                           int                       channel_index,
+                           int                       layer_id,
+                           std::vector<std::wstring> parameters)
         : client(std::move(client))
         , channel_index(channel_index)
         , layer_id(layer_id)
-        , parameters(parameters)
+        , parameters(std::move(parameters))
     {
     }
 };
@@ -26,15 +26,22 @@
 
 #include "oscpack/OscOutboundPacketStream.h"
 
+#include <common/diagnostics/graph.h>
 #include <common/endian.h>
+#include <common/timer.h>
 #include <common/utf.h>
 
 #include <core/monitor/monitor.h>
+#include <core/monitor/state_store.h>
 
 #include <boost/asio.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <map>
 #include <mutex>
+#include <set>
 #include <thread>
 #include <vector>
 
@@ -63,20 +70,115 @@ struct param_visitor : public boost::static_visitor<void>
     void operator()(const std::wstring& value) { o << u8(value).c_str(); }
 };
 
+namespace {
+
+// Matches path against a glob pattern, see subscription_options. The pattern also matches the paths below.
+bool glob_match(const char* pattern, const char* path)
+{
+    while (*pattern) {
+        if (pattern[0] == '*' && pattern[1] == '*') {
+            pattern += 2;
+            for (;; ++path) {
+                if (glob_match(pattern, path)) {
+                    return true;
+                }
+                if (!*path) {
+                    return false;
+                }
+            }
+        }
+        if (*pattern == '*') {
+            pattern += 1;
+            for (;; ++path) {
+                if (glob_match(pattern, path)) {
+                    return true;
+                }
+                if (!*path || *path == '/') {
+                    return false;
+                }
+            }
+        }
+        if (!*path || (*pattern != '?' && *pattern != *path) || (*pattern == '?' && *path == '/')) {
+            return false;
+        }
+        ++pattern;
+        ++path;
+    }
+    return !*path || *path == '/';
+}
+
+bool matches(const std::vector<std::string>& filters, const std::string& path)
+{
+    return filters.empty() || std::any_of(filters.begin(), filters.end(), [&](const std::string& filter) {
+               return glob_match(filter.c_str(), path.c_str());
+           });
+}
+
+} // namespace
+
 struct client::impl : public spl::enable_shared_from_this<client::impl>
 {
+    // Interval at which every subscriber receives the full state, in addition to the per tick changes.
+    static constexpr auto snapshot_interval = std::chrono::seconds(1);
+
+    // Largest datagram sent, an Ethernet MTU less the IPv4 and UDP headers. Bundles are split to fit, only a single
+    // message larger than this is sent as it is and left to IP fragmentation.
+    static constexpr std::size_t max_packet_size = 1500 - 20 - 8;
+
+    struct subscriber
+    {
+        udp::endpoint        endpoint;
+        subscription_options options;
+        std::string          name; // of the subscription in the diagnostics graph, unique to it
+        int                  reference_count = 0;
+        bool                 needs_snapshot  = true;
+        uint64_t             sent_version    = 0;
+
+        std::chrono::steady_clock::time_point last_sent;
+    };
+
+    // Subscribers sent the same bundles: same filters, and either a snapshot or the changes since the same version.
+    // The data is filled in outside the lock.
+    struct send_group
+    {
+        std::vector<std::string>   filters;
+        bool                       snapshot;
+        uint64_t                   since_version;
+        core::monitor::data_map_t  data;
+        std::vector<udp::endpoint> endpoints;
+        std::vector<std::string>   names;
+    };
+
     std::shared_ptr<boost::asio::io_context> service_;
     udp::socket                              socket_;
-    std::map<udp::endpoint, int>             reference_counts_by_endpoint_;
-    std::vector<char>                        buffer_;
+    std::map<uint64_t, subscriber>           subscribers_;
+    uint64_t                                 next_subscriber_id_ = 0;
+
+    // The latest state of every prefix, double buffered: a publisher swaps its state into the pending buffer and the
+    // sending thread swaps it out into its own, so neither copies, merges nor frees a state under the lock.
+    struct pending_state
+    {
+        core::monitor::state state;
+        bool                 updated = false;
+    };
 
-    std::mutex              mutex_;
-    std::condition_variable cond_;
-    core::monitor::state    bundle_;
-    uint64_t                bundle_time_ = 0;
+    std::mutex                           mutex_;
+    std::condition_variable              cond_;
+    std::map<std::string, pending_state> pending_;
+    bool                                 has_pending_ = false;
+    std::vector<std::string>             removed_names_; // of subscriptions whose last token was dropped
 
     uint64_t time_ = 0;
 
+    // Used by the sending thread only. The version of the store is also read under the lock, by the same thread.
+    std::map<std::string, pending_state> merging_;
+    core::monitor::state_store           store_;
+    std::vector<char>                    message_buffer_ = std::vector<char>(65536);
+    std::vector<char>                    packet_buffer_;
+    std::map<std::string, uint64_t>      bytes_sent_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
 
@@ -84,64 +186,75 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
     impl(std::shared_ptr<boost::asio::io_service> service)
         : service_(std::move(service))
         , socket_(*service_, udp::v4())
-        , buffer_(1000000)
     {
+        graph_->set_text(L"osc");
+        graph_->set_color("encode-time", diagnostics::color(1.0f, 0.8f, 0.0f));
+        diagnostics::register_graph(graph_);
+
         thread_ = std::thread([=] {
             try {
-                while (!abort_request_) {
-                    core::monitor::state       bundle;
-                    uint64_t                   bundle_time;
-                    std::vector<udp::endpoint> endpoints;
+                auto last_snapshot = std::chrono::steady_clock::now();
+                auto last_stats    = last_snapshot;
 
+                std::vector<std::string> removed;
+
+                while (!abort_request_) {
                     {
                         std::unique_lock<std::mutex> lock(mutex_);
-                        cond_.wait(lock, [&] { return bundle_time_ > 0 || abort_request_; });
-
-                        if (abort_request_) {
+                        if (!wait_for_due(lock)) {
                             return;
                         }
-
-                        bundle       = std::move(bundle_);
-                        bundle_time  = bundle_time_;
-                        bundle_time_ = 0;
-
-                        for (auto& p : reference_counts_by_endpoint_) {
-                            endpoints.push_back(p.first);
-                        }
+                        take_pending();
+                        removed = std::move(removed_names_);
+                        removed_names_.clear();
                     }
 
-                    if (endpoints.empty()) {
-                        continue;
+                    // The subscriptions are gone, so no bundle is sent to them from here on.
+                    for (auto& name : removed) {
+                        bytes_sent_.erase(name);
+                        graph_->remove(name);
                     }
+                    removed.clear();
 
-                    auto it = std::begin(bundle);
+                    caspar::timer encode_timer;
 
-                    while (it != std::end(bundle)) {
-                        ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
-                                                      static_cast<unsigned long>(buffer_.size()));
+                    for (auto& p : merging_) {
+                        if (p.second.updated) {
+                            store_.update(p.first, p.second.state);
+                            p.second.updated = false;
+                        }
+                    }
 
-                        o << ::osc::BeginBundle(bundle_time);
+                    std::vector<send_group> groups;
+                    uint64_t                bundle_time;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
 
-                        // TODO (fix): < 2048 is a hack. Properly calculate if messages will fit.
-                        while (it != std::end(bundle) && o.Size() < 2048) {
-                            o << ::osc::BeginMessage(it->first.c_str());
+                        // TODO: time_++ is a hack. Use proper channel time.
+                        bundle_time = time_++;
 
-                            param_visitor<decltype(o)> param_visitor(o);
-                            for (const auto& element : it->second) {
-                                boost::apply_visitor(param_visitor, element);
+                        const auto now = std::chrono::steady_clock::now();
+                        if (now - last_snapshot >= snapshot_interval) {
+                            last_snapshot = now;
+                            for (auto& p : subscribers_) {
+                                p.second.needs_snapshot = true;
                             }
-
-                            o << ::osc::EndMessage;
-
-                            ++it;
                         }
 
-                        o << ::osc::EndBundle;
+                        groups = collect_groups(now);
+                    }
 
-                        boost::system::error_code ec;
-                        for (const auto& endpoint : endpoints) {
-                            socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
-                        }
+                    for (auto& group : groups) {
+                        group.data = group.snapshot ? store_.snapshot() : store_.changes_since(group.since_version);
+                        send_bundles(group, bundle_time);
+                    }
+                    // 1.0 is 20 ms, a frame at 50 Hz.
+                    graph_->set_value("encode-time", encode_timer.elapsed() / 0.02);
+
+                    const auto now = std::chrono::steady_clock::now();
+                    if (now - last_stats >= std::chrono::seconds(1)) {
+                        update_stats(std::chrono::duration<double>(now - last_stats).count());
+                        last_stats = now;
                     }
                 }
             } catch (...) {
@@ -157,16 +270,202 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         thread_.join();
     }
 
-    // TODO (refactor) This is wierd...
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+    bool is_due(const subscriber& sub, std::chrono::steady_clock::time_point now) const
+    {
+        if (!sub.needs_snapshot && sub.sent_version == store_.version()) {
+            return false;
+        }
+        return sub.options.max_rate <= 0.0 ||
+               now - sub.last_sent >= std::chrono::duration<double>(1.0 / sub.options.max_rate);
+    }
+
+    // Waits until a state was published or a subscriber has something to send, sleeping until the earliest rate
+    // limited one may send again when all that have changes are held back. Returns false on abort.
+    bool wait_for_due(std::unique_lock<std::mutex>& lock)
+    {
+        while (!abort_request_) {
+            if (has_pending_ || !removed_names_.empty()) {
+                return true;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+
+            auto next = std::chrono::steady_clock::time_point::max();
+            for (auto& p : subscribers_) {
+                auto& sub = p.second;
+                if (is_due(sub, now)) {
+                    return true;
+                }
+                if (sub.needs_snapshot || sub.sent_version != store_.version()) {
+                    next = std::min(next,
+                                    sub.last_sent + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                        std::chrono::duration<double>(1.0 / sub.options.max_rate)));
+                }
+            }
+
+            if (next == std::chrono::steady_clock::time_point::max()) {
+                cond_.wait(lock);
+            } else {
+                cond_.wait_until(lock, next);
+            }
+        }
+        return false;
+    }
+
+    // Moves the published states into merging_. Called with the lock held.
+    void take_pending()
+    {
+        if (!has_pending_) {
+            return;
+        }
+        for (auto& p : pending_) {
+            if (p.second.updated) {
+                auto& target = merging_[p.first];
+                std::swap(target.state, p.second.state);
+                target.updated   = true;
+                p.second.updated = false;
+            }
+        }
+        has_pending_ = false;
+    }
+
+    // Picks the subscribers that are due and groups them, leaving the data of the groups to the caller. Called with the
+    // lock held.
+    std::vector<send_group> collect_groups(std::chrono::steady_clock::time_point now)
+    {
+        std::vector<send_group> groups;
+
+        for (auto& p : subscribers_) {
+            auto& sub = p.second;
+            if (!is_due(sub, now)) {
+                continue;
+            }
+
+            const auto snapshot = sub.needs_snapshot;
+            auto       group    = std::find_if(groups.begin(), groups.end(), [&](const send_group& g) {
+                return g.snapshot == snapshot && (snapshot || g.since_version == sub.sent_version) &&
+                       g.filters == sub.options.filters;
+            });
+            if (group == groups.end()) {
+                groups.push_back(send_group{sub.options.filters, snapshot, sub.sent_version, {}, {}, {}});
+                group = std::prev(groups.end());
+            }
+            group->endpoints.push_back(sub.endpoint);
+            group->names.push_back(sub.name);
+
+            sub.needs_snapshot = false;
+            sub.sent_version   = store_.version();
+            sub.last_sent      = now;
+        }
+
+        return groups;
+    }
+
+    // Encodes a message into message_buffer_, growing it as needed, and returns its size.
+    std::size_t encode_message(const std::string& path, const core::monitor::vector_t& values)
+    {
+        while (true) {
+            try {
+                ::osc::OutboundPacketStream o(message_buffer_.data(),
+                                              static_cast<unsigned long>(message_buffer_.size()));
+
+                o << ::osc::BeginMessage(path.c_str());
+
+                param_visitor<decltype(o)> param_visitor(o);
+                for (const auto& element : values) {
+                    boost::apply_visitor(param_visitor, element);
+                }
+
+                o << ::osc::EndMessage;
+
+                return o.Size();
+            } catch (::osc::OutOfBufferMemoryException&) {
+                message_buffer_.resize(message_buffer_.size() * 2);
+            }
+        }
+    }
+
+    void send_bundles(const send_group& group, uint64_t bundle_time)
+    {
+        // #bundle, the time tag and then every element prefixed by its size, all big endian.
+        constexpr std::size_t header_size = 16;
+
+        const auto begin_bundle = [&] {
+            static const char tag[8] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', '\0'};
+            packet_buffer_.assign(tag, tag + 8);
+            for (int n = 7; n >= 0; --n) {
+                packet_buffer_.push_back(static_cast<char>((bundle_time >> (n * 8)) & 0xFF));
+            }
+        };
+
+        const auto flush = [&] {
+            if (packet_buffer_.size() > header_size) {
+                boost::system::error_code ec;
+                for (std::size_t n = 0; n < group.endpoints.size(); ++n) {
+                    socket_.send_to(boost::asio::buffer(packet_buffer_), group.endpoints[n], 0, ec);
+                    bytes_sent_[group.names[n]] += packet_buffer_.size();
+                }
+            }
+            begin_bundle();
+        };
+
+        begin_bundle();
+
+        for (auto& p : group.data) {
+            if (!matches(group.filters, p.first)) {
+                continue;
+            }
+
+            const auto size = encode_message(p.first, p.second);
+
+            if (packet_buffer_.size() + 4 + size > max_packet_size) {
+                flush();
+            }
+
+            for (int n = 3; n >= 0; --n) {
+                packet_buffer_.push_back(static_cast<char>((size >> (n * 8)) & 0xFF));
+            }
+            packet_buffer_.insert(packet_buffer_.end(), message_buffer_.data(), message_buffer_.data() + size);
+        }
+
+        flush();
+    }
+
+    void update_stats(double seconds)
+    {
+        for (auto& p : bytes_sent_) {
+            // 1.0 is 1 MB/s.
+            graph_->set_value(p.first, static_cast<double>(p.second) / seconds / 1000000.0);
+            p.second = 0;
+        }
+    }
+
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 const subscription_options&           options)
     {
         std::lock_guard<std::mutex> lock(mutex_);
 
-        ++reference_counts_by_endpoint_[endpoint];
+        auto it = std::find_if(subscribers_.begin(), subscribers_.end(), [&](const auto& p) {
+            return p.second.endpoint == endpoint && p.second.options.filters == options.filters &&
+                   p.second.options.max_rate == options.max_rate;
+        });
+        if (it == subscribers_.end()) {
+            subscriber sub;
+            sub.endpoint = endpoint;
+            sub.options  = options;
+            sub.name     = endpoint.address().to_string() + ":" + std::to_string(endpoint.port()) + " #" +
+                       std::to_string(next_subscriber_id_);
+            it = subscribers_.emplace(next_subscriber_id_++, std::move(sub)).first;
+
+            graph_->set_color(it->second.name, diagnostics::color(0.3f, 0.6f + 0.1f * (it->first % 4), 1.0f));
+        }
+        it->second.reference_count += 1;
+
+        const auto id = it->first;
 
         std::weak_ptr<impl> weak_self = shared_from_this();
 
-        return std::shared_ptr<void>(nullptr, [weak_self, endpoint](void*) {
+        return std::shared_ptr<void>(nullptr, [weak_self, id](void*) {
             auto strong = weak_self.lock();
 
             if (!strong)
@@ -174,24 +473,29 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
 
             auto& self = *strong;
 
-            std::lock_guard<std::mutex> lock(self.mutex_);
+            {
+                std::lock_guard<std::mutex> lock(self.mutex_);
 
-            int reference_count_after = --self.reference_counts_by_endpoint_[endpoint];
-
-            if (reference_count_after == 0) {
-                self.reference_counts_by_endpoint_.erase(endpoint);
+                auto it = self.subscribers_.find(id);
+                if (it == self.subscribers_.end() || --it->second.reference_count > 0) {
+                    return;
+                }
+                // The sending thread owns the stats, and removes them the next time it wakes.
+                self.removed_names_.push_back(std::move(it->second.name));
+                self.subscribers_.erase(it);
             }
+            self.cond_.notify_all();
         });
     }
 
-    void send(const core::monitor::state& state)
+    void send(const std::string& prefix, core::monitor::state state)
     {
         {
             std::lock_guard<std::mutex> lock(mutex_);
-
-            // TODO: time_++ is a hack. Use proper channel time.
-            bundle_time_ = time_++;
-            bundle_      = state;
+            auto&                       slot = pending_[prefix];
+            std::swap(slot.state, state); // state now holds an older buffer, which is freed after the lock
+            slot.updated = true;
+            has_pending_ = true;
         }
         cond_.notify_all();
     }
@@ -215,11 +519,12 @@ client& client::operator=(client&& other)
 
 client::~client() {}
 
-std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                     const subscription_options&           options)
 {
-    return impl_->get_subscription_token(endpoint);
+    return impl_->get_subscription_token(endpoint, options);
 }
 
-void client::send(const core::monitor::state& state) { impl_->send(state); }
+void client::send(const std::string& prefix, core::monitor::state state) { impl_->send(prefix, std::move(state)); }
 
 }}} // namespace caspar::protocol::osc
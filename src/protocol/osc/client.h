@@ -27,8 +27,22 @@
 #include <common/memory.h>
 #include <core/monitor/monitor.h>
 
+#include <string>
+#include <vector>
+
 namespace caspar { namespace protocol { namespace osc {
 
+struct subscription_options
+{
+    // Glob patterns selecting the paths to send, all of them when empty. A * matches within one path segment, ** any
+    // number of segments and ? one character. A pattern also selects everything below the paths it matches, so
+    // /channel/1/mixer selects the whole mixer subtree.
+    std::vector<std::string> filters;
+
+    // Most bundles to send per second, 0 for one per change. Changes in between are merged into the next bundle.
+    double max_rate = 0.0;
+};
+
 class client
 {
     client(const client&);
@@ -46,16 +60,23 @@ class client
      * previously been checked out.
      *
      * @param endpoint The UDP endpoint to send OSC messages to.
+     * @param options  The paths to send and how often.
      *
      * @return The token. It is ok for the token to outlive the client
      */
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint);
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 const subscription_options&           options = {});
 
     ~client();
 
     client& operator=(client&&);
 
-    void send(const core::monitor::state& state);
+    /**
+     * Publish the state of the subtree at prefix (e.g. "/channel/1"), replacing
+     * what was previously published there. Subscribers receive the keys that
+     * changed, and periodically as well as when they subscribe the full state.
+     */
+    void send(const std::string& prefix, core::monitor::state state);
 
   private:
     struct impl;
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "exporter.h"
+
+#include "layout.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/variant.hpp>
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace shm {
+
+namespace {
+
+template <typename T>
+void put(std::vector<char>& buffer, T value)
+{
+    auto offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    std::memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+void put_string(std::vector<char>& buffer, const std::string& str)
+{
+    put(buffer, static_cast<std::uint32_t>(str.size()));
+    buffer.insert(buffer.end(), str.begin(), str.end());
+}
+
+struct value_visitor : public boost::static_visitor<void>
+{
+    std::vector<char>& buffer;
+
+    explicit value_visitor(std::vector<char>& buffer)
+        : buffer(buffer)
+    {
+    }
+
+    void operator()(bool value) const
+    {
+        put(buffer, value_type::boolean);
+        put(buffer, static_cast<std::uint8_t>(value));
+    }
+
+    void operator()(std::int32_t value) const
+    {
+        put(buffer, value_type::int32);
+        put(buffer, value);
+    }
+
+    void operator()(std::int64_t value) const
+    {
+        put(buffer, value_type::int64);
+        put(buffer, value);
+    }
+
+    void operator()(std::uint32_t value) const
+    {
+        put(buffer, value_type::uint32);
+        put(buffer, value);
+    }
+
+    void operator()(std::uint64_t value) const
+    {
+        put(buffer, value_type::uint64);
+        put(buffer, value);
+    }
+
+    void operator()(float value) const
+    {
+        put(buffer, value_type::float32);
+        put(buffer, value);
+    }
+
+    void operator()(double value) const
+    {
+        put(buffer, value_type::float64);
+        put(buffer, value);
+    }
+
+    void operator()(const std::string& value) const
+    {
+        put(buffer, value_type::string);
+        put_string(buffer, value);
+    }
+
+    void operator()(const std::wstring& value) const
+    {
+        put(buffer, value_type::string);
+        put_string(buffer, u8(value));
+    }
+};
+
+} // namespace
+
+struct exporter::impl
+{
+    const std::string name_;
+
+    boost::interprocess::shared_memory_object memory_;
+    boost::interprocess::mapped_region        region_;
+    segment_header*                           header_;
+    char*                                     data_;
+    const std::size_t                         capacity_;
+
+    // Used by the encoding thread only.
+    std::vector<std::string> keys_;
+    std::vector<char>        dictionary_;
+    std::vector<char>        buffer_;
+    std::uint64_t            generation_ = 0;
+    std::uint64_t            tick_       = 0;
+    bool                     overflow_   = false;
+
+    std::mutex                          mutex_;
+    std::condition_variable             cond_;
+    std::optional<core::monitor::state> pending_;
+    bool                                abort_request_ = false;
+    std::thread                         thread_;
+
+    impl(std::string name, std::size_t capacity)
+        : name_(std::move(name))
+        , capacity_(capacity)
+    {
+        using namespace boost::interprocess;
+
+        // Left behind by a server that did not shut down.
+        shared_memory_object::remove(name_.c_str());
+
+        memory_ = shared_memory_object(create_only, name_.c_str(), read_write);
+        memory_.truncate(static_cast<offset_t>(sizeof(segment_header) + capacity_));
+        region_ = mapped_region(memory_, read_write);
+
+        header_ = new (region_.get_address()) segment_header();
+        data_   = static_cast<char*>(region_.get_address()) + sizeof(segment_header);
+
+        header_->capacity = capacity_;
+        header_->sequence.store(0, std::memory_order_relaxed);
+        header_->closed.store(0, std::memory_order_relaxed);
+        header_->version = layout_version;
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = layout_magic;
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"[shm::exporter]");
+
+            while (true) {
+                core::monitor::state state;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cond_.wait(lock, [&] { return abort_request_ || pending_; });
+                    if (abort_request_) {
+                        return;
+                    }
+                    state = std::move(*pending_);
+                    pending_.reset();
+                }
+
+                try {
+                    publish(state);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        });
+
+        CASPAR_LOG(info) << L"Exporting monitor state to shared memory " << u16(name_) << L".";
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+
+        header_->closed.store(1, std::memory_order_release);
+        boost::interprocess::shared_memory_object::remove(name_.c_str());
+    }
+
+    void update_dictionary(const core::monitor::state& state)
+    {
+        auto n     = std::size_t{0};
+        auto equal = true;
+        for (auto& p : state) {
+            if (n >= keys_.size() || keys_[n] != p.first) {
+                equal = false;
+                break;
+            }
+            ++n;
+        }
+        if (equal && n == keys_.size()) {
+            return;
+        }
+
+        keys_.clear();
+        dictionary_.clear();
+        for (auto& p : state) {
+            const auto length = static_cast<std::uint16_t>(std::min<std::size_t>(p.first.size(), 0xFFFF));
+            put(dictionary_, length);
+            dictionary_.insert(dictionary_.end(), p.first.begin(), p.first.begin() + length);
+            keys_.push_back(p.first);
+        }
+        generation_ += 1;
+    }
+
+    void publish(const core::monitor::state& state)
+    {
+        update_dictionary(state);
+
+        buffer_.resize(sizeof(frame_header));
+        buffer_.insert(buffer_.end(), dictionary_.begin(), dictionary_.end());
+
+        value_visitor visitor(buffer_);
+        for (auto& p : state) {
+            put(buffer_, static_cast<std::uint8_t>(std::min<std::size_t>(p.second.size(), 0xFF)));
+            for (std::size_t n = 0; n < p.second.size() && n < 0xFF; ++n) {
+                boost::apply_visitor(visitor, p.second[n]);
+            }
+        }
+
+        if (buffer_.size() > capacity_) {
+            if (!overflow_) {
+                CASPAR_LOG(warning) << L"Monitor state of " << buffer_.size() << L" bytes does not fit in "
+                                    << u16(name_) << L" of " << capacity_ << L" bytes.";
+                overflow_ = true;
+            }
+            return;
+        }
+        overflow_ = false;
+
+        frame_header frame;
+        frame.tick                  = ++tick_;
+        frame.dictionary_generation = generation_;
+        frame.size                  = static_cast<std::uint32_t>(buffer_.size());
+        frame.dictionary_size       = static_cast<std::uint32_t>(dictionary_.size());
+        frame.key_count             = static_cast<std::uint32_t>(keys_.size());
+        frame.reserved              = 0;
+        std::memcpy(buffer_.data(), &frame, sizeof(frame));
+
+        const auto sequence = header_->sequence.load(std::memory_order_relaxed);
+        header_->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(data_, buffer_.data(), buffer_.size());
+        header_->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    void send(core::monitor::state state)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = std::move(state);
+        }
+        cond_.notify_one();
+    }
+};
+
+exporter::exporter(std::string name, std::size_t capacity)
+    : impl_(new impl(std::move(name), capacity))
+{
+}
+
+exporter::~exporter() {}
+
+void exporter::send(core::monitor::state state) { impl_->send(std::move(state)); }
+
+}}} // namespace caspar::protocol::shm
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/monitor/monitor.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace shm {
+
+// Publishes the monitor state of a channel to a named shared memory segment, see layout.h. The state is encoded on a
+// thread of its own, where a state not yet published is replaced by a newer one, and copied into the segment with a
+// single memcpy.
+class exporter
+{
+  public:
+    // capacity is the most bytes of encoded state, a larger state is dropped with a warning.
+    exporter(std::string name, std::size_t capacity);
+    ~exporter();
+
+    exporter(const exporter&)            = delete;
+    exporter& operator=(const exporter&) = delete;
+
+    void send(core::monitor::state state);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::shm
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Layout of the shared memory segment holding the monitor state of a channel. It is shared with the reader library
+// and must not depend on anything else in the server. All integers are in host byte order and may be unaligned in the
+// payload.
+//
+// The segment is a segment_header followed by capacity bytes of data. The data is a frame_header followed by the
+// payload, and is guarded by a sequence lock: the server makes the sequence odd, copies the data and makes it even
+// again. A reader copies the data between two loads of an even sequence and retries when they differ.
+//
+// The payload is the dictionary followed by the entries:
+//
+//   dictionary  key_count times: uint16 length, length bytes of path.
+//   entries     key_count times, in dictionary order: uint8 count, count values.
+//   value       uint8 value_type, then 1 byte for boolean, 4 for int32, uint32 and float32, 8 for int64, uint64 and
+//               float64, or uint32 length and length bytes of utf-8 for string.
+//
+// The dictionary is rewritten only when the set of paths changes, which bumps dictionary_generation, so a reader can
+// keep its parsed dictionary until then.
+
+namespace caspar { namespace protocol { namespace shm {
+
+constexpr std::uint32_t layout_magic   = 0x534D4343; // "CCMS"
+constexpr std::uint32_t layout_version = 1;
+
+enum class value_type : std::uint8_t
+{
+    boolean,
+    int32,
+    int64,
+    uint32,
+    uint64,
+    float32,
+    float64,
+    string,
+};
+
+struct segment_header
+{
+    std::uint32_t              magic;
+    std::uint32_t              version;
+    std::uint64_t              capacity; // Bytes of data following the header.
+    std::atomic<std::uint64_t> sequence; // Odd while the data is written.
+    std::atomic<std::uint32_t> closed;   // Set when the server is done with the segment.
+    std::uint32_t              reserved;
+};
+
+struct frame_header
+{
+    std::uint64_t tick;                  // Incremented on every publish.
+    std::uint64_t dictionary_generation; // Changes with the set of paths.
+    std::uint32_t size;                  // Bytes of data in use, this header included.
+    std::uint32_t dictionary_size;       // Bytes of the dictionary.
+    std::uint32_t key_count;
+    std::uint32_t reserved;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "sequence must be lock free to be shared");
+static_assert(sizeof(segment_header) == 32, "");
+static_assert(sizeof(frame_header) == 32, "");
+
+}}} // namespace caspar::protocol::shm
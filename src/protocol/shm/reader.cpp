@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "reader.h"
+
+#include "layout.h"
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace caspar { namespace protocol { namespace shm {
+
+namespace {
+
+// Bounds checked reading of the payload.
+class cursor
+{
+    const char* pos_;
+    const char* end_;
+
+  public:
+    cursor(const char* begin, const char* end)
+        : pos_(begin)
+        , end_(end)
+    {
+    }
+
+    const char* take(std::size_t size)
+    {
+        if (static_cast<std::size_t>(end_ - pos_) < size) {
+            throw std::runtime_error("truncated monitor state");
+        }
+        auto result = pos_;
+        pos_ += size;
+        return result;
+    }
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string get_string(std::size_t size)
+    {
+        auto data = take(size);
+        return std::string(data, size);
+    }
+};
+
+value get_value(cursor& c)
+{
+    switch (c.get<value_type>()) {
+        case value_type::boolean:
+            return c.get<std::uint8_t>() != 0;
+        case value_type::int32:
+            return c.get<std::int32_t>();
+        case value_type::int64:
+            return c.get<std::int64_t>();
+        case value_type::uint32:
+            return c.get<std::uint32_t>();
+        case value_type::uint64:
+            return c.get<std::uint64_t>();
+        case value_type::float32:
+            return c.get<float>();
+        case value_type::float64:
+            return c.get<double>();
+        case value_type::string:
+            return c.get_string(c.get<std::uint32_t>());
+    }
+    throw std::runtime_error("unknown monitor value type");
+}
+
+} // namespace
+
+const std::vector<value>* snapshot::find(const std::string& path) const
+{
+    if (!keys) {
+        return nullptr;
+    }
+    auto it = std::lower_bound(keys->begin(), keys->end(), path);
+    if (it == keys->end() || *it != path) {
+        return nullptr;
+    }
+    return &values[it - keys->begin()];
+}
+
+struct reader::impl
+{
+    boost::interprocess::shared_memory_object memory_;
+    boost::interprocess::mapped_region        region_;
+    const segment_header*                     header_;
+    const char*                               data_;
+    std::uint64_t                             capacity_;
+
+    std::vector<char> buffer_;
+    std::uint64_t     last_sequence_ = 0;
+
+    std::uint64_t                                   generation_ = 0;
+    std::shared_ptr<const std::vector<std::string>> keys_;
+
+    explicit impl(const std::string& name)
+    {
+        using namespace boost::interprocess;
+
+        try {
+            memory_ = shared_memory_object(open_only, name.c_str(), read_only);
+            region_ = mapped_region(memory_, read_only);
+        } catch (interprocess_exception& e) {
+            throw std::runtime_error("cannot open monitor state " + name + ": " + e.what());
+        }
+
+        if (region_.get_size() < sizeof(segment_header)) {
+            throw std::runtime_error("monitor state " + name + " is too small");
+        }
+
+        header_ = static_cast<const segment_header*>(region_.get_address());
+        data_   = static_cast<const char*>(region_.get_address()) + sizeof(segment_header);
+
+        if (header_->magic != layout_magic || header_->version != layout_version) {
+            throw std::runtime_error("monitor state " + name + " has an unknown layout");
+        }
+
+        capacity_ = std::min<std::uint64_t>(header_->capacity, region_.get_size() - sizeof(segment_header));
+    }
+
+    // Copies the data out of the segment, returns false when there is nothing new or no consistent copy was made.
+    bool copy()
+    {
+        for (int retry = 0; retry < 100; ++retry) {
+            const auto before = header_->sequence.load(std::memory_order_acquire);
+            if (before == last_sequence_) {
+                return false;
+            }
+            if (before % 2 == 1) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            frame_header frame;
+            std::memcpy(&frame, data_, sizeof(frame));
+
+            const auto valid = frame.size >= sizeof(frame_header) && frame.size <= capacity_;
+            if (valid) {
+                buffer_.resize(frame.size);
+                std::memcpy(buffer_.data(), data_, frame.size);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header_->sequence.load(std::memory_order_relaxed) == before && valid) {
+                last_sequence_ = before;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool read(snapshot& out)
+    {
+        if (!copy()) {
+            return false;
+        }
+
+        frame_header frame;
+        std::memcpy(&frame, buffer_.data(), sizeof(frame));
+
+        cursor c(buffer_.data() + sizeof(frame), buffer_.data() + buffer_.size());
+
+        if (!keys_ || generation_ != frame.dictionary_generation) {
+            auto keys = std::make_shared<std::vector<std::string>>();
+            keys->reserve(frame.key_count);
+            for (std::uint32_t n = 0; n < frame.key_count; ++n) {
+                keys->push_back(c.get_string(c.get<std::uint16_t>()));
+            }
+            keys_       = std::move(keys);
+            generation_ = frame.dictionary_generation;
+        } else {
+            c.take(frame.dictionary_size);
+        }
+
+        out.values.resize(frame.key_count);
+        for (auto& values : out.values) {
+            values.resize(c.get<std::uint8_t>());
+            for (auto& v : values) {
+                v = get_value(c);
+            }
+        }
+
+        out.tick                  = frame.tick;
+        out.dictionary_generation = frame.dictionary_generation;
+        out.keys                  = keys_;
+
+        return true;
+    }
+};
+
+reader::reader(const std::string& name)
+    : impl_(new impl(name))
+{
+}
+
+reader::~reader() {}
+
+bool reader::read(snapshot& out) { return impl_->read(out); }
+
+bool reader::closed() const { return impl_->header_->closed.load(std::memory_order_acquire) != 0; }
+
+std::string to_string(const value& v)
+{
+    return std::visit(
+        [](const auto& x) -> std::string {
+            using T = std::decay_t<decltype(x)>;
+            if constexpr (std::is_same_v<T, std::string>) {
+                return x;
+            } else if constexpr (std::is_same_v<T, bool>) {
+                return x ? "true" : "false";
+            } else {
+                return std::to_string(x);
+            }
+        },
+        v);
+}
+
+}}} // namespace caspar::protocol::shm
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+// Reads the monitor state a server exports to shared memory. Depends only on the standard library and
+// Boost.Interprocess, so local tools can build it on its own together with layout.h.
+
+namespace caspar { namespace protocol { namespace shm {
+
+using value = std::variant<bool, std::int32_t, std::int64_t, std::uint32_t, std::uint64_t, float, double, std::string>;
+
+struct snapshot
+{
+    std::uint64_t tick                  = 0;
+    std::uint64_t dictionary_generation = 0;
+
+    // Sorted paths, shared between snapshots of the same dictionary generation.
+    std::shared_ptr<const std::vector<std::string>> keys;
+    std::vector<std::vector<value>>                 values;
+
+    // Values of path, nullptr when it is not in the state.
+    const std::vector<value>* find(const std::string& path) const;
+};
+
+class reader
+{
+  public:
+    // Opens the segment, throws std::runtime_error when it does not exist.
+    explicit reader(const std::string& name);
+    ~reader();
+
+    reader(const reader&)            = delete;
+    reader& operator=(const reader&) = delete;
+
+    // Reads the latest state into out. Returns false, leaving out as it is, when nothing was published since the last
+    // read or the server is writing the whole time the read is retried.
+    bool read(snapshot& out);
+
+    // True once the server has removed the segment. The reader must then be recreated to follow a new server.
+    bool closed() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+// Formats a value the way the OSC monitor would show it.
+std::string to_string(const value& v);
+
+}}} // namespace caspar::protocol::shm
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Load generator for a running server: sends MIXER commands of the kind automation sends during a move on one AMCP
+// connection, keeping a window of them in flight, and prints the commands per second and the reply latency
+// percentiles. It is not run by ctest, as it needs a server with the channel and layer to address.
+//
+//     amcp_load [host] [port] [seconds] [window] [channel-layer]
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+std::string make_command(const std::string& layer, int n)
+{
+    const auto value = std::to_string((n % 100) / 100.0);
+
+    switch (n % 4) {
+        case 0:
+            return "MIXER " + layer + " OPACITY " + value + "\r\n";
+        case 1:
+            return "MIXER " + layer + " FILL " + value + " " + value + " 1 1\r\n";
+        case 2:
+            return "MIXER " + layer + " ROTATION " + std::to_string(n % 360) + "\r\n";
+        default:
+            return "MIXER " + layer + " VOLUME " + value + "\r\n";
+    }
+}
+
+// Reads one reply, however many lines it has, and returns its status code.
+int read_reply(tcp::socket& socket, boost::asio::streambuf& buffer)
+{
+    auto read_line = [&] {
+        boost::asio::read_until(socket, buffer, "\r\n");
+        std::istream stream(&buffer);
+        std::string  line;
+        std::getline(stream, line);
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        return line;
+    };
+
+    const auto status = read_line();
+    const auto code   = std::atoi(status.substr(0, 3).c_str());
+
+    if (code == 201) {
+        read_line();
+    } else if (code == 200) {
+        while (!read_line().empty()) {
+        }
+    }
+
+    return code;
+}
+
+double percentile(std::vector<double>& values, double p)
+{
+    if (values.empty())
+        return 0.0;
+    auto n = static_cast<std::size_t>(p * static_cast<double>(values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::string host    = argc > 1 ? argv[1] : "127.0.0.1";
+    const std::string port    = argc > 2 ? argv[2] : "5250";
+    const int         seconds = argc > 3 ? std::atoi(argv[3]) : 10;
+    const int         window  = std::max(1, argc > 4 ? std::atoi(argv[4]) : 16);
+    const std::string layer   = argc > 5 ? argv[5] : "1-10";
+
+    try {
+        boost::asio::io_context io;
+        tcp::socket             socket(io);
+        boost::asio::connect(socket, tcp::resolver(io).resolve(host, port));
+        socket.set_option(tcp::no_delay(true));
+
+        boost::asio::streambuf             buffer;
+        std::deque<clock_type::time_point> in_flight;
+        std::vector<double>                latencies; // in milliseconds
+        int                                sent   = 0;
+        int                                failed = 0;
+
+        const auto start = clock_type::now();
+        const auto end   = start + std::chrono::seconds(seconds);
+
+        while (clock_type::now() < end || !in_flight.empty()) {
+            std::string batch;
+            while (clock_type::now() < end && static_cast<int>(in_flight.size()) < window) {
+                batch += make_command(layer, sent++);
+                in_flight.push_back(clock_type::now());
+            }
+            if (!batch.empty())
+                boost::asio::write(socket, boost::asio::buffer(batch));
+
+            // AMCP replies to the commands of a connection in order.
+            const auto code = read_reply(socket, buffer);
+            const std::chrono::duration<double, std::milli> latency = clock_type::now() - in_flight.front();
+            latencies.push_back(latency.count());
+            in_flight.pop_front();
+
+            if (code < 200 || code >= 300)
+                ++failed;
+        }
+
+        const std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+        std::cout << latencies.size() << " commands in " << elapsed.count() << " s, window " << window << std::endl;
+        std::cout << "commands/s: " << static_cast<double>(latencies.size()) / elapsed.count() << std::endl;
+        std::cout << "failed: " << failed << std::endl;
+        std::cout << "latency p50: " << percentile(latencies, 0.5) << " ms, p99: " << percentile(latencies, 0.99)
+                  << " ms, max: " << percentile(latencies, 1.0) << " ms" << std::endl;
+
+        return failed > 0 ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the AMCP parsing the command repository is built on: tokenize with quoting, escapes and parameter lists,
+// both overloads agreeing on random messages, channel specs including ones with a layer that is not a number or out of
+// range, and the command table finding every command and subcommand regardless of case and nothing else. Run with
+// --benchmark to print how many messages per second are tokenized and looked up.
+
+#include "../amcp/amcp_command_table.h"
+#include "../util/tokenize.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp { namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+std::vector<std::wstring> tokens_of(const std::wstring& message)
+{
+    std::wstring                   buffer;
+    std::vector<std::wstring_view> views;
+    IO::tokenize(message, buffer, views);
+    return std::vector<std::wstring>(views.begin(), views.end());
+}
+
+void test_tokenize()
+{
+    using tokens = std::vector<std::wstring>;
+
+    check(tokens_of(L"PLAY 1-10 AMB LOOP") == tokens{L"PLAY", L"1-10", L"AMB", L"LOOP"}, "plain tokens");
+    check(tokens_of(L"  PLAY   1  ") == tokens{L"PLAY", L"1"}, "repeated spaces");
+    check(tokens_of(L"PLAY 1 \"my clip\" LOOP") == tokens{L"PLAY", L"1", L"my clip", L"LOOP"}, "quoted token");
+    check(tokens_of(L"CALL 1 \"\"") == tokens{L"CALL", L"1", L""}, "empty quoted token");
+    check(tokens_of(L"CG 1 ADD 0 \"a \\\"b\\\" c\"") == tokens{L"CG", L"1", L"ADD", L"0", L"a \"b\" c"},
+          "escaped quotes");
+    check(tokens_of(L"X a\\\\b") == tokens{L"X", L"a\\b"}, "escaped backslash");
+    check(tokens_of(L"X \"a\\nb\"") == tokens{L"X", L"a\nb"}, "escaped newline");
+    check(tokens_of(L"X a\\qb") == tokens{L"X", L"ab"}, "unknown escape dropped");
+    check(tokens_of(L"MIXER 1 FILL (0 0 1 1) 25") == tokens{L"MIXER", L"1", L"FILL", L"(0 0 1 1)", L"25"},
+          "parameter list");
+    check(tokens_of(L"X (a \"b c\" (d e))") == tokens{L"X", L"(a \"b c\" (d e))"}, "nested parameter list");
+    check(tokens_of(L"").empty(), "empty message");
+
+    // The buffer and views are reused, and earlier tokens are not kept.
+    std::wstring                   buffer;
+    std::vector<std::wstring_view> views;
+    IO::tokenize(L"A B C D", buffer, views);
+    IO::tokenize(L"E", buffer, views);
+    check(views.size() == 1 && views[0] == L"E", "reused buffer");
+
+    // Both overloads agree on random messages of the characters that matter.
+    const wchar_t                      alphabet[] = L"ab1- \"\\()n";
+    std::mt19937                       random(1);
+    std::uniform_int_distribution<int> pick(0, static_cast<int>(std::wcslen(alphabet)) - 1);
+    std::uniform_int_distribution<int> length(0, 40);
+
+    for (int n = 0; n < 10000; ++n) {
+        std::wstring message;
+        for (int i = length(random); i > 0; --i)
+            message += alphabet[pick(random)];
+
+        std::list<std::wstring> list;
+        IO::tokenize(message, list);
+        const auto views_result = tokens_of(message);
+        check(std::vector<std::wstring>(list.begin(), list.end()) == views_result, "overloads agree");
+    }
+}
+
+void test_parse_channel_id()
+{
+    struct spec
+    {
+        const wchar_t* text;
+        bool           ok;
+        int            channel_index;
+        int            layer_index;
+    };
+    const spec specs[] = {{L"1", true, 0, -1},
+                          {L"2-10", true, 1, 10},
+                          {L" 3-4 ", true, 2, 4},
+                          {L"1-0", true, 0, 0},
+                          {L"0", true, -1, -1}, // in range is up to the repository
+                          {L"1-999999999", true, 0, 999999999},
+                          {L"1-abc", false, 0, 0},
+                          {L"1-", false, 0, 0},
+                          {L"abc", false, 0, 0},
+                          {L"", false, 0, 0},
+                          {L"-1", false, 0, 0},
+                          {L"1-1x", false, 0, 0},
+                          {L"1-1234567890", false, 0, 0},
+                          {L"1234567890", false, 0, 0},
+                          {L"1-99999999999999999999", false, 0, 0}};
+
+    for (const auto& s : specs) {
+        int        channel_index = 123;
+        int        layer_index   = 456;
+        const bool ok            = parse_channel_id(s.text, channel_index, layer_index);
+        const auto what          = "channel spec \"" + std::string(s.text, s.text + std::wcslen(s.text)) + "\"";
+
+        check(ok == s.ok, what + (s.ok ? " accepted" : " rejected"));
+        if (s.ok && ok)
+            check(channel_index == s.channel_index && layer_index == s.layer_index, what + " parsed");
+        if (!s.ok && !ok)
+            check(channel_index == 123 && layer_index == 456, what + " leaves the indexes alone");
+    }
+}
+
+std::vector<std::wstring> command_names()
+{
+    std::vector<std::wstring> names = {L"PLAY", L"LOADBG", L"LOAD", L"STOP", L"CLEAR", L"CALL", L"SWAP", L"ADD",
+                                       L"REMOVE", L"PRINT", L"SET", L"LOCK", L"PING", L"INFO", L"DIAG", L"BYE"};
+    for (auto sub : {L"KEYER", L"BLEND", L"OPACITY", L"FILL", L"CLIP", L"ANCHOR", L"ROTATION", L"VOLUME", L"CLEAR",
+                     L"COMMIT", L"BRIGHTNESS", L"CONTRAST", L"LEVELS", L"CROP", L"PERSPECTIVE", L"GRID"})
+        names.push_back(std::wstring(L"MIXER ") + sub);
+    for (auto sub : {L"ADD", L"PLAY", L"STOP", L"NEXT", L"REMOVE", L"CLEAR", L"UPDATE", L"INVOKE", L"INFO"})
+        names.push_back(std::wstring(L"CG ") + sub);
+
+    // Enough made up names for the table to grow a few times.
+    for (int n = 0; n < 200; ++n)
+        names.push_back(L"CMD" + std::to_wstring(n) + L" SUB" + std::to_wstring(n % 7));
+    return names;
+}
+
+std::wstring lower(std::wstring str)
+{
+    for (auto& c : str)
+        if (c >= L'A' && c <= L'Z')
+            c = static_cast<wchar_t>(c - L'A' + L'a');
+    return str;
+}
+
+void test_command_table()
+{
+    command_table table;
+    check(table.find(L"PLAY") == nullptr, "empty table finds nothing");
+
+    const auto names = command_names();
+    for (std::size_t n = 0; n < names.size(); ++n)
+        table.insert(names[n], nullptr, static_cast<int>(n));
+
+    table.insert(L"MIXER", nullptr, -1);
+    table.insert(L"play", nullptr, 1000); // already there, so ignored
+
+    for (std::size_t n = 0; n < names.size(); ++n) {
+        const auto& name  = names[n];
+        const auto  space = name.find(L' ');
+        const auto  what  = std::string(name.begin(), name.end());
+
+        const command_table::entry* found = nullptr;
+        if (space == std::wstring::npos)
+            found = table.find(name);
+        else
+            found = table.find(std::wstring_view(name).substr(0, space), std::wstring_view(name).substr(space + 1));
+        check(found && found->name == name && found->min_num_params == static_cast<int>(n), what + " found");
+
+        const auto lowered = lower(name);
+        if (space == std::wstring::npos)
+            found = table.find(lowered);
+        else
+            found = table.find(std::wstring_view(lowered).substr(0, space),
+                               std::wstring_view(lowered).substr(space + 1));
+        check(found && found->name == name, what + " found in lower case");
+    }
+
+    check(table.find(L"MIXER") && table.find(L"MIXER")->min_num_params == -1, "command beside its subcommands");
+    check(table.find(L"MIXER", L"") == nullptr, "empty subcommand");
+    check(table.find(L"MIXER", L"NOPE") == nullptr, "unknown subcommand");
+    check(table.find(L"MIXER", L"OPACIT") == nullptr, "subcommand prefix");
+    check(table.find(L"MIXE", L"R OPACITY") == nullptr, "split elsewhere");
+    check(table.find(L"PLA") == nullptr && table.find(L"PLAYS") == nullptr, "prefix and suffix");
+    check(table.find(L"") == nullptr, "empty name");
+}
+
+void benchmark()
+{
+    command_table table;
+    for (const auto& name : command_names())
+        table.insert(name, nullptr, 0);
+
+    const std::wstring             message = L"MIXER 1-10 FILL 0.25 0.25 0.5 0.5 25 easeinsine";
+    std::wstring                   buffer;
+    std::vector<std::wstring_view> views;
+    int                            channel_index = 0;
+    int                            layer_index   = 0;
+    std::size_t                    found         = 0;
+
+    const int  iterations = 1000000;
+    const auto start      = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; ++n) {
+        IO::tokenize(message, buffer, views);
+        if (parse_channel_id(views[1], channel_index, layer_index) && table.find(views[0], views[2]))
+            ++found;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "tokenize and look up MIXER FILL: " << found / elapsed.count() / 1e6 << " M messages/s" << std::endl;
+}
+
+}}}} // namespace caspar::protocol::amcp
+
+int main(int argc, char** argv)
+{
+    using namespace caspar::protocol::amcp;
+
+    if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+        benchmark();
+        return 0;
+    }
+
+    test_tokenize();
+    test_parse_channel_id();
+    test_command_table();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks the shared memory export of the monitor state: every value type comes back as it was sent, and a reader
+// polling while the exporter publishes as fast as it can never gets a torn snapshot. Each published state carries its
+// number in every entry, with a string whose length and content follow it and a set of paths that changes every few
+// states, so a snapshot mixing two states, or a dictionary of one with the entries of another, does not check out. As
+// the concurrent reads only overlap a write on a machine with more than one core, a write in progress is also staged
+// by writing to the segment directly.
+
+#include "../shm/exporter.h"
+#include "../shm/layout.h"
+#include "../shm/reader.h"
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace shm { namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+std::string segment_name(const char* what)
+{
+    return std::string("casparcg_shm_test_") + what + "_" +
+           std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+}
+
+// Waits for the exporter thread to publish something new.
+bool wait_read(reader& r, snapshot& out)
+{
+    for (int n = 0; n < 500; ++n) {
+        if (r.read(out)) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return false;
+}
+
+void test_values()
+{
+    const auto name = segment_name("values");
+
+    bool thrown = false;
+    try {
+        reader r(name);
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    check(thrown, "opening a missing segment throws");
+
+    auto exp = std::make_unique<exporter>(name, 1 << 16);
+    reader r(name);
+
+    core::monitor::state state;
+    state["a/bool"]    = true;
+    state["a/int32"]   = std::int32_t{-7};
+    state["a/int64"]   = std::int64_t{-(std::int64_t{1} << 40)};
+    state["a/uint32"]  = std::uint32_t{4000000000u};
+    state["a/uint64"]  = std::uint64_t{1} << 63;
+    state["a/float"]   = 0.5f;
+    state["b/double"]  = 0.25;
+    state["b/string"]  = std::string("clip");
+    state["b/wstring"] = std::wstring(L"\u00e5\u00e4\u00f6");
+    state["b/pair"]    = {std::int32_t{1}, std::string("two")};
+    exp->send(state);
+
+    snapshot s;
+    check(wait_read(r, s), "first state read");
+    check(!r.read(s), "nothing new to read");
+
+    const auto is = [&](const char* path, const value& expected) {
+        auto values = s.find(path);
+        return values && values->size() == 1 && values->at(0) == expected;
+    };
+    check(s.keys && s.keys->size() == 10, "all paths");
+    check(is("a/bool", true) && is("a/int32", std::int32_t{-7}), "bool and int32");
+    check(is("a/int64", -(std::int64_t{1} << 40)) && is("a/uint32", std::uint32_t{4000000000u}), "int64 and uint32");
+    check(is("a/uint64", std::uint64_t{1} << 63) && is("a/float", 0.5f) && is("b/double", 0.25), "uint64 and floats");
+    check(is("b/string", std::string("clip")) && is("b/wstring", std::string("\xc3\xa5\xc3\xa4\xc3\xb6")), "strings");
+
+    auto pair = s.find("b/pair");
+    check(pair && pair->size() == 2 && pair->at(0) == value(std::int32_t{1}) &&
+              pair->at(1) == value(std::string("two")),
+          "several values");
+    check(s.find("a") == nullptr && s.find("c/none") == nullptr, "missing paths");
+
+    // A state that does not fit is dropped, and the last one stays readable.
+    core::monitor::state large;
+    large["big"] = std::string(1 << 17, 'x');
+    exp->send(large);
+    exp->send(state);
+    check(wait_read(r, s) && s.find("b/string") != nullptr, "state after one that did not fit");
+
+    check(!r.closed(), "open while exported");
+    exp.reset();
+    check(r.closed(), "closed once the exporter is gone");
+}
+
+std::string path_of(int key) { return "layer/" + std::to_string(key) + "/frame"; }
+
+// State number n: between 4 and 11 paths, changing every 16 states, each holding n, the number of paths and a string
+// of a length and letter that depend on n.
+core::monitor::state make_state(std::int64_t n)
+{
+    const auto keys = static_cast<std::uint32_t>(4 + (n / 16) % 8);
+    const auto text = std::string(static_cast<std::size_t>(16 + (n * 37) % 4000), static_cast<char>('a' + n % 26));
+
+    core::monitor::state state;
+    for (std::uint32_t key = 0; key < keys; ++key) {
+        state[path_of(static_cast<int>(key))] = {n, keys, text, static_cast<double>(n) * 0.5};
+    }
+    return state;
+}
+
+// The state number of a snapshot, or -1 when its entries do not all belong to the same state.
+std::int64_t state_number(const snapshot& s)
+{
+    if (!s.keys || s.keys->empty() || s.values.size() != s.keys->size()) {
+        return -1;
+    }
+
+    const auto& first = s.values[0];
+    if (first.size() != 4 || !std::holds_alternative<std::int64_t>(first[0])) {
+        return -1;
+    }
+
+    const auto n     = std::get<std::int64_t>(first[0]);
+    const auto state = make_state(n);
+
+    std::size_t index = 0;
+    for (auto& p : state) {
+        if (index >= s.keys->size() || (*s.keys)[index] != p.first || s.values[index].size() != 4) {
+            return -1;
+        }
+
+        const auto& values = s.values[index];
+        const auto* text   = std::get_if<std::string>(&values[2]);
+        if (values[0] != value(n) || values[1] != value(boost::get<std::uint32_t>(p.second[1])) || !text ||
+            *text != boost::get<std::string>(p.second[2]) || values[3] != value(static_cast<double>(n) * 0.5)) {
+            return -1;
+        }
+        ++index;
+    }
+
+    return index == s.keys->size() ? n : -1;
+}
+
+// Plays the part of the exporter in the middle of a write, which a reader on another core can run into at any time
+// but which cannot be timed from here.
+void test_write_in_progress()
+{
+    const auto name = segment_name("sequence");
+
+    exporter exp(name, 1 << 16);
+    reader   r(name);
+
+    exp.send(make_state(1));
+    snapshot s;
+    check(wait_read(r, s) && state_number(s) == 1, "state before the write");
+
+    using namespace boost::interprocess;
+    shared_memory_object memory(open_only, name.c_str(), read_write);
+    mapped_region        region(memory, read_write);
+    auto                 header = static_cast<segment_header*>(region.get_address());
+    auto                 data   = static_cast<char*>(region.get_address()) + sizeof(segment_header);
+
+    frame_header frame;
+    std::memcpy(&frame, data, sizeof(frame));
+    const std::vector<char> saved(data, data + frame.size);
+
+    const auto sequence = header->sequence.load();
+    header->sequence.store(sequence + 1);
+    std::memset(data + sizeof(frame_header), 0xFF, frame.size - sizeof(frame_header));
+
+    const auto start = std::chrono::steady_clock::now();
+    check(!r.read(s) && state_number(s) == 1, "nothing read while the sequence is odd");
+    check(std::chrono::steady_clock::now() - start < std::chrono::seconds(1), "read gives up on a write in progress");
+
+    std::memcpy(data, saved.data(), saved.size());
+    header->sequence.store(sequence + 2);
+    check(r.read(s) && state_number(s) == 1, "state read once the write is done");
+}
+
+void test_concurrent()
+{
+    const auto name = segment_name("concurrent");
+
+    exporter exp(name, 1 << 20);
+    reader   r(name);
+
+    std::atomic<bool>         done{false};
+    std::atomic<std::int64_t> sent{0};
+
+    std::thread writer([&] {
+        for (std::int64_t n = 1; !done; ++n) {
+            exp.send(make_state(n));
+            sent = n;
+
+            // Lets the exporter thread take the state, instead of the sends keeping it from the lock.
+            std::this_thread::yield();
+        }
+    });
+
+    int           snapshots   = 0;
+    int           torn        = 0;
+    int           backwards   = 0;
+    std::int64_t  last        = 0;
+    std::uint64_t last_tick   = 0;
+    std::uint64_t generations = 0;
+    std::uint64_t generation  = 0;
+
+    snapshot   s;
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (std::chrono::steady_clock::now() < end) {
+        if (!r.read(s)) {
+            continue;
+        }
+
+        ++snapshots;
+
+        const auto n = state_number(s);
+        if (n < 0) {
+            ++torn;
+            continue;
+        }
+        if (n <= last || s.tick <= last_tick) {
+            ++backwards;
+        }
+        if (s.dictionary_generation != generation) {
+            generation = s.dictionary_generation;
+            ++generations;
+        }
+        last      = n;
+        last_tick = s.tick;
+    }
+
+    done = true;
+    writer.join();
+
+    std::cout << snapshots << " snapshots of " << sent << " states sent, " << generations << " dictionaries"
+              << std::endl;
+
+    check(torn == 0, std::to_string(torn) + " torn snapshots");
+    check(backwards == 0, std::to_string(backwards) + " snapshots older than the one before");
+    check(snapshots > 100, "enough snapshots to tell");
+    check(generations > 10, "enough dictionary changes to tell");
+}
+
+}}}} // namespace caspar::protocol::shm
+
+int main()
+{
+    using namespace caspar::protocol::shm;
+
+    test_values();
+    test_write_in_progress();
+    test_concurrent();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -23,6 +23,8 @@
 
 #include "strategy_adapters.h"
 
+#include <algorithm>
+
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/locale.hpp>
 
@@ -32,6 +34,7 @@ class to_unicode_adapter : public protocol_strategy<char>
 {
     std::string                     codepage_;
     protocol_strategy<wchar_t>::ptr unicode_strategy_;
+    std::wstring                    utf_data_;
 
   public:
     to_unicode_adapter(const std::string& codepage, const protocol_strategy<wchar_t>::ptr& unicode_strategy)
@@ -42,9 +45,15 @@ class to_unicode_adapter : public protocol_strategy<char>
 
     void parse(const std::basic_string<char>& data) override
     {
-        auto utf_data = boost::locale::conv::to_utf<wchar_t>(data, codepage_);
-
-        unicode_strategy_->parse(utf_data);
+        // Plain ASCII, which nearly all commands are and which reads the same in the codepages in use, is widened
+        // into a buffer reused between messages.
+        if (std::all_of(data.begin(), data.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; })) {
+            utf_data_.assign(data.begin(), data.end());
+        } else {
+            utf_data_ = boost::locale::conv::to_utf<wchar_t>(data, codepage_);
+        }
+
+        unicode_strategy_->parse(utf_data_);
     }
 };
 
@@ -63,7 +72,12 @@ class from_unicode_client_connection : public client_connection<wchar_t>
 
     void send(std::basic_string<wchar_t>&& data, bool skip_log) override
     {
-        auto str = boost::locale::conv::from_utf<wchar_t>(data, codepage_);
+        std::string str;
+        if (std::all_of(data.begin(), data.end(), [](wchar_t c) { return c < 0x80; })) {
+            str.assign(data.begin(), data.end());
+        } else {
+            str = boost::locale::conv::from_utf<wchar_t>(data, codepage_);
+        }
 
         client_->send(std::move(str), skip_log);
 
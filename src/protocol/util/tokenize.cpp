@@ -22,29 +22,56 @@
 namespace caspar { namespace IO {
 
 std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pTokenVector)
+{
+    std::wstring                   buffer;
+    std::vector<std::wstring_view> tokens;
+    tokenize(message, buffer, tokens);
+
+    for (auto& token : tokens) {
+        pTokenVector.emplace_back(token);
+    }
+
+    return pTokenVector.size();
+}
+
+std::size_t tokenize(const std::wstring& message, std::wstring& buffer, std::vector<std::wstring_view>& tokens)
 {
     // split on whitespace but keep strings within quotationmarks
     // treat \ as the start of an escape-sequence: the following char will indicate what to actually put in the
     // string
 
-    std::wstring currentToken;
+    // The message is copied into the buffer and the tokens are written over it as they are read. Resolving escape
+    // sequences and dropping separators only ever shortens the text, so a token never overtakes the part still to be
+    // read.
+    buffer.assign(message);
+    tokens.clear();
+
+    std::size_t tokenBegin = 0;
+    std::size_t tokenEnd   = 0;
+
+    const auto pushToken = [&] {
+        tokens.emplace_back(buffer.data() + tokenBegin, tokenEnd - tokenBegin);
+        tokenBegin = tokenEnd;
+    };
 
     bool inQuote        = false;
     int  inParamList    = 0;
     bool getSpecialCode = false;
 
-    for (unsigned int charIndex = 0; charIndex < message.size(); ++charIndex) {
+    for (std::size_t charIndex = 0; charIndex < buffer.size(); ++charIndex) {
+        const auto c = buffer[charIndex];
+
         if (getSpecialCode) {
             // insert code-handling here
-            switch (message[charIndex]) {
+            switch (c) {
                 case L'\\':
-                    currentToken += L"\\";
+                    buffer[tokenEnd++] = L'\\';
                     break;
                 case L'\"':
-                    currentToken += L"\"";
+                    buffer[tokenEnd++] = L'\"';
                     break;
                 case L'n':
-                    currentToken += L"\n";
+                    buffer[tokenEnd++] = L'\n';
                     break;
                 default:
                     break;
@@ -53,50 +80,44 @@ std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pToke
             continue;
         }
 
-        if (message[charIndex] == L'\\') {
+        if (c == L'\\') {
             getSpecialCode = true;
             continue;
         }
 
-        if (message[charIndex] == L' ' && inQuote == false && inParamList == 0) {
-            if (!currentToken.empty()) {
-                pTokenVector.push_back(currentToken);
-                currentToken.clear();
+        if (c == L' ' && inQuote == false && inParamList == 0) {
+            if (tokenEnd != tokenBegin) {
+                pushToken();
             }
             continue;
-        } else if (!inQuote && message[charIndex] == L'(') {
+        } else if (!inQuote && c == L'(') {
             inParamList++;
-            // continue;
-        } else if (!inQuote && message[charIndex] == L')') {
+        } else if (!inQuote && c == L')') {
             inParamList--;
             if (inParamList == 0) {
-                currentToken += message[charIndex];
-                pTokenVector.push_back(currentToken);
-                currentToken.clear();
+                buffer[tokenEnd++] = c;
+                pushToken();
                 continue;
             }
-            // continue;
-        } else if (message[charIndex] == L'\"') {
+        } else if (c == L'\"') {
             inQuote = !inQuote;
 
             if (inParamList == 0) {
                 if (!inQuote) {
-                    pTokenVector.push_back(currentToken);
-                    currentToken.clear();
+                    pushToken();
                 }
                 continue;
             }
         }
 
-        currentToken += message[charIndex];
+        buffer[tokenEnd++] = c;
     }
 
-    if (!currentToken.empty()) {
-        pTokenVector.push_back(currentToken);
-        currentToken.clear();
+    if (tokenEnd != tokenBegin) {
+        pushToken();
     }
 
-    return pTokenVector.size();
+    return tokens.size();
 }
 
 }} // namespace caspar::IO
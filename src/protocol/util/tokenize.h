@@ -21,9 +21,15 @@
 
 #include <list>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace caspar { namespace IO {
 
 std::size_t tokenize(const std::wstring& message, std::list<std::wstring>& pTokenVector);
 
+// Same as above, but the tokens are views of buffer, which receives the message with its escape sequences resolved.
+// Once buffer and tokens have grown to fit the messages no memory is allocated, so both are best reused between calls.
+std::size_t tokenize(const std::wstring& message, std::wstring& buffer, std::vector<std::wstring_view>& tokens);
+
 }} // namespace caspar::IO
@@ -27,6 +27,7 @@
 #include <common/bit_depth.h>
 #include <common/env.h>
 #include <common/except.h>
+#include <common/media_index.h>
 #include <common/memory.h>
 #include <common/ptree.h>
 #include <common/utf.h>
@@ -49,6 +50,7 @@
 #include <protocol/amcp/amcp_command_repository.h>
 #include <protocol/amcp/amcp_shared.h>
 #include <protocol/osc/client.h>
+#include <protocol/shm/exporter.h>
 #include <protocol/util/AsyncEventServer.h>
 #include <protocol/util/strategy_adapters.h>
 #include <protocol/util/tokenize.h>
@@ -107,6 +109,7 @@ struct server::impl
     std::shared_ptr<IO::AsyncEventServer>                  primary_amcp_server_;
     std::shared_ptr<osc::client>                           osc_client_ = std::make_shared<osc::client>(io_service_);
     std::vector<std::shared_ptr<void>>                     predefined_osc_subscriptions_;
+    std::vector<std::shared_ptr<media_index>>              media_indexes_;
     spl::shared_ptr<std::vector<protocol::amcp::channel_context>> channels_;
     spl::shared_ptr<core::cg_producer_registry>                   cg_registry_;
     spl::shared_ptr<core::frame_producer_registry>                producer_registry_;
@@ -137,6 +140,9 @@ struct server::impl
         setup_amcp_command_repo();
         CASPAR_LOG(info) << L"Initialized command repository.";
 
+        setup_media_index(env::properties());
+        CASPAR_LOG(info) << L"Initialized media index.";
+
         module_dependencies dependencies(
             cg_registry_, producer_registry_, consumer_registry_, amcp_command_repo_wrapper_);
         initialize_modules(dependencies);
@@ -166,6 +172,11 @@ struct server::impl
         primary_amcp_server_.reset();
         async_servers_.clear();
 
+        // Scheduled commands hold on to what they will load, so they go before the channels do.
+        for (auto& channel : *channels_) {
+            channel.raw_channel->clear_schedule();
+        }
+
         destroy_producers_synchronously();
         destroy_consumers_synchronously();
         channels_->clear();
@@ -173,10 +184,29 @@ struct server::impl
         while (weak_io_service.lock())
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
+        for (auto& index : media_indexes_) {
+            unregister_media_index(index);
+        }
+        media_indexes_.clear();
+
         uninitialize_modules();
         core::diagnostics::osd::shutdown();
     }
 
+    void setup_media_index(const boost::property_tree::wptree& pt)
+    {
+        if (!pt.get(L"configuration.media-index.enabled", false)) {
+            return;
+        }
+
+        const auto watch = pt.get(L"configuration.media-index.watch", true);
+        for (auto& folder : {env::media_folder(), env::template_folder()}) {
+            auto index = std::make_shared<media_index>(folder, watch);
+            register_media_index(index);
+            media_indexes_.push_back(index);
+        }
+    }
+
     void setup_video_modes(const boost::property_tree::wptree& pt)
     {
         using boost::property_tree::wptree;
@@ -251,6 +281,10 @@ struct server::impl
 
         std::vector<wptree> xml_channels;
 
+        const auto shm_export   = pt.get(L"configuration.monitor-export.enabled", false);
+        const auto shm_prefix   = u8(pt.get(L"configuration.monitor-export.name-prefix", L"casparcg-channel-"));
+        const auto shm_capacity = pt.get<std::size_t>(L"configuration.monitor-export.capacity", 1048576);
+
         for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
             xml_channels.push_back(xml_channel.second);
             ptree_verify_element_name(xml_channel, L"channel");
@@ -266,25 +300,45 @@ struct server::impl
             if (color_space_str != L"bt709" && color_space_str != L"bt2020")
                 CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid color-space, must be bt709 or bt2020"));
 
+            auto accelerator_str = boost::to_lower_copy(xml_channel.second.get(L"accelerator", L"gpu"));
+            if (accelerator_str != L"gpu" && accelerator_str != L"cpu" && accelerator_str != L"auto")
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid accelerator, must be gpu, cpu or auto"));
+
             if (format_desc.format == video_format::invalid)
                 CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
 
+            auto pipeline_latency = xml_channel.second.get(L"pipeline-latency", 0);
+            if (pipeline_latency < 0)
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Invalid pipeline-latency: " + std::to_wstring(pipeline_latency)));
+
             auto weak_client = std::weak_ptr<osc::client>(osc_client_);
             auto channel_id  = static_cast<int>(channels_->size() + 1);
+            auto exporter    = shm_export ? std::make_shared<shm::exporter>(shm_prefix + std::to_string(channel_id),
+                                                                         shm_capacity)
+                                          : nullptr;
             auto depth       = color_depth == 16 ? common::bit_depth::bit16 : common::bit_depth::bit8;
             auto color_space = color_space_str == L"bt2020" ? core::color_space::bt2020 : core::color_space::bt709;
+            auto backend     = accelerator_str == L"cpu"    ? accelerator::accelerator_type::cpu
+                               : accelerator_str == L"auto" ? accelerator::accelerator_type::automatic
+                                                            : accelerator::accelerator_type::gpu;
+            auto image_mixer = accelerator_.create_image_mixer(channel_id, depth, color_space, backend);
             auto channel =
                 spl::make_shared<video_channel>(channel_id,
                                                 format_desc,
-                                                accelerator_.create_image_mixer(channel_id, depth, color_space),
-                                                [channel_id, weak_client](core::monitor::state channel_state) {
-                                                    monitor::state state;
-                                                    state[""]["channel"][channel_id] = channel_state;
-                                                    auto client                      = weak_client.lock();
+                                                std::move(image_mixer),
+                                                [prefix = "/channel/" + std::to_string(channel_id),
+                                                 weak_client,
+                                                 exporter](core::monitor::state channel_state) {
+                                                    auto client = weak_client.lock();
                                                     if (client) {
-                                                        client->send(std::move(state));
+                                                        client->send(prefix, channel_state);
+                                                    }
+                                                    if (exporter) {
+                                                        exporter->send(std::move(channel_state));
                                                     }
-                                                });
+                                                },
+                                                pipeline_latency);
 
             const std::wstring lifecycle_key = L"lock" + std::to_wstring(channel_id);
             channels_->emplace_back(channel, channel->stage(), lifecycle_key);
@@ -310,11 +364,19 @@ struct server::impl
                 const auto address = ptree_get<std::wstring>(predefined_client.second, L"address");
                 const auto port    = ptree_get<unsigned short>(predefined_client.second, L"port");
 
+                osc::subscription_options options;
+                options.max_rate = predefined_client.second.get(L"max-rate", 0.0);
+                if (auto filters = predefined_client.second.get_child_optional(L"filters")) {
+                    for (auto& filter : *filters) {
+                        options.filters.push_back(u8(filter.second.get_value<std::wstring>()));
+                    }
+                }
+
                 boost::system::error_code ec;
                 auto                      ipaddr = address_v4::from_string(u8(address), ec);
                 if (!ec)
                     predefined_osc_subscriptions_.push_back(
-                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port)));
+                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port), options));
                 else
                     CASPAR_LOG(warning) << "Invalid OSC client. Must be valid ipv4 address: " << address;
             }
@@ -409,7 +471,8 @@ struct server::impl
             u8(caspar::env::properties().get(L"configuration.amcp.media-server.host", L"127.0.0.1")),
             u8(caspar::env::properties().get(L"configuration.amcp.media-server.port", L"8000")),
             ogl_device,
-            spl::make_shared_ptr(osc_client_));
+            spl::make_shared_ptr(osc_client_),
+            caspar::env::properties().get(L"configuration.amcp.preload-count", 8U));
 
         amcp_context_factory_ = std::make_shared<amcp::command_context_factory>(ctx);
 
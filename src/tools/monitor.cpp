@@ -0,0 +1,120 @@
+// Prints the monitor state a server exports to shared memory, see protocol/shm/layout.h.
+
+#include <protocol/shm/reader.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace caspar::protocol::shm;
+
+namespace {
+
+bool selected(const std::vector<std::string>& prefixes, const std::string& path)
+{
+    if (prefixes.empty()) {
+        return true;
+    }
+    for (auto& prefix : prefixes) {
+        if (path.compare(0, prefix.size(), prefix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string format(const std::vector<value>& values)
+{
+    std::string result;
+    for (auto& v : values) {
+        result += ' ';
+        result += to_string(v);
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    auto                     watch = false;
+    std::string              name;
+    std::vector<std::string> prefixes;
+
+    for (int n = 1; n < argc; ++n) {
+        if (std::strcmp(argv[n], "--watch") == 0) {
+            watch = true;
+        } else if (name.empty()) {
+            name = argv[n];
+        } else {
+            prefixes.push_back(argv[n]);
+        }
+    }
+
+    if (name.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--watch] <name> [path-prefix]...\n"
+                  << "Prints the monitor state of a channel, e.g. " << argv[0]
+                  << " casparcg-channel-1 /stage/layer/10\n"
+                  << "With --watch the changed paths are printed as they are published.\n";
+        return 1;
+    }
+
+    try {
+        if (!watch) {
+            reader   r(name);
+            snapshot s;
+            for (int retry = 0; !r.read(s); ++retry) {
+                if (retry == 100) {
+                    std::cerr << "Nothing published to " << name << "\n";
+                    return 1;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            for (std::size_t n = 0; n < s.keys->size(); ++n) {
+                if (selected(prefixes, (*s.keys)[n])) {
+                    std::cout << (*s.keys)[n] << format(s.values[n]) << "\n";
+                }
+            }
+            return 0;
+        }
+
+        while (true) {
+            std::unique_ptr<reader> r;
+            try {
+                r = std::make_unique<reader>(name);
+            } catch (std::runtime_error&) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+
+            std::map<std::string, std::string> last;
+            snapshot                           s;
+            while (!r->closed()) {
+                if (!r->read(s)) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    continue;
+                }
+                for (std::size_t n = 0; n < s.keys->size(); ++n) {
+                    auto& path = (*s.keys)[n];
+                    if (!selected(prefixes, path)) {
+                        continue;
+                    }
+                    auto text = format(s.values[n]);
+                    auto it   = last.find(path);
+                    if (it == last.end() || it->second != text) {
+                        std::cout << s.tick << ' ' << path << text << "\n";
+                        last[path] = std::move(text);
+                    }
+                }
+                std::cout.flush();
+            }
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}